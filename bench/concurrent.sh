@@ -0,0 +1,80 @@
+#!/bin/sh
+# Cold starts of init racing each other on a scratch root: <procs>
+# invocations at once, <runs> times.  Every round must leave the root
+# mounted exactly as one invocation does, and the slowest of the racers
+# should take about as long as a single cold start.  Needs root;
+# everything happens in a throwaway mount namespace.
+# usage: concurrent.sh [procs] [runs] [init options...]
+set -e
+procs=${1:-8}
+runs=${2:-20}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] && shift
+work=$(mktemp -d)
+trap '[ -n "$KEEP" ] || rm -rf "$work"' EXIT
+"$(dirname "$0")/hostinit.sh" "$work/init"
+# a root with just enough to exec /bin/true
+mkdir -p "$work/root/bin"
+cp /bin/true "$work/root/bin/"
+for lib in $(ldd /bin/true | grep -o '/[^ ]*'); do
+	mkdir -p "$work/root$(dirname "$lib")"
+	cp -L "$lib" "$work/root$lib"
+done
+cp "$work/init" "$work/root/init"
+export work procs runs
+unshare -m sh -e -c '
+mount --make-rprivate /
+mounts() { grep -c " $work/root[/ ]" /proc/self/mountinfo || true; }
+# the reference: one cold start on its own, after one that leaves the
+# propagation of the host mounts it shares as it will stay
+"$work/root/init" "$@" -- /bin/true
+"$work/root/init" -u
+"$work/root/init" "$@" -T3 -- /bin/true 3>"$work/single.json"
+expect=$(mounts)
+"$work/root/init" -u
+bad=0
+for i in $(seq "$runs"); do
+	for j in $(seq "$procs"); do
+		"$work/root/init" "$@" -T3 -- /bin/true 3>>"$work/race.json" &
+	done
+	wait
+	echo round >>"$work/race.json"
+	got=$(mounts)
+	if [ "$got" != "$expect" ]; then
+		echo "run $i: $got mounts under the root, expected $expect" >&2
+		bad=$((bad+1))
+	fi
+	"$work/root/init" -u
+done
+# the floor: as many at once on a root that is already set up
+"$work/root/init" "$@" -- /bin/true
+for i in $(seq "$runs"); do
+	for j in $(seq "$procs"); do
+		"$work/root/init" "$@" -T3 -- /bin/true 3>>"$work/warm.json" &
+	done
+	wait
+	echo round >>"$work/warm.json"
+done
+"$work/root/init" -u
+[ "$bad" -eq 0 ]
+' sh "$@"
+total() { sed -n 's/.*"total_us":\([0-9]*\).*/\1/p'; }
+echo "single cold start: $(total <"$work/single.json")us"
+# per round: the slowest racer, how many of them set up, the longest wait for the lock
+rounds() {
+	awk '
+		/^round/ { print max, setup; max = 0; setup = 0; next }
+		/"mounted":false/ { setup++ }
+		{ match($0, /"total_us":[0-9]+/); t = substr($0, RSTART+11, RLENGTH-11)+0; if(t > max) max = t }
+		match($0, /"lock","us":[0-9]+/) { w = substr($0, RSTART+12, RLENGTH-12)+0; if(w > wait) wait = w }
+		END { print "wait", wait }
+	' "$1" | sort -n | awk -v label="$2" -v setups="$3" '
+		$1 == "wait" { wait = $2; next }
+		{ v[++c] = $1; if($2 != setups) odd++ }
+		END {
+			printf "%s, slowest: p50 %7dus  p90 %7dus  max %7dus\n", label, v[int(c*0.5+0.999)], v[int(c*0.9+0.999)], v[c]
+			if(setups) printf "rounds where other than one set up: %d of %d; longest wait for the lock %dus\n", odd, c, wait
+		}'
+}
+rounds "$work/race.json" "$procs cold at once" 1
+rounds "$work/warm.json" "$procs warm at once" 0
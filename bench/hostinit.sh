@@ -0,0 +1,7 @@
+#!/bin/sh
+# Build jni/init for the host, for the benchmarks in this directory.
+# usage: hostinit.sh <output>
+set -e
+src="$(dirname "$0")/../jni/init"
+${CC:-cc} -std=gnu99 -D_GNU_SOURCE -D'__FBSDID(x)=' -O2 -Wall -Wextra -I"$src" \
+	"$src/init.c" "$src/broker.c" "$src/mountinfo.c" "$src/supervise.c" "$src/cgroup.c" "$src/mountstamp.c" "$src/mountspec.c" "$src/strnstr.c" -o "$1"
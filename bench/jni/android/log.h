@@ -0,0 +1,16 @@
+#pragma once
+#include <stdarg.h>
+#include <stdio.h>
+
+enum { ANDROID_LOG_INFO = 4, ANDROID_LOG_WARN, ANDROID_LOG_ERROR };
+
+static inline int __android_log_print(int, const char *tag, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	fprintf(stderr, "%s: ", tag);
+	int res = vfprintf(stderr, fmt, ap);
+	fputc('\n', stderr);
+	va_end(ap);
+	return res;
+}
@@ -0,0 +1,77 @@
+/*
+ * Just enough of JNI to build the native code on the host for the
+ * benchmarks.  A string is its UTF-16 units and an array its elements;
+ * everything else does nothing.  No call allocates, so a harness can
+ * count what the code under test does.
+ */
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+
+#define JNI_FALSE 0
+#define JNI_TRUE 1
+#define JNI_OK 0
+#define JNI_ERR (-1)
+#define JNI_VERSION_1_4 0x00010004
+#define JNI_VERSION_1_6 0x00010006
+#define JNI_ABORT 2
+#define JNIEXPORT
+#define JNICALL
+
+typedef uint8_t jboolean;
+typedef int8_t jbyte;
+typedef uint16_t jchar;
+typedef int16_t jshort;
+typedef int32_t jint;
+typedef int64_t jlong;
+typedef jint jsize;
+
+struct _jobject {
+	jsize len;		// UTF-16 units of a string, elements of an array
+	const jchar *chars;
+	_jobject **elems;
+	jint *ints;
+	jint value;		// an object's int field
+};
+typedef _jobject *jobject, *jclass, *jstring, *jarray, *jobjectArray,
+	*jintArray, *jbyteArray, *jthrowable;
+struct _jfieldID;
+typedef _jfieldID *jfieldID;
+struct _jmethodID;
+typedef _jmethodID *jmethodID;
+typedef struct { const char *name; const char *signature; void *fnPtr; } JNINativeMethod;
+
+struct JNIEnv {
+	_jobject object;	// what every NewObject() returns
+	const char *thrown;	// the message of the last ThrowNew()
+
+	jclass FindClass(const char *) { return &object; }
+	jint ThrowNew(jclass, const char *message) { thrown = message; return 0; }
+	jthrowable ExceptionOccurred() { return 0; }
+	jint RegisterNatives(jclass, const JNINativeMethod *, jint) { return 0; }
+	jobject NewGlobalRef(jobject obj) { return obj; }
+	void DeleteGlobalRef(jobject) { }
+	void DeleteLocalRef(jobject) { }
+	jfieldID GetFieldID(jclass, const char *, const char *) { return 0; }
+	jmethodID GetMethodID(jclass, const char *, const char *) { return 0; }
+	jobject NewObject(jclass, jmethodID, ...) { return &object; }
+	jint GetIntField(jobject obj, jfieldID) { return obj->value; }
+	void SetIntField(jobject obj, jfieldID, jint value) { obj->value = value; }
+	jsize GetArrayLength(jarray array) { return array->len; }
+	jobject GetObjectArrayElement(jobjectArray array, jsize i) { return array->elems[i]; }
+	void *GetPrimitiveArrayCritical(jarray array, jboolean *) { return array->ints; }
+	void ReleasePrimitiveArrayCritical(jarray, void *, jint) { }
+	jbyteArray NewByteArray(jsize) { return 0; }
+	void SetByteArrayRegion(jbyteArray, jsize, jsize, const jbyte *) { }
+	jsize GetStringLength(jstring str) { return str->len; }
+	const jchar *GetStringCritical(jstring str, jboolean *) { return str->chars; }
+	void ReleaseStringCritical(jstring, const jchar *) { }
+	const char *GetStringUTFChars(jstring, jboolean *) { return 0; }
+	void ReleaseStringUTFChars(jstring, const char *) { }
+	void *GetDirectBufferAddress(jobject) { return 0; }
+	jlong GetDirectBufferCapacity(jobject) { return 0; }
+};
+
+struct JavaVM {
+	jint GetEnv(void **, jint) { return JNI_ERR; }
+};
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Mount time and page-cache footprint of an image-backed root, with the
+# loop device on buffered and on direct I/O.  Needs root, mkfs.ext4 and
+# fincore; everything happens in a throwaway mount namespace.
+# usage: loopbench.sh [runs] [data MiB]
+set -e
+runs=${1:-5}
+size=${2:-64}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+"$(dirname "$0")/hostinit.sh" "$work/init"
+mkdir -p "$work/seed" "$work/root/run" "$work/root/proc"
+dd if=/dev/urandom of="$work/seed/data" bs=1M count="$size" status=none
+truncate -s $((size*2+64))M "$work/root/fs.img"
+mkfs.ext4 -q -F -d "$work/seed" "$work/root/fs.img"
+export work runs
+unshare -m sh -e -c '
+mount --make-rprivate /
+ms() { echo $(( $(date +%s%N)/1000000 )); }
+for mode in cached direct; do
+	[ $mode = cached ] && flag=-C || flag=
+	total=0 cache=0
+	exec 3<"$work/root/fs.img"
+	for i in $(seq "$runs"); do
+		sync; echo 3 >/proc/sys/vm/drop_caches
+		t0=$(ms)
+		"$work/init" $flag -t "$work/root/fs.img" -- /nonexistent 2>/dev/null || true
+		t1=$(ms)
+		cat "$work/root/data" >/dev/null
+		kb=$(( $(fincore -bno RES /proc/self/fd/3) / 1024 ))
+		"$work/init" -u -t "$work/root"
+		total=$((total+t1-t0)) cache=$((cache+kb))
+	done
+	exec 3<&-
+	echo "$mode: mount $((total/runs)) ms, image in page cache after reading root $((cache/runs)) KiB"
+done
+'
@@ -0,0 +1,147 @@
+#!/bin/sh
+# Exec.createSubprocess on the host with <vars> environment variables:
+# mallocs per spawn (counted by a malloc of our own in front of libc's)
+# on the first spawn and on those after it, and what /usr/bin/env in the
+# child sees of arguments and variables beyond ASCII, surrogate pairs and
+# unpaired surrogates included.
+# usage: marshal.sh [vars] [runs]
+set -e
+here="$(dirname "$0")"
+src="$here/../jni"
+vars=${1:-300}
+runs=${2:-200}
+work=$(mktemp -d)
+trap '[ -n "$KEEP" ] || rm -rf "$work"' EXIT
+# utf16_to_utf8() and jstring_to_utf8(), without the rest of JNI_OnLoad
+{
+	printf '#include "common.h"\n#include <string.h>\n'
+	sed -n '/^size_t utf16_to_utf8/,/^}/p; /^size_t jstring_to_utf8/,/^}/p' "$src/common.cpp"
+} >"$work/utf8.cpp"
+${CXX:-c++} -O2 -Wall -I"$here/jni" -I"$src" -x c++ - "$work/utf8.cpp" -o "$work/marshal" <<EOF
+#include "$src/termExec.cpp"
+#include <stdio.h>
+void reaper_track(pid_t) { }
+int reaper_wait(pid_t, struct reaper_status *) { return -1; }
+int reaper_code(const struct reaper_status *) { return -1; }
+int cgroup_open(const char *) { return -1; }
+int registerNativeMethods(JNIEnv *, const char *, JNINativeMethod *, int) { return 0; }
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+void __libc_free(void *);
+static bool counting;
+static long allocs;
+void *malloc(size_t size) { allocs += counting; return __libc_malloc(size); }
+void *calloc(size_t n, size_t size) { allocs += counting; return __libc_calloc(n, size); }
+void *realloc(void *p, size_t size) { allocs += counting; return __libc_realloc(p, size); }
+void free(void *p) { __libc_free(p); }
+}
+/* a Java string, from UTF-16 units */
+static jstring string(const char16_t *s)
+{
+	_jobject *str = new _jobject();
+	while (s[str->len]) str->len++;
+	str->chars = (const jchar *) s;
+	return str;
+}
+static jstring string(const char *s)
+{
+	jchar *units = new jchar[strlen(s) + 1];
+	size_t i;
+	for (i = 0; s[i]; i++) units[i] = (unsigned char) s[i];
+	units[i] = 0;
+	return string((const char16_t *) units);
+}
+/* the variables as Java has them, and what env should print for each */
+static const struct { const char16_t *java; const char *utf8; } wide[] = {
+	{ u"BENCH_LATIN=café", "BENCH_LATIN=caf\xc3\xa9" },
+	{ u"BENCH_CJK=漢字", "BENCH_CJK=\xe6\xbc\xa2\xe5\xad\x97" },
+	{ u"BENCH_PAIR=\U0001f600!", "BENCH_PAIR=\xf0\x9f\x98\x80!" },
+	{ u"BENCH_LONE=a\xd800" u"b\xdc00", "BENCH_LONE=a\xef\xbf\xbd" "b\xef\xbf\xbd" },
+	{ u"BENCH_ARG=ü\U0001f600", "BENCH_ARG=\xc3\xbc\xf0\x9f\x98\x80" },
+};
+#define NWIDE (sizeof(wide) / sizeof(wide[0]))
+/* everything the child writes to the pty, until it hangs up */
+static size_t drain(int ptm, char *buf, size_t size)
+{
+	size_t len = 0;
+	ssize_t n;
+	while ((n = read(ptm, buf + len, size - 1 - len)) > 0 || (n < 0 && errno == EINTR)) {
+		if (n > 0) len += n;
+	}
+	buf[len] = '\0';
+	return len;
+}
+static bool spawn(JNIEnv *env, jstring cmd, jobjectArray args, jobjectArray envVars,
+	jintArray pid, long *count, char *out, size_t size)
+{
+	allocs = 0;
+	counting = true;
+	jobject fd = android_os_Exec_createSubProcess(env, NULL, cmd, args, envVars, pid);
+	counting = false;
+	*count = allocs;
+	if (!fd || fd->value < 0) return false;
+	drain(fd->value, out, size);
+	close(fd->value);
+	waitpid(pid->ints[0], NULL, 0);
+	return true;
+}
+/* each expected line of env's output, which the pty ends with \r\n */
+static int check(const char *out, const char *what)
+{
+	int bad = 0;
+	char line[64];
+	for (size_t i = 0; i < NWIDE; i++) {
+		snprintf(line, sizeof(line), "%s\r\n", wide[i].utf8);
+		if (!strstr(out, line)) {
+			printf("%s: %s missing\n", what, wide[i].utf8);
+			bad++;
+		}
+	}
+	return bad;
+}
+int main(int argc, char **argv)
+{
+	int vars = atoi(argv[1]), runs = atoi(argv[2]);
+	JNIEnv env = JNIEnv();
+	_jobject *envVars = new _jobject(), *args = new _jobject(), *pid = new _jobject();
+	envVars->elems = new _jobject *[vars + NWIDE];
+	for (int i = 0; i < vars; i++) {
+		char var[64];
+		snprintf(var, sizeof(var), "BENCH_VAR_%03d=value of variable %d", i, i);
+		envVars->elems[envVars->len++] = string(var);
+	}
+	for (size_t i = 0; i + 1 < NWIDE; i++) envVars->elems[envVars->len++] = string(wide[i].java);
+	// the last one as an argument: env sets it for itself
+	args->elems = new _jobject *[2];
+	args->elems[args->len++] = string("env");
+	args->elems[args->len++] = string(wide[NWIDE - 1].java);
+	pid->ints = new jint[1];
+	pid->len = 1;
+	jstring cmd = string("/usr/bin/env");
+	size_t size = 1 << 20;
+	char *out = new char[size];
+	long first, most = 0, total = 0, count;
+	if (!spawn(&env, cmd, args, envVars, pid, &first, out, size)) {
+		fprintf(stderr, "spawn failed%s%s\n", env.thrown ? ": " : "", env.thrown ? env.thrown : "");
+		return 1;
+	}
+	int bad = check(out, "first spawn");
+	struct timespec t0, t1;
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < runs; i++) {
+		if (!spawn(&env, cmd, args, envVars, pid, &count, out, size)) return 1;
+		total += count;
+		if (count > most) most = count;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	bad += check(out, "last spawn");
+	printf("%d variables, %zu beyond ASCII\n", vars, NWIDE);
+	printf("first spawn  %ld allocations\n", first);
+	printf("after that   %.2f allocations/spawn, at most %ld; %.1f us/spawn\n", (double) total / runs, most,
+		((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / 1e3 / runs);
+	return bad != 0;
+}
+EOF
+"$work/marshal" "$vars" "$runs"
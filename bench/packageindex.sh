@@ -0,0 +1,126 @@
+#!/bin/sh
+# jni/packageIndex.cpp on the host: its version comparison against the
+# vectors in versions.txt (and against the local dpkg, where there is
+# one), then cold and cached reads of a full index.  The index is the
+# given Packages file, or one of Debian's size made up from the local
+# dpkg status, beside that status as dpkg's own record.
+# usage: packageindex.sh [Packages] [runs]
+set -e
+here="$(dirname "$0")"
+src="$here/../jni"
+packages=$1
+runs=${2:-20}
+work=$(mktemp -d)
+trap '[ -n "$KEEP" ] || rm -rf "$work"' EXIT
+${CXX:-c++} -O2 -Wall -I"$here/jni" -x c++ - -o "$work/packageindex" <<EOF
+#include "$src/packageIndex.cpp"
+#include <time.h>
+int registerNativeMethods(JNIEnv *, const char *, JNINativeMethod *, int) { return 0; }
+int writeSearchIndex(const char *, SearchEntry *, size_t) { return 0; }
+static double elapsed(const struct timespec &t0)
+{
+	struct timespec t1;
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	return (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+}
+/* each line: <version> <lt|eq|gt> <version> */
+static int vectors(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return 1;
+	}
+	char line[512], a[240], op[4], b[240];
+	int total = 0, bad = 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (line[0] == '#' || sscanf(line, "%239s %3s %239s", a, op, b) != 3) continue;
+		Span sa = { a, strlen(a) }, sb = { b, strlen(b) };
+		int res = compareVersions(sa, sb);
+		const char *got = res < 0 ? "lt" : res > 0 ? "gt" : "eq";
+		if (strcmp(got, op) != 0) {
+			printf("mismatch: %s %s %s, dpkg has %s\n", a, got, b, op);
+			bad++;
+		}
+		total++;
+	}
+	fclose(f);
+	printf("versions  %d pairs, %d mismatched\n", total, bad);
+	return bad != 0;
+}
+static int bench(const char *root, int runs)
+{
+	Sources src;
+	Index idx;
+	int err = findSources(&src, root);
+	double cold = 0, warm = 0;
+	off_t size = 0;
+	for (size_t i = 0; !err && i < src.count; i++) size += src.stats[i].st_size;
+	for (int i = 0; !err && i < runs; i++) {
+		struct timespec t0;
+		pruneCache();   // drops everything: readIndex() cleared the marks
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		err = readIndex(&idx, src, root, "amd64");
+		cold += elapsed(t0);
+		if (!err) freeIndex(&idx);
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		if (!err) err = readIndex(&idx, src, root, "amd64");
+		warm += elapsed(t0);
+		if (!err && i < runs - 1) freeIndex(&idx);
+	}
+	if (err) {
+		fprintf(stderr, "%s: %s\n", root, strerror(err));
+		return 1;
+	}
+	printf("index     %zu packages in %.1f MB\n", idx.count, size / 1e6);
+	printf("cold      %10.1f us/read  %6.1f MB/s\n", cold / runs, size * runs / cold);
+	printf("cached    %10.1f us/read\n", warm / runs);
+	freeIndex(&idx);
+	freeSources(&src);
+	return 0;
+}
+int main(int argc, char **argv)
+{
+	if (argc == 3 && strcmp(argv[1], "-v") == 0) return vectors(argv[2]);
+	return bench(argv[1], atoi(argv[2]));
+}
+EOF
+"$work/packageindex" -v "$here/versions.txt"
+if command -v dpkg >/dev/null; then
+	# the vectors still say what this dpkg says
+	bad=0
+	while read -r a op b; do
+		case $a in \#*) continue;; esac
+		dpkg --compare-versions "$a" "$op" "$b" || { echo "dpkg disagrees: $a $op $b"; bad=$((bad+1)); }
+	done <"$here/versions.txt"
+	[ "$bad" -eq 0 ]
+fi
+mkdir -p "$work/root/var/lib/dpkg" "$work/root/var/lib/apt/lists"
+if [ -f /var/lib/dpkg/status ]; then
+	cp /var/lib/dpkg/status "$work/root/var/lib/dpkg/status"
+else
+	: >"$work/root/var/lib/dpkg/status"
+fi
+lists="$work/root/var/lib/apt/lists"
+if [ -n "$packages" ]; then
+	cp "$packages" "$lists/bench_main_binary-amd64_Packages"
+else
+	# ~65000 stanzas, as in Debian's main for one architecture: the
+	# installed packages with newer versions, then renamed copies
+	awk -v want=65000 '
+		/^Status:/ { next }
+		{ s = s $0 "\n" }
+		/^$/ { if(s != "\n") st[n++] = s; s = "" }
+		END {
+			if(s != "") st[n++] = s
+			for(c = 0; out < want; c++)
+				for(i = 0; i < n && out < want; i++) {
+					t = st[i]
+					if(c) sub(/^Package: [^\n]*/, "&-" c, t)
+					else sub(/\nVersion: [^\n]*/, "&+b1", t)
+					printf "%s", t
+					out++
+				}
+		}' "$work/root/var/lib/dpkg/status" >"$lists/bench_main_binary-amd64_Packages"
+fi
+"$work/packageindex" "$work/root" "$runs"
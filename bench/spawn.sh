@@ -0,0 +1,121 @@
+#!/bin/sh
+# Spawning /bin/true on a pty from a parent of growing size: jni/termExec.cpp's
+# vfork() path, as Exec.createSubprocess now spawns, against the fork() and
+# putenv() it used to.  Per spawn, how long the call blocks its caller and
+# how long until the child has exited.
+# usage: spawn.sh [runs] [parent MB...]
+set -e
+here="$(dirname "$0")"
+src="$here/../jni"
+runs=${1:-200}
+[ $# -gt 0 ] && shift
+[ $# -gt 0 ] || set -- 16 256 1024
+work=$(mktemp -d)
+trap '[ -n "$KEEP" ] || rm -rf "$work"' EXIT
+# utf16_to_utf8() and jstring_to_utf8(), without the rest of JNI_OnLoad
+{
+	printf '#include "common.h"\n#include <string.h>\n'
+	sed -n '/^size_t utf16_to_utf8/,/^}/p; /^size_t jstring_to_utf8/,/^}/p' "$src/common.cpp"
+} >"$work/utf8.cpp"
+${CXX:-c++} -O2 -Wall -I"$here/jni" -I"$src" -x c++ - "$work/utf8.cpp" -o "$work/spawn" <<EOF
+#include "$src/termExec.cpp"
+#include <sys/mman.h>
+#include <stdio.h>
+void reaper_track(pid_t) { }
+int reaper_wait(pid_t, struct reaper_status *) { return -1; }
+int reaper_code(const struct reaper_status *) { return -1; }
+int cgroup_open(const char *) { return -1; }
+int registerNativeMethods(JNIEnv *, const char *, JNINativeMethod *, int) { return 0; }
+/* create_subprocess() before vfork() */
+static int fork_subprocess(const char *cmd, char *const argv[], char *const envp[], int *pProcessId)
+{
+	int ptm = open("/dev/ptmx", O_RDWR);
+	char *devname;
+	if (ptm < 0) return -1;
+	fcntl(ptm, F_SETFD, FD_CLOEXEC);
+	if (grantpt(ptm) || unlockpt(ptm) || !(devname = ptsname(ptm))) {
+		close(ptm);
+		return -1;
+	}
+	pid_t pid = fork();
+	if (pid < 0) {
+		close(ptm);
+		return -1;
+	}
+	if (pid == 0) {
+		close(ptm);
+		setsid();
+		int pts = open(devname, O_RDWR);
+		if (pts < 0) exit(-1);
+		dup2(pts, 0);
+		dup2(pts, 1);
+		dup2(pts, 2);
+		for (; envp && *envp; ++envp) putenv(*envp);
+		execv(cmd, argv);
+		exit(-1);
+	}
+	*pProcessId = pid;
+	return ptm;
+}
+static double now_us()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+static long rss_mb()
+{
+	long size = 0, resident = 0;
+	FILE *f = fopen("/proc/self/statm", "r");
+	if (f) {
+		if (fscanf(f, "%ld %ld", &size, &resident) != 2) resident = 0;
+		fclose(f);
+	}
+	return resident * sysconf(_SC_PAGESIZE) >> 20;
+}
+static bool run(bool vforked, int runs, double *call, double *exit)
+{
+	char cmd[] = "/bin/true";
+	char *argv[] = { cmd, NULL };
+	char *envp[] = { NULL };
+	*call = *exit = 0;
+	for (int i = 0; i < runs; i++) {
+		int pid, status;
+		double t0 = now_us();
+		int ptm = vforked ? create_subprocess(cmd, argv, environ, -1, &pid)
+			: fork_subprocess(cmd, argv, envp, &pid);
+		double t1 = now_us();
+		if (ptm < 0) return false;
+		waitpid(pid, &status, 0);
+		*call += t1 - t0;
+		*exit += now_us() - t0;
+		close(ptm);
+	}
+	*call /= runs;
+	*exit /= runs;
+	return true;
+}
+int main(int argc, char **argv)
+{
+	int runs = atoi(argv[1]);
+	for (int i = 2; i < argc; i++) {
+		size_t size = (size_t) atol(argv[i]) << 20;
+		char *ballast = (char *) mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (ballast == MAP_FAILED) {
+			perror("mmap");
+			return 1;
+		}
+		memset(ballast, 1, size);
+		double vcall, vexit, fcall, fexit;
+		if (!run(true, runs, &vcall, &vexit) || !run(false, runs, &fcall, &fexit)) {
+			perror("spawn");
+			return 1;
+		}
+		printf("rss %5ld MB  vfork %8.1f us/call %8.1f us/exit   fork %8.1f us/call %8.1f us/exit\n",
+			rss_mb(), vcall, vexit, fcall, fexit);
+		munmap(ballast, size);
+	}
+	return 0;
+}
+EOF
+"$work/spawn" "$runs" "$@"
@@ -0,0 +1,48 @@
+#!/bin/sh
+# Startup time of init against a scratch root, cold (not yet mounted) and
+# warm (already mounted), from its --trace output.  Needs root; everything
+# happens in a throwaway mount namespace.
+# usage: startup.sh [runs] [init options...]
+set -e
+runs=${1:-50}
+[ $# -gt 0 ] && shift
+work=$(mktemp -d)
+trap '[ -n "$KEEP" ] || rm -rf "$work"' EXIT
+"$(dirname "$0")/hostinit.sh" "$work/init"
+# a root with just enough to exec /bin/true
+mkdir -p "$work/root/bin"
+cp /bin/true "$work/root/bin/"
+for lib in $(ldd /bin/true | grep -o '/[^ ]*'); do
+	mkdir -p "$work/root$(dirname "$lib")"
+	cp -L "$lib" "$work/root$lib"
+done
+cp "$work/init" "$work/root/init"
+export work runs
+unshare -m sh -e -c '
+mount --make-rprivate /
+for i in $(seq "$runs"); do
+	"$work/root/init" "$@" -T3 -- /bin/true 3>>"$work/cold.json"
+	"$work/root/init" "$@" -T3 -- /bin/true 3>>"$work/warm.json"
+	"$work/root/init" -u
+done
+' sh "$@"
+# percentiles of total_us and of every phase, in microseconds
+for mode in cold warm; do
+	echo "$mode ($runs runs)"
+	awk '{
+		n = split($0, f, /[{},:\[\]"]+/)
+		for(i = 1; i < n; i++) {
+			if(f[i] == "name") { name = f[i+1]; if(!(name in rank)) rank[name] = ++k }
+			else if(f[i] == "us") print rank[name], name, f[i+1]
+			else if(f[i] == "total_us") print 999, "total", f[i+1]
+		}
+	}' "$work/$mode.json" | sort -k1,1n -k3,3n | awk '
+	function report() {
+		if(c) printf "  %-16s p50 %7d  p90 %7d  p99 %7d  max %7d\n", name,
+			v[int(c*0.5+0.999)], v[int(c*0.9+0.999)], v[int(c*0.99+0.999)], v[c]
+		c = 0
+	}
+	$2 != name { report(); name = $2 }
+	{ v[++c] = $3 }
+	END { report() }'
+done
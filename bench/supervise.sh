@@ -0,0 +1,121 @@
+#!/bin/sh
+# Supervisor overhead and restart latency of init --supervise, with
+# jni/init/supervise.c built for the host and run on a scratch service
+# directory (no chroot, so no root needed).  Kills one service's ./run
+# repeatedly and times, from the status page, how long until it runs
+# again; the part of that not spent in backoff is the supervisor's own.
+# usage: supervise.sh [services] [restarts]
+set -e
+services=${1:-20}
+restarts=${2:-8}
+src="$(dirname "$0")/../jni/init"
+work=$(mktemp -d)
+trap '[ -n "$pid" ] && kill "$pid" 2>/dev/null; [ -n "$KEEP" ] || rm -rf "$work"' EXIT
+${CC:-cc} -std=gnu99 -D_GNU_SOURCE -O2 -Wall -Wextra -I"$src" -x c - "$src/supervise.c" -o "$work/supervise" <<'EOF'
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "supervise.h"
+static long long now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (long long)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+/* a consistent copy of the page, as a reader without root would take it */
+static void snapshot(const volatile char *page, char *copy) {
+	const volatile struct supervise_header *h = (const volatile struct supervise_header*)page;
+	uint32_t seq;
+	do {
+		while((seq = h->seq)&1);
+		__sync_synchronize();
+		memcpy(copy,(const char*)page,SUPERVISE_PAGE_SIZE);
+		__sync_synchronize();
+	} while(h->seq != seq);
+}
+static struct supervise_slot *find(char *copy, const char *name) {
+	struct supervise_header *h = (struct supervise_header*)copy;
+	struct supervise_slot *slots = (struct supervise_slot*)(h+1);
+	uint32_t i;
+	for(i = 0; i < h->count; i++) if(strcmp(slots[i].name,name) == 0) return &slots[i];
+	return NULL;
+}
+static long cpu_ticks(int pid) {
+	char path[64], buf[1024], *p;
+	long utime, stime;
+	snprintf(path,sizeof(path),"/proc/%d/stat",pid);
+	FILE *f = fopen(path,"r");
+	if(!f) return -1;
+	p = fgets(buf,sizeof(buf),f);
+	fclose(f);
+	if((!p)||(!(p = strrchr(buf,')')))) return -1;
+	if(sscanf(p+2,"%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %ld %ld",&utime,&stime) != 2) return -1;
+	return utime+stime;
+}
+static int cmp(const void *a, const void *b) {
+	long long x = *(const long long*)a, y = *(const long long*)b;
+	return (x > y)-(x < y);
+}
+int main(int argc, char **argv) {
+	if(strcmp(argv[1],"run") == 0) return supervise_main(argv[2],argv[3])?1:0;
+	// probe <page> <service> <restarts>
+	int fd = open(argv[2],O_RDONLY), n = atoi(argv[4]), i;
+	char *page = mmap(NULL,SUPERVISE_PAGE_SIZE,PROT_READ,MAP_SHARED,fd,0);
+	static char copy[SUPERVISE_PAGE_SIZE];
+	long long *lat = calloc(n,sizeof(*lat)), *own = calloc(n,sizeof(*own));
+	struct supervise_slot *slot;
+	snapshot(page,copy);
+	int sup = ((struct supervise_header*)copy)->pid;
+	uint32_t w0 = ((struct supervise_header*)copy)->wakeups;
+	long c0 = cpu_ticks(sup);
+	sleep(2);
+	snapshot(page,copy);
+	printf("idle      %u wakeups, %ld cpu ticks in 2s\n",((struct supervise_header*)copy)->wakeups-w0,cpu_ticks(sup)-c0);
+	for(i = 0; i < n; i++) {
+		do {
+			usleep(1000);
+			snapshot(page,copy);
+		} while(!(slot = find(copy,argv[3]))||(!slot->pid)||(slot->state != 1));
+		int old = slot->pid;
+		w0 = ((struct supervise_header*)copy)->wakeups;
+		long long t0 = now_us();
+		kill(old,SIGKILL);
+		do {
+			usleep(100);
+			snapshot(page,copy);
+			slot = find(copy,argv[3]);
+		} while((!slot)||(slot->pid == old)||(!slot->pid)||(slot->state != 1));
+		lat[i] = now_us()-t0;
+		own[i] = lat[i]-slot->backoff_ms*1000LL;
+		if(i == n-1) printf("wakeups   %u for the last restart\n",((struct supervise_header*)copy)->wakeups-w0);
+	}
+	qsort(lat,n,sizeof(*lat),cmp);
+	qsort(own,n,sizeof(*own),cmp);
+	printf("restart   p50 %7lld  p90 %7lld  max %7lld us\n",lat[n/2],lat[n*9/10],lat[n-1]);
+	printf("overhead  p50 %7lld  p90 %7lld  max %7lld us (less backoff)\n",own[n/2],own[n*9/10],own[n-1]);
+	printf("restarts  %u, backoff now %u ms\n",slot->restarts,slot->backoff_ms);
+	return 0;
+}
+EOF
+mkdir -p "$work/service"
+for i in $(seq "$services"); do
+	mkdir -p "$work/service/svc$i/log"
+	printf '#!/bin/sh\nexec sleep 100000\n' >"$work/service/svc$i/run"
+	printf '#!/bin/sh\nexec cat >/dev/null\n' >"$work/service/svc$i/log/run"
+	chmod +x "$work/service/svc$i/run" "$work/service/svc$i/log/run"
+done
+"$work/supervise" run "$work/service" "$work/page" </dev/null &
+pid=$!
+while [ ! -f "$work/page" ]; do sleep 0.1; done
+sleep 1
+echo "$services services, rss $(awk '/VmRSS/ { print $2, $3 }' /proc/$pid/status)"
+"$work/supervise" probe "$work/page" svc1 "$restarts"
+start=$(date +%s%N)
+kill -TERM "$pid"
+wait "$pid"
+pid=
+echo "shutdown  $((($(date +%s%N)-start)/1000)) us"
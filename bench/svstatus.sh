@@ -0,0 +1,75 @@
+#!/bin/sh
+# Service status for a synthetic runit tree: jni/init/svstatus.c, as the
+# service list now reads it, against one `sv status` over every service,
+# as it used to (less the su and chroot that preceded it on the device).
+# usage: svstatus.sh [services] [runs]
+set -e
+services=${1:-40}
+runs=${2:-200}
+src="$(dirname "$0")/../jni/init"
+work=$(mktemp -d)
+trap '[ -n "$KEEP" ] || rm -rf "$work"' EXIT
+${CC:-cc} -std=gnu99 -D_GNU_SOURCE -O2 -Wall -Wextra -I"$src" -x c - "$src/svstatus.c" -o "$work/svstatus" <<'EOF'
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "svstatus.h"
+int main(int argc, char **argv) {
+	int runs, i;
+	size_t count = 0;
+	struct timespec t0, t1;
+	if(argc != 3) return 2;
+	runs = atoi(argv[2]);
+	clock_gettime(CLOCK_MONOTONIC,&t0);
+	for(i = 0; i < runs; i++) {
+		struct svstatus_list *list = svstatus_read(argv[1]);
+		if(!list) {
+			perror(argv[1]);
+			return 1;
+		}
+		count = list->count;
+		svstatus_free(list);
+	}
+	clock_gettime(CLOCK_MONOTONIC,&t1);
+	printf("native    %4zu services  %8.1f us/read\n",count,
+		((t1.tv_sec-t0.tv_sec)*1e9+(t1.tv_nsec-t0.tv_nsec))/1e3/runs);
+	return 0;
+}
+EOF
+# {TAI64N, pid (LE), paused, want, got TERM, state}, as runsv writes it
+octal() {
+	v=$1 n=$2 out=
+	while [ "$n" -gt 0 ]; do
+		out="$(printf '\\%03o' $((v&255)))$out"
+		v=$((v>>8)) n=$((n-1))
+	done
+	printf '%s' "$out"
+}
+le32() {
+	v=$1
+	printf '\\%03o\\%03o\\%03o\\%03o' $((v&255)) $(((v>>8)&255)) $(((v>>16)&255)) $(((v>>24)&255))
+}
+status() {
+	mkdir -p "$1/supervise"
+	printf "$(octal $((0x400000000000000a+$(date +%s)-60)) 8)$(octal 0 4)$(le32 "$2")\\000u\\000\\00$3" >"$1/supervise/status"
+}
+mkdir -p "$work/root/etc/service" "$work/root/etc/sv"
+for i in $(seq "$services"); do
+	svc="$work/root/etc/sv/svc$i"
+	mkdir -p "$svc/log"
+	status "$svc" $((1000+i)) 1
+	status "$svc/log" $((2000+i)) 1
+	# every fourth service is disabled
+	[ $((i%4)) -eq 0 ] || ln -s "../sv/svc$i" "$work/root/etc/service/svc$i"
+done
+"$work/svstatus" "$work/root" "$runs"
+if command -v sv >/dev/null; then
+	cd "$work/root/etc/service"
+	start=$(date +%s%N)
+	for i in $(seq "$runs"); do SVDIR=. sv status * >/dev/null 2>&1 || true; done
+	end=$(date +%s%N)
+	awk -v n="$(ls | wc -l)" -v t=$((end-start)) -v runs="$runs" \
+		'BEGIN { printf "sv status %4d services  %8.1f us/read\n", n, t/1e3/runs }'
+else
+	echo "sv status: runit is not installed"
+fi
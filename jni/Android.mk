@@ -10,7 +10,20 @@ LOCAL_MODULE:= libjackpal-androidterm4
 LOCAL_SRC_FILES:= \
   common.cpp \
   termExec.cpp \
-  fileCompat.cpp
+  fileCompat.cpp \
+  dirScan.cpp \
+  ptyPump.cpp \
+  reaper.cpp \
+  shellBroker.cpp \
+  mountFs.cpp \
+  packageIndex.cpp \
+  packageSearch.cpp \
+  naturalSort.cpp \
+  serviceStatus.cpp \
+  serviceUsage.cpp \
+  init/mountinfo.c \
+  init/svstatus.c \
+  init/cgroup.c
 
 LOCAL_LDLIBS := -ldl -llog
 
@@ -24,6 +37,11 @@ LOCAL_MODULE:= init
 LOCAL_SRC_FILES:= \
   init/init.c \
   init/strnstr.c \
-  init/mntent.c
+  init/broker.c \
+  init/mountinfo.c \
+  init/supervise.c \
+  init/cgroup.c \
+  init/mountstamp.c \
+  init/mountspec.c
 LOCAL_LDLIBS :=
 include $(BUILD_EXECUTABLE)
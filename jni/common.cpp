@@ -31,11 +31,109 @@
  */
 
 #include "common.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "termExec.h"
 #include "fileCompat.h"
+#include "dirScan.h"
+#include "ptyPump.h"
+#include "reaper.h"
+#include "shellBroker.h"
+#include "mountFs.h"
+#include "packageIndex.h"
+#include "packageSearch.h"
+#include "naturalSort.h"
+#include "serviceStatus.h"
+#include "serviceUsage.h"
 
 #define LOG_TAG "libjackpal-androidterm"
 
+/*
+ * Transcode UTF-16 to NUL-terminated UTF-8, returning the number of bytes
+ * stored including the terminator.  dst needs room for 3*len+1 bytes.
+ * Unpaired surrogates become U+FFFD.  Runs of ASCII, which is nearly all
+ * of what we pass around, are tested and copied four code units at a time.
+ */
+size_t utf16_to_utf8(const jchar *src, size_t len, char *dst)
+{
+    char *out = dst;
+    size_t i = 0;
+
+    while (i < len) {
+        while (i + 4 <= len) {
+            uint64_t w;
+            memcpy(&w, src + i, sizeof(w));
+            if (w & 0xff80ff80ff80ff80ULL) break;
+            out[0] = (char) src[i];
+            out[1] = (char) src[i + 1];
+            out[2] = (char) src[i + 2];
+            out[3] = (char) src[i + 3];
+            out += 4;
+            i += 4;
+        }
+        if (i == len) break;
+
+        unsigned int c = src[i++];
+        if (c < 0x80) {
+            *out++ = (char) c;
+        } else if (c < 0x800) {
+            *out++ = (char) (0xc0 | (c >> 6));
+            *out++ = (char) (0x80 | (c & 0x3f));
+        } else if (c >= 0xd800 && c < 0xdc00 && i < len &&
+                   src[i] >= 0xdc00 && src[i] < 0xe000) {
+            c = 0x10000 + ((c - 0xd800) << 10) + (src[i++] - 0xdc00);
+            *out++ = (char) (0xf0 | (c >> 18));
+            *out++ = (char) (0x80 | ((c >> 12) & 0x3f));
+            *out++ = (char) (0x80 | ((c >> 6) & 0x3f));
+            *out++ = (char) (0x80 | (c & 0x3f));
+        } else {
+            if (c >= 0xd800 && c < 0xe000) c = 0xfffd;
+            *out++ = (char) (0xe0 | (c >> 12));
+            *out++ = (char) (0x80 | ((c >> 6) & 0x3f));
+            *out++ = (char) (0x80 | (c & 0x3f));
+        }
+    }
+    *out++ = '\0';
+    return out - dst;
+}
+
+/*
+ * The real UTF-8 of str (not JNI's modified UTF-8, which splits characters
+ * outside the BMP into surrogates) at dst, which needs room for
+ * 3*GetStringLength(str)+1 bytes.  Returns the bytes stored including the
+ * terminator, or 0 if the characters could not be had.
+ */
+size_t jstring_to_utf8(JNIEnv *env, jstring str, char *dst)
+{
+    jsize len = env->GetStringLength(str);
+    const jchar *chars = env->GetStringCritical(str, 0);
+    if (!chars) {
+        return 0;
+    }
+    size_t res = utf16_to_utf8(chars, len, dst);
+    env->ReleaseStringCritical(str, chars);
+    return res;
+}
+
+/*
+ * jstring_to_utf8() into a buffer of its own, for the caller to free(), or
+ * NULL with an OutOfMemoryError thrown.
+ */
+char *jstring_dup_utf8(JNIEnv *env, jstring str)
+{
+    char *res = (char *) malloc(3 * (size_t) env->GetStringLength(str) + 1);
+    if (!res || !jstring_to_utf8(env, str, res)) {
+        free(res);
+        jclass exClass = env->FindClass("java/lang/OutOfMemoryError");
+        if (exClass) env->ThrowNew(exClass, "cannot convert string");
+        return NULL;
+    }
+    return res;
+}
+
 /*
  * Register several native methods for one class.
  */
@@ -92,6 +190,56 @@ jint JNI_OnLoad(JavaVM* vm, void* reserved) {
         goto bail;
     }
 
+    if (init_DirScan(env) != JNI_TRUE) {
+        LOGE("ERROR: init of DirScan failed");
+        goto bail;
+    }
+
+    if (init_Reaper(env) != JNI_TRUE) {
+        LOGE("ERROR: init of Reaper failed");
+        goto bail;
+    }
+
+    if (init_PtyPump(env) != JNI_TRUE) {
+        LOGE("ERROR: init of PtyPump failed");
+        goto bail;
+    }
+
+    if (init_ShellBroker(env) != JNI_TRUE) {
+        LOGE("ERROR: init of ShellBroker failed");
+        goto bail;
+    }
+
+    if (init_MountFs(env) != JNI_TRUE) {
+        LOGE("ERROR: init of MountFs failed");
+        goto bail;
+    }
+
+    if (init_PackageIndex(env) != JNI_TRUE) {
+        LOGE("ERROR: init of PackageIndex failed");
+        goto bail;
+    }
+
+    if (init_PackageSearch(env) != JNI_TRUE) {
+        LOGE("ERROR: init of PackageSearch failed");
+        goto bail;
+    }
+
+    if (init_NaturalSort(env) != JNI_TRUE) {
+        LOGE("ERROR: init of NaturalSort failed");
+        goto bail;
+    }
+
+    if (init_ServiceStatus(env) != JNI_TRUE) {
+        LOGE("ERROR: init of ServiceStatus failed");
+        goto bail;
+    }
+
+    if (init_ServiceUsage(env) != JNI_TRUE) {
+        LOGE("ERROR: init of ServiceUsage failed");
+        goto bail;
+    }
+
     result = JNI_VERSION_1_4;
 
 bail:
@@ -44,5 +44,8 @@
 
 int registerNativeMethods(JNIEnv* env, const char* className,
     JNINativeMethod* gMethods, int numMethods);
+size_t utf16_to_utf8(const jchar *src, size_t len, char *dst);
+size_t jstring_to_utf8(JNIEnv *env, jstring str, char *dst);
+char *jstring_dup_utf8(JNIEnv *env, jstring str);
 
 #endif
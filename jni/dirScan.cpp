@@ -0,0 +1,258 @@
+#include "common.h"
+
+#define LOG_TAG "DirScan"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "dirScan.h"
+#include "naturalSort.h"
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0200000
+#endif
+
+/* flags, as in DirScan.java */
+#define SCAN_STAT 1             // size, mode and mtime for every entry
+#define SCAN_EXECUTABLE 2       // whether each entry is executable
+#define SCAN_SORT 4             // in natural order
+
+/* types, as in DirScan.java */
+#define TYPE_FILE 0
+#define TYPE_DIRECTORY 1
+#define TYPE_OTHER 2            // devices, fifos, sockets and dangling links
+
+#define FLAG_EXECUTABLE 1
+#define FLAG_LINK 2
+#define FLAG_STAT 4             // size, mode and mtime are set
+
+#define DENTS_SIZE 32768
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/*
+ * One record, 8-byte aligned, followed by the UTF-8 name and padding to
+ * the next record.
+ */
+struct ScanRecord {
+    int64_t size;
+    int64_t mtime;
+    int32_t mode;
+    uint16_t name_len;
+    uint8_t type;
+    uint8_t flags;
+};
+
+struct ScanEntry {
+    ScanRecord rec;
+    size_t name;        // offset into the names buffer
+    const unsigned char *key;
+    size_t key_len;
+};
+
+struct Scan {
+    ScanEntry *entries;
+    size_t count;
+    size_t cap;
+    char *names;
+    size_t names_len;
+    size_t names_cap;
+    unsigned char *keys;
+};
+
+static bool grow(void **buf, size_t *cap, size_t need, size_t size)
+{
+    if (need <= *cap) return true;
+    size_t n = *cap ? *cap : 64;
+    while (n < need) n *= 2;
+    void *tmp = realloc(*buf, n * size);
+    if (!tmp) return false;
+    *buf = tmp;
+    *cap = n;
+    return true;
+}
+
+static int typeOf(mode_t mode)
+{
+    if (S_ISDIR(mode)) return TYPE_DIRECTORY;
+    if (S_ISREG(mode)) return TYPE_FILE;
+    return TYPE_OTHER;
+}
+
+/*
+ * Type from d_type where it is enough; links and filesystems without
+ * d_type cost one fstatat, as does asking for SCAN_STAT.
+ */
+static void describe(int dirfd, const char *name, unsigned char d_type, int flags, ScanRecord *rec)
+{
+    struct stat st;
+    bool need_stat = (flags & SCAN_STAT) || d_type == DT_UNKNOWN || d_type == DT_LNK;
+    rec->type = d_type == DT_DIR ? TYPE_DIRECTORY : d_type == DT_REG ? TYPE_FILE : TYPE_OTHER;
+    if (d_type == DT_LNK) rec->flags |= FLAG_LINK;
+    if (need_stat && fstatat(dirfd, name, &st, 0) == 0) {
+        rec->type = typeOf(st.st_mode);
+        rec->size = st.st_size;
+        rec->mtime = st.st_mtime;
+        rec->mode = st.st_mode;
+        rec->flags |= FLAG_STAT;
+    } else if (need_stat && d_type == DT_LNK) {
+        rec->type = TYPE_OTHER;
+    }
+    if ((flags & SCAN_EXECUTABLE) && syscall(__NR_faccessat, dirfd, name, X_OK, 0) == 0) {
+        rec->flags |= FLAG_EXECUTABLE;
+    }
+}
+
+/* read every entry but . and .. through getdents64; returns errno, or 0 */
+static int readEntries(int dirfd, int flags, Scan *scan)
+{
+    char *dents = (char *) malloc(DENTS_SIZE);
+    if (!dents) return ENOMEM;
+    int err = 0;
+    for (;;) {
+        long n = syscall(__NR_getdents64, dirfd, dents, DENTS_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n < 0) err = errno;
+            break;
+        }
+        for (long off = 0; off < n;) {
+            const struct linux_dirent64 *d = (const struct linux_dirent64 *) (dents + off);
+            off += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+            size_t len = strlen(name);
+            if (!grow((void **) &scan->entries, &scan->cap, scan->count + 1, sizeof(ScanEntry))
+                || !grow((void **) &scan->names, &scan->names_cap, scan->names_len + len + 1, 1)) {
+                err = ENOMEM;
+                goto done;
+            }
+            ScanEntry *e = &scan->entries[scan->count++];
+            memset(e, 0, sizeof(*e));
+            e->rec.name_len = len;
+            e->name = scan->names_len;
+            memcpy(scan->names + scan->names_len, name, len + 1);
+            scan->names_len += len + 1;
+            describe(dirfd, name, d->d_type, flags, &e->rec);
+        }
+    }
+
+done:
+    free(dents);
+    return err;
+}
+
+static int compareEntries(const void *a, const void *b)
+{
+    const ScanEntry *x = (const ScanEntry *) a;
+    const ScanEntry *y = (const ScanEntry *) b;
+    int c = memcmp(x->key, y->key, x->key_len < y->key_len ? x->key_len : y->key_len);
+    if (c) return c;
+    return (x->key_len > y->key_len) - (x->key_len < y->key_len);
+}
+
+/* natural order, by the same keys as NaturalSort; false if out of memory */
+static bool sortEntries(Scan *scan)
+{
+    size_t size = 0;
+    for (size_t i = 0; i < scan->count; i++) size += naturalKeyBound(scan->entries[i].rec.name_len);
+    if (!(scan->keys = (unsigned char *) malloc(size ? size : 1))) return false;
+    unsigned char *p = scan->keys;
+    for (size_t i = 0; i < scan->count; i++) {
+        ScanEntry *e = &scan->entries[i];
+        e->key = p;
+        e->key_len = naturalKeyUTF8(scan->names + e->name, e->rec.name_len, p);
+        if (!e->key_len) return false;
+        p += e->key_len;
+    }
+    qsort(scan->entries, scan->count, sizeof(ScanEntry), compareEntries);
+    return true;
+}
+
+static size_t recordSize(const ScanEntry &e)
+{
+    return (sizeof(ScanRecord) + e.rec.name_len + 7) & ~(size_t) 7;
+}
+
+static void throwIOException(JNIEnv *env, int errnum)
+{
+    jclass exClass = env->FindClass(errnum == ENOENT ? "java/io/FileNotFoundException" : "java/io/IOException");
+    env->ThrowNew(exClass, strerror(errnum));
+}
+
+/* the entries of a directory as packed ScanRecords */
+static jbyteArray dirScan_scan(JNIEnv *env, jclass clazz, jstring path, jint flags)
+{
+    char *path_8 = jstring_dup_utf8(env, path);
+    if (!path_8) return NULL;
+    jbyteArray result = NULL;
+    Scan scan;
+    memset(&scan, 0, sizeof(scan));
+    int err = 0;
+    int dirfd = open(path_8, O_RDONLY | O_DIRECTORY);
+    if (dirfd < 0) err = errno;
+    else {
+        fcntl(dirfd, F_SETFD, FD_CLOEXEC);
+        err = readEntries(dirfd, flags, &scan);
+        close(dirfd);
+    }
+    free(path_8);
+    if (!err && (flags & SCAN_SORT) && !sortEntries(&scan)) err = ENOMEM;
+    if (err) {
+        throwIOException(env, err);
+        goto bail;
+    }
+
+    {
+        size_t size = 0;
+        for (size_t i = 0; i < scan.count; i++) size += recordSize(scan.entries[i]);
+        char *buf = (char *) calloc(size ? size : 1, 1);
+        if (!buf) {
+            throwIOException(env, ENOMEM);
+            goto bail;
+        }
+        char *out = buf;
+        for (size_t i = 0; i < scan.count; i++) {
+            const ScanEntry &e = scan.entries[i];
+            memcpy(out, &e.rec, sizeof(ScanRecord));
+            memcpy(out + sizeof(ScanRecord), scan.names + e.name, e.rec.name_len);
+            out += recordSize(e);
+        }
+        if ((result = env->NewByteArray(size))) env->SetByteArrayRegion(result, 0, size, (const jbyte *) buf);
+        free(buf);
+    }
+
+bail:
+    free(scan.keys);
+    free(scan.names);
+    free(scan.entries);
+    return result;
+}
+
+static const char *classPathName = "com/botbrew/basil/DirScan";
+static JNINativeMethod method_table[] = {
+    { "nativeScan", "(Ljava/lang/String;I)[B", (void *) dirScan_scan },
+};
+
+int init_DirScan(JNIEnv *env)
+{
+    if (!registerNativeMethods(env, classPathName, method_table,
+                sizeof(method_table) / sizeof(method_table[0]))) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
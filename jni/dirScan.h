@@ -0,0 +1,8 @@
+#ifndef _DIRSCAN_H
+#define _DIRSCAN_H 1
+
+#include "jni.h"
+
+int init_DirScan(JNIEnv *env);
+
+#endif	/* !defined(_DIRSCAN_H) */
@@ -0,0 +1,478 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <grp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include "broker.h"
+
+#define BROKER_BACKLOG	16
+#define BROKER_TIMEOUT	2000	/* ms a client may take to send its request */
+#define BROKER_PENDING_MAX	32	/* requests arriving at once; more wait in the backlog */
+
+struct session {
+	int fd;		// -1 once the client has gone away
+	pid_t pid;	// 0 while the request is arriving
+	long long deadline;	// for the request to have arrived
+	struct ucred cred;
+	struct broker_request req;
+	char *payload;
+	size_t got;	// of req and payload, then of signo
+	int fds[3];
+	int nfds;
+	int32_t signo;
+};
+
+static int sigchld_pipe[2] = {-1,-1};
+static struct session *sessions = NULL;
+static int sessions_len = 0;
+static int sessions_cap = 0;
+static int pending_len = 0;
+
+static long long now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (long long)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+static void sigchld_handler(int signo) {
+	int saved_errno = errno;
+	(void)signo;
+	write(sigchld_pipe[1],"",1);
+	errno = saved_errno;
+}
+
+static void cloexec(int fd) {
+	fcntl(fd,F_SETFD,FD_CLOEXEC);
+}
+
+static int sockaddr_init(struct sockaddr_un *addr, const char *path) {
+	size_t len = strlen(path);
+	if(len >= sizeof(addr->sun_path)) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	memset(addr,0,sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	memcpy(addr->sun_path,path,len+1);
+	return 0;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+	char *p = (char*)buf;
+	while(len) {
+		ssize_t n = read(fd,p,len);
+		if(n < 0) {
+			if(errno == EINTR) continue;
+			return -1;
+		}
+		if(n == 0) {
+			errno = EPIPE;
+			return -1;
+		}
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static void reply(int fd, int32_t kind, int32_t value) {
+	struct broker_reply r;
+	r.kind = kind;
+	r.value = value;
+	send(fd,&r,sizeof(r),MSG_NOSIGNAL);
+}
+
+/*
+ * Split the request payload into cwd, argv and envp; returns 0 if every
+ * string is terminated inside the payload.
+ */
+static int parse_payload(char *payload, uint32_t length, uint32_t argc, uint32_t envc, char **cwd, char **argv, char **envp) {
+	char *p = payload, *end = payload+length;
+	uint32_t i;
+	char *s;
+	for(i = 0; i < 1+argc+envc; i++) {
+		if(p >= end) return -1;
+		s = p;
+		p = (char*)memchr(p,0,end-p);
+		if(!p) return -1;
+		p++;
+		if(i == 0) *cwd = s;
+		else if(i <= argc) argv[i-1] = s;
+		else envp[i-1-argc] = s;
+	}
+	argv[argc] = NULL;
+	envp[envc] = NULL;
+	return 0;
+}
+
+static void child_exec(int fds[3], uint32_t flags, const struct ucred *cred, const char *cwd, char **argv, char **envp) {
+	struct sigaction sa;
+	sigset_t mask;
+	int i;
+	memset(&sa,0,sizeof(sa));
+	sa.sa_handler = SIG_DFL;
+	sigaction(SIGCHLD,&sa,NULL);
+	sigaction(SIGPIPE,&sa,NULL);
+	sigaction(SIGHUP,&sa,NULL);
+	sigemptyset(&mask);
+	sigprocmask(SIG_SETMASK,&mask,NULL);
+	// received descriptors are always above stdio, which the broker holds on /dev/null
+	for(i = 0; i < 3; i++) dup2(fds[i],i);
+	for(i = 0; i < 3; i++) close(fds[i]);
+	setsid();
+	if(flags&BROKER_CTTY) ioctl(0,TIOCSCTTY,0);
+	if((chdir(cwd))&&(chdir("/"))) _exit(126);
+	if(!(flags&BROKER_SUPERUSER)) {
+		gid_t gid = cred->gid;
+		if((setgroups(1,&gid))||(setregid(gid,gid))||(setreuid(cred->uid,cred->uid))) {
+			fprintf(stderr,"whoops: cannot drop privileges\n");
+			_exit(126);
+		}
+	}
+	for(; *envp; envp++) {
+		char *eq = strchr(*envp,'=');
+		if(eq) {
+			*eq = 0;
+			setenv(*envp,eq+1,1);
+		} else unsetenv(*envp);
+	}
+	execvp(argv[0],argv);
+	fprintf(stderr,"whoops: cannot run `%s'\n",argv[0]);
+	_exit(127);
+}
+
+static int session_reserve(void) {
+	if(sessions_len == sessions_cap) {
+		int n = sessions_cap?2*sessions_cap:16;
+		struct session *tmp = (struct session*)realloc(sessions,n*sizeof(*tmp));
+		if(!tmp) return -1;
+		sessions = tmp;
+		sessions_cap = n;
+	}
+	return 0;
+}
+
+static void session_drop(int i) {
+	struct session *s = &sessions[i];
+	int j;
+	for(j = 0; j < s->nfds; j++) close(s->fds[j]);
+	free(s->payload);
+	if(s->fd >= 0) close(s->fd);
+	if(!s->pid) pending_len--;
+	sessions[i] = sessions[--sessions_len];
+}
+
+/* keep the descriptors that ride on the header */
+static void receive_fds(struct session *s, struct msghdr *msg) {
+	struct cmsghdr *cmsg;
+	int i;
+	for(cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg,cmsg)) {
+		if((cmsg->cmsg_level != SOL_SOCKET)||(cmsg->cmsg_type != SCM_RIGHTS)) continue;
+		int *p = (int*)CMSG_DATA(cmsg);
+		int count = (cmsg->cmsg_len-CMSG_LEN(0))/sizeof(int);
+		for(i = 0; i < count; i++) {
+			if(s->nfds < 3) {
+				s->fds[s->nfds++] = p[i];
+				cloexec(p[i]);
+			} else close(p[i]);
+		}
+	}
+}
+
+/*
+ * Take what has arrived of the request on session i, and once all of it
+ * has, start the command.  Nothing here blocks: a client that sends its
+ * request slowly, or not at all, holds up no one but itself.
+ */
+static void broker_receive(int i, uid_t owner, int *listening) {
+	struct session *s = &sessions[i];
+	struct iovec iov;
+	struct msghdr msg;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(3*sizeof(int))];
+	} control;
+	char **argv = NULL, **envp = NULL, *cwd = NULL;
+	ssize_t n;
+	int err = 0;
+	int j;
+	// header, with the descriptors attached to it
+	while(s->got < sizeof(s->req)) {
+		memset(&msg,0,sizeof(msg));
+		iov.iov_base = (char*)&s->req+s->got;
+		iov.iov_len = sizeof(s->req)-s->got;
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+		n = recvmsg(s->fd,&msg,MSG_DONTWAIT);
+		if(n > 0) {
+			receive_fds(s,&msg);
+			s->got += n;
+			continue;
+		}
+		if((n < 0)&&((errno == EAGAIN)||(errno == EINTR))) return;
+		session_drop(i);	// gone before asking anything
+		return;
+	}
+	if(!s->payload) {
+		int privileged = (s->cred.uid == 0)||(s->cred.uid == owner);
+		if((s->req.magic != BROKER_MAGIC)||(s->req.length > BROKER_MAX_LENGTH)) err = EINVAL;
+		else if(s->req.flags&BROKER_SHUTDOWN) {
+			if(privileged) *listening = 0;
+			else err = EPERM;
+		} else if((s->req.flags&BROKER_SUPERUSER)&&(!privileged)) err = EPERM;
+		else if(s->nfds != 3) err = EBADF;
+		else if((s->req.argc == 0)||(s->req.argc > s->req.length)||(s->req.envc > s->req.length)) err = EINVAL;
+		if((err)||(s->req.flags&BROKER_SHUTDOWN)) goto done;
+		// not empty: there is at least argv[0]
+		if(!(s->payload = (char*)malloc(s->req.length))) {
+			err = ENOMEM;
+			goto done;
+		}
+	}
+	while(s->got < sizeof(s->req)+s->req.length) {
+		n = read(s->fd,s->payload+s->got-sizeof(s->req),sizeof(s->req)+s->req.length-s->got);
+		if(n > 0) {
+			s->got += n;
+			continue;
+		}
+		if((n < 0)&&((errno == EAGAIN)||(errno == EINTR))) return;
+		err = n?errno:EPIPE;
+		goto done;
+	}
+	argv = (char**)malloc((s->req.argc+1)*sizeof(char*));
+	envp = (char**)malloc((s->req.envc+1)*sizeof(char*));
+	if((!argv)||(!envp)) err = ENOMEM;
+	else if(parse_payload(s->payload,s->req.length,s->req.argc,s->req.envc,&cwd,argv,envp)) err = EINVAL;
+	else {
+		pid_t pid = fork();
+		if(pid == 0) child_exec(s->fds,s->req.flags,&s->cred,cwd,argv,envp);
+		if(pid < 0) err = errno;
+		else {
+			for(j = 0; j < s->nfds; j++) close(s->fds[j]);
+			s->nfds = 0;
+			free(s->payload);
+			s->payload = NULL;
+			s->pid = pid;
+			s->got = 0;
+			pending_len--;
+			reply(s->fd,BROKER_STARTED,pid);
+		}
+	}
+	free(envp);
+	free(argv);
+	if(!err) return;
+done:
+	reply(s->fd,BROKER_STARTED,-err);
+	session_drop(i);
+}
+
+static void broker_accept(int lfd, uid_t owner, int *listening) {
+	struct ucred cred;
+	socklen_t credlen = sizeof(cred);
+	int fd = accept(lfd,NULL,NULL);
+	if(fd < 0) return;
+	cloexec(fd);
+	fcntl(fd,F_SETFL,O_NONBLOCK);
+	if((getsockopt(fd,SOL_SOCKET,SO_PEERCRED,&cred,&credlen) < 0)||(session_reserve())) {
+		close(fd);
+		return;
+	}
+	struct session *s = &sessions[sessions_len++];
+	memset(s,0,sizeof(*s));
+	s->fd = fd;
+	s->cred = cred;
+	s->deadline = now_ms()+BROKER_TIMEOUT;
+	pending_len++;
+	// the request usually arrives with the connection
+	broker_receive(sessions_len-1,owner,listening);
+}
+
+static void broker_signal(struct session *s) {
+	ssize_t n = recv(s->fd,(char*)&s->signo+s->got,sizeof(s->signo)-s->got,MSG_DONTWAIT);
+	if(n > 0) {
+		s->got += n;
+		if(s->got < sizeof(s->signo)) return;
+		s->got = 0;
+		if((s->signo > 0)&&(s->signo < NSIG)&&(kill(-s->pid,s->signo))) kill(s->pid,s->signo);
+		return;
+	}
+	if((n < 0)&&((errno == EINTR)||(errno == EAGAIN))) return;
+	// client went away; the command keeps running until it notices
+	close(s->fd);
+	s->fd = -1;
+}
+
+static void broker_reap(void) {
+	char buf[64];
+	int status, i;
+	pid_t pid;
+	while(read(sigchld_pipe[0],buf,sizeof(buf)) > 0);
+	while((pid = waitpid(-1,&status,WNOHANG)) > 0) {
+		for(i = 0; i < sessions_len; i++) if(sessions[i].pid == pid) {
+			if(sessions[i].fd >= 0) reply(sessions[i].fd,BROKER_EXITED,status);
+			session_drop(i);
+			break;
+		}
+	}
+}
+
+/*
+ * Serve commands on a unix socket at path until asked to shut down.
+ * Returns 0 in the calling process once the socket is accepting
+ * connections (or if a broker already is), -1 on error.
+ */
+int broker_main(const char *path, uid_t owner) {
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	struct pollfd *pfds = NULL;
+	int pfds_cap = 0;
+	int listening = 1;
+	int i;
+	if(sockaddr_init(&addr,path)) return -1;
+	// already running?
+	int lfd = socket(AF_UNIX,SOCK_STREAM,0);
+	if(lfd < 0) return -1;
+	if(connect(lfd,(struct sockaddr*)&addr,sizeof(addr)) == 0) {
+		close(lfd);
+		return 0;
+	}
+	close(lfd);
+	unlink(path);
+	if((lfd = socket(AF_UNIX,SOCK_STREAM,0)) < 0) return -1;
+	cloexec(lfd);
+	if((bind(lfd,(struct sockaddr*)&addr,sizeof(addr)))||(chmod(path,0666))||(listen(lfd,BROKER_BACKLOG))) {
+		close(lfd);
+		unlink(path);
+		return -1;
+	}
+	pid_t pid = fork();
+	if(pid < 0) {
+		close(lfd);
+		unlink(path);
+		return -1;
+	}
+	if(pid > 0) {
+		close(lfd);
+		return 0;
+	}
+	// daemonize
+	setsid();
+	chdir("/");
+	int nullfd = open("/dev/null",O_RDWR);
+	if(nullfd >= 0) {
+		dup2(nullfd,0);
+		dup2(nullfd,1);
+		dup2(nullfd,2);
+		if(nullfd > 2) close(nullfd);
+	}
+	if(pipe(sigchld_pipe)) exit(EXIT_FAILURE);
+	for(i = 0; i < 2; i++) {
+		cloexec(sigchld_pipe[i]);
+		fcntl(sigchld_pipe[i],F_SETFL,O_NONBLOCK);
+	}
+	memset(&sa,0,sizeof(sa));
+	sa.sa_handler = sigchld_handler;
+	sa.sa_flags = SA_RESTART|SA_NOCLDSTOP;
+	sigaction(SIGCHLD,&sa,NULL);
+	sa.sa_handler = SIG_IGN;
+	sa.sa_flags = 0;
+	sigaction(SIGPIPE,&sa,NULL);
+	sigaction(SIGHUP,&sa,NULL);
+	// serve until shut down and every command has been reaped
+	while((listening)||(sessions_len)) {
+		if(pfds_cap < sessions_len+2) {
+			struct pollfd *tmp = (struct pollfd*)realloc(pfds,(sessions_cap+2)*sizeof(*tmp));
+			if(!tmp) break;
+			pfds = tmp;
+			pfds_cap = sessions_cap+2;
+		}
+		long long now = now_ms();
+		int timeout = -1;
+		int npfds = 0;
+		pfds[npfds].fd = sigchld_pipe[0];
+		pfds[npfds++].events = POLLIN;
+		if((listening)&&(pending_len < BROKER_PENDING_MAX)) {
+			pfds[npfds].fd = lfd;
+			pfds[npfds++].events = POLLIN;
+		}
+		for(i = 0; i < sessions_len; i++) {
+			if(sessions[i].fd < 0) continue;
+			pfds[npfds].fd = sessions[i].fd;
+			pfds[npfds++].events = POLLIN;
+			if(!sessions[i].pid) {
+				long long wait = (sessions[i].deadline > now)?sessions[i].deadline-now:0;
+				if((timeout < 0)||(wait < timeout)) timeout = wait;
+			}
+		}
+		if(poll(pfds,npfds,timeout) < 0) {
+			if(errno == EINTR) continue;
+			break;
+		}
+		for(i = 0; i < npfds; i++) {
+			if(!pfds[i].revents) continue;
+			if(pfds[i].fd == sigchld_pipe[0]) broker_reap();
+			else if((listening)&&(pfds[i].fd == lfd)) broker_accept(lfd,owner,&listening);
+			else {
+				int j;
+				for(j = 0; j < sessions_len; j++) if(sessions[j].fd == pfds[i].fd) {
+					if(sessions[j].pid) broker_signal(&sessions[j]);
+					else broker_receive(j,owner,&listening);
+					break;
+				}
+			}
+		}
+		// requests that did not arrive in time
+		now = now_ms();
+		for(i = sessions_len; i-- > 0;) if((!sessions[i].pid)&&(sessions[i].deadline <= now)) {
+			reply(sessions[i].fd,BROKER_STARTED,-ETIMEDOUT);
+			session_drop(i);
+		}
+		if((!listening)&&(lfd >= 0)) {
+			close(lfd);
+			unlink(path);
+			lfd = -1;
+		}
+	}
+	exit(EXIT_SUCCESS);
+}
+
+/*
+ * Ask the broker listening at path to exit.  Returns 0 on success.
+ */
+int broker_shutdown(const char *path) {
+	struct sockaddr_un addr;
+	struct broker_request req;
+	struct broker_reply r;
+	if(sockaddr_init(&addr,path)) return -1;
+	int fd = socket(AF_UNIX,SOCK_STREAM,0);
+	if(fd < 0) return -1;
+	if(connect(fd,(struct sockaddr*)&addr,sizeof(addr))) {
+		close(fd);
+		return -1;
+	}
+	memset(&req,0,sizeof(req));
+	req.magic = BROKER_MAGIC;
+	req.flags = BROKER_SHUTDOWN;
+	int res = -1;
+	if((send(fd,&req,sizeof(req),MSG_NOSIGNAL) == sizeof(req))&&(read_full(fd,&r,sizeof(r)) == 0)) res = (r.value == 0)?0:-1;
+	close(fd);
+	return res;
+}
@@ -0,0 +1,54 @@
+#ifndef BROKER_H
+#define BROKER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Wire protocol of `init --broker', shared with the client in libjackpal.
+ *
+ * A request is one broker_request header followed by `length' bytes holding
+ * NUL-terminated strings: the working directory, argc arguments and envc
+ * environment overrides ("NAME=value", or "NAME" to unset).  The stdin,
+ * stdout and stderr of the command ride along as SCM_RIGHTS on the first
+ * byte.  The broker answers with BROKER_STARTED and, once the command has
+ * been reaped, BROKER_EXITED.  Until then the client may write an int32_t
+ * signal number, which is delivered to the command's process group.
+ */
+
+#define BROKER_SOCKET	"/run/init.sock"
+#define BROKER_MAGIC	0x42724b31	/* "BrK1" */
+#define BROKER_MAX_LENGTH	(256*1024)
+
+#define BROKER_SUPERUSER	1	/* run as root instead of the peer's uid */
+#define BROKER_CTTY	2	/* make stdin the controlling terminal */
+#define BROKER_SHUTDOWN	4	/* stop listening and exit; no command */
+
+#define BROKER_STARTED	1	/* value = pid, or -errno */
+#define BROKER_EXITED	2	/* value = wait status */
+
+struct broker_request {
+	uint32_t magic;
+	uint32_t flags;
+	uint32_t argc;
+	uint32_t envc;
+	uint32_t length;
+};
+
+struct broker_reply {
+	int32_t kind;
+	int32_t value;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int broker_main(const char *path, uid_t owner);
+int broker_shutdown(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <signal.h>
+#include <sys/stat.h>
+
+#include "cgroup.h"
+#include "mountinfo.h"
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC	02000000
+#endif
+
+/* the unified hierarchy; Android mounts it at /sys/fs/cgroup, or not at all */
+static char *cgroup_root(void) {
+	struct mountinfo *mi = mountinfo_read(NULL);
+	char *root = NULL;
+	size_t i;
+	if(!mi) return NULL;
+	for(i = 0; i < mi->count; i++) {
+		const struct mountinfo_entry *m = &mi->entries[i];
+		if(strcmp(m->type,"cgroup2") != 0) continue;
+		if((!root)||(strcmp(m->dir,"/sys/fs/cgroup") == 0)) {
+			free(root);
+			root = strdup(m->dir);
+		}
+	}
+	mountinfo_free(mi);
+	if(!root) errno = ENOENT;
+	return root;
+}
+
+static int valid_name(const char *name) {
+	const char *p = name;
+	if(!*name) return 0;
+	while(*p) {
+		const char *end = p;
+		while((*end)&&(*end != '/')) {
+			char c = *end++;
+			if(!(((c >= 'a')&&(c <= 'z'))||((c >= 'A')&&(c <= 'Z'))||((c >= '0')&&(c <= '9'))||(c == '_')||(c == '-')||(c == '.'))) return 0;
+		}
+		if((end == p)||((end-p == 1)&&(p[0] == '.'))||((end-p == 2)&&(p[0] == '.')&&(p[1] == '.'))) return 0;
+		p = *end?end+1:end;
+		if((*end)&&(!*p)) return 0;	// trailing slash
+	}
+	return 1;
+}
+
+char *cgroup_path(const char *name) {
+	if(!valid_name(name)) {
+		errno = EINVAL;
+		return NULL;
+	}
+	char *root = cgroup_root();
+	if(!root) return NULL;
+	char *path = (char*)malloc(strlen(root)+sizeof("/"CGROUP_PARENT"/")+strlen(name));
+	if(path) sprintf(path,"%s/"CGROUP_PARENT"/%s",root,name);
+	free(root);
+	return path;
+}
+
+static int write_file(const char *dir, const char *file, const char *value) {
+	char path[PATH_MAX];
+	snprintf(path,sizeof(path),"%s/%s",dir,file);
+	int fd = open(path,O_WRONLY|O_CLOEXEC);
+	if(fd < 0) return -1;
+	ssize_t n = write(fd,value,strlen(value));
+	int err = errno;
+	close(fd);
+	if(n < 0) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+/* nonzero if the space-separated list in dir/file has word */
+static int has_word(const char *dir, const char *file, const char *word) {
+	char path[PATH_MAX], buf[256];
+	snprintf(path,sizeof(path),"%s/%s",dir,file);
+	int fd = open(path,O_RDONLY|O_CLOEXEC);
+	if(fd < 0) return 0;
+	ssize_t n = read(fd,buf,sizeof(buf)-1);
+	close(fd);
+	if(n <= 0) return 0;
+	buf[n] = 0;
+	size_t len = strlen(word);
+	char *p;
+	for(p = buf; (p = strstr(p,word)); p += len) {
+		if(((p == buf)||(p[-1] == ' '))&&((p[len] == ' ')||(p[len] == '\n')||(!p[len]))) return 1;
+	}
+	return 0;
+}
+
+/*
+ * Let the children of every directory on the way from the cgroup root to
+ * path use controller.  Only what a limit needs is enabled: at the root
+ * this also applies to the system's own groups.
+ */
+static int enable_controller(char *path, size_t root_len, const char *controller) {
+	char *slash, word[16];
+	int res = 0;
+	snprintf(word,sizeof(word),"+%s",controller);
+	// each slash from the root on ends the path of an ancestor
+	for(slash = path+root_len; slash; slash = strchr(slash+1,'/')) {
+		*slash = 0;
+		const char *dir = (slash == path)?"/":path;
+		if((!has_word(dir,"cgroup.subtree_control",controller))&&(write_file(dir,"cgroup.subtree_control",word))) res = -1;
+		*slash = '/';
+	}
+	return res;
+}
+
+int cgroup_create(const char *name, const struct cgroup_limits *limits) {
+	char *path = cgroup_path(name);
+	if(!path) return -1;
+	size_t root_len = strlen(path)-strlen(name)-sizeof("/"CGROUP_PARENT"/")+1;
+	char *p;
+	// mkdir -p from CGROUP_PARENT down
+	for(p = strchr(path+root_len+1,'/');; p = strchr(p+1,'/')) {
+		if(p) *p = 0;
+		if((mkdir(path,0755))&&(errno != EEXIST)) {
+			free(path);
+			return -1;
+		}
+		if(!p) break;
+		*p = '/';
+	}
+	int res = 0;
+	if(limits) {
+		char value[32];
+		if(limits->cpu_weight > 0) {
+			snprintf(value,sizeof(value),"%d",limits->cpu_weight);
+			if((enable_controller(path,root_len,"cpu"))||(write_file(path,"cpu.weight",value))) res = 1;
+		}
+		if(limits->io_weight > 0) {
+			snprintf(value,sizeof(value),"default %d",limits->io_weight);
+			if((enable_controller(path,root_len,"io"))||(write_file(path,"io.weight",value))) res = 1;
+		}
+		if(limits->memory_high) {
+			if(limits->memory_high < 0) strcpy(value,"max");
+			else snprintf(value,sizeof(value),"%lld",limits->memory_high);
+			if((enable_controller(path,root_len,"memory"))||(write_file(path,"memory.high",value))) res = 1;
+		}
+	}
+	free(path);
+	return res;
+}
+
+int cgroup_open(const char *name) {
+	char *path = cgroup_path(name);
+	if(!path) return -1;
+	char *procs = (char*)malloc(strlen(path)+sizeof("/cgroup.procs"));
+	int fd = -1;
+	if(procs) {
+		sprintf(procs,"%s/cgroup.procs",path);
+		fd = open(procs,O_WRONLY|O_CLOEXEC);
+		free(procs);
+	}
+	free(path);
+	return fd;
+}
+
+int cgroup_enter(const char *name, pid_t pid) {
+	char value[16];
+	int fd = cgroup_open(name);
+	if(fd < 0) return -1;
+	snprintf(value,sizeof(value),"%d",(int)pid);
+	ssize_t n = write(fd,value,strlen(value));
+	int err = errno;
+	close(fd);
+	if(n < 0) {
+		errno = err;
+		return -1;
+	}
+	return 0;
+}
+
+int cgroup_freeze(const char *name, int frozen) {
+	char *path = cgroup_path(name);
+	if(!path) return -1;
+	int res = write_file(path,"cgroup.freeze",frozen?"1":"0");
+	int err = errno;
+	free(path);
+	errno = err;
+	return res;
+}
+
+/* before cgroup.kill (Linux 5.14): signal what each cgroup.procs lists, children first */
+static void kill_tree(const char *path) {
+	char sub[PATH_MAX];
+	DIR *dir = opendir(path);
+	struct dirent *de;
+	if(dir) {
+		while((de = readdir(dir))) {
+			if((de->d_type != DT_DIR)||(de->d_name[0] == '.')) continue;
+			snprintf(sub,sizeof(sub),"%s/%s",path,de->d_name);
+			kill_tree(sub);
+		}
+		closedir(dir);
+	}
+	snprintf(sub,sizeof(sub),"%s/cgroup.procs",path);
+	FILE *f = fopen(sub,"r");
+	int pid;
+	if(!f) return;
+	while(fscanf(f,"%d",&pid) == 1) kill(pid,SIGKILL);
+	fclose(f);
+}
+
+int cgroup_kill(const char *name) {
+	char *path = cgroup_path(name);
+	if(!path) return -1;
+	int res = write_file(path,"cgroup.kill","1");
+	if((res)&&(errno == ENOENT)) {
+		// frozen, nothing can fork while we go; SIGKILL still gets through
+		int frozen = write_file(path,"cgroup.freeze","1") == 0;
+		struct stat st;
+		res = stat(path,&st);
+		if(!res) kill_tree(path);
+		if(frozen) write_file(path,"cgroup.freeze","0");
+	}
+	int err = errno;
+	free(path);
+	errno = err;
+	return res;
+}
+
+int cgroup_parse_size(const char *s, long long *bytes) {
+	char *end;
+	if(strcmp(s,"max") == 0) {
+		*bytes = -1;
+		return 0;
+	}
+	long long n = strtoll(s,&end,10);
+	if((end == s)||(n <= 0)) return -1;
+	switch(*end) {
+		case 'g': case 'G': n *= 1024;
+			/* fall through */
+		case 'm': case 'M': n *= 1024;
+			/* fall through */
+		case 'k': case 'K': n *= 1024;
+			end++;
+			/* fall through */
+		case 0:
+			break;
+		default:
+			return -1;
+	}
+	if(*end) return -1;
+	*bytes = n;
+	return 0;
+}
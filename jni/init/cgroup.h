@@ -0,0 +1,50 @@
+#ifndef CGROUP_H
+#define CGROUP_H
+
+#include <sys/types.h>
+
+/*
+ * Named cgroup v2 groups for sessions and services, all below
+ * CGROUP_PARENT in the unified hierarchy.  A name may have several
+ * components ("pkg/apt"); each is letters, digits, '_', '-' or '.', but
+ * not "." or "..".
+ */
+
+#define CGROUP_PARENT	"botbrew"
+#define CGROUP_WEIGHT_MAX	10000
+
+/* limits to apply; 0 leaves a limit as it is */
+struct cgroup_limits {
+	int cpu_weight;		// 1..10000, default 100
+	int io_weight;		// 1..10000, default 100
+	long long memory_high;	// bytes, throttled and reclaimed above this; -1 for none
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The directory of group name, to free(); NULL with errno set if there is no cgroup2 mount or the name is bad. */
+char *cgroup_path(const char *name);
+/*
+ * Create group name if needed, with its controllers enabled as far as the
+ * kernel allows, then apply limits (may be NULL).  Returns -1 if the group
+ * cannot be created, 1 if a limit could not be applied, else 0.
+ */
+int cgroup_create(const char *name, const struct cgroup_limits *limits);
+/* cgroup.procs of group name, open for writing "0" from a child; -1 with errno set. */
+int cgroup_open(const char *name);
+/* Move pid (0 for the caller) into group name. */
+int cgroup_enter(const char *name, pid_t pid);
+/* Freeze or thaw every process in group name and its children. */
+int cgroup_freeze(const char *name, int frozen);
+/* SIGKILL every process in group name and its children. */
+int cgroup_kill(const char *name);
+/* Parse "<n>[KMG]" into *bytes; "max" is -1. */
+int cgroup_parse_size(const char *s, long long *bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,15 +2,21 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <alloca.h>
 #include <malloc.h>
 #include <unistd.h>
 #include <sched.h>
 #include <errno.h>
-#include <mntent.h>
 #include <dirent.h>
 #include <fcntl.h>
-#include <stdarg.h>
+#include <time.h>
+#include <stdint.h>
+#include <grp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <sys/mount.h>
@@ -22,19 +28,77 @@
 #include <linux/loop.h>
 
 #include "strnstr.h"
+#include "broker.h"
+#include "mountinfo.h"
+#include "supervise.h"
+#include "cgroup.h"
+#include "mountstamp.h"
+#include "mountspec.h"
 
 #define ENV_PATH	"/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin:/sbin:/bin:/usr/local/games:/usr/games:/botbrew/bin:/usr/lib/busybox"
 #define LOOP_MAX	4096
+#define NS_PIN	"/run/.mntns"
+#define TRACE_MAX	16
 
-struct mountspec {
-	const char *src;
-	const char *dst;
-	const char *type;
-	unsigned long flags;
-	const void *data;
-	unsigned long remount_flags;
+#ifndef CLONE_NEWNS
+#define CLONE_NEWNS	0x00020000
+#endif
+#ifndef MS_PRIVATE
+#define MS_PRIVATE	(1<<18)
+#endif
+#ifndef MS_SLAVE
+#define MS_SLAVE	(1<<19)
+#endif
+#ifndef O_CLOEXEC
+#define O_CLOEXEC	02000000
+#endif
+#ifndef LO_FLAGS_AUTOCLEAR
+#define LO_FLAGS_AUTOCLEAR	4
+#endif
+#ifndef LO_FLAGS_DIRECT_IO
+#define LO_FLAGS_DIRECT_IO	16
+#endif
+#ifndef LOOP_SET_DIRECT_IO
+#define LOOP_SET_DIRECT_IO	0x4C08
+#endif
+#ifndef LOOP_SET_BLOCK_SIZE
+#define LOOP_SET_BLOCK_SIZE	0x4C09
+#endif
+#ifndef LOOP_CONFIGURE
+#define LOOP_CONFIGURE	0x4C0A
+#endif
+#ifndef LOOP_CTL_GET_FREE
+#define LOOP_CTL_GET_FREE	0x4C82
+#endif
+#define LOOP_CONTROL	"/dev/loop-control"
+
+/* struct loop_config, which our kernel headers predate */
+struct loopdev_config {
+	uint32_t fd;
+	uint32_t block_size;
+	struct loop_info64 info;
+	uint64_t reserved[8];
 };
+#ifndef __NR_unshare
+#if defined(__arm__)
+#define __NR_unshare	337
+#elif defined(__i386__)
+#define __NR_unshare	310
+#elif defined(__mips__)
+#define __NR_unshare	4303
+#endif
+#endif
+#ifndef __NR_setns
+#if defined(__arm__)
+#define __NR_setns	375
+#elif defined(__i386__)
+#define __NR_setns	346
+#elif defined(__mips__)
+#define __NR_setns	4344
+#endif
+#endif
 
+/* the mount table of a root without MOUNTSPEC_PATH */
 static struct mountspec foreign_mounts[] = {
 	{NULL,"/proc","proc",0,NULL,0},
 	{"/dev","/dev",NULL,MS_BIND|MS_REC,NULL,0},
@@ -60,20 +124,8 @@ static struct mountspec local_mounts[] = {
 	{NULL,NULL,NULL,0,NULL,0}
 };
 
-typedef struct mntent_node {
-	char *buf;
-	struct mntent *mnt;
-	struct mntent_node *next;
-} mntent_node;
-
-typedef struct mntent_dnode {
-	char *buf;
-	struct mntent *mnt;
-	struct mntent_dnode *prev;
-	struct mntent_dnode *next;
-} mntent_dnode;
-
-struct mntent *getmntent_r(FILE *f, struct mntent *mnt, char *linebuf, int buflen);
+/* symlinks from the root into its /mnt, for paths Android apps hardcode */
+static const char *const mnt_links[] = {"/emmc","/sdcard","/sdcard2","/usbdisk",NULL};
 
 static void usage(char *progname) {
 	fprintf(stderr,
@@ -82,7 +134,21 @@ static void usage(char *progname) {
 		"Available options:\n"
 		"\t-t <target>\t| --target=<target>\tSpecify chroot directory or image\n"
 		"\t-r\t\t| --remount\t\tRemount chroot directory\n"
-		"\t-u\t\t| --unmount\t\tUnmount chroot directory and exit\n",
+		"\t-u\t\t| --unmount\t\tUnmount chroot directory and exit\n"
+		"\t-b[<uid>]\t| --broker[=<uid>]\tServe commands on <target>"BROKER_SOCKET"; <uid> may run them as root\n"
+		"\t-S\t\t| --supervise\t\tSupervise the services in "SUPERVISE_DIR" until SIGTERM or stdin hangs up\n"
+		"\t-w\t\t| --watch\t\tBind storage mounted under /mnt later into <target>/mnt until SIGTERM or stdin hangs up\n"
+		"\t-n\t\t| --namespace\t\tMount into a private namespace pinned at <target>"NS_PIN"\n"
+		"\t-B <size>\t| --block-size=<size>\tLogical block size of the loop device for an image\n"
+		"\t-C\t\t| --cached\t\tBack the loop device with buffered instead of direct I/O\n"
+		"\t-T[<fd>]\t| --trace[=<fd>]\tWrite phase timings as JSON to <fd> (default 2) before running the command\n"
+		"\t-g <name>\t| --cgroup=<name>\tRun in cgroup v2 group "CGROUP_PARENT"/<name>, created if needed by uid=0\n"
+		"\t-W <weight>\t| --cpu-weight=<weight>\tCPU weight of the group, 1-10000 (default 100)\n"
+		"\t-I <weight>\t| --io-weight=<weight>\tI/O weight of the group, 1-10000 (default 100)\n"
+		"\t-M <size>\t| --memory-high=<size>\tThrottle the group above <size>[KMG] of memory, or max\n"
+		"\t-F\t\t| --freeze\t\tFreeze the group and exit\n"
+		"\t-Z\t\t| --thaw\t\tThaw the group and exit\n"
+		"\t-K\t\t| --kill\t\tKill every process in the group and exit\n",
 	progname);
 	exit(EXIT_FAILURE);
 }
@@ -102,9 +168,45 @@ static void privdrop(void) {
 #endif
 }
 
-static pid_t child_pid = 0;
-static void sighandler(int signo) {
-	if(child_pid != 0) kill(child_pid,signo);
+static unsigned int loop_block_size = 0;	// 0 leaves it to the kernel
+static int loop_direct_io = 1;
+
+/* --trace: phase durations, written as one line of JSON before exec */
+static int trace_fd = -1;
+static int trace_count = 0;
+static struct {
+	const char *name;
+	long long us;
+} trace_phases[TRACE_MAX];
+static long long trace_start, trace_last;
+
+static long long trace_now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (long long)ts.tv_sec*1000000+ts.tv_nsec/1000;
+}
+
+/* the phase that just ended */
+static void trace_mark(const char *name) {
+	if(trace_fd < 0) return;
+	long long now = trace_now();
+	if(trace_count < TRACE_MAX) {
+		trace_phases[trace_count].name = name;
+		trace_phases[trace_count++].us = now-trace_last;
+	}
+	trace_last = now;
+}
+
+static void trace_emit(int mounted) {
+	char buf[128+TRACE_MAX*48];
+	int i, len;
+	if(trace_fd < 0) return;
+	len = snprintf(buf,sizeof(buf),"{\"pid\":%d,\"mounted\":%s,\"phases\":[",getpid(),mounted?"true":"false");
+	for(i = 0; i < trace_count; i++) {
+		len += snprintf(buf+len,sizeof(buf)-len,"%s{\"name\":\"%s\",\"us\":%lld}",i?",":"",trace_phases[i].name,trace_phases[i].us);
+	}
+	len += snprintf(buf+len,sizeof(buf)-len,"],\"total_us\":%lld}\n",trace_now()-trace_start);
+	write(trace_fd,buf,len);
 }
 
 static char *strconcat(const char *a, const char *b) {
@@ -133,48 +235,88 @@ static void mkdir_p(const char *dir, mode_t mode) {
 	free(tmp);
 }
 
-static char *loopdev_get(const char *filepath) {
-	char *devpath = (char*)malloc(PATH_MAX);
+/* create (if needed) and open the node for loop device i */
+static int loopdev_open(int i, char *devpath) {
+	unsigned int dev = (0xff&i)|((i<<12)&0xfff00000)|(7<<8);
+	sprintf(devpath,"%s%d",(access("/dev/block",F_OK) == 0)?"/dev/block/loop":"/dev/loop",i);
+	if((mknod(devpath,0660|S_IFBLK,dev) < 0)&&(errno != EEXIST)) return -1;
+	return open(devpath,O_RDWR);
+}
+
+/* open an unbound loop device */
+static int loopdev_find(char *devpath) {
 	struct loop_info64 loopinfo;
-	mode_t mode = 0660 | S_IFBLK;
-	int devfd = -1;
-	int success = 0;
-	int i;
+	int devfd, i;
+	int ctlfd = open(LOOP_CONTROL,O_RDWR);
+	if((ctlfd < 0)&&(errno == ENOENT)&&(mknod(LOOP_CONTROL,0600|S_IFCHR,(10<<8)|237) == 0)) {
+		if((ctlfd = open(LOOP_CONTROL,O_RDWR)) < 0) unlink(LOOP_CONTROL);
+	}
+	if(ctlfd >= 0) {
+		// one ioctl, which also allocates a new device if all are taken
+		i = ioctl(ctlfd,LOOP_CTL_GET_FREE);
+		close(ctlfd);
+		if((i >= 0)&&((devfd = loopdev_open(i,devpath)) >= 0)) return devfd;
+	}
+	// no loop-control before Linux 3.1: probe
 	for(i = 0; i < LOOP_MAX; i++) {
-		unsigned int dev = (0xff&i)|((i<<12)&0xfff00000)|(7<<8);
-		sprintf(devpath,"/dev/block/loop%d",i);
-		if((mknod(devpath,mode,dev) < 0)&&(errno != EEXIST)) break;
-		if((devfd = open(devpath,O_RDWR)) < 0) break;
-		if(ioctl(devfd,LOOP_GET_STATUS64,&loopinfo) < 0) {
-			if(errno == ENXIO) success = 1;
-			break;
-		}
+		if((devfd = loopdev_open(i,devpath)) < 0) return -1;
+		if((ioctl(devfd,LOOP_GET_STATUS64,&loopinfo) < 0)&&(errno == ENXIO)) return devfd;
 		close(devfd);
 	}
-	devpath = (char*)realloc(devpath,strlen(devpath)+1);
-	int filefd = -1;
-	if((filefd = open(filepath,O_RDWR)) < 0) {
-		close(devfd);
-		free(devpath);
-		return NULL;
+	return -1;
+}
+
+/* bind filefd to devfd; returns -1 with errno EBUSY if someone beat us to it */
+static int loopdev_attach(int devfd, int filefd, const char *filepath) {
+	struct loopdev_config config;
+	memset(&config,0,sizeof(config));
+	config.fd = filefd;
+	config.block_size = loop_block_size;
+	config.info.lo_flags = LO_FLAGS_AUTOCLEAR|(loop_direct_io?LO_FLAGS_DIRECT_IO:0);
+	strncpy((char*)config.info.lo_file_name,filepath,LO_NAME_SIZE-1);
+	if(ioctl(devfd,LOOP_CONFIGURE,&config) == 0) return 0;
+	if(errno == EBUSY) return -1;
+	if(config.info.lo_flags&LO_FLAGS_DIRECT_IO) {
+		// the backing filesystem may not support O_DIRECT
+		config.info.lo_flags &= ~LO_FLAGS_DIRECT_IO;
+		if(ioctl(devfd,LOOP_CONFIGURE,&config) == 0) return 0;
+		if(errno == EBUSY) return -1;
 	}
-	if(ioctl(devfd,LOOP_SET_FD,filefd) < 0) {
-		close(filefd);
-		close(devfd);
-		free(devpath);
-		return NULL;
+	// no LOOP_CONFIGURE before Linux 5.8
+	if(ioctl(devfd,LOOP_SET_FD,filefd) < 0) return -1;
+	if(ioctl(devfd,LOOP_SET_STATUS64,&config.info) < 0) {
+		ioctl(devfd,LOOP_CLR_FD,0);
+		return -1;
 	}
-	memset(&loopinfo,0,sizeof(loopinfo));
-	strlcpy((char*)loopinfo.lo_file_name,filepath,LO_NAME_SIZE);
-	if(ioctl(devfd,LOOP_SET_STATUS64,&loopinfo) < 0) {
-		close(filefd);
+	if(loop_block_size) ioctl(devfd,LOOP_SET_BLOCK_SIZE,(unsigned long)loop_block_size);
+	if(loop_direct_io) ioctl(devfd,LOOP_SET_DIRECT_IO,1UL);
+	return 0;
+}
+
+/*
+ * Bind filepath to a free loop device.  The device is set to autoclear,
+ * so *fd must stay open until it has been mounted.
+ */
+static char *loopdev_get(const char *filepath, int *fd) {
+	char *devpath = (char*)malloc(PATH_MAX);
+	int filefd = open(filepath,O_RDWR);
+	int devfd = -1;
+	int tries;
+	if(filefd >= 0) for(tries = 0; tries < 8; tries++) {
+		if((devfd = loopdev_find(devpath)) < 0) break;
+		if(loopdev_attach(devfd,filefd,filepath) == 0) break;
+		int err = errno;
 		close(devfd);
+		devfd = -1;
+		if(err != EBUSY) break;
+	}
+	if(filefd >= 0) close(filefd);
+	if(devfd < 0) {
 		free(devpath);
 		return NULL;
 	}
-	close(filefd);
-	close(devfd);
-	return devpath;
+	*fd = devfd;
+	return (char*)realloc(devpath,strlen(devpath)+1);
 }
 
 static int loopdev_del(const char *devpath) {
@@ -188,149 +330,139 @@ static int loopdev_del(const char *devpath) {
 	return 0;
 }
 
+/* detach once the last user is gone, or now if unused */
+static int loopdev_autoclear(const char *devpath) {
+	struct loop_info64 loopinfo;
+	int devfd = open(devpath,O_RDONLY);
+	if(devfd < 0) return -1;
+	int res = ioctl(devfd,LOOP_GET_STATUS64,&loopinfo);
+	if(res == 0) {
+		loopinfo.lo_flags |= LO_FLAGS_AUTOCLEAR;
+		res = ioctl(devfd,LOOP_SET_STATUS64,&loopinfo);
+	}
+	if(ioctl(devfd,LOOP_CLR_FD,0) == 0) res = 0;
+	close(devfd);
+	return res;
+}
+
 static int loopdev_mount(const char *source, const char *target, const char *filesystemtype, unsigned long mountflags, const void *data) {
-	const char *devpath = loopdev_get(source);
+	int devfd;
+	char *devpath = loopdev_get(source,&devfd);
 	if(!devpath) return -1;
 	int res = mount(devpath,target,filesystemtype,mountflags,data);
 	if(res) loopdev_del(devpath);
+	close(devfd);
+	free(devpath);
 	return res;
 }
 
-static int loopdev_umount2(const char *target, int flags) {
-	FILE *mntfp = fopen("/proc/self/mounts","r");
-	struct mntent *mntent;
-	while(mntent = getmntent(mntfp)) {
-		if(strcmp(mntent->mnt_dir,target) == 0) {
-			int res = umount2(target,flags);
-			loopdev_del(mntent->mnt_fsname);
-			fclose(mntfp);
-			return res;
+static void dynamic_remount(struct mountinfo *mi, const char *src, const char *tmp) {
+	struct stat st;
+	char *src_real = realpath(src,(char*)malloc(PATH_MAX));
+	if(!src_real) return;
+	size_t src_len = strlen(src_real);
+	size_t i, count;
+	struct mountinfo_entry **under = mountinfo_under(mi,src_real,&count);
+	if(!under) {
+		free(src_real);
+		return;
+	}
+	// set up staging area
+	mkdir(tmp,0755);
+	mount(NULL,tmp,"tmpfs",0,"size=1M");
+	mount(NULL,tmp,NULL,MS_PRIVATE,NULL);
+	// set up bind mounts in mount order, skipping src itself
+	for(i = 0; i < count; i++) {
+		struct mountinfo_entry *m = under[i];
+		if(m->dir_len == src_len) continue;
+		char *tmp_mnt = strconcat(tmp,m->dir+src_len);
+		mkdir_p(tmp_mnt,0755);
+		if(stat(m->dir,&st) == 0) chmod(tmp_mnt,st.st_mode);
+		mount(NULL,m->dir,NULL,MS_SHARED,NULL);
+		mount(m->dir,tmp_mnt,NULL,MS_BIND,NULL);
+		mount(NULL,m->dir,NULL,MS_SLAVE,NULL);
+		free(tmp_mnt);
+	}
+	// unmount in reverse order
+	for(i = count; i-- > 0;) if(under[i]->dir_len != src_len) umount2(under[i]->dir,MNT_DETACH);
+	free(under);
+	free(src_real);
+	// make sure subdirectories exist
+	DIR *dp = opendir(src);
+	if(dp) {
+		struct dirent *ep;
+		char *tmp_slash = strconcat(tmp,"/"), *tmp_path;
+		while((ep = readdir(dp))) if((ep->d_name[0] != '.')&&(stat(ep->d_name,&st) == 0)) {
+			tmp_path = strconcat(tmp_slash,ep->d_name);
+			mkdir(tmp_path,st.st_mode);
+			free(tmp_path);
 		}
+		closedir(dp);
+		free(tmp_slash);
 	}
-	fclose(mntfp);
-	return -1;
+	// commit staging area
+	umount2(src,MNT_DETACH);
+	mount(NULL,tmp,NULL,MS_SHARED|MS_REC,NULL);
+	mount(tmp,src,NULL,MS_BIND|MS_REC,NULL);
+	mount(NULL,tmp,NULL,MS_SLAVE|MS_REC,NULL);
+	umount2(tmp,MNT_DETACH);
+	rmdir(tmp);
 }
 
-static void dynamic_remount(const char *src, const char *tmp) {
-	FILE *fp = fopen("/proc/self/mounts","r");
-	if(fp) {
-		struct stat st;
-		char *buf = (char*)malloc(PATH_MAX);
-		char *src_real = realpath(src,buf);
-		char *src_slash = strconcat(src_real,"/");
-		size_t src_len = strlen(src_real);
-		size_t src_slash_len = src_len+1;
-		free(buf);
-		mntent_dnode *head = NULL, *node = (mntent_dnode*)malloc(sizeof(mntent_dnode));
-		mntent_dnode *tail = node;
-		buf = node->buf = (char*)malloc(3*PATH_MAX);
-		struct mntent *mnt = node->mnt = (struct mntent*)malloc(sizeof(struct mntent));
-		// set up staging area
-		mkdir(tmp,0755);
-		mount(NULL,tmp,"tmpfs",0,"size=1M");
-		mount(NULL,tmp,NULL,MS_PRIVATE,NULL);
-		// build linked list of interesting mounts
-		while(getmntent_r(fp,mnt,buf,3*PATH_MAX)) if(strncmp(mnt->mnt_dir,src_slash,src_slash_len) == 0) {
-			node->mnt = mnt;
-			node->buf = buf;
-			node->next = head;
-			if(head) head->prev = node;
-			head = node;
-			node = (mntent_dnode*)malloc(sizeof(mntent_dnode));
-			buf = node->buf = (char*)malloc(3*PATH_MAX);
-			mnt = node->mnt = (struct mntent*)malloc(sizeof(struct mntent));
-		}
-		fclose(fp);
-		free(node->mnt);
-		free(node->buf);
-		free(node);
-		free(src_slash);
-		head->prev = 0;
-		if(tail == node) tail = 0;
-		// iterate while setting up bind mounts
-		while(node = tail) {
-			mnt = node->mnt;
-			char *tmp_mnt = strconcat(tmp,mnt->mnt_dir+src_len);
-			mkdir_p(tmp_mnt,0755);
-			if(stat(mnt->mnt_dir,&st) == 0) chmod(tmp_mnt,st.st_mode);
-			mount(NULL,mnt->mnt_dir,NULL,MS_SHARED,NULL);
-			mount(mnt->mnt_dir,tmp_mnt,NULL,MS_BIND,NULL);
-			mount(NULL,mnt->mnt_dir,NULL,MS_SLAVE,NULL);
-			free(tmp_mnt);
-			tail = node->prev;
-		}
-		// iterate while unmounting and cleaning up
-		while(node = head) {
-			mnt = node->mnt;
-			umount2(mnt->mnt_dir,MNT_DETACH);
-			head = node->next;
-			free(node->mnt);
-			free(node->buf);
-			free(node);
-		}
-		// make sure subdirectories exist
-		DIR *dp = opendir(src);
-		if(dp) {
-			struct dirent *ep;
-			char *tmp_slash = strconcat(tmp,"/"), *tmp_path;
-			while(ep = readdir(dp)) if((ep->d_name[0] != '.')&&(stat(ep->d_name,&st) == 0)) {
-				tmp_path = strconcat(tmp_slash,ep->d_name);
-				mkdir(tmp_path,st.st_mode);
-				free(tmp_path);
-			}
-			closedir(dp);
-			free(tmp_slash);
-		}
-		// commit staging area
-		umount2(src,MNT_DETACH);
-		mount(NULL,tmp,NULL,MS_SHARED|MS_REC,NULL);
-		mount(tmp,src,NULL,MS_BIND|MS_REC,NULL);
-		mount(NULL,tmp,NULL,MS_SLAVE|MS_REC,NULL);
-		umount2(tmp,MNT_DETACH);
-		rmdir(tmp);
+static void fix_mnt_symlink(const char *src, const char *dst, const char *name) {
+	char *dst_name = strconcat(dst,name);
+	unlink(dst_name);
+	char *src_name = strconcat(src,name);
+	symlink(src_name,dst_name);
+	free(src_name);
+	free(dst_name);
+}
+
+/* a mount of something outside target; target is left unbindable, for the caller to share again */
+static void mount_foreign(const char *target, const struct mountspec *m) {
+	struct stat st;
+	if(m->src) {
+		if(stat(m->src,&st) != 0) return;
+		if(m->flags&MS_BIND) mount(NULL,m->src,NULL,MS_SHARED|MS_REC,NULL);
+	}
+	char *dst = strconcat(target,m->dst);
+	mkdir(dst,0755);
+	mount(NULL,target,NULL,MS_UNBINDABLE,NULL);
+	if(mount(m->src,dst,m->type,m->flags,m->data)) rmdir(dst);
+	else {
+		if(m->remount_flags) mount(dst,dst,NULL,m->remount_flags|MS_REMOUNT,NULL);
+		mount(NULL,dst,NULL,MS_UNBINDABLE,NULL);
 	}
+	free(dst);
 }
 
-static void fix_mnt_symlink(const char *src, const char *dst, ...) {
-	va_list args;
-	va_start(args,dst);
-	char *name, *dst_name, *src_name;
-	while(name = va_arg(args,char*)) {
-		dst_name = strconcat(dst,name);
-		unlink(dst_name);
-		src_name = strconcat(src,name);
-		symlink(src_name,dst_name);
-		free(src_name);
-		free(dst_name);
+/* a mount of something inside target */
+static void mount_local(const char *target, const struct mountspec *m) {
+	struct stat st;
+	char *src = NULL;
+	if(m->src) {
+		src = strconcat(target,m->src);
+		if(stat(src,&st) != 0) {
+			free(src);
+			return;
+		}
 	}
-	va_end(args);
+	char *dst = strconcat(target,m->dst);
+	mkdir(dst,0755);
+	if((src)&&(m->flags&MS_BIND)) mount(NULL,src,NULL,MS_SHARED|MS_REC,NULL);
+	if(mount(src,dst,m->type,m->flags,m->data)) rmdir(dst);
+	else if(m->remount_flags) mount(dst,dst,NULL,m->remount_flags|MS_REMOUNT,NULL);
+	free(dst);
+	free(src);
 }
 
-static void mount_setup(char *target, int loopdev) {
+static void mount_setup(char *target, int loopdev, const struct mountspec *foreign, const struct mountspec *local) {
 	// prepare self-mount
 	if(!loopdev) mount(target,target,NULL,MS_BIND,NULL);
 	mount(target,target,NULL,MS_REMOUNT|MS_NODEV|MS_NOATIME,NULL);
-	int i = 0;
-	struct stat st;
 	char *dst;
 	// prepare foreign mounts
-	while(1) {
-		struct mountspec m = foreign_mounts[i++];
-		if(m.dst == NULL) break;
-		if(m.src) {
-			if(stat(m.src,&st) != 0) continue;
-			if(m.flags&MS_BIND) mount(NULL,m.src,NULL,MS_SHARED|MS_REC,NULL);
-		}
-		dst = strconcat(target,m.dst);
-		mkdir(dst,0755);
-		mount(NULL,target,NULL,MS_UNBINDABLE,NULL);
-		if(mount(m.src,dst,m.type,m.flags,m.data)) rmdir(dst);
-		else {
-			if(m.remount_flags) mount(dst,dst,NULL,m.remount_flags|MS_REMOUNT,NULL);
-			mount(NULL,dst,NULL,MS_UNBINDABLE,NULL);
-		}
-		free(dst);
-	}
+	for(; foreign->dst; foreign++) mount_foreign(target,foreign);
 	// share self mount
 	mount(NULL,target,NULL,MS_SHARED|MS_REC,NULL);
 	// make temporary directories
@@ -340,76 +472,362 @@ static void mount_setup(char *target, int loopdev) {
 	dst = strconcat(target,"/run/lock");
 	mkdir(dst,01777);
 	free(dst);
-	i = 0;
-	char *src;
 	// prepare local mounts
-	while(1) {
-		struct mountspec m = local_mounts[i++];
-		if(m.dst == NULL) break;
-		if(m.src) {
-			src = strconcat(target,m.src);
-			if(stat(src,&st) != 0) {
-				free(src);
+	for(; local->dst; local++) mount_local(target,local);
+}
+
+/* nonzero if path is one of the n paths in dirs or below one */
+static int is_below_any(const char *path, char **dirs, size_t n) {
+	while(n-- > 0) {
+		size_t len = strlen(dirs[n]);
+		if((strncmp(path,dirs[n],len) == 0)&&((path[len] == '/')||(!path[len]))) return 1;
+	}
+	return 0;
+}
+
+/*
+ * Bring the mounts of a root that is set up from the tables it was set up
+ * with (had) to the wanted ones, touching only entries that differ: a
+ * changed flag is one remount, a new entry one mount; only entries whose
+ * source or type changed are unmounted, and with them whatever was
+ * mounted below them.  Index 0 is the foreign table, 1 the local one.
+ * Returns the number of entries changed.
+ */
+static int mount_reconcile(struct mountinfo *mi, char *target, const struct mountspec *want[2], const struct mountspec *had[2]) {
+	const struct mountspec *m, *h;
+	size_t count = 0, dropped = 0;
+	int k, changes = 0;
+	for(k = 0; k < 2; k++) for(m = had[k]; m->dst; m++) count++;
+	char **gone = (char**)calloc(count+1,sizeof(char*));
+	if(!gone) return -1;
+	// unmount what is no longer wanted or cannot be remounted into shape, latest first
+	for(k = 1; k >= 0; k--) {
+		for(count = 0; had[k][count].dst; count++);
+		while(count-- > 0) {
+			h = &had[k][count];
+			m = mountspec_find(want[k],h->dst);
+			if((m)&&(mountspec_remountable(h,m))) continue;
+			char *dst = strconcat(target,h->dst);
+			if(mountinfo_by_dir(mi,dst)) {
+				mount(NULL,dst,NULL,MS_SLAVE|MS_REC,NULL);
+				umount2(dst,MNT_DETACH);
+				changes++;
+			}
+			gone[dropped++] = dst;
+		}
+	}
+	// then mount or remount what differs, in table order
+	for(k = 0; k < 2; k++) {
+		for(m = want[k]; m->dst; m++) {
+			char *dst = strconcat(target,m->dst);
+			char *src = ((k == 1)&&(m->src))?strconcat(target,m->src):NULL;
+			h = mountspec_find(had[k],m->dst);
+			// mi predates the unmounts above; a bind of something they took away is stale too
+			int present = (mountinfo_by_dir(mi,dst) != NULL)&&(!is_below_any(dst,gone,dropped))&&((!src)||(!is_below_any(src,gone,dropped)));
+			free(src);
+			if((h)&&(present)&&(mountspec_remountable(h,m))) {
+				if(!mountspec_equal(h,m)) {
+					// per-mount flags only, unless a filesystem's data changed
+					if((m->flags&MS_BIND)) mount(NULL,dst,NULL,MS_BIND|MS_REMOUNT|(m->remount_flags&~MS_REMOUNT),NULL);
+					else if((m->data == h->data)||((m->data)&&(h->data)&&(strcmp((const char*)m->data,(const char*)h->data) == 0))) mount(NULL,dst,NULL,MS_BIND|MS_REMOUNT|m->flags,NULL);
+					else mount(NULL,dst,NULL,MS_REMOUNT|m->flags,m->data);
+					changes++;
+				}
+				free(dst);
 				continue;
 			}
-		} else src = NULL;
-		dst = strconcat(target,m.dst);
-		mkdir(dst,0755);
-		if((src)&&(m.flags&MS_BIND)) mount(NULL,src,NULL,MS_SHARED|MS_REC,NULL);
-		if(mount(src,dst,m.type,m.flags,m.data)) rmdir(dst);
-		else if(m.remount_flags) mount(dst,dst,NULL,m.remount_flags|MS_REMOUNT,NULL);
-		free(dst);
-		free(src);
-	}
-}
-
-static void mount_teardown(char *target, int loopdev) {
-	FILE *fp = fopen("/proc/self/mounts","r");
-	if(fp) {
-		char *target_slash = strconcat(target,"/");
-		size_t target_slash_len = strlen(target_slash);
-		mntent_node *head = NULL, *node = (mntent_node*)malloc(sizeof(mntent_node));
-		char *buf = node->buf = (char*)malloc(3*PATH_MAX);
-		struct mntent *mnt = node->mnt = (struct mntent*)malloc(sizeof(struct mntent));
-		// iterate, building a reversed linked list of interesting mounts
-		while(mnt = getmntent_r(fp,mnt,buf,3*PATH_MAX)) {
-			if(strncmp(mnt->mnt_dir,target_slash,target_slash_len) == 0) {
-			} else if(strcmp(mnt->mnt_dir,target) == 0) {
-			} else continue;
-			mount(NULL,mnt->mnt_dir,NULL,MS_SLAVE,NULL);
-			node->mnt = mnt;
-			node->buf = buf;
-			node->next = head;
-			head = node;
-			node = (mntent_node*)malloc(sizeof(mntent_node));
-			buf = node->buf = (char*)malloc(3*PATH_MAX);
-			mnt = node->mnt = (struct mntent*)malloc(sizeof(struct mntent));
+			// something we did not put there, or left over from a mount we took away
+			if(present) {
+				mount(NULL,dst,NULL,MS_SLAVE|MS_REC,NULL);
+				umount2(dst,MNT_DETACH);
+			}
+			if(k == 0) {
+				mount_foreign(target,m);
+				mount(NULL,target,NULL,MS_SHARED,NULL);
+				mount(NULL,dst,NULL,MS_SHARED|MS_REC,NULL);
+			} else mount_local(target,m);
+			changes++;
+			free(dst);
 		}
-		free(node->mnt);
-		free(node->buf);
-		free(node);
-		// iterate, unmounting and cleaning up
-		while(node = head) {
-			mnt = node->mnt;
-			mount(NULL,mnt->mnt_dir,NULL,MS_SLAVE|MS_REC,NULL);
-			if(
-				(strncmp(mnt->mnt_fsname,"/dev/block/loop",sizeof("/dev/block/loop")-1) == 0)||
-				(strncmp(mnt->mnt_fsname,"/dev/loop",sizeof("/dev/loop")-1) == 0)
-			) loopdev_umount2(mnt->mnt_dir,MNT_DETACH);
-			else umount2(mnt->mnt_dir,MNT_DETACH);
-			head = node->next;
-			free(node->mnt);
-			free(node->buf);
-			free(node);
+	}
+	while(dropped-- > 0) free(gone[dropped]);
+	free(gone);
+	return changes;
+}
+
+/* the root's own mount table if it has a good one, else the built-in one */
+static void mount_table(const char *target, struct mounttable *t, const struct mountspec **foreign, const struct mountspec **local) {
+	char *path = strconcat(target,MOUNTSPEC_PATH);
+	int line;
+	*foreign = foreign_mounts;
+	*local = local_mounts;
+	if(mounttable_read(path,t,&line) == 0) {
+		*foreign = t->foreign;
+		*local = t->local;
+	} else if(errno == EINVAL) fprintf(stderr,"whoops: `%s' line %d is not <foreign|local> <source|none> <target> <type|bind|rbind> [<options>]; using the built-in mounts\n",path,line);
+	free(path);
+}
+
+/* nonzero if m is mounted on dir (len long) or below it */
+static int mounted_under(const struct mountinfo_entry *m, const char *dir, size_t len) {
+	return (strncmp(m->dir,dir,len) == 0)&&((m->dir[len] == '/')||(!m->dir[len]));
+}
+
+/*
+ * Detach target and everything below it: a lazy unmount takes a whole
+ * subtree, so it is one call per mount stacked on target (one, as we set
+ * it up), each after making the subtree a slave so the unmount does not
+ * propagate back into what it bound.  Loop devices below are set to
+ * autoclear, once each, and let go when their last user does.
+ */
+static void mount_teardown(struct mountinfo *mi, char *target) {
+	size_t len = strlen(target), stacked = 1, i, j;
+	if(mi) {
+		stacked = 0;
+		for(i = 0; i < mi->count; i++) {
+			const struct mountinfo_entry *m = &mi->entries[i];
+			if(!mounted_under(m,target,len)) continue;
+			if(m->dir_len == len) stacked++;
+			if(!mountinfo_is_loop(m)) continue;
+			// a device bound in more than one place
+			for(j = 0; j < i; j++) {
+				const struct mountinfo_entry *n = &mi->entries[j];
+				if((n->major == m->major)&&(n->minor == m->minor)&&(mounted_under(n,target,len))&&(mountinfo_is_loop(n))) break;
+			}
+			if(j == i) loopdev_autoclear(m->source);
 		}
-		free(target_slash);
-		fclose(fp);
-	} else {
-		// fallback (deprecated)
+	}
+	while(stacked-- > 0) {
 		mount(NULL,target,NULL,MS_SLAVE|MS_REC,NULL);
-		if(loopdev) loopdev_umount2(target,MNT_DETACH);
-		else umount2(target,MNT_DETACH);
+		if(umount2(target,MNT_DETACH)) break;
+	}
+}
+
+/* the same directory of the same filesystem */
+static int same_mount(const struct mountinfo_entry *a, const struct mountinfo_entry *b) {
+	return (a->major == b->major)&&(a->minor == b->minor)&&(strcmp(a->root,b->root) == 0);
+}
+
+/* note in *links which of mnt_links the path below src's mirror is under */
+static void mnt_links_touched(const char *rel, unsigned int *links) {
+	int i;
+	for(i = 0; mnt_links[i]; i++) {
+		size_t len = strlen(mnt_links[i]);
+		if((strncmp(rel,mnt_links[i],len) == 0)&&((rel[len] == '/')||(!rel[len]))) *links |= 1U<<i;
+	}
+}
+
+/*
+ * Bring the mounts below target's copy of src in line with those below
+ * src.  The copy is a bind of src made at setup; the root is shared
+ * apart from the outside, so nothing mounted on src since has followed.
+ * Only what differs is touched: gone or replaced mounts are detached,
+ * new ones bound one by one in mount order, and the symlinks into them
+ * made again.  Returns the number of changes.
+ */
+static int mnt_mirror(struct mountinfo *mi, const char *src, char *target) {
+	size_t src_len = strlen(src), count, mirror_count, dropped = 0, i;
+	char *mirror = strconcat(target,src);
+	size_t mirror_len = strlen(mirror);
+	struct mountinfo_entry **under = mountinfo_under(mi,src,&count);
+	struct mountinfo_entry **mirrored = mountinfo_under(mi,mirror,&mirror_count);
+	char **gone = mirrored?(char**)calloc(mirror_count+1,sizeof(char*)):NULL;
+	unsigned int links = 0;
+	int changes = 0;
+	if((!under)||(!gone)) {
+		free(gone);
+		free(mirrored);
+		free(under);
+		free(mirror);
+		return -1;
+	}
+	// detach what went away or was replaced, latest first
+	for(i = mirror_count; i-- > 0;) {
+		struct mountinfo_entry *m = mirrored[i];
+		if((m->dir_len == mirror_len)||(mountinfo_by_dir(mi,m->dir) != m)) continue;	// the copy itself, or covered
+		char *path = strconcat(src,m->dir+mirror_len);
+		struct mountinfo_entry *s = mountinfo_by_dir(mi,path);
+		free(path);
+		if((s)&&(same_mount(s,m))) continue;
+		mount(NULL,m->dir,NULL,MS_SLAVE|MS_REC,NULL);
+		umount2(m->dir,MNT_DETACH);
+		mnt_links_touched(m->dir+mirror_len,&links);
+		gone[dropped++] = (char*)m->dir;
+		changes++;
+	}
+	// bind what is new, in mount order; a detach above took whatever was below it too
+	for(i = 0; i < count; i++) {
+		struct mountinfo_entry *s = under[i];
+		if((s->dir_len == src_len)||(mountinfo_by_dir(mi,s->dir) != s)||(is_below_any(s->dir,&target,1))) continue;
+		char *path = strconcat(mirror,s->dir+src_len);
+		struct mountinfo_entry *m = mountinfo_by_dir(mi,path);
+		if((!m)||(!same_mount(s,m))||(is_below_any(path,gone,dropped))) {
+			mkdir_p(path,0755);
+			if(mount(s->dir,path,NULL,MS_BIND,NULL) == 0) {
+				mnt_links_touched(s->dir+src_len,&links);
+				changes++;
+			}
+		}
+		free(path);
+	}
+	for(i = 0; mnt_links[i]; i++) if(links&(1U<<i)) fix_mnt_symlink(src,target,mnt_links[i]);
+	free(gone);
+	free(mirrored);
+	free(under);
+	free(mirror);
+	return changes;
+}
+
+static volatile sig_atomic_t watch_stopping = 0;
+
+static void watch_sighandler(int signo) {
+	(void)signo;
+	watch_stopping = 1;
+}
+
+/*
+ * --watch: keep target's copy of src in line with it until SIGTERM or
+ * stdin hangs up.  mountinfo polls POLLPRI whenever a mount in this
+ * namespace changes, so between changes this sleeps.
+ */
+static int mnt_watch(const char *src, char *target) {
+	struct sigaction sa;
+	struct pollfd pfds[2];
+	char *src_real = realpath(src,(char*)malloc(PATH_MAX));
+	if(!src_real) return -1;
+	int fd = open("/proc/self/mountinfo",O_RDONLY);
+	if(fd < 0) {
+		free(src_real);
+		return -1;
+	}
+	memset(&sa,0,sizeof(sa));
+	sa.sa_handler = watch_sighandler;	// without SA_RESTART, so poll() returns
+	sigaction(SIGTERM,&sa,NULL);
+	sigaction(SIGINT,&sa,NULL);
+	sigaction(SIGHUP,&sa,NULL);
+	int watch_stdin = fcntl(0,F_GETFD) != -1;
+	int pending = 1;
+	while(!watch_stopping) {
+		if(pending) {
+			struct mountinfo *mi = mountinfo_read(NULL);
+			if(mi) {
+				mnt_mirror(mi,src_real,target);
+				mountinfo_free(mi);
+			}
+			pending = 0;
+		}
+		pfds[0].fd = fd;
+		pfds[0].events = POLLPRI;
+		pfds[1].fd = 0;
+		pfds[1].events = 0;	// only hangups
+		if(poll(pfds,watch_stdin?2:1,-1) < 0) {
+			if(errno == EINTR) continue;
+			break;
+		}
+		if(pfds[0].revents&(POLLPRI|POLLERR)) pending = 1;
+		if((watch_stdin)&&(pfds[1].revents)) {
+			if(pfds[1].revents&POLLNVAL) watch_stdin = 0;
+			else watch_stopping = 1;
+		}
 	}
+	close(fd);
+	free(src_real);
+	return 0;
+}
+
+/* setup and teardown of a root take turns on its directory, or its image */
+static int root_lock(const char *path) {
+	int fd = open(path,O_RDONLY|O_CLOEXEC);
+	if(fd < 0) return -1;
+	while(flock(fd,LOCK_EX)) {
+		if(errno != EINTR) {
+			close(fd);
+			return -1;
+		}
+	}
+	return fd;
+}
+
+static int ns_enter(int fd) {
+	return syscall(__NR_setns,fd,CLONE_NEWNS);
+}
+
+/* join the namespace pinned at pin; setns() also resets root and cwd */
+static int ns_join(const char *pin) {
+	int fd = open(pin,O_RDONLY);
+	if(fd < 0) return -1;
+	int res = ns_enter(fd);
+	close(fd);
+	return res;
+}
+
+static int ns_create(void) {
+	if(syscall(__NR_unshare,CLONE_NEWNS)) return -1;
+	// keep receiving sdcard mounts from outside, but never leak ours back
+	mount(NULL,"/",NULL,MS_SLAVE|MS_REC,NULL);
+	return 0;
+}
+
+/*
+ * Keep the current namespace alive after we exit by binding it onto pin
+ * in the outer namespace; returns to the current namespace afterwards.
+ */
+static int ns_pin(int outer, const char *pin) {
+	char src[32];
+	int res = -1;
+	int inner = open("/proc/self/ns/mnt",O_RDONLY);
+	if(inner < 0) return -1;
+	if(ns_enter(outer) == 0) {
+		char *dir = strdup(pin);
+		mkdir_p(dirname(dir),0755);
+		free(dir);
+		close(open(pin,O_RDONLY|O_CREAT,0600));
+		// a private mount underneath, so the pin cannot propagate into the namespace it pins
+		mount(pin,pin,NULL,MS_BIND,NULL);
+		mount(NULL,pin,NULL,MS_PRIVATE,NULL);
+		sprintf(src,"/proc/self/fd/%d",inner);
+		res = mount(src,pin,NULL,MS_BIND,NULL);
+		if(res) {
+			umount2(pin,MNT_DETACH);
+			unlink(pin);
+		}
+		ns_enter(inner);
+	}
+	close(inner);
+	return res;
+}
+
+/*
+ * Drop the namespace pinned at pin.  Its mounts go away with the last
+ * process still inside; loop devices are set to detach when they do.
+ * Returns -1 if nothing was pinned.
+ */
+static int ns_teardown(int outer, const char *target, const char *pin) {
+	if(ns_join(pin)) return -1;
+	char *page_path = strconcat(target,SUPERVISE_PAGE);
+	supervise_shutdown(page_path);
+	free(page_path);
+	char *broker_path = strconcat(target,BROKER_SOCKET);
+	broker_shutdown(broker_path);
+	free(broker_path);
+	char *loopdev = NULL;
+	struct mountinfo *mi = mountinfo_read(NULL);
+	if(mi) {
+		struct mountinfo_entry *m = mountinfo_by_dir(mi,target);
+		if((m)&&(mountinfo_is_loop(m))) loopdev = strdup(m->source);
+		mountinfo_free(mi);
+	}
+	ns_enter(outer);
+	// ns_pin() left two mounts on pin: the namespace over a private bind
+	int unmounted = 0;
+	while(umount2(pin,MNT_DETACH) == 0) unmounted++;
+	if((unmounted == 0)||(errno != EINVAL)) fprintf(stderr,"whoops: cannot unmount `%s': %s\n",pin,strerror(errno));
+	else unlink(pin);
+	if(loopdev) {
+		loopdev_autoclear(loopdev);
+		free(loopdev);
+	}
+	return 0;
 }
 
 static int copy(char *src, char *dst) {
@@ -423,16 +841,16 @@ static int copy(char *src, char *dst) {
 		close(src_fd);
 		return dst_fd;
 	}
-	if((int)(src_ptr = mmap(0,st.st_size,PROT_READ,MAP_SHARED,src_fd,0)) < 0) {
+	if((src_ptr = mmap(0,st.st_size,PROT_READ,MAP_SHARED,src_fd,0)) == MAP_FAILED) {
 		close(dst_fd);
 		close(src_fd);
-		return (int)src_ptr;
+		return -1;
 	}
-	if((int)(dst_ptr = mmap(0,st.st_size,PROT_WRITE,MAP_SHARED,dst_fd,0)) < 0) {
+	if((dst_ptr = mmap(0,st.st_size,PROT_WRITE,MAP_SHARED,dst_fd,0)) == MAP_FAILED) {
 		munmap(src_ptr,st.st_size);
 		close(dst_fd);
 		close(src_fd);
-		return (int)dst_ptr;
+		return -1;
 	}
 	lseek(dst_fd,st.st_size-1,SEEK_SET);
 	write(dst_fd,"",1);
@@ -449,11 +867,22 @@ int main(int argc, char *argv[]) {
 	char apath[PATH_MAX];
 	int remount = 0;
 	int unmount = 0;
+	int broker = 0;
+	int supervise = 0;
+	int watch = 0;
+	int use_ns = 0;
+	uid_t broker_owner = 0;
+	const char *cgroup = NULL;
+	struct cgroup_limits cgroup_limits = {0,0,0};
+	int cgroup_action = 0;	// 'F', 'Z' or 'K'
 	char *loopmount = NULL;
 	char *self = argv[0];
 	uid_t uid = getuid();
-	// get absolute path
-	char *child_root = realpath(dirname(self),apath);
+	trace_start = trace_last = trace_now();
+	// get absolute path; dirname() may modify its argument
+	char *self_dir = strdup(self);
+	char *child_root = realpath(dirname(self_dir),apath);
+	free(self_dir);
 	int c;
 	while(1) {
 		static struct option long_options[] = {
@@ -461,10 +890,24 @@ int main(int argc, char *argv[]) {
 			{"target",required_argument,0,'t'},
 			{"remount",no_argument,0,'r'},
 			{"unmount",no_argument,0,'u'},
+			{"broker",optional_argument,0,'b'},
+			{"supervise",no_argument,0,'S'},
+			{"watch",no_argument,0,'w'},
+			{"namespace",no_argument,0,'n'},
+			{"block-size",required_argument,0,'B'},
+			{"cached",no_argument,0,'C'},
+			{"trace",optional_argument,0,'T'},
+			{"cgroup",required_argument,0,'g'},
+			{"cpu-weight",required_argument,0,'W'},
+			{"io-weight",required_argument,0,'I'},
+			{"memory-high",required_argument,0,'M'},
+			{"freeze",no_argument,0,'F'},
+			{"thaw",no_argument,0,'Z'},
+			{"kill",no_argument,0,'K'},
 			{0,0,0,0}
 		};
 		int option_index = 0;
-		c = getopt_long(argc,argv,"d:t:ru",long_options,&option_index);
+		c = getopt_long(argc,argv,"d:t:rub::SwnB:CT::g:W:I:M:FZK",long_options,&option_index);
 		if(c == -1) break;
 		switch(c) {
 			case 'd':
@@ -482,14 +925,85 @@ int main(int argc, char *argv[]) {
 				break;
 			case 'r':
 				remount = 1;
+				/* fall through */
 			case 'u':
 				unmount = 1;
 				break;
+			case 'b':
+				// the broker runs commands as root on request
+				if(uid) {
+					fprintf(stderr,"whoops: --broker is only available for uid=0\n");
+					return EXIT_FAILURE;
+				}
+				broker = 1;
+				if(optarg) broker_owner = atoi(optarg);
+				break;
+			case 'S':
+				// services run as root, as they did under runsvdir
+				if(uid) {
+					fprintf(stderr,"whoops: --supervise is only available for uid=0\n");
+					return EXIT_FAILURE;
+				}
+				supervise = 1;
+				break;
+			case 'w':
+				// binding into the root takes the privileges that set it up
+				if(uid) {
+					fprintf(stderr,"whoops: --watch is only available for uid=0\n");
+					return EXIT_FAILURE;
+				}
+				watch = 1;
+				break;
+			case 'n':
+				use_ns = 1;
+				break;
+			case 'B':
+				loop_block_size = strtoul(optarg,NULL,0);
+				if((loop_block_size < 512)||(loop_block_size > 4096)||(loop_block_size&(loop_block_size-1))) usage(self);
+				break;
+			case 'C':
+				loop_direct_io = 0;
+				break;
+			case 'T':
+				// an inherited descriptor, since we may be running setuid
+				trace_fd = optarg?atoi(optarg):2;
+				break;
+			case 'g':
+				cgroup = optarg;
+				break;
+			case 'W':
+				cgroup_limits.cpu_weight = atoi(optarg);
+				if((cgroup_limits.cpu_weight < 1)||(cgroup_limits.cpu_weight > CGROUP_WEIGHT_MAX)) usage(self);
+				break;
+			case 'I':
+				cgroup_limits.io_weight = atoi(optarg);
+				if((cgroup_limits.io_weight < 1)||(cgroup_limits.io_weight > CGROUP_WEIGHT_MAX)) usage(self);
+				break;
+			case 'M':
+				if(cgroup_parse_size(optarg,&cgroup_limits.memory_high)) usage(self);
+				break;
+			case 'F':
+			case 'Z':
+			case 'K':
+				// the group may hold root's services
+				if(uid) {
+					fprintf(stderr,"whoops: --freeze, --thaw and --kill are only available for uid=0\n");
+					return EXIT_FAILURE;
+				}
+				cgroup_action = c;
+				break;
 			default:
 				usage(self);
 		}
 	}
 	char *const *child_argv = (optind==argc)?NULL:(argv+optind);
+	trace_mark("options");
+	if(((cgroup_action)||(cgroup_limits.cpu_weight)||(cgroup_limits.io_weight)||(cgroup_limits.memory_high))&&(!cgroup)) usage(self);
+	// limits apply to whoever is in the group, which may be root's services
+	if((uid)&&((cgroup_limits.cpu_weight)||(cgroup_limits.io_weight)||(cgroup_limits.memory_high))) {
+		fprintf(stderr,"whoops: --cpu-weight, --io-weight and --memory-high are only available for uid=0\n");
+		return EXIT_FAILURE;
+	}
 	// prevent privilege escalation: fail if link/symlink is not owned by superuser
 	if(uid) {
 		if(lstat(self,&st)) {
@@ -501,6 +1015,13 @@ int main(int argc, char *argv[]) {
 			return EXIT_FAILURE;
 		}
 	}
+	if(cgroup_action) {
+		if((cgroup_action == 'K')?cgroup_kill(cgroup):cgroup_freeze(cgroup,cgroup_action == 'F')) {
+			fprintf(stderr,"whoops: cannot %s cgroup `%s': %s\n",(cgroup_action == 'K')?"kill":(cgroup_action == 'F')?"freeze":"thaw",cgroup,strerror(errno));
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
 	// check if target exists
 	if(stat(child_root,&st)) {
 		fprintf(stderr,"whoops: `%s' does not exist\n",child_root);
@@ -508,8 +1029,10 @@ int main(int argc, char *argv[]) {
 	}
 	if(S_ISREG(st.st_mode)) {
 		loopmount = child_root;
+		char *loopdir = strdup(loopmount);	// dirname() may modify its argument
 		child_root = (char*)malloc(PATH_MAX);
-		child_root = realpath(dirname(loopmount),child_root);
+		child_root = realpath(dirname(loopdir),child_root);
+		free(loopdir);
 		child_root = (char*)realloc(child_root,strlen(child_root)+1);
 	} else if(!S_ISDIR(st.st_mode)) {
 		fprintf(stderr,"whoops: `%s' is not a directory\n",child_root);
@@ -520,35 +1043,53 @@ int main(int argc, char *argv[]) {
 	}
 	self = (char*)malloc(snprintf(NULL,0,"%s/init",child_root)+1);
 	sprintf(self,"%s/init",child_root);
+	// setns() resets the working directory, so save it first
+	char cwd[PATH_MAX];
+	if(getcwd(cwd,sizeof(cwd)) == NULL) {
+		fprintf(stderr,"whoops: cannot get working directory\n");
+		return EXIT_FAILURE;
+	}
+	char *ns_path = strconcat(child_root,NS_PIN);
+	int ns_outer = open("/proc/self/ns/mnt",O_RDONLY);
 	// check if directory mounted
 	int mounted = 0;
 	int loopmounted = 0;
-	FILE *fp1;
-	if(fp1 = fopen("/proc/self/mounts","r")) {
-		char *mntpt = child_root;
-		struct mntent *mnt;
-		while(mnt = getmntent(fp1)) {
-			if(strcmp(mnt->mnt_dir,mntpt) != 0) continue;
-			if(
-				(strncmp(mnt->mnt_fsname,"/dev/block/loop",sizeof("/dev/block/loop")-1) == 0)||
-				(strncmp(mnt->mnt_fsname,"/dev/loop",sizeof("/dev/loop")-1) == 0)
-			) {
+	struct mountinfo *mi = NULL;
+	const char *probe = "mountinfo";
+	int lock_fd = -1;
+	while(1) {
+		if((!unmount)&&(ns_join(ns_path) == 0)) {
+			mounted = 1;	// everything is already set up in there
+			probe = "setns";
+		} else if((!unmount)&&(mountstamp_check(child_root,NULL) == 0)) {
+			mounted = 1;	// as we left it; no need to parse mountinfo
+			probe = "stamp";
+		} else {
+			if(lock_fd < 0) {
+				// one invocation sets up at a time; the others wait, then look again
+				lock_fd = root_lock(loopmount?loopmount:child_root);
+				trace_mark("lock");
+				if(lock_fd >= 0) continue;
+			}
+			// --remount changes the mounts where they are, in a pinned namespace if there is one
+			if((remount)&&(ns_join(ns_path) == 0)) use_ns = 1;
+			mi = mountinfo_read(NULL);
+		}
+		break;
+	}
+	trace_mark(probe);
+	if(mi) {
+		struct mountinfo_entry *mnt = mountinfo_by_dir(mi,child_root);
+		if(mnt) {
+			if(mountinfo_is_loop(mnt)) {
 				loopmounted = 1;
-				FILE *fp2;
-				if(fp2 = fopen("/proc/self/mounts","r")) {
-					char *mntpt_run = (char*)malloc(snprintf(NULL,0,"%s/run",mntpt)+1);
-					sprintf(mntpt_run,"%s/run",mntpt);
-					while(mnt = getmntent(fp2)) if(strcmp(mnt->mnt_dir,mntpt_run) == 0) {
-						mounted = 1;
-						break;
-					}
-					fclose(fp2);
-					free(mntpt_run);
-				}
+				char *mntpt_run = strconcat(child_root,"/run");
+				if(mountinfo_by_dir(mi,mntpt_run)) mounted = 1;
+				free(mntpt_run);
 			} else mounted = 1;
-			break;
 		}
-		fclose(fp1);
+		// set up, but the stamp was missing or stale; leave one for next time
+		if((mounted)&&(!unmount)) mountstamp_write(child_root,loopmounted);
 	}
 	// check if directory needs to be unmounted
 	if(unmount) {
@@ -556,9 +1097,40 @@ int main(int argc, char *argv[]) {
 			fprintf(stderr,"whoops: superuser privileges required to unmount\n");
 			return EXIT_FAILURE;
 		}
-		mount_teardown(child_root,loopmounted);
-		if(remount) mounted = 0;
-		else return EXIT_SUCCESS;
+		if((remount)&&(mounted)&&(mi)) {
+			// change only what differs from how it was set up; services keep running
+			struct mounttable wanted, applied;
+			const struct mountspec *want[2], *had[2];
+			char *applied_path = strconcat(child_root,MOUNTSPEC_APPLIED);
+			int line;
+			mount_table(child_root,&wanted,&want[0],&want[1]);
+			had[0] = foreign_mounts;
+			had[1] = local_mounts;
+			if(mounttable_read(applied_path,&applied,&line) == 0) {
+				had[0] = applied.foreign;
+				had[1] = applied.local;
+			}
+			if(mount_reconcile(mi,child_root,want,had) > 0) mounttable_write(applied_path,want[0],want[1]);
+			mounttable_free(&applied);
+			mounttable_free(&wanted);
+			free(applied_path);
+			mountstamp_write(child_root,loopmounted);
+			trace_mark("reconcile");
+		} else if((ns_outer < 0)||(ns_teardown(ns_outer,child_root,ns_path))) {
+			char *page_path = strconcat(child_root,SUPERVISE_PAGE);
+			supervise_shutdown(page_path);
+			free(page_path);
+			char *broker_path = strconcat(child_root,BROKER_SOCKET);
+			broker_shutdown(broker_path);
+			free(broker_path);
+			mount_teardown(mi,child_root);
+		}
+		if(!remount) return EXIT_SUCCESS;
+		if(!mounted) {
+			mountinfo_free(mi);
+			mi = mountinfo_read(NULL);
+			trace_mark("unmount");
+		}
 	}
 	if(!mounted) {
 		// require superuser
@@ -566,8 +1138,20 @@ int main(int argc, char *argv[]) {
 			fprintf(stderr,"whoops: superuser privileges required for first invocation of `%s'\n",self);
 			return EXIT_FAILURE;
 		}
+		if(use_ns) {
+			if((ns_outer < 0)||(ns_create())) {
+				fprintf(stderr,"whoops: cannot create mount namespace\n");
+				use_ns = 0;
+			} else {
+				// mount ids are renumbered in the copy
+				mountinfo_free(mi);
+				mi = mountinfo_read(NULL);
+			}
+			trace_mark("unshare");
+		}
 		// prepare dynamic mounts
-		dynamic_remount("/mnt","/data/.botbrew");
+		if(mi) dynamic_remount(mi,"/mnt","/data/.botbrew");
+		trace_mark("dynamic_remount");
 		if(loopmount) {
 			// perform loopback mount
 			if(loopdev_mount(loopmount,child_root,"ext4",0,NULL)) {
@@ -577,14 +1161,26 @@ int main(int argc, char *argv[]) {
 				return EXIT_FAILURE;
 			}
 			loopmounted = 1;
+			trace_mark("loopdev_mount");
 		}
 		// set up directory mappings
 		char *child_mnt = strconcat(child_root,"/mnt");
 		unlink(child_mnt);
 		free(child_mnt);
-		mount_setup(child_root,loopmounted);
+		struct mounttable table;
+		const struct mountspec *foreign, *local;
+		mount_table(child_root,&table,&foreign,&local);
+		mount_setup(child_root,loopmounted,foreign,local);
+		// what --remount will compare against
+		char *applied_path = strconcat(child_root,MOUNTSPEC_APPLIED);
+		mounttable_write(applied_path,foreign,local);
+		free(applied_path);
+		mounttable_free(&table);
+		trace_mark("mount_setup");
 		// fix symlinks
-		fix_mnt_symlink("/mnt",child_root,"/emmc","/sdcard","/sdcard2","/usbdisk",NULL);
+		const char *const *link;
+		for(link = mnt_links; *link; link++) fix_mnt_symlink("/mnt",child_root,*link);
+		trace_mark("fix_mnt_symlink");
 		// copy self
 		if(strcmp(argv[0],self) != 0) {
 			time_t mtime = stat(argv[0],&st)?0:st.st_mtime;
@@ -598,13 +1194,36 @@ int main(int argc, char *argv[]) {
 			if((st.st_uid)||(st.st_gid)) chown(self,0,0);
 			if((st.st_mode&S_IWGRP)||(st.st_mode&S_IWOTH)||!(st.st_mode&S_ISUID)) chmod(self,04755);
 		}
+		trace_mark("copy");
+		// keep the namespace alive for later invocations
+		if(use_ns) {
+			if(ns_pin(ns_outer,ns_path)) fprintf(stderr,"whoops: cannot pin namespace at `%s'\n",ns_path);
+			trace_mark("ns_pin");
+		}
+		// the next invocation can trust this instead of parsing mountinfo
+		mountstamp_write(child_root,loopmounted);
+		trace_mark("stamp_write");
 	}
-	// do the chroot and chdir dance
-	char cwd[PATH_MAX];
-	if(getcwd(cwd,sizeof(cwd)) == NULL) {
-		fprintf(stderr,"whoops: cannot get working directory\n");
-		return EXIT_FAILURE;
+	mountinfo_free(mi);
+	if(ns_outer >= 0) close(ns_outer);
+	if(lock_fd >= 0) close(lock_fd);
+	free(ns_path);
+	// follow /mnt from outside the root instead of running a command
+	if(watch) {
+		if(mnt_watch("/mnt",child_root)) {
+			fprintf(stderr,"whoops: cannot watch mounts under `/mnt'\n");
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	// join the group while /sys is still in reach; throttling is best effort,
+	// and limits whose controller the kernel keeps in cgroup v1 are skipped.
+	// Only root creates groups; anyone else may join one that exists
+	if(cgroup) {
+		if(((!uid)&&(cgroup_create(cgroup,&cgroup_limits) < 0))||(cgroup_enter(cgroup,0))) fprintf(stderr,"whoops: cannot join cgroup `%s': %s\n",cgroup,strerror(errno));
+		trace_mark("cgroup");
 	}
+	// do the chroot and chdir dance
 	if(chdir(child_root)) {
 		fprintf(stderr,"whoops: cannot chdir to namespace\n");
 		return EXIT_FAILURE;
@@ -617,8 +1236,10 @@ int main(int argc, char *argv[]) {
 		fprintf(stderr,"whoops: cannot chdir to chroot\n");
 		return EXIT_FAILURE;
 	}
+	trace_mark("chroot");
 	// drop privileges
 	privdrop();
+	trace_mark("privdrop");
 	// configure environment
 	char *env_path = getenv("PATH");
 	if((env_path)&&(env_path[0])) {
@@ -641,6 +1262,25 @@ int main(int argc, char *argv[]) {
 	unsetenv("LD_LIBRARY_PATH");
 	setenv("BOTBREW_PREFIX",child_root,1);
 	if(loopmount) setenv("BOTBREW_IMAGE",loopmount,1);
+	trace_mark("environment");
+	trace_emit(mounted);
+	// serve commands over a socket instead of running one
+	if(broker) {
+		if(broker_main(BROKER_SOCKET,broker_owner)) {
+			fprintf(stderr,"whoops: cannot listen on `%s"BROKER_SOCKET"'\n",child_root);
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
+	// supervise services in the foreground instead of running one
+	if(supervise) {
+		if(supervise_main(SUPERVISE_DIR,SUPERVISE_PAGE)) {
+			if(errno == EBUSY) fprintf(stderr,"whoops: `%s"SUPERVISE_DIR"' is already supervised\n",child_root);
+			else fprintf(stderr,"whoops: cannot supervise `%s"SUPERVISE_DIR"'\n",child_root);
+			return EXIT_FAILURE;
+		}
+		return EXIT_SUCCESS;
+	}
 	// run specified command or /init.sh
 	if(child_argv == NULL) {
 		const char *argv0[2];
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include "mountinfo.h"
+
+#define MOUNTINFO_PATH	"/proc/self/mountinfo"
+
+/* FNV-1a */
+static size_t hash_bytes(const char *s, size_t len) {
+	size_t h = 2166136261u;
+	while(len--) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static size_t hash_int(int id) {
+	return (size_t)id*2654435761u;
+}
+
+/* /proc is not seekable by size; read until EOF */
+static char *slurp(const char *path, size_t *len) {
+	int fd = open(path,O_RDONLY);
+	if(fd < 0) return NULL;
+	size_t cap = 16384, used = 0;
+	char *buf = (char*)malloc(cap);
+	while(buf) {
+		if(used+1 >= cap) {
+			char *tmp = (char*)realloc(buf,cap *= 2);
+			if(!tmp) {
+				free(buf);
+				buf = NULL;
+				break;
+			}
+			buf = tmp;
+		}
+		ssize_t n = read(fd,buf+used,cap-used-1);
+		if(n < 0) {
+			if(errno == EINTR) continue;
+			free(buf);
+			buf = NULL;
+			break;
+		}
+		if(n == 0) break;
+		used += n;
+	}
+	close(fd);
+	if(!buf) return NULL;
+	buf[used] = 0;
+	*len = used;
+	return buf;
+}
+
+/* decode \ooo escapes in place; returns the new length */
+static size_t unescape(char *s) {
+	char *r = s, *w = s;
+	while(*r) {
+		if((r[0] == '\\')&&(r[1] >= '0')&&(r[1] <= '3')&&(r[2] >= '0')&&(r[2] <= '7')&&(r[3] >= '0')&&(r[3] <= '7')) {
+			*w++ = (char)(((r[1]-'0')<<6)|((r[2]-'0')<<3)|(r[3]-'0'));
+			r += 4;
+		} else *w++ = *r++;
+	}
+	*w = 0;
+	return w-s;
+}
+
+/* cut the next space-separated field off *p */
+static char *field(char **p, char *end) {
+	char *s = *p;
+	if(s >= end) return NULL;
+	char *e = (char*)memchr(s,' ',end-s);
+	if(!e) e = end;
+	*e = 0;
+	*p = e+1;
+	return s;
+}
+
+static int parse_line(struct mountinfo_entry *m, char *line, char *end) {
+	char *p = line, *s;
+	char *id = field(&p,end);
+	char *parent = field(&p,end);
+	char *dev = field(&p,end);
+	char *root = field(&p,end);
+	char *dir = field(&p,end);
+	char *opts = field(&p,end);
+	if(!opts) return -1;
+	// optional fields run up to a lone "-"
+	char *optional = p;
+	char *optional_end = p;
+	while(1) {
+		s = field(&p,end);
+		if(!s) return -1;
+		if(strcmp(s,"-") == 0) break;
+		if(optional_end != s) *(s-1) = ' ';
+		optional_end = s+strlen(s);
+	}
+	*optional_end = 0;
+	if(optional_end == optional) optional = optional_end;
+	char *type = field(&p,end);
+	char *source = field(&p,end);
+	char *super_opts = field(&p,end);
+	if(!super_opts) return -1;
+	memset(m,0,sizeof(*m));
+	m->id = atoi(id);
+	m->parent_id = atoi(parent);
+	if(sscanf(dev,"%u:%u",&m->major,&m->minor) != 2) return -1;
+	unescape(root);
+	m->root = root;
+	m->dir_len = unescape(dir);
+	m->dir = dir;
+	m->opts = opts;
+	m->optional = optional;
+	unescape(type);
+	m->type = type;
+	unescape(source);
+	m->source = source;
+	m->super_opts = super_opts;
+	return 0;
+}
+
+struct mountinfo *mountinfo_read(const char *path) {
+	size_t len, lines = 0, i, n, buckets;
+	char *p, *end, *nl;
+	char *buf = slurp(path?path:MOUNTINFO_PATH,&len);
+	if(!buf) return NULL;
+	struct mountinfo *mi = (struct mountinfo*)calloc(1,sizeof(struct mountinfo));
+	if(!mi) {
+		free(buf);
+		return NULL;
+	}
+	mi->buf = buf;
+	for(p = buf; (p = (char*)memchr(p,'\n',buf+len-p)); p++) lines++;
+	if((len)&&(buf[len-1] != '\n')) lines++;
+	for(buckets = 16; buckets < 2*lines; buckets *= 2);
+	mi->entries = (struct mountinfo_entry*)malloc((lines?lines:1)*sizeof(struct mountinfo_entry));
+	mi->by_id = (struct mountinfo_entry**)calloc(buckets,sizeof(struct mountinfo_entry*));
+	mi->by_dir = (struct mountinfo_entry**)calloc(buckets,sizeof(struct mountinfo_entry*));
+	if((!mi->entries)||(!mi->by_id)||(!mi->by_dir)) {
+		mountinfo_free(mi);
+		errno = ENOMEM;
+		return NULL;
+	}
+	mi->mask = buckets-1;
+	// one pass over the text
+	n = 0;
+	for(p = buf, end = buf+len; p < end; p = nl+1) {
+		nl = (char*)memchr(p,'\n',end-p);
+		if(!nl) nl = end;
+		*nl = 0;
+		struct mountinfo_entry *m = &mi->entries[n];
+		if(parse_line(m,p,nl) == 0) {
+			m->seq = n++;
+			size_t h = hash_int(m->id)&mi->mask;
+			m->id_next = mi->by_id[h];
+			mi->by_id[h] = m;
+			// later mounts go first, so a lookup finds the topmost one
+			h = hash_bytes(m->dir,m->dir_len)&mi->mask;
+			m->dir_next = mi->by_dir[h];
+			mi->by_dir[h] = m;
+		}
+	}
+	mi->count = n;
+	// link the tree; walk backwards so children end up in mount order
+	for(i = n; i-- > 0;) {
+		struct mountinfo_entry *m = &mi->entries[i];
+		if(m->parent_id == m->id) continue;
+		m->parent = mountinfo_by_id(mi,m->parent_id);
+		if(m->parent) {
+			m->sibling = m->parent->child;
+			m->parent->child = m;
+		}
+	}
+	return mi;
+}
+
+void mountinfo_free(struct mountinfo *mi) {
+	if(!mi) return;
+	free(mi->by_dir);
+	free(mi->by_id);
+	free(mi->entries);
+	free(mi->buf);
+	free(mi);
+}
+
+struct mountinfo_entry *mountinfo_by_id(const struct mountinfo *mi, int id) {
+	struct mountinfo_entry *m;
+	for(m = mi->by_id[hash_int(id)&mi->mask]; m; m = m->id_next) if(m->id == id) return m;
+	return NULL;
+}
+
+static struct mountinfo_entry *by_dir(const struct mountinfo *mi, const char *dir, size_t len) {
+	struct mountinfo_entry *m;
+	for(m = mi->by_dir[hash_bytes(dir,len)&mi->mask]; m; m = m->dir_next) {
+		if((m->dir_len == len)&&(memcmp(m->dir,dir,len) == 0)) return m;
+	}
+	return NULL;
+}
+
+struct mountinfo_entry *mountinfo_by_dir(const struct mountinfo *mi, const char *dir) {
+	return by_dir(mi,dir,strlen(dir));
+}
+
+struct mountinfo_entry *mountinfo_find(const struct mountinfo *mi, const char *path) {
+	size_t len = strlen(path);
+	struct mountinfo_entry *m;
+	while((len > 1)&&(path[len-1] == '/')) len--;
+	while(len > 0) {
+		if((m = by_dir(mi,path,len))) return m;
+		while((len > 0)&&(path[len-1] != '/')) len--;	// drop the last component
+		if(len > 1) len--;				// and its slash, unless that is "/"
+		else if(len == 1) return by_dir(mi,"/",1);
+	}
+	return NULL;
+}
+
+/* a path equal to or below dir */
+static int is_under(const char *path, size_t path_len, const char *dir, size_t dir_len) {
+	if((dir_len == 1)&&(dir[0] == '/')) return 1;
+	if((path_len < dir_len)||(memcmp(path,dir,dir_len) != 0)) return 0;
+	return (path_len == dir_len)||(path[dir_len] == '/');
+}
+
+static int by_seq(const void *a, const void *b) {
+	size_t x = (*(struct mountinfo_entry* const*)a)->seq;
+	size_t y = (*(struct mountinfo_entry* const*)b)->seq;
+	return (x > y)-(x < y);
+}
+
+struct mountinfo_entry **mountinfo_under(const struct mountinfo *mi, const char *dir, size_t *count) {
+	size_t dir_len = strlen(dir), n = 0, top = 0;
+	while((dir_len > 1)&&(dir[dir_len-1] == '/')) dir_len--;
+	struct mountinfo_entry **res = (struct mountinfo_entry**)malloc((mi->count+1)*sizeof(struct mountinfo_entry*));
+	struct mountinfo_entry **stack = (struct mountinfo_entry**)malloc((mi->count+1)*sizeof(struct mountinfo_entry*));
+	if((!res)||(!stack)) {
+		free(res);
+		free(stack);
+		return NULL;
+	}
+	// start below everything stacked on dir, since mounts hidden by those hang off their parent
+	struct mountinfo_entry *base = mountinfo_find(mi,dir), *m;
+	while((base)&&(base->parent)&&(is_under(base->dir,base->dir_len,dir,dir_len))) base = base->parent;
+	if(base) stack[top++] = base;
+	while(top) {
+		m = stack[--top];
+		if(is_under(m->dir,m->dir_len,dir,dir_len)) res[n++] = m;
+		for(m = m->child; m; m = m->sibling) {
+			// prune subtrees that lie beside dir
+			if((is_under(m->dir,m->dir_len,dir,dir_len))||(is_under(dir,dir_len,m->dir,m->dir_len))) stack[top++] = m;
+		}
+	}
+	free(stack);
+	qsort(res,n,sizeof(struct mountinfo_entry*),by_seq);
+	res[n] = NULL;
+	if(count) *count = n;
+	return res;
+}
+
+int mountinfo_is_loop(const struct mountinfo_entry *m) {
+	return (strncmp(m->source,"/dev/block/loop",sizeof("/dev/block/loop")-1) == 0)||
+		(strncmp(m->source,"/dev/loop",sizeof("/dev/loop")-1) == 0);
+}
@@ -0,0 +1,64 @@
+#ifndef MOUNTINFO_H
+#define MOUNTINFO_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * One line of /proc/<pid>/mountinfo.  Strings point into the table's
+ * buffer and have their octal escapes (\040 etc.) decoded.
+ */
+struct mountinfo_entry {
+	int id;
+	int parent_id;
+	unsigned int major;
+	unsigned int minor;
+	const char *root;	// path of the mounted directory inside its filesystem
+	const char *dir;	// mount point
+	const char *opts;	// per-mount options
+	const char *optional;	// optional fields, e.g. "shared:1 master:2", or ""
+	const char *type;
+	const char *source;
+	const char *super_opts;
+	size_t seq;		// position in the file, i.e. mount order
+	size_t dir_len;
+	struct mountinfo_entry *parent;	// NULL for the root or if not visible
+	struct mountinfo_entry *child;	// first child, in mount order
+	struct mountinfo_entry *sibling;
+	struct mountinfo_entry *id_next;	// hash chains
+	struct mountinfo_entry *dir_next;
+};
+
+struct mountinfo {
+	struct mountinfo_entry *entries;
+	size_t count;
+	char *buf;
+	struct mountinfo_entry **by_id;
+	struct mountinfo_entry **by_dir;
+	size_t mask;		// hash buckets - 1
+};
+
+/* Parse path, or /proc/self/mountinfo if NULL; returns NULL with errno set. */
+struct mountinfo *mountinfo_read(const char *path);
+void mountinfo_free(struct mountinfo *mi);
+struct mountinfo_entry *mountinfo_by_id(const struct mountinfo *mi, int id);
+/* The topmost mount on exactly dir, or NULL. */
+struct mountinfo_entry *mountinfo_by_dir(const struct mountinfo *mi, const char *dir);
+/* The mount that path (absolute, canonical) lives on. */
+struct mountinfo_entry *mountinfo_find(const struct mountinfo *mi, const char *path);
+/*
+ * Every mount on dir or below it, in mount order, as a NULL-terminated
+ * array to free(); *count (if not NULL) receives the length.
+ */
+struct mountinfo_entry **mountinfo_under(const struct mountinfo *mi, const char *dir, size_t *count);
+/* Nonzero if the entry is backed by a loop device. */
+int mountinfo_is_loop(const struct mountinfo_entry *m);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
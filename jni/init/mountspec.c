@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mount.h>
+#include <sys/stat.h>
+
+#include "mountspec.h"
+
+#ifndef MS_REC
+#define MS_REC	16384
+#endif
+
+static const struct {
+	const char *name;
+	unsigned long flag;
+} flag_names[] = {
+	{"ro",MS_RDONLY},
+	{"nosuid",MS_NOSUID},
+	{"nodev",MS_NODEV},
+	{"noexec",MS_NOEXEC},
+	{"noatime",MS_NOATIME},
+	{NULL,0}
+};
+
+#define OPT_FLAGS	(MS_RDONLY|MS_NOSUID|MS_NODEV|MS_NOEXEC|MS_NOATIME)
+
+static char *slurp(const char *path) {
+	struct stat st;
+	int fd = open(path,O_RDONLY);
+	if(fd < 0) return NULL;
+	char *buf = NULL;
+	if((fstat(fd,&st) == 0)&&(buf = (char*)malloc(st.st_size+1))) {
+		ssize_t n = read(fd,buf,st.st_size);
+		if(n < 0) {
+			free(buf);
+			buf = NULL;
+		} else buf[n] = 0;
+	}
+	close(fd);
+	return buf;
+}
+
+static char *token(char **p) {
+	while((**p == ' ')||(**p == '\t')) (*p)++;
+	if((!**p)||(**p == '#')) return NULL;
+	char *start = *p;
+	while((**p)&&(**p != ' ')&&(**p != '\t')) (*p)++;
+	if(**p) *(*p)++ = 0;
+	return start;
+}
+
+/* split opts into flags and, compacted in place, the data left over */
+static unsigned long parse_options(char *opts, const char **data) {
+	unsigned long flags = 0;
+	char *out = opts, *opt = opts, *end;
+	int i;
+	while(opt) {
+		end = strchr(opt,',');
+		if(end) *end++ = 0;
+		for(i = 0; flag_names[i].name; i++) if(strcmp(opt,flag_names[i].name) == 0) break;
+		if(flag_names[i].name) flags |= flag_names[i].flag;
+		else if((*opt)&&(strcmp(opt,"defaults") != 0)) {
+			if(out != opts) *out++ = ',';
+			memmove(out,opt,strlen(opt));
+			out += strlen(opt);
+		}
+		opt = end;
+	}
+	*out = 0;
+	*data = *opts?opts:NULL;
+	return flags;
+}
+
+static int parse_line(char *line, struct mountspec *m, int *local) {
+	char *kind = token(&line);
+	if(!kind) return 0;	// blank or comment
+	char *src = token(&line), *dst = token(&line), *type = token(&line), *opts = token(&line);
+	if((!type)||(token(&line))) return -1;
+	if(strcmp(kind,"local") == 0) *local = 1;
+	else if(strcmp(kind,"foreign") == 0) *local = 0;
+	else return -1;
+	size_t len = strlen(dst);
+	if((dst[0] != '/')||(strstr(dst,"/../"))||((len >= 3)&&(strcmp(dst+len-3,"/..") == 0))) return -1;
+	memset(m,0,sizeof(*m));
+	m->src = (strcmp(src,"none") == 0)?NULL:src;
+	m->dst = dst;
+	const char *data = NULL;
+	unsigned long flags = opts?parse_options(opts,&data):0;
+	if((strcmp(type,"bind") == 0)||(strcmp(type,"rbind") == 0)) {
+		if((!m->src)||(data)) return -1;
+		m->flags = MS_BIND|((type[0] == 'r')?MS_REC:0);
+		if(flags) m->remount_flags = MS_REMOUNT|flags;
+	} else {
+		m->type = type;
+		m->flags = flags;
+		m->data = data;
+	}
+	return 1;
+}
+
+int mounttable_read(const char *path, struct mounttable *t, int *line) {
+	size_t lines = 1, nforeign = 0, nlocal = 0;
+	char *p, *next;
+	memset(t,0,sizeof(*t));
+	t->buf = slurp(path);
+	if(!t->buf) return -1;
+	for(p = t->buf; *p; p++) if(*p == '\n') lines++;
+	t->foreign = (struct mountspec*)calloc(lines+1,sizeof(struct mountspec));
+	t->local = (struct mountspec*)calloc(lines+1,sizeof(struct mountspec));
+	if((!t->foreign)||(!t->local)) {
+		mounttable_free(t);
+		errno = ENOMEM;
+		return -1;
+	}
+	*line = 0;
+	for(p = t->buf; p; p = next) {
+		struct mountspec m;
+		int local = 0, res;
+		next = strchr(p,'\n');
+		if(next) *next++ = 0;
+		++*line;
+		res = parse_line(p,&m,&local);
+		if(res < 0) {
+			mounttable_free(t);
+			errno = EINVAL;
+			return -1;
+		}
+		if(res) {
+			if(local) t->local[nlocal++] = m;
+			else t->foreign[nforeign++] = m;
+		}
+	}
+	return 0;
+}
+
+static void write_table(FILE *f, const char *kind, const struct mountspec *m) {
+	for(; m->dst; m++) {
+		unsigned long flags = (m->flags&MS_BIND)?(m->remount_flags&OPT_FLAGS):(m->flags&OPT_FLAGS);
+		const char *sep = " ";
+		int i;
+		fprintf(f,"%s %s %s %s",kind,m->src?m->src:"none",m->dst,(m->flags&MS_BIND)?((m->flags&MS_REC)?"rbind":"bind"):m->type);
+		for(i = 0; flag_names[i].name; i++) if(flags&flag_names[i].flag) {
+			fprintf(f,"%s%s",sep,flag_names[i].name);
+			sep = ",";
+		}
+		if(m->data) fprintf(f,"%s%s",sep,(const char*)m->data);
+		fputc('\n',f);
+	}
+}
+
+int mounttable_write(const char *path, const struct mountspec *foreign, const struct mountspec *local) {
+	char *tmp = (char*)malloc(strlen(path)+sizeof(".tmp"));
+	if(!tmp) return -1;
+	sprintf(tmp,"%s.tmp",path);
+	FILE *f = fopen(tmp,"w");
+	int res = -1;
+	if(f) {
+		write_table(f,"foreign",foreign);
+		write_table(f,"local",local);
+		res = (fclose(f) == 0)?rename(tmp,path):-1;
+		if(res) unlink(tmp);
+	}
+	free(tmp);
+	return res;
+}
+
+void mounttable_free(struct mounttable *t) {
+	free(t->foreign);
+	free(t->local);
+	free(t->buf);
+	memset(t,0,sizeof(*t));
+}
+
+static int str_equal(const char *a, const char *b) {
+	return (a == b)||((a)&&(b)&&(strcmp(a,b) == 0));
+}
+
+int mountspec_remountable(const struct mountspec *a, const struct mountspec *b) {
+	return (str_equal(a->src,b->src))&&(str_equal(a->dst,b->dst))&&(str_equal(a->type,b->type))&&
+		((a->flags&(MS_BIND|MS_REC)) == (b->flags&(MS_BIND|MS_REC)));
+}
+
+int mountspec_equal(const struct mountspec *a, const struct mountspec *b) {
+	return (mountspec_remountable(a,b))&&(a->flags == b->flags)&&(a->remount_flags == b->remount_flags)&&
+		(str_equal((const char*)a->data,(const char*)b->data));
+}
+
+const struct mountspec *mountspec_find(const struct mountspec *table, const char *dst) {
+	for(; table->dst; table++) if(strcmp(table->dst,dst) == 0) return table;
+	return NULL;
+}
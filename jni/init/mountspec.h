@@ -0,0 +1,59 @@
+#ifndef MOUNTSPEC_H
+#define MOUNTSPEC_H
+
+/*
+ * The mounts that make up a root.  Foreign mounts bring in parts of the
+ * Android system (sources are outside the root); local mounts rearrange
+ * the root itself (sources are inside it).  Both are arrays ending with
+ * an entry whose dst is NULL.
+ *
+ * A root may replace the built-in tables with MOUNTSPEC_PATH, one mount
+ * per line, fields separated by blanks, '#' starting a comment:
+ *
+ *	<foreign|local> <source|none> <target> <type|bind|rbind> [<options>]
+ *
+ * where options are comma-separated and ro, nosuid, nodev, noexec and
+ * noatime become flags; anything else is passed on as data.  The flags of
+ * a bind are applied by remounting it.  The table actually applied is
+ * kept in MOUNTSPEC_APPLIED, so --remount can change only what differs.
+ */
+
+#define MOUNTSPEC_PATH	"/etc/init.mounts"
+#define MOUNTSPEC_APPLIED	"/run/.mounts"
+
+struct mountspec {
+	const char *src;
+	const char *dst;
+	const char *type;
+	unsigned long flags;
+	const void *data;
+	unsigned long remount_flags;
+};
+
+struct mounttable {
+	struct mountspec *foreign;
+	struct mountspec *local;
+	char *buf;		// the strings of both
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Parse path; returns -1 with errno set if it cannot be read, or EINVAL with *line set to the bad line. */
+int mounttable_read(const char *path, struct mounttable *t, int *line);
+/* Write both tables to path in the format mounttable_read() takes. */
+int mounttable_write(const char *path, const struct mountspec *foreign, const struct mountspec *local);
+void mounttable_free(struct mounttable *t);
+/* Nonzero if a and b mount the same thing the same way. */
+int mountspec_equal(const struct mountspec *a, const struct mountspec *b);
+/* Nonzero if a remount can turn a into b: the same source and type, only flags or (for a filesystem) data differ. */
+int mountspec_remountable(const struct mountspec *a, const struct mountspec *b);
+/* The entry of table mounting on dst, or NULL. */
+const struct mountspec *mountspec_find(const struct mountspec *table, const char *dst);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
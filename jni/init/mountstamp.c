@@ -0,0 +1,139 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/vfs.h>
+
+#include "mountstamp.h"
+
+#define BOOT_ID	"/proc/sys/kernel/random/boot_id"
+
+#ifndef TMPFS_MAGIC
+#define TMPFS_MAGIC	0x01021994
+#endif
+#ifndef AT_FDCWD
+#define AT_FDCWD	-100
+#endif
+#ifndef AT_SYMLINK_NOFOLLOW
+#define AT_SYMLINK_NOFOLLOW	0x100
+#endif
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW	0100000
+#endif
+#ifndef __NR_statx
+#if defined(__arm__)
+#define __NR_statx	397
+#elif defined(__aarch64__)
+#define __NR_statx	291
+#elif defined(__i386__)
+#define __NR_statx	383
+#elif defined(__x86_64__)
+#define __NR_statx	332
+#elif defined(__mips__)
+#define __NR_statx	4366
+#endif
+#endif
+#define STATX_MNT_ID	0x00001000U
+
+/* struct statx, which our kernel headers predate; only the mount ID is used */
+struct statx_buf {
+	uint32_t mask;
+	uint32_t other[35];
+	uint64_t mnt_id;	// offset 0x90
+	uint64_t spare[13];
+};
+
+static uint64_t mnt_id(const char *path) {
+#ifdef __NR_statx
+	struct statx_buf stx;
+	memset(&stx,0,sizeof(stx));
+	if((syscall(__NR_statx,AT_FDCWD,path,AT_SYMLINK_NOFOLLOW,STATX_MNT_ID,&stx) == 0)&&(stx.mask&STATX_MNT_ID)) return stx.mnt_id;
+#endif
+	return 0;
+}
+
+static int boot_id(char *buf, size_t size) {
+	int fd = open(BOOT_ID,O_RDONLY);
+	if(fd < 0) return -1;
+	memset(buf,0,size);
+	ssize_t n = read(fd,buf,size-1);
+	close(fd);
+	return (n > 0)?0:-1;
+}
+
+static char *stamp_path(const char *root) {
+	char *path = (char*)malloc(strlen(root)+sizeof(MOUNTSTAMP_PATH));
+	if(path) sprintf(path,"%s"MOUNTSTAMP_PATH,root);
+	return path;
+}
+
+int mountstamp_write(const char *root, int loop) {
+	struct mountstamp stamp;
+	struct stat st;
+	if(strlen(root) >= sizeof(stamp.root)) return -1;
+	memset(&stamp,0,sizeof(stamp));
+	stamp.magic = MOUNTSTAMP_MAGIC;
+	stamp.size = sizeof(stamp);
+	strcpy(stamp.root,root);
+	if(boot_id(stamp.boot_id,sizeof(stamp.boot_id))) return -1;
+	stamp.root_mnt_id = mnt_id(root);
+	if(loop) {
+		if(stat(root,&st)) return -1;
+		stamp.loop_dev = st.st_dev;
+	}
+	char *path = stamp_path(root);
+	if(!path) return -1;
+	char *tmp = (char*)malloc(strlen(path)+sizeof(".tmp"));
+	if(!tmp) {
+		free(path);
+		return -1;
+	}
+	sprintf(tmp,"%s.tmp",path);
+	int res = -1;
+	int fd = open(tmp,O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW,0644);
+	if(fd >= 0) {
+		struct statfs sfs;
+		if((fstat(fd,&st) == 0)&&(fstatfs(fd,&sfs) == 0)&&(sfs.f_type == TMPFS_MAGIC)) {
+			stamp.run_dev = st.st_dev;
+			if(write(fd,&stamp,sizeof(stamp)) == sizeof(stamp)) res = 0;
+		}
+		close(fd);
+		// renamed into place whole, so a reader never sees half a stamp
+		if((res)||(rename(tmp,path))) {
+			unlink(tmp);
+			res = -1;
+		}
+	}
+	free(tmp);
+	free(path);
+	return res;
+}
+
+int mountstamp_check(const char *root, struct mountstamp *stamp) {
+	struct mountstamp buf;
+	struct stat st;
+	struct statfs sfs;
+	char boot[sizeof(buf.boot_id)];
+	if(!stamp) stamp = &buf;
+	char *path = stamp_path(root);
+	if(!path) return -1;
+	int fd = open(path,O_RDONLY|O_NOFOLLOW);
+	free(path);
+	if(fd < 0) return -1;
+	ssize_t n = read(fd,stamp,sizeof(*stamp));
+	// only root may have written it, and it must be on the /run it describes
+	int valid = (n == sizeof(*stamp))&&(fstat(fd,&st) == 0)&&(fstatfs(fd,&sfs) == 0)&&
+		(S_ISREG(st.st_mode))&&(st.st_uid == 0)&&(!(st.st_mode&(S_IWGRP|S_IWOTH)))&&
+		(sfs.f_type == TMPFS_MAGIC)&&(st.st_dev == stamp->run_dev);
+	close(fd);
+	if(!valid) return -1;
+	if((stamp->magic != MOUNTSTAMP_MAGIC)||(stamp->size != sizeof(*stamp))) return -1;
+	if(strncmp(stamp->root,root,sizeof(stamp->root)) != 0) return -1;
+	if((boot_id(boot,sizeof(boot)))||(memcmp(boot,stamp->boot_id,sizeof(boot)) != 0)) return -1;
+	if((stamp->root_mnt_id)&&(mnt_id(root) != stamp->root_mnt_id)) return -1;
+	return 0;
+}
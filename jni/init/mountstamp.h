@@ -0,0 +1,41 @@
+#ifndef MOUNTSTAMP_H
+#define MOUNTSTAMP_H
+
+#include <stdint.h>
+#include <limits.h>
+
+/*
+ * A note that a root is set up, so later invocations need not parse
+ * mountinfo to find out.  It lives on the root's /run tmpfs, so it goes
+ * away with the mounts; what it records about them (the tmpfs instance,
+ * the mount ID of the root where statx can tell, the boot) is checked
+ * with a handful of system calls before it is trusted.
+ */
+
+#define MOUNTSTAMP_PATH	"/run/.mounted"
+#define MOUNTSTAMP_MAGIC	0x544e4d53	/* "SMNT" */
+
+struct mountstamp {
+	uint32_t magic;
+	uint32_t size;		// of this struct, as its version
+	char boot_id[40];
+	uint64_t run_dev;	// of the /run tmpfs the stamp is on
+	uint64_t root_mnt_id;	// 0 if the kernel cannot tell (before Linux 5.8)
+	uint64_t loop_dev;	// the loop device holding the root, or 0
+	char root[PATH_MAX];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Record that root is set up; loop is nonzero for an image. */
+int mountstamp_write(const char *root, int loop);
+/* 0 if root has a valid stamp, which is copied to *stamp (may be NULL); else -1. */
+int mountstamp_check(const char *root, struct mountstamp *stamp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
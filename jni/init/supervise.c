@@ -0,0 +1,701 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "supervise.h"
+#include "svstatus.h"
+
+#define BACKOFF_MIN_MS	100	/* before restarting a service that exited */
+#define BACKOFF_MAX_MS	30000	/* doubling per quick exit up to this */
+#define BACKOFF_RESET_MS	10000	/* up for this long, back to the minimum */
+#define SHUTDOWN_MS	5000	/* after TERM, before KILL */
+#define RESCAN_MS	5000	/* without inotify, as runsvdir does */
+
+#ifndef __NR_signalfd4
+#if defined(__arm__)
+#define __NR_signalfd4	355
+#elif defined(__i386__)
+#define __NR_signalfd4	327
+#elif defined(__mips__)
+#define __NR_signalfd4	4324
+#endif
+#endif
+
+/* the part of struct signalfd_siginfo we use; the kernel writes 128 bytes */
+struct sfd_siginfo {
+	uint32_t signo;
+	uint8_t pad[124];
+};
+
+/* ./run of a service or of its log, as runsv would supervise it */
+struct proc {
+	char *dir;
+	int lockfd;
+	int controlfd;
+	int controlwfd;	// keeps control from hanging up between writers
+	int okfd;
+	pid_t pid;	// of ./run, or of ./finish while finishing
+	int state;
+	char want;	// 'u' or 'd'
+	char paused;
+	char term;
+	char normally_up;
+	struct timespec since;
+	long long started_ms;	// when ./run last started, or 0 if never
+	long long due_ms;	// when to start ./run, or 0
+	unsigned int backoff_ms;
+	unsigned int restarts;
+	int status;
+};
+
+struct service {
+	char *name;
+	int seen;
+	int removing;
+	int has_log;
+	int logpipe[2];
+	struct proc main;
+	struct proc log;
+};
+
+static struct service **services = NULL;
+static size_t services_len = 0;
+static size_t services_cap = 0;
+static struct supervise_header *page = NULL;
+static int nullfd = -1;
+static int page_fd = -1;	// locked while we supervise
+static uint32_t wakeups = 0;
+static int stopping = 0;
+static int changed = 0;
+
+static long long now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (long long)ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+static void cloexec(int fd) {
+	fcntl(fd,F_SETFD,FD_CLOEXEC);
+}
+
+static char *path_of(const char *dir, const char *name) {
+	char *res = (char*)malloc(strlen(dir)+strlen(name)+2);
+	if(res) sprintf(res,"%s/%s",dir,name);
+	return res;
+}
+
+/* write supervise/<name> through a rename, like runsv */
+static void put_file(const struct proc *p, const char *name, const void *buf, size_t len) {
+	char path[PATH_MAX], tmp[PATH_MAX+4];
+	snprintf(path,sizeof(path),"%s/supervise/%s",p->dir,name);
+	snprintf(tmp,sizeof(tmp),"%s.new",path);
+	int fd = open(tmp,O_WRONLY|O_CREAT|O_TRUNC,0644);
+	if(fd < 0) return;
+	ssize_t n = write(fd,buf,len);
+	close(fd);
+	if(n == (ssize_t)len) rename(tmp,path);
+	else unlink(tmp);
+}
+
+static void proc_publish(const struct proc *p) {
+	unsigned char buf[SVSTATUS_SIZE];
+	unsigned long long tai = SVSTATUS_TAI64_EPOCH+p->since.tv_sec;
+	char text[32];
+	int i;
+	for(i = 7; i >= 0; i--, tai >>= 8) buf[i] = tai&0xff;
+	for(i = 0; i < 4; i++) {
+		buf[8+i] = ((unsigned long)p->since.tv_nsec>>(24-8*i))&0xff;
+		buf[12+i] = ((unsigned int)p->pid>>(8*i))&0xff;
+	}
+	buf[16] = p->paused;
+	buf[17] = p->want;
+	buf[18] = p->term;
+	buf[19] = p->state;
+	put_file(p,"status",buf,sizeof(buf));
+	put_file(p,"stat",text,sprintf(text,"%s\n",(p->state == SVSTATUS_RUN)?"run":(p->state == SVSTATUS_FINISH)?"finish":"down"));
+	put_file(p,"pid",text,p->pid?sprintf(text,"%d\n",p->pid):0);
+}
+
+static void proc_changed(struct proc *p) {
+	clock_gettime(CLOCK_REALTIME,&p->since);
+	proc_publish(p);
+	changed = 1;
+}
+
+static uint8_t proc_flags(const struct proc *p) {
+	return (p->normally_up?SUPERVISE_NORMALLY_UP:0)|(p->paused?SUPERVISE_PAUSED:0)|(p->term?SUPERVISE_TERM:0)|
+		((p->want == 'u')?SUPERVISE_WANT_UP:SUPERVISE_WANT_DOWN);
+}
+
+static void page_publish(void) {
+	size_t i, count = services_len < SUPERVISE_SLOTS?services_len:SUPERVISE_SLOTS;
+	struct supervise_slot *slots = (struct supervise_slot*)(page+1);
+	page->seq++;
+	__sync_synchronize();
+	for(i = 0; i < count; i++) {
+		const struct service *s = services[i];
+		struct supervise_slot *slot = &slots[i];
+		memset(slot,0,sizeof(*slot));
+		strncpy(slot->name,s->name,SUPERVISE_NAME_MAX-1);
+		slot->since = s->main.since.tv_sec;
+		slot->pid = s->main.pid;
+		slot->status = s->main.status;
+		slot->restarts = s->main.restarts;
+		slot->backoff_ms = s->main.backoff_ms;
+		slot->state = s->main.state;
+		slot->flags = proc_flags(&s->main)|(s->has_log?SUPERVISE_HAS_LOG:0);
+		if(s->has_log) {
+			slot->log_since = s->log.since.tv_sec;
+			slot->log_pid = s->log.pid;
+			slot->log_restarts = s->log.restarts;
+			slot->log_state = s->log.state;
+			slot->log_flags = proc_flags(&s->log);
+		}
+	}
+	page->count = count;
+	page->wakeups = wakeups;
+	__sync_synchronize();
+	page->seq++;
+	changed = 0;
+}
+
+/* fork and exec prog in dir; stdin and stdout are replaced if not -1 */
+static pid_t spawn(const char *dir, int in, int out, char *const argv[]) {
+	pid_t pid = fork();
+	if(pid != 0) return pid;
+	sigset_t set;
+	sigemptyset(&set);
+	sigprocmask(SIG_SETMASK,&set,NULL);
+	signal(SIGPIPE,SIG_DFL);
+	setsid();
+	if(chdir(dir)) _exit(127);
+	if(in >= 0) dup2(in,0);
+	if(out >= 0) dup2(out,1);
+	execv(argv[0],argv);
+	_exit(127);
+}
+
+static void proc_schedule(struct service *s, struct proc *p) {
+	p->due_ms = 0;
+	if((p->want != 'u')||(stopping)||(s->removing)) return;
+	long long now = now_ms();
+	if((!p->backoff_ms)||(now-p->started_ms >= BACKOFF_RESET_MS)) p->backoff_ms = BACKOFF_MIN_MS;
+	else if((p->backoff_ms *= 2) > BACKOFF_MAX_MS) p->backoff_ms = BACKOFF_MAX_MS;
+	p->due_ms = now+p->backoff_ms;
+}
+
+static void proc_start(struct service *s, struct proc *p) {
+	char *argv[] = {"./run",NULL};
+	int log = p == &s->log;
+	p->due_ms = 0;
+	p->pid = spawn(p->dir,log?s->logpipe[0]:nullfd,log?-1:s->logpipe[1],argv);
+	if(p->pid < 0) {
+		p->pid = 0;
+		p->started_ms = now_ms();
+		proc_schedule(s,p);
+		return;
+	}
+	if(p->started_ms) p->restarts++;
+	p->started_ms = now_ms();
+	p->state = SVSTATUS_RUN;
+	p->paused = p->term = 0;
+	proc_changed(p);
+}
+
+static void proc_signal(struct proc *p, int signo) {
+	if((p->pid)&&(p->state == SVSTATUS_RUN)) kill(p->pid,signo);
+}
+
+static void proc_stop(struct proc *p) {
+	p->want = 'd';
+	p->due_ms = 0;
+	if((p->pid)&&(p->state == SVSTATUS_RUN)) {
+		kill(p->pid,SIGTERM);
+		kill(p->pid,SIGCONT);
+		p->term = 1;
+		p->paused = 0;
+	}
+	proc_publish(p);
+	changed = 1;
+}
+
+/* ./run or ./finish has been reaped */
+static void proc_exited(struct service *s, struct proc *p, int status) {
+	char code[16], signo[16];
+	char *argv[] = {"./finish",code,signo,NULL};
+	p->pid = 0;
+	if(p->state == SVSTATUS_RUN) {
+		p->status = status;
+		p->paused = p->term = 0;
+		snprintf(code,sizeof(code),"%d",WIFEXITED(status)?WEXITSTATUS(status):-1);
+		snprintf(signo,sizeof(signo),"%d",WIFSIGNALED(status)?WTERMSIG(status):0);
+		char *finish = path_of(p->dir,"finish");
+		if((finish)&&(access(finish,X_OK) == 0)) {
+			p->pid = spawn(p->dir,nullfd,(p == &s->main)?s->logpipe[1]:-1,argv);
+			if(p->pid < 0) p->pid = 0;
+		}
+		free(finish);
+	}
+	p->state = p->pid?SVSTATUS_FINISH:SVSTATUS_DOWN;
+	if(!p->pid) proc_schedule(s,p);
+	proc_changed(p);
+}
+
+static void proc_control(struct service *s, struct proc *p) {
+	char buf[64];
+	ssize_t n, i;
+	while((n = read(p->controlfd,buf,sizeof(buf))) > 0) for(i = 0; i < n; i++) switch(buf[i]) {
+		case 'u':
+			p->want = 'u';
+			if((!p->pid)&&(!stopping)&&(!s->removing)) proc_start(s,p);
+			else proc_publish(p);
+			changed = 1;
+			break;
+		case 'o':
+			p->want = 'd';
+			if((!p->pid)&&(!stopping)&&(!s->removing)) proc_start(s,p);
+			else proc_publish(p);
+			changed = 1;
+			break;
+		case 'd':
+		case 'x':	// the supervisor, not sv, decides when supervision ends
+			proc_stop(p);
+			break;
+		case 'p':
+			proc_signal(p,SIGSTOP);
+			p->paused = p->pid != 0;
+			proc_publish(p);
+			changed = 1;
+			break;
+		case 'c':
+			proc_signal(p,SIGCONT);
+			p->paused = 0;
+			proc_publish(p);
+			changed = 1;
+			break;
+		case 't':
+			proc_signal(p,SIGTERM);
+			break;
+		case 'k':
+			proc_signal(p,SIGKILL);
+			break;
+		case 'h':
+			proc_signal(p,SIGHUP);
+			break;
+		case 'a':
+			proc_signal(p,SIGALRM);
+			break;
+		case 'i':
+			proc_signal(p,SIGINT);
+			break;
+		case 'q':
+			proc_signal(p,SIGQUIT);
+			break;
+		case '1':
+			proc_signal(p,SIGUSR1);
+			break;
+		case '2':
+			proc_signal(p,SIGUSR2);
+			break;
+	}
+}
+
+static int fifo_open(const struct proc *p, const char *name, int flags) {
+	char path[PATH_MAX];
+	snprintf(path,sizeof(path),"%s/supervise/%s",p->dir,name);
+	if((mkfifo(path,0600))&&(errno != EEXIST)) return -1;
+	int fd = open(path,flags|O_NONBLOCK);
+	if(fd >= 0) cloexec(fd);
+	return fd;
+}
+
+/* take over dir/supervise; fails if runsv or another supervisor holds it */
+static int proc_init(struct proc *p, const char *dir) {
+	char path[PATH_MAX];
+	struct stat st;
+	memset(p,0,sizeof(*p));
+	p->lockfd = p->controlfd = p->controlwfd = p->okfd = -1;
+	if(!(p->dir = strdup(dir))) return -1;
+	snprintf(path,sizeof(path),"%s/supervise",dir);
+	mkdir(path,0700);
+	snprintf(path,sizeof(path),"%s/supervise/lock",dir);
+	if((p->lockfd = open(path,O_WRONLY|O_CREAT,0600)) < 0) return -1;
+	cloexec(p->lockfd);
+	if(flock(p->lockfd,LOCK_EX|LOCK_NB)) return -1;
+	if((p->controlfd = fifo_open(p,"control",O_RDONLY)) < 0) return -1;
+	p->controlwfd = fifo_open(p,"control",O_WRONLY);
+	p->okfd = fifo_open(p,"ok",O_RDONLY);
+	snprintf(path,sizeof(path),"%s/down",dir);
+	p->normally_up = stat(path,&st) != 0;
+	p->want = p->normally_up?'u':'d';
+	p->state = SVSTATUS_DOWN;
+	proc_changed(p);
+	return 0;
+}
+
+static void proc_free(struct proc *p) {
+	if(p->okfd >= 0) close(p->okfd);
+	if(p->controlwfd >= 0) close(p->controlwfd);
+	if(p->controlfd >= 0) close(p->controlfd);
+	if(p->lockfd >= 0) close(p->lockfd);
+	free(p->dir);
+}
+
+static void service_free(struct service *s) {
+	proc_free(&s->main);
+	if(s->has_log) proc_free(&s->log);
+	if(s->logpipe[0] >= 0) close(s->logpipe[0]);
+	if(s->logpipe[1] >= 0) close(s->logpipe[1]);
+	free(s->name);
+	free(s);
+}
+
+static struct service *service_add(const char *dir, const char *name) {
+	struct stat st;
+	struct service *s = (struct service*)calloc(1,sizeof(*s));
+	char *path = path_of(dir,name), *log = NULL;
+	if(!s) goto fail;
+	s->logpipe[0] = s->logpipe[1] = -1;
+	s->main.lockfd = s->main.controlfd = s->main.controlwfd = s->main.okfd = -1;
+	if((!path)||(!(s->name = strdup(name)))||(proc_init(&s->main,path))) goto fail;
+	if(!(log = path_of(path,"log"))) goto fail;
+	if((stat(log,&st) == 0)&&(S_ISDIR(st.st_mode))) {
+		if((pipe(s->logpipe))||(proc_init(&s->log,log))) goto fail;
+		cloexec(s->logpipe[0]);
+		cloexec(s->logpipe[1]);
+		s->has_log = 1;
+	}
+	if(services_len == services_cap) {
+		size_t n = services_cap?services_cap*2:16;
+		struct service **tmp = (struct service**)realloc(services,n*sizeof(*tmp));
+		if(!tmp) goto fail;
+		services = tmp;
+		services_cap = n;
+	}
+	services[services_len++] = s;
+	free(log);
+	free(path);
+	if(s->has_log) proc_start(s,&s->log);
+	if(s->main.want == 'u') proc_start(s,&s->main);
+	return s;
+fail:
+	if(s) {
+		if(s->log.dir) s->has_log = 1;
+		service_free(s);
+	}
+	free(log);
+	free(path);
+	return NULL;
+}
+
+/* the supervisor's copy of the pipe goes, so the log sees EOF after ./run */
+static void service_stop(struct service *s) {
+	proc_stop(&s->main);
+	if(s->logpipe[1] >= 0) {
+		close(s->logpipe[1]);
+		s->logpipe[1] = -1;
+	}
+	if(s->has_log) {
+		s->log.want = 'd';
+		s->log.due_ms = 0;
+		proc_publish(&s->log);
+	}
+}
+
+static int service_down(const struct service *s) {
+	return (!s->main.pid)&&((!s->has_log)||(!s->log.pid));
+}
+
+/* start new services and stop those that have gone, like runsvdir */
+static void scan(const char *dir) {
+	struct stat st;
+	struct dirent *d;
+	size_t i;
+	DIR *dp = opendir(dir);
+	if(!dp) return;
+	for(i = 0; i < services_len; i++) services[i]->seen = 0;
+	while((d = readdir(dp))) {
+		if(d->d_name[0] == '.') continue;
+		for(i = 0; i < services_len; i++) if(strcmp(services[i]->name,d->d_name) == 0) break;
+		if(i < services_len) {
+			services[i]->seen = 1;
+			continue;
+		}
+		char *path = path_of(dir,d->d_name);
+		if((path)&&(stat(path,&st) == 0)&&(S_ISDIR(st.st_mode))) {
+			struct service *s = service_add(dir,d->d_name);
+			if(s) s->seen = 1;
+		}
+		free(path);
+	}
+	closedir(dp);
+	for(i = 0; i < services_len; i++) if((!services[i]->seen)&&(!services[i]->removing)) {
+		services[i]->removing = 1;
+		service_stop(services[i]);
+	}
+}
+
+static void reap(void) {
+	int status;
+	pid_t pid;
+	size_t i;
+	while((pid = waitpid(-1,&status,WNOHANG)) > 0) for(i = 0; i < services_len; i++) {
+		struct service *s = services[i];
+		if(s->main.pid == pid) proc_exited(s,&s->main,status);
+		else if((s->has_log)&&(s->log.pid == pid)) proc_exited(s,&s->log,status);
+		else continue;
+		break;
+	}
+}
+
+/* drop services that were removed and are down; any that came back are started again */
+static void sweep(const char *dir) {
+	size_t i;
+	int swept = 0;
+	for(i = 0; i < services_len;) if((services[i]->removing)&&(service_down(services[i]))) {
+		service_free(services[i]);
+		memmove(services+i,services+i+1,(--services_len-i)*sizeof(*services));
+		changed = swept = 1;
+	} else i++;
+	if((swept)&&(!stopping)) scan(dir);
+}
+
+/* fd is locked and still the file at path */
+static int lock_held(int fd, const char *path) {
+	struct stat st_fd, st_path;
+	if(flock(fd,LOCK_EX|LOCK_NB)) return 0;
+	return (fstat(fd,&st_fd) == 0)&&(stat(path,&st_path) == 0)&&(st_fd.st_dev == st_path.st_dev)&&(st_fd.st_ino == st_path.st_ino);
+}
+
+/*
+ * Take over the page at path, unless a live supervisor holds it.  Starters
+ * take turns on <path>.new, and the page in place stays locked until the
+ * new one is renamed over it, so only one of them gets that far.  Fails
+ * with EBUSY if another supervisor is running or starting.
+ */
+static int page_create(const char *path) {
+	char tmp[PATH_MAX+4];
+	snprintf(tmp,sizeof(tmp),"%s.new",path);
+	int fd = open(tmp,O_RDWR|O_CREAT,0644);
+	if(fd < 0) return -1;
+	cloexec(fd);
+	if(!lock_held(fd,tmp)) {
+		close(fd);
+		errno = EBUSY;
+		return -1;
+	}
+	int old = open(path,O_RDONLY);
+	if((old < 0)&&(errno != ENOENT)) {
+		close(fd);
+		return -1;
+	}
+	if((old >= 0)&&(!lock_held(old,path))) {
+		unlink(tmp);	// ours while we hold its lock
+		close(old);
+		close(fd);
+		errno = EBUSY;
+		return -1;
+	}
+	fchmod(fd,0644);
+	void *p = MAP_FAILED;
+	if((ftruncate(fd,0) == 0)&&(ftruncate(fd,SUPERVISE_PAGE_SIZE) == 0)) p = mmap(NULL,SUPERVISE_PAGE_SIZE,PROT_READ|PROT_WRITE,MAP_SHARED,fd,0);
+	if(p == MAP_FAILED) {
+		unlink(tmp);
+		close(fd);
+		if(old >= 0) close(old);
+		return -1;
+	}
+	page_fd = fd;
+	page = (struct supervise_header*)p;
+	page->magic = SUPERVISE_MAGIC;
+	page->pid = getpid();
+	page->started = time(NULL);
+	int res = rename(tmp,path);
+	if(old >= 0) close(old);
+	return res;
+}
+
+static int signalfd_open(void) {
+	// the kernel's sigset_t, which is wider than bionic's
+	uint64_t mask = (1ULL<<(SIGCHLD-1))|(1ULL<<(SIGTERM-1))|(1ULL<<(SIGINT-1))|(1ULL<<(SIGHUP-1));
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set,SIGCHLD);
+	sigaddset(&set,SIGTERM);
+	sigaddset(&set,SIGINT);
+	sigaddset(&set,SIGHUP);
+	if(sigprocmask(SIG_BLOCK,&set,NULL)) return -1;
+	int fd = syscall(__NR_signalfd4,-1,&mask,sizeof(mask),0);
+	if(fd < 0) return -1;
+	cloexec(fd);
+	fcntl(fd,F_SETFL,O_NONBLOCK);
+	return fd;
+}
+
+int supervise_main(const char *dir, const char *path) {
+	struct sfd_siginfo si;
+	struct pollfd *pfds = NULL;
+	size_t pfds_cap = 0, i;
+	long long deadline = 0;
+	int watch_stdin = fcntl(0,F_GETFD) != -1;
+	int sfd = signalfd_open();
+	if(sfd < 0) return -1;
+	if(page_create(path)) {
+		close(sfd);
+		return -1;
+	}
+	signal(SIGPIPE,SIG_IGN);
+	if((nullfd = open("/dev/null",O_RDWR)) >= 0) cloexec(nullfd);
+	int ifd = inotify_init();
+	if(ifd >= 0) {
+		cloexec(ifd);
+		fcntl(ifd,F_SETFL,O_NONBLOCK);
+		if(inotify_add_watch(ifd,dir,IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_ATTRIB) < 0) {
+			close(ifd);
+			ifd = -1;
+		}
+	}
+	long long rescan = now_ms()+RESCAN_MS;
+	scan(dir);
+	// supervise until stopped and every ./run, ./finish and log has exited
+	while((!stopping)||(services_len)) {
+		long long now = now_ms();
+		int timeout = -1;
+		if(changed) page_publish();
+		if(pfds_cap < 3+2*services_len) {
+			pfds_cap = 3+2*services_cap;
+			pfds = (struct pollfd*)realloc(pfds,pfds_cap*sizeof(*pfds));
+			if(!pfds) break;
+		}
+		nfds_t npfds = 0;
+		pfds[npfds].fd = sfd;
+		pfds[npfds++].events = POLLIN;
+		if((ifd >= 0)&&(!stopping)) {
+			pfds[npfds].fd = ifd;
+			pfds[npfds++].events = POLLIN;
+		}
+		if((watch_stdin)&&(!stopping)) {
+			pfds[npfds].fd = 0;
+			pfds[npfds++].events = 0;	// only hangups
+		}
+		for(i = 0; i < services_len; i++) {
+			struct service *s = services[i];
+			struct proc *p;
+			int j;
+			for(j = 0, p = &s->main; j < 1+s->has_log; j++, p = &s->log) {
+				pfds[npfds].fd = p->controlfd;
+				pfds[npfds++].events = POLLIN;
+				if(p->due_ms) {
+					long long wait = p->due_ms > now?p->due_ms-now:0;
+					if((timeout < 0)||(wait < timeout)) timeout = wait;
+				}
+			}
+		}
+		if(stopping) {
+			long long wait = deadline > now?deadline-now:0;
+			if((timeout < 0)||(wait < timeout)) timeout = wait;
+		} else if(ifd < 0) {
+			long long wait = rescan > now?rescan-now:0;
+			if((timeout < 0)||(wait < timeout)) timeout = wait;
+		}
+		if(poll(pfds,npfds,timeout) < 0) {
+			if(errno == EINTR) continue;
+			break;
+		}
+		wakeups++;
+		changed = 1;
+		for(i = 0; i < npfds; i++) {
+			if(!pfds[i].revents) continue;
+			if(pfds[i].fd == sfd) {
+				while(read(sfd,&si,sizeof(si)) == sizeof(si)) {
+					if(si.signo == SIGCHLD) reap();
+					else stopping = 1;
+				}
+			} else if(pfds[i].fd == ifd) {
+				char buf[4096];
+				while(read(ifd,buf,sizeof(buf)) > 0);
+				if(!stopping) scan(dir);
+			} else if(pfds[i].fd == 0) {
+				if(pfds[i].revents&POLLNVAL) watch_stdin = 0;
+				else stopping = 1;
+			} else {
+				size_t j;
+				for(j = 0; j < services_len; j++) {
+					struct service *s = services[j];
+					if(s->main.controlfd == pfds[i].fd) proc_control(s,&s->main);
+					else if((s->has_log)&&(s->log.controlfd == pfds[i].fd)) proc_control(s,&s->log);
+					else continue;
+					break;
+				}
+			}
+		}
+		now = now_ms();
+		if((stopping)&&(!deadline)) {
+			deadline = now+SHUTDOWN_MS;
+			for(i = 0; i < services_len; i++) {
+				services[i]->removing = 1;
+				service_stop(services[i]);
+			}
+		} else if((stopping)&&(now >= deadline)) {
+			for(i = 0; i < services_len; i++) {
+				if(services[i]->main.pid) kill(services[i]->main.pid,SIGKILL);
+				if(services[i]->log.pid) kill(services[i]->log.pid,SIGKILL);
+			}
+			deadline = now+SHUTDOWN_MS;
+		}
+		if((!stopping)&&(ifd < 0)&&(now >= rescan)) {
+			scan(dir);
+			rescan = now+RESCAN_MS;
+		}
+		for(i = 0; i < services_len; i++) {
+			struct service *s = services[i];
+			if((s->has_log)&&(s->log.due_ms)&&(s->log.due_ms <= now)&&(!s->log.pid)) proc_start(s,&s->log);
+			if((s->main.due_ms)&&(s->main.due_ms <= now)&&(!s->main.pid)) proc_start(s,&s->main);
+		}
+		sweep(dir);
+	}
+	page_publish();
+	page->pid = 0;
+	munmap(page,SUPERVISE_PAGE_SIZE);
+	page = NULL;
+	close(page_fd);
+	free(pfds);
+	if(ifd >= 0) close(ifd);
+	if(nullfd >= 0) close(nullfd);
+	close(sfd);
+	return 0;
+}
+
+/* the page stays locked while its supervisor lives, so a stale pid is never signalled */
+int supervise_shutdown(const char *path) {
+	struct supervise_header h;
+	int fd = open(path,O_RDONLY);
+	if(fd < 0) return -1;
+	if((flock(fd,LOCK_SH|LOCK_NB) == 0)||(read(fd,&h,sizeof(h)) != sizeof(h))||(h.magic != SUPERVISE_MAGIC)||(h.pid <= 0)||(kill(h.pid,SIGTERM))) {
+		close(fd);
+		return -1;
+	}
+	// every service gets SHUTDOWN_MS before KILL, and its log as long again
+	long long deadline = now_ms()+3*SHUTDOWN_MS;
+	while((flock(fd,LOCK_SH|LOCK_NB))&&(now_ms() < deadline)) usleep(10000);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,77 @@
+#ifndef SUPERVISE_H
+#define SUPERVISE_H
+
+#include <stdint.h>
+
+/*
+ * `init --supervise': runsvdir and runsv in one process.  Every directory
+ * in SUPERVISE_DIR is a runit service; its supervise/ directory is kept
+ * compatible, so sv and svstatus_read() work as before.
+ *
+ * The state of every service is also published in SUPERVISE_PAGE, one
+ * world-readable page that the app can map without root.  It is written
+ * under a sequence lock: seq is odd while an update is in progress, so a
+ * reader copies the page and retries if seq was odd or has changed.
+ */
+
+#define SUPERVISE_DIR	"/etc/service"
+#define SUPERVISE_PAGE	"/run/init.svc"
+#define SUPERVISE_MAGIC	0x53765031	/* "SvP1" */
+#define SUPERVISE_PAGE_SIZE	4096
+#define SUPERVISE_NAME_MAX	32	/* including the NUL; longer names are cut */
+
+/* flags, as in ServiceStatus.java; log_flags has all but HAS_LOG */
+#define SUPERVISE_NORMALLY_UP	2
+#define SUPERVISE_HAS_LOG	4
+#define SUPERVISE_WANT_UP	8
+#define SUPERVISE_WANT_DOWN	16
+#define SUPERVISE_PAUSED	32
+#define SUPERVISE_TERM	64
+
+struct supervise_header {
+	uint32_t magic;
+	uint32_t seq;
+	int32_t pid;		// of the supervisor; 0 once it has exited
+	uint32_t count;		// slots in use
+	int64_t started;	// unix time
+	uint32_t wakeups;	// times the supervisor has woken up
+	uint32_t reserved;
+};
+
+struct supervise_slot {
+	char name[SUPERVISE_NAME_MAX];
+	int64_t since;		// unix time of the last state change
+	int64_t log_since;
+	int32_t pid;		// of ./run, or ./finish while finishing
+	int32_t log_pid;
+	int32_t status;		// wait status of the last ./run
+	uint32_t restarts;
+	uint32_t log_restarts;
+	uint32_t backoff_ms;	// before the next restart
+	int8_t state;		// SVSTATUS_DOWN, _RUN or _FINISH
+	int8_t log_state;
+	uint8_t flags;
+	uint8_t log_flags;
+	uint32_t reserved;
+};
+
+#define SUPERVISE_SLOTS	((SUPERVISE_PAGE_SIZE-sizeof(struct supervise_header))/sizeof(struct supervise_slot))
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Supervise the services in dir until SIGTERM, SIGINT or SIGHUP, or until
+ * stdin hangs up, then stop them all.  Returns 0 once they have exited,
+ * -1 if supervision could not start.
+ */
+int supervise_main(const char *dir, const char *page);
+/* Ask the supervisor publishing page to stop, and wait for it. */
+int supervise_shutdown(const char *page);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+
+#include "svstatus.h"
+
+#define SERVICE_DIR	"etc/service"
+#define SV_DIR	"etc/sv"
+
+/* runsv replaces supervise/status atomically; it ignores leap seconds, as do we */
+void svstatus_proc_read(int dirfd, const char *dir, struct svstatus_proc *p) {
+	char path[PATH_MAX];
+	unsigned char buf[SVSTATUS_SIZE];
+	struct stat st;
+	memset(p,0,sizeof(*p));
+	p->state = SVSTATUS_NONE;
+	if((size_t)snprintf(path,sizeof(path),"%s/supervise/status",dir) >= sizeof(path)) return;
+	snprintf(path,sizeof(path),"%s/down",dir);
+	p->normally_up = fstatat(dirfd,path,&st,0) != 0;
+	snprintf(path,sizeof(path),"%s/supervise/status",dir);
+	int fd = openat(dirfd,path,O_RDONLY);
+	if(fd < 0) {
+		if((errno == EACCES)||(errno == EPERM)) p->state = SVSTATUS_UNREADABLE;
+		return;
+	}
+	ssize_t n;
+	do n = read(fd,buf,sizeof(buf)); while((n < 0)&&(errno == EINTR));
+	close(fd);
+	if(n != SVSTATUS_SIZE) {
+		if(n < 0) p->state = SVSTATUS_UNREADABLE;
+		return;
+	}
+	unsigned long long tai = 0;
+	int i;
+	for(i = 0; i < 8; i++) tai = (tai<<8)|buf[i];
+	p->since = tai >= SVSTATUS_TAI64_EPOCH?(long long)(tai-SVSTATUS_TAI64_EPOCH):0;
+	p->pid = buf[12]|(buf[13]<<8)|(buf[14]<<16)|(buf[15]<<24);
+	p->paused = buf[16];
+	p->want = ((buf[17] == 'u')||(buf[17] == 'd'))?buf[17]:0;
+	p->term = buf[18];
+	p->state = buf[19] <= SVSTATUS_FINISH?buf[19]:SVSTATUS_DOWN;
+}
+
+static int is_dir(int dirfd, const char *path) {
+	struct stat st;
+	return (fstatat(dirfd,path,&st,0) == 0)&&(S_ISDIR(st.st_mode));
+}
+
+static struct svstatus *add(struct svstatus_list *list, size_t *cap, const char *name) {
+	if(list->count == *cap) {
+		size_t n = *cap?*cap*2:32;
+		struct svstatus *tmp = (struct svstatus*)realloc(list->services,n*sizeof(*tmp));
+		if(!tmp) return NULL;
+		list->services = tmp;
+		*cap = n;
+	}
+	struct svstatus *s = &list->services[list->count];
+	memset(s,0,sizeof(*s));
+	if(!(s->name = strdup(name))) return NULL;
+	list->count++;
+	return s;
+}
+
+static int listed(const struct svstatus_list *list, size_t count, const char *name) {
+	size_t i;
+	for(i = 0; i < count; i++) if(strcmp(list->services[i].name,name) == 0) return 1;
+	return 0;
+}
+
+/* runsvdir ignores dot names, and sv/enabled is a directory of links */
+static int skip(const char *name) {
+	return (name[0] == '.')||(strcmp(name,"enabled") == 0);
+}
+
+struct svstatus_list *svstatus_read(const char *root) {
+	char path[PATH_MAX];
+	struct svstatus_list *list = (struct svstatus_list*)calloc(1,sizeof(*list));
+	size_t cap = 0, enabled;
+	struct dirent *d;
+	DIR *dir;
+	int err = 0;
+	if(!list) return NULL;
+	snprintf(path,sizeof(path),"%s/" SERVICE_DIR,root);
+	if(!(dir = opendir(path))&&(errno != ENOENT)) {
+		err = errno;
+		goto fail;
+	}
+	while((dir)&&(d = readdir(dir))) {
+		struct svstatus *s;
+		char log[NAME_MAX+5];
+		if((skip(d->d_name))||(!is_dir(dirfd(dir),d->d_name))) continue;
+		if(!(s = add(list,&cap,d->d_name))) {
+			err = ENOMEM;
+			break;
+		}
+		s->enabled = 1;
+		svstatus_proc_read(dirfd(dir),d->d_name,&s->main);
+		snprintf(log,sizeof(log),"%s/log",d->d_name);
+		s->log.state = SVSTATUS_NONE;
+		if((s->has_log = is_dir(dirfd(dir),log))) svstatus_proc_read(dirfd(dir),log,&s->log);
+	}
+	if(dir) closedir(dir);
+	if(err) goto fail;
+	enabled = list->count;
+	snprintf(path,sizeof(path),"%s/" SV_DIR,root);
+	if((dir = opendir(path))) {
+		while((d = readdir(dir))) {
+			struct svstatus *s;
+			if((skip(d->d_name))||(listed(list,enabled,d->d_name))) continue;
+			if(!(s = add(list,&cap,d->d_name))) {
+				err = ENOMEM;
+				break;
+			}
+			s->main.state = s->log.state = SVSTATUS_NONE;
+		}
+		closedir(dir);
+		if(err) goto fail;
+	}
+	return list;
+fail:
+	svstatus_free(list);
+	errno = err;
+	return NULL;
+}
+
+void svstatus_free(struct svstatus_list *list) {
+	size_t i;
+	if(!list) return;
+	for(i = 0; i < list->count; i++) free((char*)list->services[i].name);
+	free(list->services);
+	free(list);
+}
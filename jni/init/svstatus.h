@@ -0,0 +1,65 @@
+#ifndef SVSTATUS_H
+#define SVSTATUS_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* states, as in the last byte of supervise/status */
+#define SVSTATUS_DOWN	0
+#define SVSTATUS_RUN	1
+#define SVSTATUS_FINISH	2
+#define SVSTATUS_NONE	-1	// no supervise/status: runsv is not running
+#define SVSTATUS_UNREADABLE	-2	// e.g. supervise is 0700 and we are not root
+
+/*
+ * supervise/status as runsv writes it: {TAI64N of the last change, pid
+ * (LE), paused, want, got TERM, state}.  TAI64 labels count from this.
+ */
+#define SVSTATUS_SIZE	20
+#define SVSTATUS_TAI64_EPOCH	4611686018427387914ULL
+
+/* one process supervised by runsv, decoded from its 20-byte status file */
+struct svstatus_proc {
+	int state;
+	int pid;	// 0 unless running
+	long long since;	// unix time of the last state change
+	char want;	// 'u', 'd' or 0
+	char paused;
+	char term;	// got TERM, not yet down
+	char normally_up;	// no down file
+};
+
+struct svstatus {
+	const char *name;
+	int enabled;	// in etc/service rather than only etc/sv
+	int has_log;
+	struct svstatus_proc main;
+	struct svstatus_proc log;
+};
+
+struct svstatus_list {
+	struct svstatus *services;
+	size_t count;
+};
+
+/*
+ * Every service under root: those in etc/service first, then those only
+ * in etc/sv, each set in directory order.  Returns NULL with errno set if
+ * etc/service exists but cannot be read.
+ */
+struct svstatus_list *svstatus_read(const char *root);
+void svstatus_free(struct svstatus_list *list);
+/*
+ * Decode dir/supervise/status and look for dir/down; the state tells why
+ * if there is no status.
+ */
+void svstatus_proc_read(int dirfd, const char *dir, struct svstatus_proc *p);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
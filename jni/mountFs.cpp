@@ -0,0 +1,192 @@
+#include "common.h"
+
+#define LOG_TAG "MountFs"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mountFs.h"
+#include "init/mountinfo.h"
+
+/* fields per entry in the String[] handed to Java */
+#define ENTRY_FIELDS	9
+
+static jclass class_string;
+
+/*
+ * Decode UTF-8 from the kernel; NewStringUTF() would abort on the
+ * malformed bytes a mount point may legally contain.
+ */
+static jstring newString(JNIEnv *env, const char *s)
+{
+    size_t len = strlen(s);
+    const unsigned char *p = (const unsigned char *) s, *end = p + len;
+    for (; p < end && *p < 0x80; p++);
+    if (p == end) return env->NewStringUTF(s);
+
+    jchar *buf = (jchar *) malloc(len * sizeof(jchar));
+    if (!buf) return NULL;
+    size_t n = 0;
+    for (p = (const unsigned char *) s; p < end;) {
+        unsigned int c = *p, need = 0;
+        if (c < 0x80) {
+            buf[n++] = c;
+            p++;
+            continue;
+        }
+        if (c >= 0xc2 && c < 0xe0) { need = 1; c &= 0x1f; }
+        else if (c >= 0xe0 && c < 0xf0) { need = 2; c &= 0x0f; }
+        else if (c >= 0xf0 && c < 0xf5) { need = 3; c &= 0x07; }
+        unsigned int i;
+        for (i = 1; need && i <= need && p + i < end && (p[i] & 0xc0) == 0x80; i++) {
+            c = (c << 6) | (p[i] & 0x3f);
+        }
+        if (!need || i <= need || (need == 2 && (c < 0x800 || (c >= 0xd800 && c < 0xe000)))
+            || (need == 3 && (c < 0x10000 || c > 0x10ffff))) {
+            buf[n++] = 0xfffd;
+            p++;
+            continue;
+        }
+        if (c >= 0x10000) {
+            c -= 0x10000;
+            buf[n++] = 0xd800 | (c >> 10);
+            buf[n++] = 0xdc00 | (c & 0x3ff);
+        } else {
+            buf[n++] = c;
+        }
+        p += need + 1;
+    }
+    jstring result = env->NewString(buf, n);
+    free(buf);
+    return result;
+}
+
+static void throwFileNotFound(JNIEnv *env, int errnum)
+{
+    jclass exClass = env->FindClass("java/io/FileNotFoundException");
+    env->ThrowNew(exClass, strerror(errnum));
+}
+
+static struct mountinfo *readMountinfo(JNIEnv *env, jstring path)
+{
+    char *path_8 = path ? jstring_dup_utf8(env, path) : NULL;
+    if (path && !path_8) return NULL;
+    struct mountinfo *mi = mountinfo_read(path_8);
+    int err = errno;
+    free(path_8);
+    if (!mi) throwFileNotFound(env, err);
+    return mi;
+}
+
+static bool setField(JNIEnv *env, jobjectArray array, jsize index, const char *s)
+{
+    jstring str = newString(env, s);
+    if (!str) return false;
+    env->SetObjectArrayElement(array, index, str);
+    env->DeleteLocalRef(str);
+    return true;
+}
+
+/*
+ * Flatten entries into {id, parent, source, dir, type, opts, super_opts,
+ * root, optional} per mount.
+ */
+static jobjectArray toArray(JNIEnv *env, struct mountinfo_entry **entries, size_t count)
+{
+    char num[16];
+    jobjectArray result = env->NewObjectArray(count * ENTRY_FIELDS, class_string, NULL);
+    if (!result) return NULL;
+    for (size_t i = 0; i < count; i++) {
+        const struct mountinfo_entry *m = entries[i];
+        jsize base = i * ENTRY_FIELDS;
+        snprintf(num, sizeof(num), "%d", m->id);
+        if (!setField(env, result, base, num)) return NULL;
+        snprintf(num, sizeof(num), "%d", m->parent_id);
+        if (!setField(env, result, base + 1, num)
+            || !setField(env, result, base + 2, m->source)
+            || !setField(env, result, base + 3, m->dir)
+            || !setField(env, result, base + 4, m->type)
+            || !setField(env, result, base + 5, m->opts)
+            || !setField(env, result, base + 6, m->super_opts)
+            || !setField(env, result, base + 7, m->root)
+            || !setField(env, result, base + 8, m->optional)) {
+            return NULL;
+        }
+    }
+    return result;
+}
+
+static jobjectArray mountFs_read(JNIEnv *env, jclass clazz, jstring mountinfo)
+{
+    struct mountinfo *mi = readMountinfo(env, mountinfo);
+    if (!mi) return NULL;
+    struct mountinfo_entry **entries = (struct mountinfo_entry **)
+        malloc((mi->count + 1) * sizeof(struct mountinfo_entry *));
+    jobjectArray result = NULL;
+    if (entries) {
+        for (size_t i = 0; i < mi->count; i++) entries[i] = &mi->entries[i];
+        result = toArray(env, entries, mi->count);
+        free(entries);
+    }
+    mountinfo_free(mi);
+    return result;
+}
+
+static jobjectArray mountFs_find(JNIEnv *env, jclass clazz, jstring mountinfo, jstring path)
+{
+    char *path_8 = jstring_dup_utf8(env, path);
+    if (!path_8) return NULL;
+    jobjectArray result = NULL;
+    struct mountinfo *mi = readMountinfo(env, mountinfo);
+    if (mi) {
+        struct mountinfo_entry *m = mountinfo_find(mi, path_8);
+        if (m) result = toArray(env, &m, 1);
+        mountinfo_free(mi);
+    }
+    free(path_8);
+    return result;
+}
+
+static jobjectArray mountFs_under(JNIEnv *env, jclass clazz, jstring mountinfo, jstring path)
+{
+    char *path_8 = jstring_dup_utf8(env, path);
+    if (!path_8) return NULL;
+    jobjectArray result = NULL;
+    struct mountinfo *mi = readMountinfo(env, mountinfo);
+    if (mi) {
+        size_t count;
+        struct mountinfo_entry **entries = mountinfo_under(mi, path_8, &count);
+        if (entries) {
+            result = toArray(env, entries, count);
+            free(entries);
+        }
+        mountinfo_free(mi);
+    }
+    free(path_8);
+    return result;
+}
+
+static const char *classPathName = "com/botbrew/basil/MountFs";
+static JNINativeMethod method_table[] = {
+    { "nativeRead", "(Ljava/lang/String;)[Ljava/lang/String;", (void *) mountFs_read },
+    { "nativeFind", "(Ljava/lang/String;Ljava/lang/String;)[Ljava/lang/String;", (void *) mountFs_find },
+    { "nativeUnder", "(Ljava/lang/String;Ljava/lang/String;)[Ljava/lang/String;", (void *) mountFs_under },
+};
+
+int init_MountFs(JNIEnv *env) {
+    jclass clazz = env->FindClass("java/lang/String");
+    if (clazz == NULL) {
+        return JNI_FALSE;
+    }
+    class_string = (jclass) env->NewGlobalRef(clazz);
+    env->DeleteLocalRef(clazz);
+
+    if (!registerNativeMethods(env, classPathName, method_table,
+                 sizeof(method_table) / sizeof(method_table[0]))) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
@@ -0,0 +1,8 @@
+#ifndef _MOUNTFS_H
+#define _MOUNTFS_H 1
+
+#include "jni.h"
+
+int init_MountFs(JNIEnv *env);
+
+#endif	/* !defined(_MOUNTFS_H) */
@@ -0,0 +1,250 @@
+#include "common.h"
+
+#define LOG_TAG "NaturalSort"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "naturalSort.h"
+
+#define DIGIT_MARK 0x30     // '0'; digits themselves never appear in a key
+#define RUN_MAX 253         // digits per length byte
+
+static jclass class_byteArray;
+
+/*
+ * Keys compare with memcmp in natural order:
+ *
+ *   primary, case-folded: other characters as CESU-8, and each run of
+ *     digits as DIGIT_MARK, 1 + its length without leading zeros, then
+ *     the digits, so longer numbers sort after shorter ones
+ *   0
+ *   secondary: the name as CESU-8, to order names equal but for case
+ *     or leading zeros
+ *
+ * NUL is written as C0 80 like modified UTF-8, so the primary has no 0
+ * bytes and a name sorts before every name it is a prefix of.
+ */
+
+static jchar foldChar(jchar c)
+{
+    if (c >= 'A' && c <= 'Z') return c + ('a' - 'A');
+    if (c < 0xc0) return c;
+    if (c <= 0xde && c != 0xd7) return c + 0x20;                   // Latin-1
+    if (c >= 0x391 && c <= 0x3ab && c != 0x3a2) return c + 0x20;   // Greek
+    if (c >= 0x410 && c <= 0x42f) return c + 0x20;                 // Cyrillic
+    if (c >= 0x400 && c <= 0x40f) return c + 0x50;
+    return c;
+}
+
+static inline bool isDigit(jchar c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static unsigned char *putChar(unsigned char *p, jchar c)
+{
+    if (c && c < 0x80) {
+        *p++ = c;
+    } else if (c < 0x800) {
+        *p++ = 0xc0 | (c >> 6);
+        *p++ = 0x80 | (c & 0x3f);
+    } else {
+        *p++ = 0xe0 | (c >> 12);
+        *p++ = 0x80 | ((c >> 6) & 0x3f);
+        *p++ = 0x80 | (c & 0x3f);
+    }
+    return p;
+}
+
+/* room for the key of a name len characters long: 3 bytes a character at most, twice */
+size_t naturalKeyBound(size_t len)
+{
+    return 6 * len + 1;
+}
+
+static size_t makeKey(const jchar *s, size_t len, unsigned char *key)
+{
+    unsigned char *p = key;
+    size_t i = 0;
+    while (i < len) {
+        if (!isDigit(s[i])) {
+            p = putChar(p, foldChar(s[i++]));
+            continue;
+        }
+        while (i < len && s[i] == '0') i++;
+        size_t n = 0;
+        while (i + n < len && n < RUN_MAX && isDigit(s[i + n])) n++;
+        *p++ = DIGIT_MARK;
+        *p++ = 1 + n;
+        for (; n; n--) *p++ = s[i++];
+    }
+    *p++ = 0;
+    for (i = 0; i < len; i++) p = putChar(p, s[i]);
+    return p - key;
+}
+
+/* UTF-8 to UTF-16, leaving malformed bytes as they are; returns the units written */
+static size_t decodeUTF8(const char *s, size_t len, jchar *out)
+{
+    const unsigned char *p = (const unsigned char *) s, *end = p + len;
+    jchar *o = out;
+    while (p < end) {
+        unsigned c = *p;
+        if (c >= 0xc0 && c < 0xe0 && end - p >= 2 && (p[1] & 0xc0) == 0x80) {
+            *o++ = ((c & 0x1f) << 6) | (p[1] & 0x3f);
+            p += 2;
+        } else if (c >= 0xe0 && c < 0xf0 && end - p >= 3 && (p[1] & 0xc0) == 0x80 && (p[2] & 0xc0) == 0x80) {
+            *o++ = ((c & 0x0f) << 12) | ((p[1] & 0x3f) << 6) | (p[2] & 0x3f);
+            p += 3;
+        } else if (c >= 0xf0 && c < 0xf8 && end - p >= 4 && (p[1] & 0xc0) == 0x80 && (p[2] & 0xc0) == 0x80
+                   && (p[3] & 0xc0) == 0x80) {
+            unsigned u = (((c & 0x07) << 18) | ((p[1] & 0x3f) << 12) | ((p[2] & 0x3f) << 6) | (p[3] & 0x3f)) - 0x10000;
+            *o++ = 0xd800 | ((u >> 10) & 0x3ff);
+            *o++ = 0xdc00 | (u & 0x3ff);
+            p += 4;
+        } else {
+            *o++ = c;
+            p++;
+        }
+    }
+    return o - out;
+}
+
+size_t naturalKeyUTF8(const char *s, size_t len, unsigned char *key)
+{
+    jchar buf[256];
+    jchar *u = len <= sizeof(buf) / sizeof(buf[0]) ? buf : (jchar *) malloc(len * sizeof(jchar));
+    if (!u) return 0;
+    u[0] = 0;   // gcc cannot tell that makeKey() reads only the units decoded
+    size_t n = makeKey(u, decodeUTF8(s, len, u), key);
+    if (u != buf) free(u);
+    return n;
+}
+
+struct Key {
+    const unsigned char *p;
+    size_t len;
+    jint index;
+};
+
+/* key each string into *buf, which the caller frees; false if out of memory */
+static bool makeKeys(JNIEnv *env, jobjectArray names, Key *keys, jsize count, unsigned char **buf)
+{
+    size_t size = 0;
+    *buf = NULL;
+    for (jsize i = 0; i < count; i++) {
+        jstring name = (jstring) env->GetObjectArrayElement(names, i);
+        if (name) size += naturalKeyBound(env->GetStringLength(name));
+        env->DeleteLocalRef(name);
+    }
+    unsigned char *p = *buf = (unsigned char *) malloc(size ? size : 1);
+    if (!p) return false;
+    for (jsize i = 0; i < count; i++) {
+        jstring name = (jstring) env->GetObjectArrayElement(names, i);
+        keys[i].p = p;
+        keys[i].len = 0;
+        keys[i].index = i;
+        if (!name) continue;
+        const jchar *s = env->GetStringChars(name, NULL);
+        if (s) {
+            keys[i].len = makeKey(s, env->GetStringLength(name), p);
+            env->ReleaseStringChars(name, s);
+        }
+        env->DeleteLocalRef(name);
+        p += keys[i].len;
+    }
+    return true;
+}
+
+static int compareKeys(const void *a, const void *b)
+{
+    const Key *x = (const Key *) a;
+    const Key *y = (const Key *) b;
+    int c = memcmp(x->p, y->p, x->len < y->len ? x->len : y->len);
+    if (c) return c;
+    if (x->len != y->len) return (x->len > y->len) - (x->len < y->len);
+    return x->index - y->index;
+}
+
+static void throwOutOfMemory(JNIEnv *env)
+{
+    jclass exClass = env->FindClass("java/lang/OutOfMemoryError");
+    env->ThrowNew(exClass, strerror(ENOMEM));
+}
+
+static jobjectArray naturalSort_keys(JNIEnv *env, jclass clazz, jobjectArray names)
+{
+    jsize count = env->GetArrayLength(names);
+    Key *keys = (Key *) malloc((count ? count : 1) * sizeof(Key));
+    unsigned char *buf = NULL;
+    jobjectArray result = NULL;
+    if (!keys || !makeKeys(env, names, keys, count, &buf)) {
+        throwOutOfMemory(env);
+        goto bail;
+    }
+    if (!(result = env->NewObjectArray(count, class_byteArray, NULL))) goto bail;
+    for (jsize i = 0; i < count; i++) {
+        jbyteArray key = env->NewByteArray(keys[i].len);
+        if (!key) {
+            result = NULL;
+            goto bail;
+        }
+        env->SetByteArrayRegion(key, 0, keys[i].len, (const jbyte *) keys[i].p);
+        env->SetObjectArrayElement(result, i, key);
+        env->DeleteLocalRef(key);
+    }
+
+bail:
+    free(buf);
+    free(keys);
+    return result;
+}
+
+/* the indices of names in natural order; a stable sort */
+static jintArray naturalSort_order(JNIEnv *env, jclass clazz, jobjectArray names)
+{
+    jsize count = env->GetArrayLength(names);
+    Key *keys = (Key *) malloc((count ? count : 1) * sizeof(Key));
+    jint *order = (jint *) malloc((count ? count : 1) * sizeof(jint));
+    unsigned char *buf = NULL;
+    jintArray result = NULL;
+    if (!keys || !order || !makeKeys(env, names, keys, count, &buf)) {
+        throwOutOfMemory(env);
+        goto bail;
+    }
+    qsort(keys, count, sizeof(Key), compareKeys);
+    for (jsize i = 0; i < count; i++) order[i] = keys[i].index;
+    if ((result = env->NewIntArray(count))) env->SetIntArrayRegion(result, 0, count, order);
+
+bail:
+    free(buf);
+    free(order);
+    free(keys);
+    return result;
+}
+
+static const char *classPathName = "com/botbrew/basil/NaturalSort";
+static JNINativeMethod method_table[] = {
+    { "nativeKeys", "([Ljava/lang/String;)[[B", (void *) naturalSort_keys },
+    { "nativeOrder", "([Ljava/lang/String;)[I", (void *) naturalSort_order },
+};
+
+int init_NaturalSort(JNIEnv *env)
+{
+    jclass clazz = env->FindClass("[B");
+    if (clazz == NULL) {
+        return JNI_FALSE;
+    }
+    class_byteArray = (jclass) env->NewGlobalRef(clazz);
+    env->DeleteLocalRef(clazz);
+
+    if (!registerNativeMethods(env, classPathName, method_table,
+                sizeof(method_table) / sizeof(method_table[0]))) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
@@ -0,0 +1,20 @@
+#ifndef _NATURALSORT_H
+#define _NATURALSORT_H 1
+
+#include <stddef.h>
+
+#include "jni.h"
+
+/* bytes needed for the key of a name len UTF-16 units, or UTF-8 bytes, long */
+size_t naturalKeyBound(size_t len);
+
+/*
+ * Write the natural-sort key of the UTF-8 name s to key, which has room
+ * for naturalKeyBound(len) bytes.  Returns its length, at least 1 even
+ * for an empty name, or 0 if out of memory.
+ */
+size_t naturalKeyUTF8(const char *s, size_t len, unsigned char *key);
+
+int init_NaturalSort(JNIEnv *env);
+
+#endif	/* !defined(_NATURALSORT_H) */
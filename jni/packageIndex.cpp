@@ -0,0 +1,990 @@
+#include "common.h"
+
+#define LOG_TAG "PackageIndex"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "packageIndex.h"
+#include "packageSearch.h"
+
+#define STATUS_PATH "/var/lib/dpkg/status"
+#define ARCH_PATH "/var/lib/dpkg/arch"
+#define LISTS_PATH "/var/lib/apt/lists"
+#define LISTS_SUFFIX "_Packages"
+#define ARCH_MAX 32
+#define SNAPSHOT_MAGIC 0x32584950  // "PIX2"
+
+/* first byte of what nativeRead() returns */
+#define RESULT_FULL 'F'         // every package; no usable snapshot
+#define RESULT_DELTA 'D'        // only what changed since the snapshot
+#define RESULT_UNCHANGED 'U'
+#define OP_PUT '+'
+#define OP_REMOVE '-'
+
+struct Span {
+    const char *p;
+    size_t len;
+};
+
+struct Package {
+    Span name;
+    Span version;
+    Span summary;
+    Span status;
+    Span arch;
+    Span candidate;     // highest version available for an enabled architecture
+};
+
+/*
+ * One parsed file.  Files stay mapped and parsed between calls, so a list
+ * that did not change since the last refresh is not parsed again.
+ */
+struct ListFile {
+    char *path;
+    bool dpkg;
+    bool seen;
+    off_t size;
+    time_t mtime;
+    ino_t ino;
+    uint64_t hash;
+    void *addr;
+    size_t len;
+    Package *stanzas;
+    size_t count;
+};
+
+/*
+ * Every package by name.  Strings point into the cached files, so the
+ * cache stays locked while an index is in use.
+ */
+struct Index {
+    Package *pkgs;
+    size_t count;
+    size_t cap;
+    uint32_t *table;    // open addressing; index + 1, 0 if empty
+    size_t mask;
+    char *arch_buf;
+    Span archs[ARCH_MAX];
+    size_t narchs;      // 0 accepts every architecture
+};
+
+/* FNV-1a */
+static uint32_t hashSpan(const Span &s)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < s.len; i++) {
+        h ^= (unsigned char) s.p[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool spanEquals(const Span &a, const Span &b)
+{
+    return a.len == b.len && memcmp(a.p, b.p, a.len) == 0;
+}
+
+/*
+ * memchr() for '\n' a word at a time; bionic's memchr() goes byte by byte,
+ * and this is where nearly all of the parse time is spent.
+ */
+static const char *findNewline(const char *p, const char *end)
+{
+    const uintptr_t ones = (uintptr_t) -1 / 0xff;
+    const uintptr_t highs = ones * 0x80;
+    const uintptr_t nl = ones * '\n';
+    for (; p < end && ((uintptr_t) p & (sizeof(uintptr_t) - 1)); p++) {
+        if (*p == '\n') return p;
+    }
+    for (; p + sizeof(uintptr_t) <= end; p += sizeof(uintptr_t)) {
+        uintptr_t w;
+        memcpy(&w, p, sizeof(w));
+        w ^= nl;
+        if ((w - ones) & ~w & highs) break;
+    }
+    for (; p < end; p++) {
+        if (*p == '\n') return p;
+    }
+    return end;
+}
+
+static int order(int c)
+{
+    if (c >= '0' && c <= '9') return 0;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) return c;
+    if (c == '~') return -1;
+    if (c) return c + 256;
+    return 0;
+}
+
+static bool isDigit(int c)
+{
+    return c >= '0' && c <= '9';
+}
+
+/* dpkg's verrevcmp(): alternating non-digit and digit runs; '~' sorts before everything */
+static int compareFragment(const char *a, const char *a_end, const char *b, const char *b_end)
+{
+#define AT(p, end) ((p) < (end) ? (unsigned char) *(p) : 0)
+    while (a < a_end || b < b_end) {
+        int first_diff = 0;
+        while ((a < a_end && !isDigit(*a)) || (b < b_end && !isDigit(*b))) {
+            int ac = order(AT(a, a_end));
+            int bc = order(AT(b, b_end));
+            if (ac != bc) return ac - bc;
+            a++;
+            b++;
+        }
+        while (a < a_end && *a == '0') a++;
+        while (b < b_end && *b == '0') b++;
+        while (isDigit(AT(a, a_end)) && isDigit(AT(b, b_end))) {
+            if (!first_diff) first_diff = *a - *b;
+            a++;
+            b++;
+        }
+        if (isDigit(AT(a, a_end))) return 1;
+        if (isDigit(AT(b, b_end))) return -1;
+        if (first_diff) return first_diff;
+    }
+    return 0;
+#undef AT
+}
+
+/* [epoch:]upstream[-revision] */
+static void splitVersion(const Span &v, unsigned long *epoch, Span *upstream, Span *revision)
+{
+    const char *p = v.p, *end = v.p + v.len;
+    const char *colon = (const char *) memchr(p, ':', v.len);
+    *epoch = 0;
+    if (colon) {
+        for (; p < colon && isDigit(*p); p++) *epoch = *epoch * 10 + (*p - '0');
+        p = colon + 1;
+    }
+    const char *hyphen = NULL;
+    for (const char *q = p; q < end; q++) {
+        if (*q == '-') hyphen = q;
+    }
+    upstream->p = p;
+    upstream->len = (hyphen ? hyphen : end) - p;
+    revision->p = hyphen ? hyphen + 1 : end;
+    revision->len = hyphen ? end - hyphen - 1 : 0;
+}
+
+/* <0, 0 or >0 as a is older than, the same as or newer than b, like dpkg --compare-versions */
+static int compareVersions(const Span &a, const Span &b)
+{
+    unsigned long a_epoch, b_epoch;
+    Span a_up, a_rev, b_up, b_rev;
+    splitVersion(a, &a_epoch, &a_up, &a_rev);
+    splitVersion(b, &b_epoch, &b_up, &b_rev);
+    if (a_epoch != b_epoch) return a_epoch > b_epoch ? 1 : -1;
+    int res = compareFragment(a_up.p, a_up.p + a_up.len, b_up.p, b_up.p + b_up.len);
+    if (res) return res;
+    return compareFragment(a_rev.p, a_rev.p + a_rev.len, b_rev.p, b_rev.p + b_rev.len);
+}
+
+static bool archEnabled(const Index *idx, const Span &arch)
+{
+    if (!idx->narchs || !arch.len) return true;
+    if (arch.len == 3 && memcmp(arch.p, "all", 3) == 0) return true;
+    for (size_t i = 0; i < idx->narchs; i++) {
+        if (spanEquals(idx->archs[i], arch)) return true;
+    }
+    return false;
+}
+
+/* take ownership of a comma, space or newline separated list */
+static void setArchs(Index *idx, char *list)
+{
+    idx->arch_buf = list;
+    idx->narchs = 0;
+    for (char *p = list; *p && idx->narchs < ARCH_MAX;) {
+        size_t len = strcspn(p, ", \t\r\n");
+        if (len) {
+            idx->archs[idx->narchs].p = p;
+            idx->archs[idx->narchs++].len = len;
+        }
+        p += len;
+        if (*p) p++;
+    }
+}
+
+/* dpkg's native and foreign architectures, as written by pm_writeconf() */
+static void readArchs(Index *idx, const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    char *buf = (char *) malloc(4096);
+    ssize_t len = buf ? read(fd, buf, 4095) : -1;
+    close(fd);
+    if (len <= 0) {
+        free(buf);
+        return;
+    }
+    buf[len] = 0;
+    setArchs(idx, buf);
+}
+
+static bool growTable(Index *idx)
+{
+    size_t buckets = (idx->mask + 1) * 2;
+    uint32_t *table = (uint32_t *) calloc(buckets, sizeof(uint32_t));
+    if (!table) return false;
+    for (size_t i = 0; i < idx->count; i++) {
+        size_t h = hashSpan(idx->pkgs[i].name) & (buckets - 1);
+        while (table[h]) h = (h + 1) & (buckets - 1);
+        table[h] = i + 1;
+    }
+    free(idx->table);
+    idx->table = table;
+    idx->mask = buckets - 1;
+    return true;
+}
+
+/* the package called name, added if new; NULL if out of memory */
+static Package *lookup(Index *idx, const Span &name)
+{
+    size_t h = hashSpan(name) & idx->mask;
+    for (; idx->table[h]; h = (h + 1) & idx->mask) {
+        Package *pkg = &idx->pkgs[idx->table[h] - 1];
+        if (spanEquals(pkg->name, name)) return pkg;
+    }
+    if (idx->count == idx->cap) {
+        size_t cap = idx->cap * 2;
+        Package *pkgs = (Package *) realloc(idx->pkgs, cap * sizeof(Package));
+        if (!pkgs) return NULL;
+        idx->pkgs = pkgs;
+        idx->cap = cap;
+    }
+    if (idx->count * 2 >= idx->mask) {
+        if (!growTable(idx)) return NULL;
+        for (h = hashSpan(name) & idx->mask; idx->table[h]; h = (h + 1) & idx->mask);
+    }
+    Package *pkg = &idx->pkgs[idx->count];
+    memset(pkg, 0, sizeof(*pkg));
+    pkg->name = name;
+    idx->table[h] = ++idx->count;
+    return pkg;
+}
+
+static bool matchField(const char *p, const char *eol, const char *field, size_t len, Span *value)
+{
+    if ((size_t) (eol - p) < len || memcmp(p, field, len) != 0) return false;
+    for (p += len; p < eol && (*p == ' ' || *p == '\t'); p++);
+    while (eol > p && (eol[-1] == ' ' || eol[-1] == '\t' || eol[-1] == '\r')) eol--;
+    value->p = p;
+    value->len = eol - p;
+    return true;
+}
+
+#define MATCH(field, value) matchField(p, eol, field, sizeof(field) - 1, value)
+
+/* fields of interest from the first line of one field */
+static void parseField(Package *cur, const char *p, const char *eol)
+{
+    switch (*p) {
+        case 'P':
+            MATCH("Package:", &cur->name);
+            break;
+        case 'V':
+            MATCH("Version:", &cur->version);
+            break;
+        case 'S':
+            MATCH("Status:", &cur->status);
+            break;
+        case 'D':
+            MATCH("Description:", &cur->summary);
+            break;
+        case 'A':
+            MATCH("Architecture:", &cur->arch);
+            break;
+    }
+}
+
+static void appendSpan(char **out, const Span &s)
+{
+    memcpy(*out, s.p, s.len);
+    *out += s.len;
+    *(*out)++ = 0;
+}
+
+/*
+ * Fold one stanza into the index.  dpkg's own record wins for the version
+ * and status; the first list to mention a package supplies the rest, and
+ * the highest version for an enabled architecture becomes the candidate.
+ */
+static bool addStanza(Index *idx, const Package &cur, bool dpkg)
+{
+    Package *pkg = lookup(idx, cur.name);
+    if (!pkg) return false;
+    if (dpkg) {
+        pkg->version = cur.version;
+        pkg->status = cur.status;
+    } else {
+        if (!pkg->version.len) pkg->version = cur.version;
+        if (cur.version.len && archEnabled(idx, cur.arch)
+            && (!pkg->candidate.len || compareVersions(cur.version, pkg->candidate) > 0)) {
+            pkg->candidate = cur.version;
+        }
+    }
+    if (!pkg->summary.len) pkg->summary = cur.summary;
+    return true;
+}
+
+static bool appendStanza(Package **stanzas, size_t *count, size_t *cap, const Package &cur)
+{
+    if (!cur.name.len) return true;
+    if (*count == *cap) {
+        size_t n = *cap ? *cap * 2 : 256;
+        Package *tmp = (Package *) realloc(*stanzas, n * sizeof(Package));
+        if (!tmp) return false;
+        *stanzas = tmp;
+        *cap = n;
+    }
+    (*stanzas)[(*count)++] = cur;
+    return true;
+}
+
+/* RFC 822 stanzas separated by blank lines; continuation lines start with whitespace */
+static bool parseStanzas(Package **stanzas, size_t *count, const char *p, const char *end)
+{
+    Package cur;
+    size_t cap = 0;
+    memset(&cur, 0, sizeof(cur));
+    *stanzas = NULL;
+    *count = 0;
+    while (p < end) {
+        const char *eol = findNewline(p, end);
+        if (eol == p || (eol == p + 1 && *p == '\r')) {
+            if (!appendStanza(stanzas, count, &cap, cur)) return false;
+            memset(&cur, 0, sizeof(cur));
+        } else if (*p != ' ' && *p != '\t') {
+            parseField(&cur, p, eol);
+        }
+        p = eol + 1;
+    }
+    return appendStanza(stanzas, count, &cap, cur);
+}
+
+/* a quick 64-bit content hash, a word at a time */
+static uint64_t hashContent(const char *p, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL ^ len;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t w;
+        memcpy(&w, p + i, sizeof(w));
+        h = (h ^ w) * 1099511628211ULL;
+        h ^= h >> 29;
+    }
+    for (; i < len; i++) h = (h ^ (unsigned char) p[i]) * 1099511628211ULL;
+    return h;
+}
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static ListFile *cache;
+static size_t cache_count;
+
+static void releaseFile(ListFile *lf)
+{
+    if (lf->addr) munmap(lf->addr, lf->len);
+    free(lf->stanzas);
+    lf->addr = NULL;
+    lf->len = 0;
+    lf->stanzas = NULL;
+    lf->count = 0;
+}
+
+static ListFile *cachedFile(const char *path)
+{
+    for (size_t i = 0; i < cache_count; i++) {
+        if (strcmp(cache[i].path, path) == 0) return &cache[i];
+    }
+    ListFile *tmp = (ListFile *) realloc(cache, (cache_count + 1) * sizeof(ListFile));
+    if (!tmp) return NULL;
+    cache = tmp;
+    ListFile *lf = &cache[cache_count];
+    memset(lf, 0, sizeof(*lf));
+    if (!(lf->path = strdup(path))) return NULL;
+    cache_count++;
+    return lf;
+}
+
+/*
+ * Bring the cache entry for path up to date: reuse it if size, mtime and
+ * inode are unchanged, or if the content hashes the same; parse it
+ * otherwise.  Returns errno, or 0.
+ */
+static int loadFile(const char *path, const struct stat &st, bool dpkg)
+{
+    ListFile *lf = cachedFile(path);
+    if (!lf) return ENOMEM;
+    lf->seen = true;
+    lf->dpkg = dpkg;
+    if (lf->size == st.st_size && lf->mtime == st.st_mtime && lf->ino == st.st_ino && (lf->addr || !st.st_size)) {
+        return 0;
+    }
+    void *addr = NULL;
+    if (st.st_size) {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) return errno;
+        addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        int err = errno;
+        close(fd);
+        if (addr == MAP_FAILED) return err;
+    }
+    const char *p = (const char *) addr;
+    uint64_t hash = hashContent(p, st.st_size);
+    if (lf->addr && lf->len == (size_t) st.st_size && lf->hash == hash) {
+        // touched but not changed
+        munmap(addr, st.st_size);
+    } else {
+        Package *stanzas;
+        size_t count;
+        if (addr) madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        if (!parseStanzas(&stanzas, &count, p, p + st.st_size)) {
+            free(stanzas);
+            if (addr) munmap(addr, st.st_size);
+            return ENOMEM;
+        }
+        releaseFile(lf);
+        lf->addr = addr;
+        lf->len = st.st_size;
+        lf->stanzas = stanzas;
+        lf->count = count;
+        lf->hash = hash;
+    }
+    lf->size = st.st_size;
+    lf->mtime = st.st_mtime;
+    lf->ino = st.st_ino;
+    return 0;
+}
+
+/* drop files that were not seen by this refresh, and reset the marks */
+static void pruneCache()
+{
+    size_t n = 0;
+    for (size_t i = 0; i < cache_count; i++) {
+        if (cache[i].seen) {
+            cache[i].seen = false;
+            cache[n++] = cache[i];
+        } else {
+            releaseFile(&cache[i]);
+            free(cache[i].path);
+        }
+    }
+    cache_count = n;
+}
+
+static void freeIndex(Index *idx)
+{
+    free(idx->pkgs);
+    free(idx->table);
+    free(idx->arch_buf);
+}
+
+/* files to read, dpkg's status first and the lists in a stable order */
+struct Sources {
+    char **paths;
+    struct stat *stats;
+    size_t count;
+};
+
+static int comparePaths(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+static void freeSources(Sources *src)
+{
+    for (size_t i = 0; i < src->count; i++) free(src->paths[i]);
+    free(src->paths);
+    free(src->stats);
+}
+
+static bool addSource(Sources *src, size_t *cap, const char *path)
+{
+    if (src->count == *cap) {
+        size_t n = *cap ? *cap * 2 : 16;
+        char **paths = (char **) realloc(src->paths, n * sizeof(char *));
+        if (!paths) return false;
+        src->paths = paths;
+        *cap = n;
+    }
+    if (!(src->paths[src->count] = strdup(path))) return false;
+    src->count++;
+    return true;
+}
+
+static int findSources(Sources *src, const char *root)
+{
+    size_t cap = 0;
+    memset(src, 0, sizeof(*src));
+    size_t root_len = strlen(root);
+    char *path = (char *) malloc(root_len + sizeof(LISTS_PATH) + NAME_MAX + 2);
+    if (!path) return ENOMEM;
+    memcpy(path, root, root_len);
+    memcpy(path + root_len, STATUS_PATH, sizeof(STATUS_PATH));
+    int err = addSource(src, &cap, path) ? 0 : ENOMEM;
+    memcpy(path + root_len, LISTS_PATH, sizeof(LISTS_PATH));
+    DIR *dir = err ? NULL : opendir(path);
+    if (dir) {
+        size_t dir_len = root_len + sizeof(LISTS_PATH) - 1;
+        path[dir_len] = '/';
+        struct dirent *de;
+        while (!err && (de = readdir(dir))) {
+            size_t len = strlen(de->d_name);
+            if (len <= sizeof(LISTS_SUFFIX) - 1
+                || memcmp(de->d_name + len - (sizeof(LISTS_SUFFIX) - 1), LISTS_SUFFIX, sizeof(LISTS_SUFFIX) - 1) != 0) {
+                continue;
+            }
+            memcpy(path + dir_len + 1, de->d_name, len + 1);
+            if (!addSource(src, &cap, path)) err = ENOMEM;
+        }
+        closedir(dir);
+        if (src->count > 1) qsort(src->paths + 1, src->count - 1, sizeof(char *), comparePaths);
+    }
+    free(path);
+    if (err) return err;
+    src->stats = (struct stat *) malloc(src->count * sizeof(struct stat));
+    if (!src->stats) return ENOMEM;
+    size_t n = 0;
+    for (size_t i = 0; i < src->count; i++) {
+        if (stat(src->paths[i], &src->stats[n]) < 0) {
+            if (i == 0) return errno;       // no dpkg status, no root
+            free(src->paths[i]);            // raced with apt-get update
+            continue;
+        }
+        src->paths[n++] = src->paths[i];
+    }
+    src->count = n;
+    return 0;
+}
+
+/*
+ * Merge the sources into idx through the cache; returns errno, or 0.
+ * archs limits candidates like APT::Architectures, and defaults to dpkg's
+ * architectures.  Call with cache_lock held.
+ */
+static int readIndex(Index *idx, const Sources &src, const char *root, const char *archs)
+{
+    memset(idx, 0, sizeof(*idx));
+    idx->cap = 1024;
+    idx->mask = 2047;
+    idx->pkgs = (Package *) malloc(idx->cap * sizeof(Package));
+    idx->table = (uint32_t *) calloc(idx->mask + 1, sizeof(uint32_t));
+    if (!idx->pkgs || !idx->table) return ENOMEM;
+    if (archs) {
+        char *list = strdup(archs);
+        if (list) setArchs(idx, list);
+    } else {
+        char *path = (char *) malloc(strlen(root) + sizeof(ARCH_PATH));
+        if (!path) return ENOMEM;
+        strcpy(path, root);
+        strcat(path, ARCH_PATH);
+        readArchs(idx, path);
+        free(path);
+    }
+    for (size_t i = 0; i < src.count; i++) {
+        int err = loadFile(src.paths[i], src.stats[i], i == 0);
+        if (err) return err;
+    }
+    pruneCache();
+    for (size_t i = 0; i < src.count; i++) {
+        const ListFile *lf = cachedFile(src.paths[i]);
+        for (size_t j = 0; j < lf->count; j++) {
+            if (!addStanza(idx, lf->stanzas[j], lf->dpkg)) return ENOMEM;
+        }
+    }
+    return 0;
+}
+
+static const Span installedStatus = { "install ok installed", sizeof("install ok installed") - 1 };
+
+/* the candidate if the package is installed and the candidate is newer */
+static Span upgradable(const Package &pkg)
+{
+    static const Span none = { "", 0 };
+    if (!pkg.candidate.len || !spanEquals(pkg.status, installedStatus)) return none;
+    return compareVersions(pkg.candidate, pkg.version) > 0 ? pkg.candidate : none;
+}
+
+static uint64_t hashBytes(uint64_t h, const Span &s)
+{
+    for (size_t i = 0; i < s.len; i++) h = (h ^ (unsigned char) s.p[i]) * 1099511628211ULL;
+    return (h ^ 0xff) * 1099511628211ULL;   // separator
+}
+
+/* what the packagecache row for pkg holds */
+static uint64_t hashRow(const Package &pkg)
+{
+    static const Span none = { "", 0 };
+    uint64_t h = 14695981039346656037ULL;
+    h = hashBytes(h, spanEquals(pkg.status, installedStatus) ? pkg.version : none);
+    h = hashBytes(h, pkg.summary);
+    return hashBytes(h, upgradable(pkg));
+}
+
+/*
+ * What the package cache was last built from: the fingerprint of every
+ * source and the architectures, and a hash of every row, sorted by the
+ * hash of the package name.
+ */
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t nfiles;
+    uint32_t nrows;
+    uint32_t archs;     // offset into the string pool
+    uint32_t pool_size;
+    uint32_t reserved;
+};
+
+struct SnapshotFile {
+    uint64_t size;
+    int64_t mtime;
+    uint64_t ino;
+    uint32_t path;
+    uint32_t reserved;
+};
+
+struct SnapshotRow {
+    uint64_t name_hash;
+    uint64_t row_hash;
+    uint32_t name;
+    uint32_t index;     // into the new index; unused once written
+};
+
+struct Snapshot {
+    SnapshotHeader header;
+    SnapshotFile *files;
+    SnapshotRow *rows;
+    char *pool;
+    char *buf;
+};
+
+static bool readSnapshot(Snapshot *snap, const char *path)
+{
+    memset(snap, 0, sizeof(*snap));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(SnapshotHeader)
+        && (snap->buf = (char *) malloc(st.st_size + 1)) != NULL;
+    size_t done = 0;
+    while (ok && done < (size_t) st.st_size) {
+        ssize_t n = read(fd, snap->buf + done, st.st_size - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) ok = false;
+        else done += n;
+    }
+    close(fd);
+    if (ok) {
+        memcpy(&snap->header, snap->buf, sizeof(SnapshotHeader));
+        const SnapshotHeader &h = snap->header;
+        size_t size = sizeof(SnapshotHeader) + h.nfiles * sizeof(SnapshotFile) + h.nrows * sizeof(SnapshotRow) + h.pool_size;
+        ok = h.magic == SNAPSHOT_MAGIC && size == (size_t) st.st_size && h.archs < h.pool_size;
+    }
+    if (!ok) {
+        free(snap->buf);
+        snap->buf = NULL;
+        return false;
+    }
+    snap->files = (SnapshotFile *) (snap->buf + sizeof(SnapshotHeader));
+    snap->rows = (SnapshotRow *) (snap->files + snap->header.nfiles);
+    snap->pool = (char *) (snap->rows + snap->header.nrows);
+    snap->pool[snap->header.pool_size - 1] = 0;
+    // packDelta() reads old names straight out of the pool
+    for (size_t i = 0; ok && i < snap->header.nfiles; i++) ok = snap->files[i].path < snap->header.pool_size;
+    for (size_t i = 0; ok && i < snap->header.nrows; i++) ok = snap->rows[i].name < snap->header.pool_size;
+    if (!ok) {
+        free(snap->buf);
+        memset(snap, 0, sizeof(*snap));
+        return false;
+    }
+    return true;
+}
+
+/* nothing to do if every source still has the same size, mtime and inode */
+static bool snapshotCurrent(const Snapshot &snap, const Sources &src, const char *archs)
+{
+    if (!snap.buf || snap.header.nfiles != src.count) return false;
+    if (strcmp(snap.pool + snap.header.archs, archs ? archs : "") != 0) return false;
+    for (size_t i = 0; i < src.count; i++) {
+        const SnapshotFile &f = snap.files[i];
+        const struct stat &st = src.stats[i];
+        if (f.path >= snap.header.pool_size || strcmp(snap.pool + f.path, src.paths[i]) != 0
+            || f.size != (uint64_t) st.st_size || f.mtime != (int64_t) st.st_mtime || f.ino != (uint64_t) st.st_ino) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int compareRows(const void *a, const void *b)
+{
+    uint64_t x = ((const SnapshotRow *) a)->name_hash;
+    uint64_t y = ((const SnapshotRow *) b)->name_hash;
+    return (x > y) - (x < y);
+}
+
+static bool writeAll(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *) buf;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * write path + ".new", for Java to rename over path once the delta is
+ * applied; on failure there is no ".new", which Java takes to mean the
+ * snapshot is gone
+ */
+static void writeSnapshot(const char *path, const Sources &src, const char *archs,
+                          const Index &idx, SnapshotRow *rows)
+{
+    size_t pool_size = (archs ? strlen(archs) : 0) + 1;
+    for (size_t i = 0; i < src.count; i++) pool_size += strlen(src.paths[i]) + 1;
+    for (size_t i = 0; i < idx.count; i++) pool_size += idx.pkgs[i].name.len + 1;
+    char *pool = (char *) malloc(pool_size);
+    SnapshotFile *files = (SnapshotFile *) calloc(src.count ? src.count : 1, sizeof(SnapshotFile));
+    char *tmp = (char *) malloc(strlen(path) + sizeof(".new"));
+    if (pool && files && tmp) {
+        char *out = pool;
+        SnapshotHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = SNAPSHOT_MAGIC;
+        h.nfiles = src.count;
+        h.nrows = idx.count;
+        h.pool_size = pool_size;
+        h.archs = 0;
+        Span s = { archs ? archs : "", archs ? strlen(archs) : 0 };
+        appendSpan(&out, s);
+        for (size_t i = 0; i < src.count; i++) {
+            files[i].size = src.stats[i].st_size;
+            files[i].mtime = src.stats[i].st_mtime;
+            files[i].ino = src.stats[i].st_ino;
+            files[i].path = out - pool;
+            s.p = src.paths[i];
+            s.len = strlen(src.paths[i]);
+            appendSpan(&out, s);
+        }
+        for (size_t i = 0; i < idx.count; i++) {
+            rows[i].name = out - pool;
+            appendSpan(&out, idx.pkgs[rows[i].index].name);
+        }
+        strcpy(tmp, path);
+        strcat(tmp, ".new");
+        int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd >= 0) {
+            bool ok = writeAll(fd, &h, sizeof(h))
+                && writeAll(fd, files, src.count * sizeof(SnapshotFile))
+                && writeAll(fd, rows, idx.count * sizeof(SnapshotRow))
+                && writeAll(fd, pool, pool_size);
+            int err = errno;
+            close(fd);
+            if (!ok) {
+                unlink(tmp);
+                LOGW("cannot write snapshot %s: %s", path, strerror(err));
+            }
+        } else {
+            LOGW("cannot write snapshot %s: %s", path, strerror(errno));
+        }
+    }
+    free(tmp);
+    free(files);
+    free(pool);
+}
+
+/* write path + ".new" alongside the snapshot, from the same index */
+static void writeSearch(const char *path, const Index &idx)
+{
+    SearchEntry *entries = (SearchEntry *) malloc((idx.count ? idx.count : 1) * sizeof(SearchEntry));
+    char *tmp = (char *) malloc(strlen(path) + sizeof(".new"));
+    int err = ENOMEM;
+    if (entries && tmp) {
+        for (size_t i = 0; i < idx.count; i++) {
+            entries[i].name = idx.pkgs[i].name.p;
+            entries[i].name_len = idx.pkgs[i].name.len;
+            entries[i].summary = idx.pkgs[i].summary.p;
+            entries[i].summary_len = idx.pkgs[i].summary.len;
+        }
+        strcpy(tmp, path);
+        strcat(tmp, ".new");
+        err = writeSearchIndex(tmp, entries, idx.count);
+    }
+    if (err) LOGW("cannot write search index %s: %s", path, strerror(err));
+    free(tmp);
+    free(entries);
+}
+
+static void throwIOException(JNIEnv *env, int errnum)
+{
+    jclass exClass = env->FindClass(errnum == ENOENT ? "java/io/FileNotFoundException" : "java/io/IOException");
+    env->ThrowNew(exClass, strerror(errnum));
+}
+
+static jbyteArray toByteArray(JNIEnv *env, const char *buf, size_t size)
+{
+    jbyteArray result = env->NewByteArray(size);
+    if (result) env->SetByteArrayRegion(result, 0, size, (const jbyte *) buf);
+    return result;
+}
+
+/* the record for a put: {name, version, summary, status, upgradable} */
+static size_t recordSize(const Package &pkg)
+{
+    return 1 + pkg.name.len + pkg.version.len + pkg.summary.len + pkg.status.len + upgradable(pkg).len + 5;
+}
+
+static void appendRecord(char **out, const Package &pkg)
+{
+    *(*out)++ = OP_PUT;
+    appendSpan(out, pkg.name);
+    appendSpan(out, pkg.version);
+    appendSpan(out, pkg.summary);
+    appendSpan(out, pkg.status);
+    appendSpan(out, upgradable(pkg));
+}
+
+/*
+ * Compare the new rows against the snapshot and pack the records for Java:
+ * puts for every package with no old row or a different one, and removals
+ * for old rows with no package; or puts for everything without a snapshot.
+ */
+static jbyteArray packDelta(JNIEnv *env, const Index &idx, SnapshotRow *rows, const Snapshot &snap)
+{
+    const bool full = snap.buf == NULL;
+    const SnapshotRow *old = snap.rows;
+    const size_t nold = full ? 0 : snap.header.nrows;
+    size_t size = 1, i, j;
+    for (i = 0, j = 0; i < idx.count || j < nold;) {
+        if (j == nold || (i < idx.count && rows[i].name_hash < old[j].name_hash)) {
+            size += recordSize(idx.pkgs[rows[i++].index]);
+        } else if (i == idx.count || old[j].name_hash < rows[i].name_hash) {
+            size += 2 + strlen(snap.pool + old[j++].name);
+        } else {
+            if (rows[i].row_hash != old[j].row_hash) size += recordSize(idx.pkgs[rows[i].index]);
+            i++;
+            j++;
+        }
+    }
+    char *buf = (char *) malloc(size);
+    if (!buf) {
+        throwIOException(env, ENOMEM);
+        return NULL;
+    }
+    char *out = buf;
+    *out++ = full ? RESULT_FULL : RESULT_DELTA;
+    for (i = 0, j = 0; i < idx.count || j < nold;) {
+        if (j == nold || (i < idx.count && rows[i].name_hash < old[j].name_hash)) {
+            appendRecord(&out, idx.pkgs[rows[i++].index]);
+        } else if (i == idx.count || old[j].name_hash < rows[i].name_hash) {
+            Span name = { snap.pool + old[j].name, strlen(snap.pool + old[j].name) };
+            *out++ = OP_REMOVE;
+            appendSpan(&out, name);
+            j++;
+        } else {
+            if (rows[i].row_hash != old[j].row_hash) appendRecord(&out, idx.pkgs[rows[i].index]);
+            i++;
+            j++;
+        }
+    }
+    jbyteArray result = toByteArray(env, buf, size);
+    free(buf);
+    return result;
+}
+
+/*
+ * Packed records of every package that changed since the snapshot (if
+ * any), which is then rewritten as snapshot + ".new", along with the
+ * search index as search + ".new".  See PackageIndex.java for the layout.
+ */
+static jbyteArray packageIndex_read(JNIEnv *env, jclass clazz, jstring root, jstring archs, jstring snapshot,
+                                    jstring search)
+{
+    const char *root_8 = env->GetStringUTFChars(root, NULL);
+    const char *archs_8 = archs ? env->GetStringUTFChars(archs, NULL) : NULL;
+    const char *snapshot_8 = snapshot ? env->GetStringUTFChars(snapshot, NULL) : NULL;
+    const char *search_8 = search ? env->GetStringUTFChars(search, NULL) : NULL;
+    jbyteArray result = NULL;
+    if (!root_8 || (archs && !archs_8) || (snapshot && !snapshot_8) || (search && !search_8)) goto bail;
+
+    {
+        Sources src;
+        Snapshot snap;
+        int err = findSources(&src, root_8);
+        if (err) {
+            freeSources(&src);
+            throwIOException(env, err);
+            goto bail;
+        }
+        memset(&snap, 0, sizeof(snap));
+        if (snapshot_8) readSnapshot(&snap, snapshot_8);
+        if (snapshotCurrent(snap, src, archs_8) && (!search_8 || access(search_8, F_OK) == 0)) {
+            char unchanged = RESULT_UNCHANGED;
+            result = toByteArray(env, &unchanged, 1);
+        } else {
+            Index idx;
+            pthread_mutex_lock(&cache_lock);
+            err = readIndex(&idx, src, root_8, archs_8);
+            SnapshotRow *rows = err ? NULL : (SnapshotRow *) malloc((idx.count ? idx.count : 1) * sizeof(SnapshotRow));
+            if (rows) {
+                for (size_t i = 0; i < idx.count; i++) {
+                    const Package &pkg = idx.pkgs[i];
+                    rows[i].name_hash = hashBytes(14695981039346656037ULL, pkg.name);
+                    rows[i].row_hash = hashRow(pkg);
+                    rows[i].index = i;
+                }
+                qsort(rows, idx.count, sizeof(SnapshotRow), compareRows);
+                result = packDelta(env, idx, rows, snap);
+                if (result && snapshot_8) writeSnapshot(snapshot_8, src, archs_8, idx, rows);
+                if (result && search_8) writeSearch(search_8, idx);
+                free(rows);
+            } else {
+                throwIOException(env, err ? err : ENOMEM);
+            }
+            freeIndex(&idx);
+            pthread_mutex_unlock(&cache_lock);
+        }
+        free(snap.buf);
+        freeSources(&src);
+    }
+
+bail:
+    if (search_8) env->ReleaseStringUTFChars(search, search_8);
+    if (snapshot_8) env->ReleaseStringUTFChars(snapshot, snapshot_8);
+    if (archs_8) env->ReleaseStringUTFChars(archs, archs_8);
+    if (root_8) env->ReleaseStringUTFChars(root, root_8);
+    return result;
+}
+
+static const char *classPathName = "com/botbrew/basil/PackageIndex";
+static JNINativeMethod method_table[] = {
+    { "nativeRead", "(Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;Ljava/lang/String;)[B",
+            (void *) packageIndex_read },
+};
+
+int init_PackageIndex(JNIEnv *env) {
+    if (!registerNativeMethods(env, classPathName, method_table,
+                 sizeof(method_table) / sizeof(method_table[0]))) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
@@ -0,0 +1,8 @@
+#ifndef _PACKAGEINDEX_H
+#define _PACKAGEINDEX_H 1
+
+#include "jni.h"
+
+int init_PackageIndex(JNIEnv *env);
+
+#endif	/* !defined(_PACKAGEINDEX_H) */
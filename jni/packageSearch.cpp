@@ -0,0 +1,710 @@
+#include "common.h"
+
+#define LOG_TAG "PackageSearch"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "packageSearch.h"
+
+#define SEARCH_MAGIC 0x31585350  // "PSX1"
+#define QUERY_MAX 256
+#define TERM_MAX 8
+#define FRAGMENT_MAX 16
+
+/*
+ * The index is written once per refresh and only ever mapped read-only:
+ *
+ *   SearchHeader
+ *   SearchDoc[count]             sorted by name, so a prefix is a range
+ *   SearchTrigram[ntrigrams]     sorted by key
+ *   postings                     per trigram, ascending doc numbers as
+ *                                LEB128 deltas
+ *   string pool                  NUL-terminated names and summaries
+ *
+ * Trigrams are taken from the ASCII-folded name and summary separately,
+ * so none spans the two.
+ */
+struct SearchHeader {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t ntrigrams;
+    uint32_t postings_size;
+    uint32_t pool_size;
+    uint32_t reserved;
+};
+
+struct SearchDoc {
+    uint32_t name;          // offsets into the string pool
+    uint32_t name_len;
+    uint32_t summary;
+    uint32_t summary_len;
+};
+
+struct SearchTrigram {
+    uint32_t key;
+    uint32_t postings;      // offset into the postings
+    uint32_t count;
+};
+
+static inline unsigned char fold(unsigned char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline uint32_t trigramAt(const char *p)
+{
+    return (fold(p[0]) << 16) | (fold(p[1]) << 8) | fold(p[2]);
+}
+
+static int compareEntries(const void *a, const void *b)
+{
+    const SearchEntry *x = (const SearchEntry *) a;
+    const SearchEntry *y = (const SearchEntry *) b;
+    int c = memcmp(x->name, y->name, x->name_len < y->name_len ? x->name_len : y->name_len);
+    if (c) return c;
+    return (x->name_len > y->name_len) - (x->name_len < y->name_len);
+}
+
+static int compareKeys(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *) a;
+    uint32_t y = *(const uint32_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* the distinct trigrams of an entry, sorted; returns how many, or -1 */
+static ssize_t entryTrigrams(const SearchEntry &e, uint32_t **buf, size_t *cap)
+{
+    size_t need = (e.name_len > 2 ? e.name_len - 2 : 0) + (e.summary_len > 2 ? e.summary_len - 2 : 0);
+    if (need > *cap) {
+        uint32_t *tmp = (uint32_t *) realloc(*buf, need * sizeof(uint32_t));
+        if (!tmp) return -1;
+        *buf = tmp;
+        *cap = need;
+    }
+    size_t n = 0, i;
+    for (i = 0; i + 3 <= e.name_len; i++) (*buf)[n++] = trigramAt(e.name + i);
+    for (i = 0; i + 3 <= e.summary_len; i++) (*buf)[n++] = trigramAt(e.summary + i);
+    if (!n) return 0;
+    qsort(*buf, n, sizeof(uint32_t), compareKeys);
+    size_t m = 1;
+    for (i = 1; i < n; i++) {
+        if ((*buf)[i] != (*buf)[m - 1]) (*buf)[m++] = (*buf)[i];
+    }
+    return m;
+}
+
+struct Gram {
+    uint32_t key;
+    uint32_t count;
+    uint32_t offset;    // into the unencoded postings
+    uint32_t fill;
+};
+
+struct GramTable {
+    Gram *grams;
+    size_t count;
+    size_t cap;
+    uint32_t *slots;    // open addressing; index + 1, 0 if empty
+    size_t mask;
+};
+
+static inline size_t gramSlot(uint32_t key, size_t mask)
+{
+    uint32_t h = key * 2654435761U;
+    return (h ^ (h >> 15)) & mask;
+}
+
+static bool rehashGrams(GramTable *t, size_t size)
+{
+    uint32_t *slots = (uint32_t *) calloc(size, sizeof(uint32_t));
+    if (!slots) return false;
+    free(t->slots);
+    t->slots = slots;
+    t->mask = size - 1;
+    for (size_t i = 0; i < t->count; i++) {
+        size_t j = gramSlot(t->grams[i].key, t->mask);
+        while (slots[j]) j = (j + 1) & t->mask;
+        slots[j] = i + 1;
+    }
+    return true;
+}
+
+/* the entry for key, added if absent; NULL if out of memory */
+static Gram *findGram(GramTable *t, uint32_t key)
+{
+    size_t j = gramSlot(key, t->mask);
+    while (t->slots[j]) {
+        Gram *g = &t->grams[t->slots[j] - 1];
+        if (g->key == key) return g;
+        j = (j + 1) & t->mask;
+    }
+    if (t->count == t->cap) {
+        size_t cap = t->cap ? 2 * t->cap : 4096;
+        Gram *tmp = (Gram *) realloc(t->grams, cap * sizeof(Gram));
+        if (!tmp) return NULL;
+        t->grams = tmp;
+        t->cap = cap;
+    }
+    Gram *g = &t->grams[t->count++];
+    memset(g, 0, sizeof(*g));
+    g->key = key;
+    t->slots[j] = t->count;
+    if (2 * t->count > t->mask && !rehashGrams(t, 2 * (t->mask + 1))) return NULL;
+    return findGram(t, key);
+}
+
+static int compareGrams(const void *a, const void *b)
+{
+    return compareKeys(&((const Gram *) a)->key, &((const Gram *) b)->key);
+}
+
+static unsigned char *writeVarint(unsigned char *p, uint32_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static bool writeAll(int fd, const void *buf, size_t len)
+{
+    const char *p = (const char *) buf;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+/*
+ * Two passes over every entry's trigrams: count the postings of each
+ * trigram, then fill them in entry order, which leaves every posting
+ * list ascending and ready for delta encoding.
+ */
+int writeSearchIndex(const char *path, SearchEntry *entries, size_t count)
+{
+    qsort(entries, count, sizeof(SearchEntry), compareEntries);
+
+    int err = ENOMEM;
+    GramTable t;
+    memset(&t, 0, sizeof(t));
+    uint32_t *keys = NULL, *docs = NULL;
+    size_t keys_cap = 0, total = 0, pool_size = 0, i;
+    ssize_t n;
+    SearchHeader h;
+    SearchDoc *out_docs = NULL;
+    SearchTrigram *out_grams = NULL;
+    unsigned char *postings = NULL, *pp;
+    char *pool = NULL, *out;
+    int fd;
+    bool ok;
+
+    if (!rehashGrams(&t, 4096)) goto bail;
+    for (i = 0; i < count; i++) {
+        if ((n = entryTrigrams(entries[i], &keys, &keys_cap)) < 0) goto bail;
+        for (ssize_t k = 0; k < n; k++) {
+            Gram *g = findGram(&t, keys[k]);
+            if (!g) goto bail;
+            g->count++;
+        }
+        total += n;
+        pool_size += entries[i].name_len + entries[i].summary_len + 2;
+    }
+    qsort(t.grams, t.count, sizeof(Gram), compareGrams);
+    if (!rehashGrams(&t, t.mask + 1)) goto bail;
+    for (i = 0, total = 0; i < t.count; i++) {
+        t.grams[i].offset = total;
+        total += t.grams[i].count;
+    }
+    if (!(docs = (uint32_t *) malloc((total ? total : 1) * sizeof(uint32_t)))) goto bail;
+    for (i = 0; i < count; i++) {
+        if ((n = entryTrigrams(entries[i], &keys, &keys_cap)) < 0) goto bail;
+        for (ssize_t k = 0; k < n; k++) {
+            Gram *g = findGram(&t, keys[k]);
+            docs[g->offset + g->fill++] = i;
+        }
+    }
+
+    out_docs = (SearchDoc *) malloc((count ? count : 1) * sizeof(SearchDoc));
+    out_grams = (SearchTrigram *) malloc((t.count ? t.count : 1) * sizeof(SearchTrigram));
+    postings = (unsigned char *) malloc(total * 5 + 1);
+    pool = (char *) malloc(pool_size + 1);
+    if (!out_docs || !out_grams || !postings || !pool) goto bail;
+    for (i = 0, pp = postings; i < t.count; i++) {
+        const Gram &g = t.grams[i];
+        out_grams[i].key = g.key;
+        out_grams[i].postings = pp - postings;
+        out_grams[i].count = g.count;
+        uint32_t prev = 0;
+        for (uint32_t k = 0; k < g.count; k++) {
+            pp = writeVarint(pp, docs[g.offset + k] - prev);
+            prev = docs[g.offset + k];
+        }
+    }
+    for (i = 0, out = pool; i < count; i++) {
+        out_docs[i].name = out - pool;
+        out_docs[i].name_len = entries[i].name_len;
+        memcpy(out, entries[i].name, entries[i].name_len);
+        out += entries[i].name_len;
+        *out++ = 0;
+        out_docs[i].summary = out - pool;
+        out_docs[i].summary_len = entries[i].summary_len;
+        memcpy(out, entries[i].summary, entries[i].summary_len);
+        out += entries[i].summary_len;
+        *out++ = 0;
+    }
+
+    memset(&h, 0, sizeof(h));
+    h.magic = SEARCH_MAGIC;
+    h.count = count;
+    h.ntrigrams = t.count;
+    h.postings_size = pp - postings;
+    h.pool_size = pool_size;
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        err = errno;
+        goto bail;
+    }
+    ok = writeAll(fd, &h, sizeof(h))
+        && writeAll(fd, out_docs, count * sizeof(SearchDoc))
+        && writeAll(fd, out_grams, t.count * sizeof(SearchTrigram))
+        && writeAll(fd, postings, h.postings_size)
+        && writeAll(fd, pool, pool_size);
+    err = ok ? 0 : errno;
+    close(fd);
+    if (!ok) unlink(path);
+
+bail:
+    free(pool);
+    free(postings);
+    free(out_grams);
+    free(out_docs);
+    free(docs);
+    free(keys);
+    free(t.slots);
+    free(t.grams);
+    return err;
+}
+
+/*
+ * The mapped index, replaced when the file at its path is.  Queries are
+ * short, so they simply hold the lock.
+ */
+struct SearchFile {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    void *addr;
+    SearchHeader header;
+    const SearchDoc *docs;
+    const SearchTrigram *grams;
+    const unsigned char *postings;
+    const char *pool;
+};
+
+static pthread_mutex_t search_lock = PTHREAD_MUTEX_INITIALIZER;
+static SearchFile search;
+
+static bool validSearch(const SearchFile &s, size_t size)
+{
+    const SearchHeader &h = s.header;
+    if (h.magic != SEARCH_MAGIC) return false;
+    if ((uint64_t) size != sizeof(SearchHeader) + (uint64_t) h.count * sizeof(SearchDoc)
+        + (uint64_t) h.ntrigrams * sizeof(SearchTrigram) + h.postings_size + h.pool_size) {
+        return false;
+    }
+    for (size_t i = 0; i < h.count; i++) {
+        const SearchDoc &d = s.docs[i];
+        if (d.name + (size_t) d.name_len >= h.pool_size || d.summary + (size_t) d.summary_len >= h.pool_size) {
+            return false;
+        }
+    }
+    // every posting takes at least a byte, and names a doc at most once
+    for (size_t i = 0; i < h.ntrigrams; i++) {
+        const SearchTrigram &g = s.grams[i];
+        if (g.postings >= h.postings_size || g.count > h.count
+            || (uint64_t) g.postings + g.count > h.postings_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* map path unless it is already mapped; returns errno, or 0 */
+static int mapSearch(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) < 0) return errno;
+    if (search.addr && strcmp(search.path, path) == 0 && search.dev == st.st_dev && search.ino == st.st_ino
+        && search.size == st.st_size && search.mtime == st.st_mtime) {
+        return 0;
+    }
+    if ((size_t) st.st_size < sizeof(SearchHeader)) return EINVAL;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return errno;
+    void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (addr == MAP_FAILED) return err;
+    char *copy = strdup(path);
+    if (!copy) {
+        munmap(addr, st.st_size);
+        return ENOMEM;
+    }
+
+    SearchFile s;
+    s.path = copy;
+    s.dev = st.st_dev;
+    s.ino = st.st_ino;
+    s.size = st.st_size;
+    s.mtime = st.st_mtime;
+    s.addr = addr;
+    memcpy(&s.header, addr, sizeof(SearchHeader));
+    s.docs = (const SearchDoc *) ((const char *) addr + sizeof(SearchHeader));
+    s.grams = (const SearchTrigram *) (s.docs + s.header.count);
+    s.postings = (const unsigned char *) (s.grams + s.header.ntrigrams);
+    s.pool = (const char *) (s.postings + s.header.postings_size);
+    if (!validSearch(s, st.st_size)) {
+        munmap(addr, st.st_size);
+        free(copy);
+        return EINVAL;
+    }
+    if (search.addr) munmap(search.addr, search.size);
+    free(search.path);
+    search = s;
+    return 0;
+}
+
+struct Fragment {
+    const char *p;
+    size_t len;
+};
+
+/*
+ * Whitespace separates terms, which must all match; '*' separates the
+ * fragments of a term, which must match in order.  So "lib*ssl" finds
+ * libssl-dev as well as libcurl-openssl.
+ */
+struct Query {
+    char buf[QUERY_MAX];
+    Fragment frags[FRAGMENT_MAX];
+    size_t terms[TERM_MAX + 1];     // first fragment of each term, then the end
+    size_t nterms;
+    bool anchored;                  // the first term may match at the start of a name
+};
+
+static void parseQuery(Query *q, const char *s)
+{
+    size_t len = 0, nfrags = 0;
+    for (; s[len] && len < QUERY_MAX - 1; len++) q->buf[len] = fold(s[len]);
+    q->buf[len] = 0;
+    q->nterms = 0;
+    q->anchored = false;
+    const char *p = q->buf, *end = q->buf + len;
+    while (p < end && q->nterms < TERM_MAX && nfrags < FRAGMENT_MAX) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n')) p++;
+        const char *term = p;
+        size_t first = nfrags;
+        while (p < end && *p != ' ' && *p != '\t' && *p != '\n') {
+            const char *frag = p;
+            while (p < end && *p != '*' && *p != ' ' && *p != '\t' && *p != '\n') p++;
+            if (p > frag && nfrags < FRAGMENT_MAX) {
+                q->frags[nfrags].p = frag;
+                q->frags[nfrags].len = p - frag;
+                nfrags++;
+            }
+            if (p < end && *p == '*') p++;
+        }
+        if (nfrags > first) {
+            if (!q->nterms) q->anchored = *term != '*';
+            q->terms[q->nterms++] = first;
+        }
+    }
+    q->terms[q->nterms] = nfrags;
+}
+
+static const char *findFolded(const char *h, const char *h_end, const Fragment &f)
+{
+    if ((size_t) (h_end - h) < f.len) return NULL;
+    const char *last = h_end - f.len;
+    const unsigned char first = f.p[0];
+    for (; h <= last; h++) {
+        if (fold(*h) != first) continue;
+        size_t i = 1;
+        while (i < f.len && fold(h[i]) == (unsigned char) f.p[i]) i++;
+        if (i == f.len) return h;
+    }
+    return NULL;
+}
+
+/* whether term t matches s; *start says if it matched from the first byte */
+static bool matchTerm(const Query &q, size_t t, const char *s, size_t len, bool *start)
+{
+    const char *p = s, *end = s + len;
+    for (size_t i = q.terms[t]; i < q.terms[t + 1]; i++) {
+        const char *at = findFolded(p, end, q.frags[i]);
+        if (!at) return false;
+        if (i == q.terms[t]) *start = at == s;
+        p = at + q.frags[i].len;
+    }
+    return true;
+}
+
+/* lower is better; -1 if doc does not match at all */
+static int rankDoc(const Query &q, const SearchDoc &d, bool summaries)
+{
+    const char *name = search.pool + d.name;
+    bool in_name = true, start = false;
+    for (size_t t = 0; t < q.nterms; t++) {
+        bool at_start = false;
+        if (matchTerm(q, t, name, d.name_len, &at_start)) {
+            if (t == 0) start = at_start && q.anchored;
+        } else if (summaries && matchTerm(q, t, search.pool + d.summary, d.summary_len, &at_start)) {
+            in_name = false;
+        } else {
+            return -1;
+        }
+    }
+    if (!in_name) return 3;
+    if (!start) return 2;
+    if (q.nterms == 1 && q.terms[1] == 1 && q.frags[0].len == d.name_len) return 0;
+    return 1;
+}
+
+struct Hit {
+    uint32_t doc;
+    uint32_t rank;
+};
+
+static int compareHits(const void *a, const void *b)
+{
+    const Hit *x = (const Hit *) a;
+    const Hit *y = (const Hit *) b;
+    if (x->rank != y->rank) return (x->rank > y->rank) - (x->rank < y->rank);
+    uint32_t xl = search.docs[x->doc].name_len, yl = search.docs[y->doc].name_len;
+    if (xl != yl) return (xl > yl) - (xl < yl);
+    return (x->doc > y->doc) - (x->doc < y->doc);
+}
+
+static const SearchTrigram *findTrigram(uint32_t key)
+{
+    size_t lo = 0, hi = search.header.ntrigrams;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (search.grams[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < search.header.ntrigrams && search.grams[lo].key == key) ? &search.grams[lo] : NULL;
+}
+
+static int compareTrigramCounts(const void *a, const void *b)
+{
+    uint32_t x = (*(const SearchTrigram * const *) a)->count;
+    uint32_t y = (*(const SearchTrigram * const *) b)->count;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Narrow cand (ascending, *n long, room for cap) to the docs in the
+ * posting list of g; with first, take the whole list.  Returns false if
+ * the postings are corrupt.
+ */
+static bool intersectPostings(const SearchTrigram *g, uint32_t *cand, size_t *n, size_t cap, bool first)
+{
+    const unsigned char *p = search.postings + g->postings;
+    const unsigned char *end = search.postings + search.header.postings_size;
+    uint32_t doc = 0;
+    size_t j = 0, m = 0;
+    for (uint32_t k = 0; k < g->count; k++) {
+        uint32_t delta = 0;
+        int shift = 0;
+        for (;;) {
+            if (p == end || shift > 28) return false;
+            unsigned char c = *p++;
+            delta |= (uint32_t) (c & 0x7f) << shift;
+            if (!(c & 0x80)) break;
+            shift += 7;
+        }
+        // ascending and within the doc table
+        if ((k && !delta) || (uint64_t) doc + delta >= search.header.count) return false;
+        doc += delta;
+        if (first) {
+            if (m == cap) return false;
+            cand[m++] = doc;
+            continue;
+        }
+        while (j < *n && cand[j] < doc) j++;
+        if (j == *n) break;
+        if (cand[j] == doc) cand[m++] = cand[j++];
+    }
+    *n = m;
+    return true;
+}
+
+/* the docs whose names start with f, by binary search over the sorted names */
+static void prefixRange(const Fragment &f, size_t *lo_out, size_t *hi_out)
+{
+    size_t lo = 0, hi = search.header.count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const SearchDoc &d = search.docs[mid];
+        size_t n = d.name_len < f.len ? d.name_len : f.len;
+        int c = memcmp(search.pool + d.name, f.p, n);
+        if (c < 0 || (c == 0 && d.name_len < f.len)) lo = mid + 1;
+        else hi = mid;
+    }
+    *lo_out = lo;
+    while (hi < search.header.count) {
+        const SearchDoc &d = search.docs[hi];
+        if (d.name_len < f.len || memcmp(search.pool + d.name, f.p, f.len) != 0) break;
+        hi++;
+    }
+    *hi_out = hi;
+}
+
+/*
+ * Candidates come from intersecting the posting lists of every trigram in
+ * the query, rarest first.  A query too short for trigrams only looks at
+ * names: the prefix range if that alone fills the limit, every name
+ * otherwise.  Candidates are then checked and ranked: exact name, name
+ * prefix, within the name, within the summary; shorter names first.
+ */
+static int runQuery(const Query &q, size_t limit, Hit **hits_out, size_t *nhits_out)
+{
+    const size_t count = search.header.count;
+    uint32_t *cand = (uint32_t *) malloc((count ? count : 1) * sizeof(uint32_t));
+    Hit *hits = (Hit *) malloc((count ? count : 1) * sizeof(Hit));
+    if (!cand || !hits) {
+        free(cand);
+        free(hits);
+        return ENOMEM;
+    }
+    uint32_t keys[QUERY_MAX];
+    const SearchTrigram *grams[QUERY_MAX];
+    size_t nkeys = 0, ncand = 0, nhits = 0, i;
+    bool summaries = false;
+    for (i = 0; i < q.terms[q.nterms]; i++) {
+        for (size_t k = 0; k + 3 <= q.frags[i].len; k++) keys[nkeys++] = trigramAt(q.frags[i].p + k);
+    }
+    if (nkeys) {
+        summaries = true;
+        qsort(keys, nkeys, sizeof(uint32_t), compareKeys);
+        size_t ngrams = 0;
+        for (i = 0; i < nkeys; i++) {
+            if (i && keys[i] == keys[i - 1]) continue;
+            if (!(grams[ngrams++] = findTrigram(keys[i]))) goto done;
+        }
+        qsort(grams, ngrams, sizeof(grams[0]), compareTrigramCounts);
+        for (i = 0; i < ngrams && (i == 0 || ncand); i++) {
+            if (!intersectPostings(grams[i], cand, &ncand, count, i == 0)) {
+                free(cand);
+                free(hits);
+                return EINVAL;
+            }
+        }
+    } else if (q.nterms) {
+        size_t lo = 0, hi = 0;
+        if (q.anchored) prefixRange(q.frags[0], &lo, &hi);
+        if (hi - lo < limit) {
+            lo = 0;
+            hi = count;
+        }
+        for (i = lo; i < hi; i++) cand[ncand++] = i;
+    }
+    for (i = 0; i < ncand; i++) {
+        int rank = rankDoc(q, search.docs[cand[i]], summaries);
+        if (rank < 0) continue;
+        hits[nhits].doc = cand[i];
+        hits[nhits].rank = rank;
+        nhits++;
+    }
+    qsort(hits, nhits, sizeof(Hit), compareHits);
+
+done:
+    free(cand);
+    *hits_out = hits;
+    *nhits_out = nhits < limit ? nhits : limit;
+    return 0;
+}
+
+static void throwIOException(JNIEnv *env, int errnum)
+{
+    jclass exClass = env->FindClass(errnum == ENOENT ? "java/io/FileNotFoundException" : "java/io/IOException");
+    env->ThrowNew(exClass, strerror(errnum));
+}
+
+/* NUL-terminated {name, summary} for each hit, best first */
+static jbyteArray packageSearch_query(JNIEnv *env, jclass clazz, jstring index, jstring query, jint limit)
+{
+    const char *index_8 = env->GetStringUTFChars(index, NULL);
+    const char *query_8 = env->GetStringUTFChars(query, NULL);
+    jbyteArray result = NULL;
+    if (!index_8 || !query_8) goto bail;
+
+    {
+        Query q;
+        Hit *hits = NULL;
+        size_t nhits = 0, size = 0;
+        parseQuery(&q, query_8);
+        pthread_mutex_lock(&search_lock);
+        int err = mapSearch(index_8);
+        if (!err) err = runQuery(q, limit > 0 ? limit : 0, &hits, &nhits);
+        if (err) {
+            pthread_mutex_unlock(&search_lock);
+            throwIOException(env, err);
+            goto bail;
+        }
+        for (size_t i = 0; i < nhits; i++) {
+            const SearchDoc &d = search.docs[hits[i].doc];
+            size += d.name_len + d.summary_len + 2;
+        }
+        if ((result = env->NewByteArray(size))) {
+            jsize off = 0;
+            for (size_t i = 0; i < nhits; i++) {
+                const SearchDoc &d = search.docs[hits[i].doc];
+                env->SetByteArrayRegion(result, off, d.name_len + 1, (const jbyte *) (search.pool + d.name));
+                off += d.name_len + 1;
+                env->SetByteArrayRegion(result, off, d.summary_len + 1, (const jbyte *) (search.pool + d.summary));
+                off += d.summary_len + 1;
+            }
+        }
+        pthread_mutex_unlock(&search_lock);
+        free(hits);
+    }
+
+bail:
+    if (query_8) env->ReleaseStringUTFChars(query, query_8);
+    if (index_8) env->ReleaseStringUTFChars(index, index_8);
+    return result;
+}
+
+static const char *classPathName = "com/botbrew/basil/PackageSearch";
+static JNINativeMethod method_table[] = {
+    { "nativeQuery", "(Ljava/lang/String;Ljava/lang/String;I)[B", (void *) packageSearch_query },
+};
+
+int init_PackageSearch(JNIEnv *env)
+{
+    if (!registerNativeMethods(env, classPathName, method_table,
+                sizeof(method_table) / sizeof(method_table[0]))) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
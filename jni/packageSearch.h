@@ -0,0 +1,23 @@
+#ifndef _PACKAGESEARCH_H
+#define _PACKAGESEARCH_H 1
+
+#include <stddef.h>
+
+#include "jni.h"
+
+struct SearchEntry {
+    const char *name;
+    size_t name_len;
+    const char *summary;
+    size_t summary_len;
+};
+
+/*
+ * Write the search index for entries to path, sorting entries by name.
+ * Returns errno, or 0.
+ */
+int writeSearchIndex(const char *path, SearchEntry *entries, size_t count);
+
+int init_PackageSearch(JNIEnv *env);
+
+#endif	/* !defined(_PACKAGESEARCH_H) */
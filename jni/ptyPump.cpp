@@ -0,0 +1,226 @@
+#include "common.h"
+
+#define LOG_TAG "PtyPump"
+
+#include <sys/types.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ptyPump.h"
+#include "reaper.h"
+
+#define PUMP_MAX_SESSIONS	256
+#define PUMP_MAX_EVENTS		64
+
+/* records handed to PtyPump.dispatch(): {token, exit code or 128+signal} */
+#define EVENT_INTS	2
+
+struct session {
+    int token;		// 0 when the slot is free
+    pid_t pid;
+    bool exitPending;	// the reaper has reported pid's exit
+    int exitCode;
+};
+
+static JavaVM *gVM;
+static jclass class_ptyPump;
+static jmethodID method_ptyPump_dispatch;
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static struct session gSessions[PUMP_MAX_SESSIONS];
+static int gWake[2] = {-1, -1};
+static jintArray gEvents;
+
+static struct session *session_find(int token)
+{
+    for (int i = 0; i < PUMP_MAX_SESSIONS; i++) {
+        if (gSessions[i].token == token) return &gSessions[i];
+    }
+    return NULL;
+}
+
+/*
+ * Runs on the reaper thread; the exit event is dispatched by the pump thread,
+ * so a slow listener never holds up reaping.
+ */
+static void session_exited(pid_t pid, const struct reaper_status *status, void *arg)
+{
+    int token = (int) (intptr_t) arg;
+    pthread_mutex_lock(&gLock);
+    struct session *s = session_find(token);
+    if (s && s->pid == pid) {
+        s->exitPending = true;
+        s->exitCode = reaper_code(status);
+        write(gWake[1], "", 1);
+    }
+    pthread_mutex_unlock(&gLock);
+}
+
+/* move up to PUMP_MAX_EVENTS reported exits into events, freeing their slots */
+static int collect_exits(jint *events)
+{
+    int count = 0;
+    pthread_mutex_lock(&gLock);
+    for (int i = 0; i < PUMP_MAX_SESSIONS && count < PUMP_MAX_EVENTS; i++) {
+        struct session *s = &gSessions[i];
+        if (s->token && s->exitPending) {
+            events[count * EVENT_INTS] = s->token;
+            events[count * EVENT_INTS + 1] = s->exitCode;
+            count++;
+            s->token = 0;
+        }
+    }
+    pthread_mutex_unlock(&gLock);
+    return count;
+}
+
+static void *pump_loop(void *arg)
+{
+    JNIEnv *env;
+    jint events[PUMP_MAX_EVENTS * EVENT_INTS];
+
+    if (gVM->AttachCurrentThread(&env, NULL) != JNI_OK) {
+        LOGE("cannot attach pump thread");
+        return NULL;
+    }
+
+    for (;;) {
+        char buf[64];
+        ssize_t r = read(gWake[0], buf, sizeof(buf));
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) {
+            LOGE("wake pipe failed: %s", r ? strerror(errno) : "closed");
+            break;
+        }
+
+        int count;
+        do {
+            count = collect_exits(events);
+            if (count == 0) break;
+            env->SetIntArrayRegion(gEvents, 0, count * EVENT_INTS, events);
+            env->CallStaticVoidMethod(class_ptyPump, method_ptyPump_dispatch,
+                count, gEvents);
+            if (env->ExceptionCheck()) {
+                LOGE("exception in PtyPump.dispatch()");
+                env->ExceptionDescribe();
+                env->ExceptionClear();
+            }
+        } while (count == PUMP_MAX_EVENTS);
+    }
+
+    gVM->DetachCurrentThread();
+    return NULL;
+}
+
+/*
+ * Set up the wake pipe and the pump thread on first use.  Called with gLock
+ * held.
+ */
+static int pump_start(JNIEnv *env)
+{
+    pthread_t thread;
+    jintArray events;
+
+    if (gWake[0] >= 0) return 0;
+
+    events = env->NewIntArray(PUMP_MAX_EVENTS * EVENT_INTS);
+    if (events) {
+        gEvents = (jintArray) env->NewGlobalRef(events);
+        env->DeleteLocalRef(events);
+    }
+    if (!gEvents) goto bail;
+
+    if (pipe(gWake) < 0) goto bail;
+    fcntl(gWake[0], F_SETFD, FD_CLOEXEC);
+    fcntl(gWake[1], F_SETFD, FD_CLOEXEC);
+    // a full pipe already wakes the pump; never block the reaper on it
+    fcntl(gWake[1], F_SETFL, O_NONBLOCK);
+
+    if (pthread_create(&thread, NULL, pump_loop, NULL) != 0) goto bail;
+    pthread_detach(thread);
+    return 0;
+
+bail:
+    LOGE("cannot start pump: %s", strerror(errno));
+    // leave nothing behind, so the next watch starts over
+    for (int i = 0; i < 2; i++) {
+        if (gWake[i] >= 0) close(gWake[i]);
+        gWake[i] = -1;
+    }
+    if (gEvents) env->DeleteGlobalRef(gEvents);
+    gEvents = NULL;
+    return -1;
+}
+
+static jboolean ptyPump_watch(JNIEnv *env, jclass clazz, jint token, jint pid)
+{
+    struct session *s;
+
+    if (token == 0 || pid <= 0) return JNI_FALSE;
+
+    pthread_mutex_lock(&gLock);
+    if (pump_start(env) < 0 || !(s = session_find(0))) {
+        pthread_mutex_unlock(&gLock);
+        return JNI_FALSE;
+    }
+    s->token = token;
+    s->pid = pid;
+    s->exitPending = false;
+    pthread_mutex_unlock(&gLock);
+
+    // outside gLock: the callback runs at once if pid is already gone
+    if (reaper_watch(pid, session_exited, (void *) (intptr_t) token) < 0) {
+        LOGE("cannot watch pid %d", pid);
+        pthread_mutex_lock(&gLock);
+        if ((s = session_find(token))) s->token = 0;
+        pthread_mutex_unlock(&gLock);
+        return JNI_FALSE;
+    }
+    return JNI_TRUE;
+}
+
+static void ptyPump_unwatch(JNIEnv *env, jclass clazz, jint token)
+{
+    if (token == 0) return;
+    pthread_mutex_lock(&gLock);
+    struct session *s = session_find(token);
+    if (s) s->token = 0;
+    pthread_mutex_unlock(&gLock);
+}
+
+static const char *classPathName = "com/botbrew/basil/PtyPump";
+static JNINativeMethod method_table[] = {
+    { "nativeWatch", "(II)Z", (void *) ptyPump_watch },
+    { "nativeUnwatch", "(I)V", (void *) ptyPump_unwatch },
+};
+
+int init_PtyPump(JNIEnv *env) {
+    if (env->GetJavaVM(&gVM) != JNI_OK) {
+        return JNI_FALSE;
+    }
+
+    jclass clazz = env->FindClass(classPathName);
+    if (clazz == NULL) {
+        LOGE("Can't find class %s", classPathName);
+        return JNI_FALSE;
+    }
+    class_ptyPump = (jclass) env->NewGlobalRef(clazz);
+    env->DeleteLocalRef(clazz);
+    method_ptyPump_dispatch = env->GetStaticMethodID(class_ptyPump, "dispatch", "(I[I)V");
+    if (method_ptyPump_dispatch == NULL) {
+        LOGE("Can't find PtyPump.dispatch");
+        return JNI_FALSE;
+    }
+
+    if (!registerNativeMethods(env, classPathName, method_table,
+                 sizeof(method_table) / sizeof(method_table[0]))) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
@@ -0,0 +1,8 @@
+#ifndef _PTYPUMP_H
+#define _PTYPUMP_H 1
+
+#include "jni.h"
+
+int init_PtyPump(JNIEnv *env);
+
+#endif	/* !defined(_PTYPUMP_H) */
@@ -0,0 +1,479 @@
+#include "common.h"
+
+#define LOG_TAG "Reaper"
+
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "reaper.h"
+
+#ifndef __NR_pidfd_open
+#if defined(__mips__)
+#define __NR_pidfd_open 4434
+#else
+#define __NR_pidfd_open 434
+#endif
+#endif
+
+#define REAPER_MAX_CHILDREN	512
+#define REAPER_MAX_NOTIFY	64
+#define REAPER_POLL_MS		100
+
+/* layout of the long[] handed to Java */
+#define RESULT_EXIT_CODE	0
+#define RESULT_SIGNAL		1
+#define RESULT_UTIME_US		2
+#define RESULT_STIME_US		3
+#define RESULT_MAXRSS_KB	4
+#define RESULT_WALL_US		5
+#define RESULT_LONGS		6
+
+enum { SLOT_FREE, SLOT_RUNNING, SLOT_EXITED };
+
+struct child {
+    int state;
+    pid_t pid;
+    int pidfd;			// -1 when pidfd_open() is not supported
+    long long started;
+    long long exited;
+    struct reaper_status status;
+    reaper_callback cb;
+    void *cbArg;
+    bool javaWatch;
+    bool notify;		// exit callbacks still have to run
+};
+
+static JavaVM *gVM;
+static jclass class_reaper;
+static jmethodID method_reaper_onExit;
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gExited = PTHREAD_COND_INITIALIZER;
+static struct child gChildren[REAPER_MAX_CHILDREN];
+static int gEpoll = -1;
+static int gWake[2] = {-1, -1};
+static int gPolled = 0;		// running children without a pidfd
+
+static long long monotonic_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static long long timeval_us(const struct timeval *tv)
+{
+    return (long long) tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+int reaper_code(const struct reaper_status *status)
+{
+    return status->signal ? 128 + status->signal : status->exitCode;
+}
+
+static void wake()
+{
+    write(gWake[1], "", 1);
+}
+
+/*
+ * Prefer the running child if a pid has been reused.
+ */
+static struct child *child_find(pid_t pid)
+{
+    struct child *res = NULL;
+    for (int i = 0; i < REAPER_MAX_CHILDREN; i++) {
+        struct child *c = &gChildren[i];
+        if (c->state == SLOT_FREE || c->pid != pid) continue;
+        if (c->state == SLOT_RUNNING) return c;
+        if (!res || c->exited > res->exited) res = c;
+    }
+    return res;
+}
+
+/*
+ * Take a free slot, evicting the oldest unclaimed exit record if needed.
+ */
+static struct child *child_alloc()
+{
+    struct child *oldest = NULL;
+    for (int i = 0; i < REAPER_MAX_CHILDREN; i++) {
+        struct child *c = &gChildren[i];
+        if (c->state == SLOT_FREE) return c;
+        if (c->state == SLOT_EXITED && !c->notify &&
+            (!oldest || c->exited < oldest->exited)) oldest = c;
+    }
+    return oldest;
+}
+
+static void child_release(struct child *c)
+{
+    if (!c->notify) c->state = SLOT_FREE;
+}
+
+static void *reaper_loop(void *arg);
+
+/*
+ * Set up the reaper thread on first use.  Called with gLock held.
+ */
+static int reaper_start()
+{
+    pthread_t thread;
+    struct epoll_event ev;
+
+    if (gEpoll >= 0) return 0;
+    if (gWake[0] < 0) {
+        if (pipe(gWake) < 0) return -1;
+        fcntl(gWake[0], F_SETFD, FD_CLOEXEC);
+        fcntl(gWake[1], F_SETFD, FD_CLOEXEC);
+        fcntl(gWake[0], F_SETFL, O_NONBLOCK);
+    }
+    int epfd = epoll_create(REAPER_MAX_CHILDREN);
+    if (epfd < 0) return -1;
+    fcntl(epfd, F_SETFD, FD_CLOEXEC);
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, gWake[0], &ev) < 0 ||
+        pthread_create(&thread, NULL, reaper_loop, NULL) != 0) {
+        LOGE("cannot start reaper: %s", strerror(errno));
+        close(epfd);
+        return -1;
+    }
+    pthread_detach(thread);
+    gEpoll = epfd;
+    return 0;
+}
+
+/*
+ * Start tracking pid.  Called with gLock held.
+ */
+static struct child *child_track(pid_t pid)
+{
+    struct child *c = child_find(pid);
+    if (c && c->state == SLOT_RUNNING) return c;
+    if (reaper_start() < 0 || !(c = child_alloc())) return NULL;
+
+    memset(c, 0, sizeof(*c));
+    c->state = SLOT_RUNNING;
+    c->pid = pid;
+    c->started = monotonic_us();
+    c->pidfd = syscall(__NR_pidfd_open, pid, 0);
+    if (c->pidfd >= 0) {
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.u64 = (uint32_t) pid;
+        fcntl(c->pidfd, F_SETFD, FD_CLOEXEC);
+        epoll_ctl(gEpoll, EPOLL_CTL_ADD, c->pidfd, &ev);
+    } else {
+        // kernels before 5.3: poll with wait4(WNOHANG)
+        if (gPolled++ == 0) wake();
+    }
+    return c;
+}
+
+static void fill_status(struct reaper_status *st, int status,
+    const struct rusage *ru)
+{
+    memset(st, 0, sizeof(*st));
+    if (WIFSIGNALED(status)) {
+        st->signal = WTERMSIG(status);
+    } else {
+        st->exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    }
+    if (ru) {
+        st->utimeUs = timeval_us(&ru->ru_utime);
+        st->stimeUs = timeval_us(&ru->ru_stime);
+        st->maxRssKb = ru->ru_maxrss;
+    }
+}
+
+/*
+ * Collect a child if it has exited.  Called with gLock held.
+ */
+static bool child_reap(struct child *c)
+{
+    int status = 0;
+    struct rusage ru;
+    pid_t r = wait4(c->pid, &status, WNOHANG, &ru);
+    if (r == 0 || (r < 0 && errno == EINTR)) return false;
+
+    if (r == c->pid) {
+        fill_status(&c->status, status, &ru);
+    } else {
+        // somebody else reaped it
+        fill_status(&c->status, 0, NULL);
+        c->status.exitCode = -1;
+    }
+    c->exited = monotonic_us();
+    c->status.wallUs = c->exited - c->started;
+    if (c->pidfd >= 0) {
+        struct epoll_event ev;
+        epoll_ctl(gEpoll, EPOLL_CTL_DEL, c->pidfd, &ev);
+        close(c->pidfd);
+        c->pidfd = -1;
+    } else {
+        gPolled--;
+    }
+    c->state = SLOT_EXITED;
+    c->notify = (c->cb != NULL) || c->javaWatch;
+    return true;
+}
+
+struct notification {
+    pid_t pid;
+    struct reaper_status status;
+    reaper_callback cb;
+    void *cbArg;
+    bool javaWatch;
+};
+
+static void notify_java(JNIEnv *env, const struct notification *n)
+{
+    jlong result[RESULT_LONGS];
+    result[RESULT_EXIT_CODE] = n->status.exitCode;
+    result[RESULT_SIGNAL] = n->status.signal;
+    result[RESULT_UTIME_US] = n->status.utimeUs;
+    result[RESULT_STIME_US] = n->status.stimeUs;
+    result[RESULT_MAXRSS_KB] = n->status.maxRssKb;
+    result[RESULT_WALL_US] = n->status.wallUs;
+    jlongArray array = env->NewLongArray(RESULT_LONGS);
+    if (!array) {
+        env->ExceptionClear();
+        return;
+    }
+    env->SetLongArrayRegion(array, 0, RESULT_LONGS, result);
+    env->CallStaticVoidMethod(class_reaper, method_reaper_onExit, n->pid, array);
+    if (env->ExceptionCheck()) {
+        LOGE("exception in Reaper.onExit()");
+        env->ExceptionDescribe();
+        env->ExceptionClear();
+    }
+    env->DeleteLocalRef(array);
+}
+
+static void *reaper_loop(void *arg)
+{
+    JNIEnv *env;
+    struct epoll_event ready[REAPER_MAX_NOTIFY];
+    struct notification pending[REAPER_MAX_NOTIFY];
+
+    if (gVM->AttachCurrentThread(&env, NULL) != JNI_OK) {
+        LOGE("cannot attach reaper thread");
+        return NULL;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&gLock);
+        int timeout = gPolled ? REAPER_POLL_MS : -1;
+        pthread_mutex_unlock(&gLock);
+
+        int n = epoll_wait(gEpoll, ready, REAPER_MAX_NOTIFY, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            LOGE("epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        pthread_mutex_lock(&gLock);
+        bool reaped = false;
+        for (int i = 0; i < n; i++) {
+            pid_t pid = (pid_t) ready[i].data.u64;
+            if (pid == 0) {
+                char buf[64];
+                while (read(gWake[0], buf, sizeof(buf)) > 0);
+                continue;
+            }
+            struct child *c = child_find(pid);
+            if (c && c->state == SLOT_RUNNING && child_reap(c)) reaped = true;
+        }
+        if (gPolled) {
+            for (int i = 0; i < REAPER_MAX_CHILDREN; i++) {
+                struct child *c = &gChildren[i];
+                if (c->state == SLOT_RUNNING && c->pidfd < 0 && child_reap(c)) {
+                    reaped = true;
+                }
+            }
+        }
+        if (reaped) pthread_cond_broadcast(&gExited);
+
+        int count = 0;
+        for (int i = 0; i < REAPER_MAX_CHILDREN; i++) {
+            struct child *c = &gChildren[i];
+            if (!c->notify) continue;
+            if (count == REAPER_MAX_NOTIFY) {
+                wake();
+                break;
+            }
+            struct notification *p = &pending[count++];
+            p->pid = c->pid;
+            p->status = c->status;
+            p->cb = c->cb;
+            p->cbArg = c->cbArg;
+            p->javaWatch = c->javaWatch;
+            c->cb = NULL;
+            c->javaWatch = false;
+            c->notify = false;
+        }
+        pthread_mutex_unlock(&gLock);
+
+        for (int i = 0; i < count; i++) {
+            if (pending[i].cb) pending[i].cb(pending[i].pid, &pending[i].status, pending[i].cbArg);
+            if (pending[i].javaWatch) notify_java(env, &pending[i]);
+        }
+    }
+
+    gVM->DetachCurrentThread();
+    return NULL;
+}
+
+void reaper_track(pid_t pid)
+{
+    if (pid <= 0) return;
+    pthread_mutex_lock(&gLock);
+    child_track(pid);
+    pthread_mutex_unlock(&gLock);
+}
+
+int reaper_wait(pid_t pid, struct reaper_status *status)
+{
+    pthread_mutex_lock(&gLock);
+    struct child *c = child_find(pid);
+    if (!c) c = child_track(pid);
+    if (!c) {
+        // no room to track it: wait the old-fashioned way
+        pthread_mutex_unlock(&gLock);
+        int st;
+        struct rusage ru;
+        long long started = monotonic_us();
+        pid_t r;
+        do {
+            r = wait4(pid, &st, 0, &ru);
+        } while (r < 0 && errno == EINTR);
+        if (r < 0) return -1;
+        fill_status(status, st, &ru);
+        status->wallUs = monotonic_us() - started;
+        return 0;
+    }
+    while (c->state == SLOT_RUNNING && c->pid == pid) {
+        pthread_cond_wait(&gExited, &gLock);
+    }
+    *status = c->status;
+    child_release(c);
+    pthread_mutex_unlock(&gLock);
+    return 0;
+}
+
+int reaper_poll(pid_t pid, struct reaper_status *status)
+{
+    int result = -1;
+    pthread_mutex_lock(&gLock);
+    struct child *c = child_find(pid);
+    if (c && c->state == SLOT_RUNNING) {
+        result = 0;
+    } else if (c) {
+        *status = c->status;
+        child_release(c);
+        result = 1;
+    }
+    pthread_mutex_unlock(&gLock);
+    return result;
+}
+
+int reaper_watch(pid_t pid, reaper_callback cb, void *arg)
+{
+    pthread_mutex_lock(&gLock);
+    struct child *c = child_find(pid);
+    if (!c) c = child_track(pid);
+    if (!c) {
+        pthread_mutex_unlock(&gLock);
+        return -1;
+    }
+    c->cb = cb;
+    c->cbArg = arg;
+    if (c->state == SLOT_EXITED) {
+        c->notify = true;
+        wake();
+    }
+    pthread_mutex_unlock(&gLock);
+    return 0;
+}
+
+static jboolean reaper_nativePoll(JNIEnv *env, jclass clazz, jint pid,
+    jlongArray resultArray)
+{
+    struct reaper_status st;
+    if (reaper_poll(pid, &st) != 1) {
+        return JNI_FALSE;
+    }
+    jlong result[RESULT_LONGS];
+    result[RESULT_EXIT_CODE] = st.exitCode;
+    result[RESULT_SIGNAL] = st.signal;
+    result[RESULT_UTIME_US] = st.utimeUs;
+    result[RESULT_STIME_US] = st.stimeUs;
+    result[RESULT_MAXRSS_KB] = st.maxRssKb;
+    result[RESULT_WALL_US] = st.wallUs;
+    env->SetLongArrayRegion(resultArray, 0, RESULT_LONGS, result);
+    return JNI_TRUE;
+}
+
+static jboolean reaper_nativeWatch(JNIEnv *env, jclass clazz, jint pid)
+{
+    pthread_mutex_lock(&gLock);
+    struct child *c = child_find(pid);
+    if (!c) c = child_track(pid);
+    if (c) {
+        c->javaWatch = true;
+        if (c->state == SLOT_EXITED) {
+            c->notify = true;
+            wake();
+        }
+    }
+    pthread_mutex_unlock(&gLock);
+    return c ? JNI_TRUE : JNI_FALSE;
+}
+
+static const char *classPathName = "com/botbrew/basil/Reaper";
+static JNINativeMethod method_table[] = {
+    { "nativePoll", "(I[J)Z", (void *) reaper_nativePoll },
+    { "nativeWatch", "(I)Z", (void *) reaper_nativeWatch },
+};
+
+int init_Reaper(JNIEnv *env) {
+    if (env->GetJavaVM(&gVM) != JNI_OK) {
+        return JNI_FALSE;
+    }
+
+    jclass clazz = env->FindClass(classPathName);
+    if (clazz == NULL) {
+        LOGE("Can't find class %s", classPathName);
+        return JNI_FALSE;
+    }
+    class_reaper = (jclass) env->NewGlobalRef(clazz);
+    env->DeleteLocalRef(clazz);
+    method_reaper_onExit = env->GetStaticMethodID(class_reaper, "onExit", "(I[J)V");
+    if (method_reaper_onExit == NULL) {
+        LOGE("Can't find Reaper.onExit");
+        return JNI_FALSE;
+    }
+
+    if (!registerNativeMethods(env, classPathName, method_table,
+                 sizeof(method_table) / sizeof(method_table[0]))) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
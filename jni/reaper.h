@@ -0,0 +1,32 @@
+#ifndef _REAPER_H
+#define _REAPER_H 1
+
+#include <sys/types.h>
+
+#include "jni.h"
+
+struct reaper_status {
+    int exitCode;		// valid unless signal != 0
+    int signal;			// terminating signal, or 0
+    long long utimeUs;		// user CPU time
+    long long stimeUs;		// system CPU time
+    long maxRssKb;		// peak resident set size
+    long long wallUs;		// time from reaper_track() to exit
+};
+
+typedef void (*reaper_callback)(pid_t pid, const struct reaper_status *status, void *arg);
+
+/* Start accounting for a child; called right after it is spawned. */
+void reaper_track(pid_t pid);
+/* Block until pid exits; returns 0 and fills status, or -1 (errno set). */
+int reaper_wait(pid_t pid, struct reaper_status *status);
+/* Returns 1 and fills status if pid has exited, 0 if it is running, -1 if unknown. */
+int reaper_poll(pid_t pid, struct reaper_status *status);
+/* Call cb on the reaper thread once pid exits (at once if it already has). */
+int reaper_watch(pid_t pid, reaper_callback cb, void *arg);
+/* Shell-style exit code: the exit status, or 128+signal. */
+int reaper_code(const struct reaper_status *status);
+
+int init_Reaper(JNIEnv *env);
+
+#endif	/* !defined(_REAPER_H) */
@@ -0,0 +1,115 @@
+#include "common.h"
+
+#define LOG_TAG "ServiceStatus"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "serviceStatus.h"
+#include "init/svstatus.h"
+
+/* flags, as in ServiceStatus.java; the log's go in log_flags, less the first and third */
+#define FLAG_ENABLED 1
+#define FLAG_NORMALLY_UP 2
+#define FLAG_HAS_LOG 4
+#define FLAG_WANT_UP 8
+#define FLAG_WANT_DOWN 16
+#define FLAG_PAUSED 32
+#define FLAG_TERM 64
+
+/*
+ * One record per service, 8-byte aligned, followed by the UTF-8 name and
+ * padding to the next record.
+ */
+struct StatusRecord {
+    int64_t since;
+    int64_t log_since;
+    int32_t pid;
+    int32_t log_pid;
+    int8_t state;
+    int8_t log_state;
+    uint8_t flags;
+    uint8_t log_flags;
+    uint16_t name_len;
+    uint16_t pad;
+};
+
+static uint8_t procFlags(const struct svstatus_proc &p)
+{
+    return (p.want == 'u' ? FLAG_WANT_UP : 0) | (p.want == 'd' ? FLAG_WANT_DOWN : 0)
+        | (p.paused ? FLAG_PAUSED : 0) | (p.term ? FLAG_TERM : 0) | (p.normally_up ? FLAG_NORMALLY_UP : 0);
+}
+
+static size_t recordSize(size_t name_len)
+{
+    return (sizeof(StatusRecord) + name_len + 7) & ~(size_t) 7;
+}
+
+static void throwIOException(JNIEnv *env, int errnum)
+{
+    jclass exClass = env->FindClass(errnum == ENOENT ? "java/io/FileNotFoundException" : "java/io/IOException");
+    env->ThrowNew(exClass, strerror(errnum));
+}
+
+/* every service under root as packed StatusRecords */
+static jbyteArray serviceStatus_read(JNIEnv *env, jclass clazz, jstring root)
+{
+    const char *root_8 = env->GetStringUTFChars(root, NULL);
+    if (!root_8) return NULL;
+    struct svstatus_list *list = svstatus_read(root_8);
+    int err = errno;
+    env->ReleaseStringUTFChars(root, root_8);
+    if (!list) {
+        throwIOException(env, err);
+        return NULL;
+    }
+
+    jbyteArray result = NULL;
+    size_t size = 0;
+    for (size_t i = 0; i < list->count; i++) size += recordSize(strlen(list->services[i].name));
+    char *buf = (char *) calloc(size ? size : 1, 1);
+    if (!buf) {
+        svstatus_free(list);
+        throwIOException(env, ENOMEM);
+        return NULL;
+    }
+    char *out = buf;
+    for (size_t i = 0; i < list->count; i++) {
+        const struct svstatus &s = list->services[i];
+        StatusRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.since = s.main.since;
+        rec.log_since = s.log.since;
+        rec.pid = s.main.pid;
+        rec.log_pid = s.log.pid;
+        rec.state = s.main.state;
+        rec.log_state = s.log.state;
+        rec.flags = procFlags(s.main) | (s.enabled ? FLAG_ENABLED : 0) | (s.has_log ? FLAG_HAS_LOG : 0);
+        rec.log_flags = procFlags(s.log);
+        rec.name_len = strlen(s.name);
+        memcpy(out, &rec, sizeof(rec));
+        memcpy(out + sizeof(rec), s.name, rec.name_len);
+        out += recordSize(rec.name_len);
+    }
+    svstatus_free(list);
+    if ((result = env->NewByteArray(size))) env->SetByteArrayRegion(result, 0, size, (const jbyte *) buf);
+    free(buf);
+    return result;
+}
+
+static const char *classPathName = "com/botbrew/basil/ServiceStatus";
+static JNINativeMethod method_table[] = {
+    { "nativeRead", "(Ljava/lang/String;)[B", (void *) serviceStatus_read },
+};
+
+int init_ServiceStatus(JNIEnv *env)
+{
+    if (!registerNativeMethods(env, classPathName, method_table,
+                sizeof(method_table) / sizeof(method_table[0]))) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
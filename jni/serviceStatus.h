@@ -0,0 +1,8 @@
+#ifndef _SERVICESTATUS_H
+#define _SERVICESTATUS_H 1
+
+#include "jni.h"
+
+int init_ServiceStatus(JNIEnv *env);
+
+#endif	/* !defined(_SERVICESTATUS_H) */
@@ -0,0 +1,458 @@
+#include "common.h"
+
+#define LOG_TAG "ServiceUsage"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "serviceUsage.h"
+#include "init/supervise.h"
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0200000
+#endif
+
+#define RING_TICKS 64
+#define INTERVAL_MIN_MS 250
+#define DENTS_SIZE 32768
+#define MAX_DEPTH 32            // of a process below its service's ./run
+
+/* flags, as in ServiceUsage.java */
+#define FLAG_NO_PSS 1           // smaps_rollup missing or unreadable for some process
+#define FLAG_NO_IO 2            // io unreadable for some process, e.g. run by root
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+/*
+ * What we know of one process.  The table is sorted by pid, which is
+ * the order /proc lists them in, so each tick is a merge of two lists.
+ */
+struct ProcEntry {
+    pid_t pid;
+    pid_t ppid;
+    uint64_t ino;               // of /proc/<pid>; changes if the pid is reused
+    pid_t owner;                // ./run (or log/run) it descends from, 0 if none, -1 if unsure
+    unsigned long long cpu;     // utime+stime, in clock ticks
+    unsigned long long cpu_last;        // at the previous tick
+    long rss;                   // pages
+    long pss;                   // kB, or -1
+    long long read_bytes;       // or -1
+    long long write_bytes;
+    long long read_delta;       // since the previous tick
+    long long write_delta;
+    int threads;
+    bool fresh;                 // first seen this tick
+};
+
+/* one service at one tick; the record handed to Java */
+struct UsageRecord {
+    char name[SUPERVISE_NAME_MAX];
+    int64_t read_bytes;         // over the interval
+    int64_t write_bytes;
+    int32_t cpu_ms;
+    int32_t rss_kb;
+    int32_t pss_kb;
+    int32_t threads;
+    int32_t processes;
+    int32_t flags;
+};
+
+struct UsageTick {
+    int64_t seq;
+    int64_t time_ms;            // unix time
+    int32_t interval_ms;
+    int32_t count;
+    UsageRecord records[SUPERVISE_SLOTS];
+};
+
+static pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gCond = PTHREAD_COND_INITIALIZER;
+static pthread_t gThread;
+static bool gRunning;
+static bool gStop;
+static int gIntervalMs;
+static char *gPagePath;
+static UsageTick *gRing;
+static int64_t gSeq;
+
+/* sampler thread state, not shared */
+static ProcEntry *gProcs;
+static size_t gProcsLen;
+static const volatile char *gPage;
+static ino_t gPageIno;
+static long gPageKb;
+static long gClockTick;
+static char gDents[DENTS_SIZE];
+
+static long long nowMs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/* read a small procfs file whole; returns its length, or -1 with errno set */
+static ssize_t readFile(const char *path, char *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    int err = errno;
+    close(fd);
+    if (n < 0) {
+        errno = err;
+        return -1;
+    }
+    buf[n] = 0;
+    return n;
+}
+
+/* ppid, CPU time, threads and RSS from /proc/<pid>/stat */
+static bool readStat(ProcEntry *p)
+{
+    char path[32], buf[512];
+    snprintf(path, sizeof(path), "/proc/%d/stat", p->pid);
+    if (readFile(path, buf, sizeof(buf)) < 0) return false;
+    // the command may contain anything, including ") "
+    char *s = strrchr(buf, ')');
+    if (!s) return false;
+    unsigned long utime, stime;
+    long threads, rss;
+    if (sscanf(s + 2, "%*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d %*d %*d %ld %*d %*u %*u %ld",
+            &p->ppid, &utime, &stime, &threads, &rss) != 5) {
+        return false;
+    }
+    p->cpu = (unsigned long long) utime + stime;
+    p->threads = threads;
+    p->rss = rss;
+    return true;
+}
+
+static long long field(const char *buf, const char *name)
+{
+    const char *s = strstr(buf, name);
+    return s ? strtoll(s + strlen(name), NULL, 10) : -1;
+}
+
+/* PSS and I/O, which only change while the process runs */
+static void readMemoryAndIo(ProcEntry *p)
+{
+    char path[40], buf[1024];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", p->pid);
+    p->pss = readFile(path, buf, sizeof(buf)) < 0 ? -1 : field(buf, "\nPss:");
+    snprintf(path, sizeof(path), "/proc/%d/io", p->pid);
+    long long read_bytes = -1, write_bytes = -1;
+    if (readFile(path, buf, sizeof(buf)) >= 0) {
+        read_bytes = field(buf, "read_bytes:");
+        write_bytes = field(buf, "\nwrite_bytes:");
+    }
+    // a process is not charged for what it did before it was first seen
+    p->read_delta = (p->fresh || p->read_bytes < 0 || read_bytes < 0) ? 0 : read_bytes - p->read_bytes;
+    p->write_delta = (p->fresh || p->write_bytes < 0 || write_bytes < 0) ? 0 : write_bytes - p->write_bytes;
+    p->read_bytes = read_bytes;
+    p->write_bytes = write_bytes;
+}
+
+static ProcEntry *findProc(pid_t pid)
+{
+    size_t lo = 0, hi = gProcsLen;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (gProcs[mid].pid < pid) lo = mid + 1;
+        else if (gProcs[mid].pid > pid) hi = mid;
+        else return &gProcs[mid];
+    }
+    return NULL;
+}
+
+/* a consistent copy of the supervisor's page, mapped again if it was replaced */
+static bool snapshotPage(char *copy)
+{
+    struct stat st;
+    if (stat(gPagePath, &st) != 0) return false;
+    if (!gPage || st.st_ino != gPageIno) {
+        if (gPage) munmap((void *) gPage, SUPERVISE_PAGE_SIZE);
+        gPage = NULL;
+        int fd = open(gPagePath, O_RDONLY);
+        if (fd < 0) return false;
+        void *p = mmap(NULL, SUPERVISE_PAGE_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) return false;
+        gPage = (const volatile char *) p;
+        gPageIno = st.st_ino;
+    }
+    const volatile supervise_header *h = (const volatile supervise_header *) gPage;
+    uint32_t seq;
+    do {
+        while ((seq = h->seq) & 1) sched_yield();
+        __sync_synchronize();
+        memcpy(copy, (const char *) gPage, SUPERVISE_PAGE_SIZE);
+        __sync_synchronize();
+    } while (h->seq != seq);
+    const supervise_header *c = (const supervise_header *) copy;
+    return c->magic == SUPERVISE_MAGIC && c->pid > 0 && c->count <= SUPERVISE_SLOTS;
+}
+
+/*
+ * List /proc and carry over what we knew of every pid still there; new
+ * ones get their stat read once, to learn their parent.
+ */
+static bool scanProcs()
+{
+    int dirfd = open("/proc", O_RDONLY | O_DIRECTORY);
+    if (dirfd < 0) return false;
+    ProcEntry *next = NULL;
+    size_t len = 0, cap = gProcsLen, old = 0;
+    if (cap) next = (ProcEntry *) malloc(cap * sizeof(*next));
+    for (;;) {
+        long n = syscall(__NR_getdents64, dirfd, gDents, DENTS_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        for (long off = 0; off < n;) {
+            const struct linux_dirent64 *d = (const struct linux_dirent64 *) (gDents + off);
+            off += d->d_reclen;
+            if (d->d_name[0] < '1' || d->d_name[0] > '9') continue;
+            pid_t pid = atoi(d->d_name);
+            if (len == cap) {
+                size_t c = cap ? cap * 2 : 512;
+                ProcEntry *tmp = (ProcEntry *) realloc(next, c * sizeof(*tmp));
+                if (!tmp) {
+                    free(next);
+                    close(dirfd);
+                    return false;
+                }
+                next = tmp;
+                cap = c;
+            }
+            while (old < gProcsLen && gProcs[old].pid < pid) old++;
+            ProcEntry *e = &next[len];
+            if (old < gProcsLen && gProcs[old].pid == pid && gProcs[old].ino == d->d_ino) {
+                *e = gProcs[old];
+                e->fresh = false;
+            } else {
+                memset(e, 0, sizeof(*e));
+                e->pid = pid;
+                e->ino = d->d_ino;
+                e->owner = -1;
+                e->fresh = true;
+                e->pss = e->read_bytes = e->write_bytes = -1;
+                if (!readStat(e)) continue;     // already gone
+                e->cpu_last = e->cpu;
+            }
+            len++;
+        }
+    }
+    close(dirfd);
+    free(gProcs);
+    gProcs = next;
+    gProcsLen = len;
+    return true;
+}
+
+static bool isRoot(const supervise_header *h, pid_t pid)
+{
+    const supervise_slot *slots = (const supervise_slot *) (h + 1);
+    for (uint32_t i = 0; i < h->count; i++) {
+        if (slots[i].pid == pid || slots[i].log_pid == pid) return true;
+    }
+    return false;
+}
+
+/*
+ * The ./run a process descends from.  A child of the supervisor that the
+ * page does not list yet stays unsure, and is looked at again next tick.
+ */
+static pid_t resolveOwner(const supervise_header *h, ProcEntry *p, int depth)
+{
+    if (p->owner >= 0) return p->owner;
+    if (isRoot(h, p->pid)) return p->owner = p->pid;
+    if (p->ppid == h->pid) return -1;
+    ProcEntry *parent = depth < MAX_DEPTH ? findProc(p->ppid) : NULL;
+    if (!parent) return p->owner = 0;
+    pid_t owner = resolveOwner(h, parent, depth + 1);
+    if (owner >= 0) p->owner = owner;
+    return owner;
+}
+
+static void sample(UsageTick *tick, const char *copy, long long intervalMs)
+{
+    const supervise_header *h = (const supervise_header *) copy;
+    const supervise_slot *slots = (const supervise_slot *) (h + 1);
+    memset(tick->records, 0, sizeof(tick->records));
+    tick->count = h->count;
+    for (uint32_t i = 0; i < h->count; i++) memcpy(tick->records[i].name, slots[i].name, SUPERVISE_NAME_MAX);
+    for (size_t i = 0; i < gProcsLen; i++) {
+        ProcEntry *p = &gProcs[i];
+        // a restarted ./run is a root again; anything else keeps its owner
+        if (p->owner > 0 && p->owner != p->pid && !findProc(p->owner)) p->owner = -1;
+        pid_t owner = resolveOwner(h, p, 0);
+        if (owner <= 0) continue;
+        uint32_t slot;
+        for (slot = 0; slot < h->count; slot++) {
+            if (slots[slot].pid == owner || slots[slot].log_pid == owner) break;
+        }
+        if (slot == h->count) {
+            p->owner = -1;
+            continue;
+        }
+        // new entries were just read; PSS and I/O only move while the CPU time does
+        p->cpu_last = p->cpu;
+        p->read_delta = p->write_delta = 0;
+        if (!p->fresh && !readStat(p)) continue;
+        if (p->fresh || p->cpu != p->cpu_last) readMemoryAndIo(p);
+        UsageRecord *r = &tick->records[slot];
+        r->cpu_ms += (p->cpu - p->cpu_last) * 1000 / gClockTick;
+        r->rss_kb += p->rss * gPageKb;
+        r->threads += p->threads;
+        r->processes++;
+        if (p->pss < 0) r->flags |= FLAG_NO_PSS;
+        else r->pss_kb += p->pss;
+        if (p->read_bytes < 0 || p->write_bytes < 0) r->flags |= FLAG_NO_IO;
+        r->read_bytes += p->read_delta;
+        r->write_bytes += p->write_delta;
+    }
+    tick->interval_ms = intervalMs;
+}
+
+static void *sampleLoop(void *arg)
+{
+    char *copy = (char *) malloc(SUPERVISE_PAGE_SIZE);
+    UsageTick *tick = (UsageTick *) malloc(sizeof(UsageTick));
+    long long last = nowMs(CLOCK_MONOTONIC);
+    pthread_mutex_lock(&gLock);
+    while (!gStop && copy && tick) {
+        pthread_mutex_unlock(&gLock);
+        long long now = nowMs(CLOCK_MONOTONIC);
+        // a dead supervisor's pids may belong to someone else by now
+        bool ok = snapshotPage(copy) && scanProcs() && findProc(((const supervise_header *) copy)->pid);
+        if (ok) {
+            sample(tick, copy, now - last);
+            tick->time_ms = nowMs(CLOCK_REALTIME);
+        }
+        last = now;
+        pthread_mutex_lock(&gLock);
+        if (ok) {
+            tick->seq = ++gSeq;
+            memcpy(&gRing[tick->seq % RING_TICKS], tick, sizeof(*tick));
+        }
+        // pthread_cond_timedwait() takes CLOCK_REALTIME
+        struct timeval tv;
+        struct timespec until;
+        gettimeofday(&tv, NULL);
+        long long due = (long long) tv.tv_sec * 1000 + tv.tv_usec / 1000 + gIntervalMs;
+        until.tv_sec = due / 1000;
+        until.tv_nsec = (due % 1000) * 1000000;
+        while (!gStop && pthread_cond_timedwait(&gCond, &gLock, &until) != ETIMEDOUT);
+    }
+    pthread_mutex_unlock(&gLock);
+    free(tick);
+    free(copy);
+    free(gProcs);
+    gProcs = NULL;
+    gProcsLen = 0;
+    if (gPage) munmap((void *) gPage, SUPERVISE_PAGE_SIZE);
+    gPage = NULL;
+    return NULL;
+}
+
+static void serviceUsage_stop(JNIEnv *env, jclass clazz)
+{
+    pthread_mutex_lock(&gLock);
+    if (!gRunning) {
+        pthread_mutex_unlock(&gLock);
+        return;
+    }
+    gStop = true;
+    pthread_cond_signal(&gCond);
+    pthread_mutex_unlock(&gLock);
+    pthread_join(gThread, NULL);
+    pthread_mutex_lock(&gLock);
+    gRunning = false;
+    free(gPagePath);
+    gPagePath = NULL;
+    pthread_mutex_unlock(&gLock);
+}
+
+/* sample the services published in page every intervalMs; restarts if running */
+static jboolean serviceUsage_start(JNIEnv *env, jclass clazz, jstring page, jint intervalMs)
+{
+    serviceUsage_stop(env, clazz);
+    const char *page_8 = env->GetStringUTFChars(page, NULL);
+    if (!page_8) return JNI_FALSE;
+    pthread_mutex_lock(&gLock);
+    gPagePath = strdup(page_8);
+    env->ReleaseStringUTFChars(page, page_8);
+    if (!gRing) gRing = (UsageTick *) calloc(RING_TICKS, sizeof(UsageTick));
+    gClockTick = sysconf(_SC_CLK_TCK);
+    gPageKb = sysconf(_SC_PAGESIZE) / 1024;
+    gIntervalMs = intervalMs < INTERVAL_MIN_MS ? INTERVAL_MIN_MS : intervalMs;
+    gStop = false;
+    gRunning = gPagePath && gRing && pthread_create(&gThread, NULL, sampleLoop, NULL) == 0;
+    if (!gRunning) {
+        free(gPagePath);
+        gPagePath = NULL;
+    }
+    pthread_mutex_unlock(&gLock);
+    return gRunning ? JNI_TRUE : JNI_FALSE;
+}
+
+/* ticks after seq, oldest first, as packed {seq, time, interval, count, records...} */
+static jbyteArray serviceUsage_read(JNIEnv *env, jclass clazz, jlong since)
+{
+    pthread_mutex_lock(&gLock);
+    int64_t first = since < 0 ? 1 : since + 1;
+    if (gSeq - first >= RING_TICKS) first = gSeq - RING_TICKS + 1;
+    size_t size = 0;
+    for (int64_t seq = first; seq <= gSeq; seq++) {
+        size += offsetof(UsageTick, records) + gRing[seq % RING_TICKS].count * sizeof(UsageRecord);
+    }
+    char *buf = (char *) malloc(size ? size : 1);
+    char *out = buf;
+    if (buf) for (int64_t seq = first; seq <= gSeq; seq++) {
+        const UsageTick *t = &gRing[seq % RING_TICKS];
+        size_t len = offsetof(UsageTick, records) + t->count * sizeof(UsageRecord);
+        memcpy(out, t, len);
+        out += len;
+    }
+    pthread_mutex_unlock(&gLock);
+    if (!buf) return NULL;
+    jbyteArray result = env->NewByteArray(size);
+    if (result) env->SetByteArrayRegion(result, 0, size, (const jbyte *) buf);
+    free(buf);
+    return result;
+}
+
+static const char *classPathName = "com/botbrew/basil/ServiceUsage";
+static JNINativeMethod method_table[] = {
+    { "nativeStart", "(Ljava/lang/String;I)Z", (void *) serviceUsage_start },
+    { "nativeStop", "()V", (void *) serviceUsage_stop },
+    { "nativeRead", "(J)[B", (void *) serviceUsage_read },
+};
+
+int init_ServiceUsage(JNIEnv *env)
+{
+    if (!registerNativeMethods(env, classPathName, method_table,
+                sizeof(method_table) / sizeof(method_table[0]))) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
@@ -0,0 +1,8 @@
+#ifndef _SERVICEUSAGE_H
+#define _SERVICEUSAGE_H 1
+
+#include "jni.h"
+
+int init_ServiceUsage(JNIEnv *env);
+
+#endif	/* !defined(_SERVICEUSAGE_H) */
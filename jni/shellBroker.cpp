@@ -0,0 +1,328 @@
+#include "common.h"
+
+#define LOG_TAG "ShellBroker"
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "shellBroker.h"
+#include "init/broker.h"
+
+static jclass class_fileDescriptor;
+static jfieldID field_fileDescriptor_descriptor;
+static jmethodID method_fileDescriptor_init;
+
+static void throwIOException(JNIEnv *env, int errnum)
+{
+    jclass exClass = env->FindClass("java/io/IOException");
+    env->ThrowNew(exClass, strerror(errnum));
+}
+
+static jobject newFileDescriptor(JNIEnv *env, int fd)
+{
+    jobject result = env->NewObject(class_fileDescriptor, method_fileDescriptor_init);
+    if (result) env->SetIntField(result, field_fileDescriptor_descriptor, fd);
+    return result;
+}
+
+static int read_full(int fd, void *buf, size_t len)
+{
+    char *p = (char *) buf;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            if (n == 0) errno = EPIPE;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/*
+ * With buf NULL, the most bytes the UTF-8 of the strings can take;
+ * otherwise append it, each string NUL-terminated, and return the bytes
+ * stored.  Returns -1 for a null string, or characters that could not be had.
+ */
+static ssize_t pack_strings(JNIEnv *env, jobjectArray array, char *buf)
+{
+    if (!array) return 0;
+    size_t total = 0;
+    jsize n = env->GetArrayLength(array);
+    for (jsize i = 0; i < n; i++) {
+        jstring str = (jstring) env->GetObjectArrayElement(array, i);
+        if (!str) return -1;
+        size_t len = buf ? jstring_to_utf8(env, str, buf + total)
+                         : 3 * (size_t) env->GetStringLength(str) + 1;
+        env->DeleteLocalRef(str);
+        if (!len) return -1;
+        total += len;
+    }
+    return total;
+}
+
+static void close_all(int *fds, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+}
+
+/*
+ * Run argv on the broker listening at socketPath.  The local ends of the
+ * command's stdin, stdout and stderr (null if redirect) and the connection
+ * to the broker are stored in fds[0..3].  Returns the pid.
+ */
+static jint shellBroker_spawn(JNIEnv *env, jclass clazz,
+    jstring socketPath, jint flags, jstring cwd, jobjectArray argv,
+    jobjectArray envp, jboolean redirect, jobjectArray fdArray)
+{
+    struct sockaddr_un addr;
+    struct broker_request req;
+    struct broker_reply reply;
+    int pipes[6] = {-1, -1, -1, -1, -1, -1};
+    int conn = -1;
+    int err = 0;
+    char *payload = NULL;
+    jobject connFd;
+
+    if (!socketPath || !argv || !fdArray || env->GetArrayLength(fdArray) < 4) {
+        throwIOException(env, EINVAL);
+        return -1;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    {
+        char path[3 * sizeof(addr.sun_path) + 1];
+        if ((size_t) env->GetStringLength(socketPath) >= sizeof(addr.sun_path) ||
+            !jstring_to_utf8(env, socketPath, path) ||
+            strlen(path) >= sizeof(addr.sun_path)) {
+            throwIOException(env, ENAMETOOLONG);
+            return -1;
+        }
+        strcpy(addr.sun_path, path);
+    }
+
+    // cwd, then argv, then envp: sized for the worst case, then packed
+    ssize_t cwdLen = cwd ? 3 * (size_t) env->GetStringLength(cwd) + 1 : 2;
+    ssize_t argvLen = pack_strings(env, argv, NULL);
+    ssize_t envpLen = pack_strings(env, envp, NULL);
+    if (argvLen <= 0 || envpLen < 0) {
+        throwIOException(env, EINVAL);
+        return -1;
+    }
+    if (!(payload = (char *) malloc(cwdLen + argvLen + envpLen))) {
+        throwIOException(env, ENOMEM);
+        return -1;
+    }
+    cwdLen = cwd ? (ssize_t) jstring_to_utf8(env, cwd, payload) : 2;
+    if (!cwd) memcpy(payload, "/", 2);
+    argvLen = cwdLen ? pack_strings(env, argv, payload + cwdLen) : -1;
+    envpLen = argvLen > 0 ? pack_strings(env, envp, payload + cwdLen + argvLen) : -1;
+    if (argvLen <= 0 || envpLen < 0) {
+        free(payload);
+        throwIOException(env, EINVAL);
+        return -1;
+    }
+    size_t length = cwdLen + argvLen + envpLen;
+    if (length > BROKER_MAX_LENGTH) {
+        free(payload);
+        throwIOException(env, E2BIG);
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.magic = BROKER_MAGIC;
+    req.flags = flags & ~BROKER_SHUTDOWN;
+    req.argc = env->GetArrayLength(argv);
+    req.envc = envp ? env->GetArrayLength(envp) : 0;
+    req.length = length;
+
+    // pipes[2*i] is read by the reader, pipes[2*i+1] written by the writer
+    int remote[3];
+    int local[3];
+    for (int i = 0; i < (redirect ? 2 : 3); i++) {
+        if (pipe(pipes + 2 * i) < 0) {
+            err = errno;
+            goto bail;
+        }
+    }
+    remote[0] = pipes[0];
+    local[0] = pipes[1];
+    remote[1] = pipes[3];
+    local[1] = pipes[2];
+    remote[2] = redirect ? pipes[3] : pipes[5];
+    local[2] = redirect ? -1 : pipes[4];
+    for (int i = 0; i < 3; i++) {
+        if (local[i] >= 0) fcntl(local[i], F_SETFD, FD_CLOEXEC);
+    }
+
+    conn = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conn < 0) {
+        err = errno;
+        goto bail;
+    }
+    fcntl(conn, F_SETFD, FD_CLOEXEC);
+    if (connect(conn, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        err = errno;
+        goto bail;
+    }
+
+    {
+        union {
+            struct cmsghdr align;
+            char buf[CMSG_SPACE(3 * sizeof(int))];
+        } control;
+        struct iovec iov[2];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        iov[0].iov_base = &req;
+        iov[0].iov_len = sizeof(req);
+        iov[1].iov_base = payload;
+        iov[1].iov_len = length;
+        msg.msg_iov = iov;
+        msg.msg_iovlen = 2;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), remote, 3 * sizeof(int));
+
+        ssize_t sent;
+        do {
+            sent = sendmsg(conn, &msg, MSG_NOSIGNAL);
+        } while (sent < 0 && errno == EINTR);
+        if (sent < 0) {
+            err = errno;
+            goto bail;
+        }
+        // the descriptors went with the first byte; send whatever is left
+        size_t done = sent;
+        while (done < sizeof(req) + length) {
+            const char *p = done < sizeof(req) ? (const char *) &req + done
+                : payload + (done - sizeof(req));
+            size_t left = done < sizeof(req) ? sizeof(req) - done
+                : length - (done - sizeof(req));
+            sent = send(conn, p, left, MSG_NOSIGNAL);
+            if (sent < 0 && errno == EINTR) continue;
+            if (sent < 0) {
+                err = errno;
+                goto bail;
+            }
+            done += sent;
+        }
+    }
+    free(payload);
+    payload = NULL;
+
+    if (read_full(conn, &reply, sizeof(reply)) < 0) {
+        err = errno;
+        goto bail;
+    }
+    if (reply.kind != BROKER_STARTED || reply.value <= 0) {
+        err = reply.value < 0 ? -reply.value : EPROTO;
+        goto bail;
+    }
+
+    // only our ends stay open here
+    close(remote[0]);
+    close(remote[1]);
+    if (!redirect) close(remote[2]);
+    for (int i = 0; i < 3; i++) {
+        jobject fd = local[i] >= 0 ? newFileDescriptor(env, local[i]) : NULL;
+        if (local[i] >= 0 && !fd) {
+            // the FileDescriptors already in fdArray own theirs
+            close_all(local + i, 3 - i);
+            close(conn);
+            return -1;
+        }
+        env->SetObjectArrayElement(fdArray, i, fd);
+        if (fd) env->DeleteLocalRef(fd);
+    }
+    connFd = newFileDescriptor(env, conn);
+    if (!connFd) {
+        close(conn);
+        return -1;
+    }
+    env->SetObjectArrayElement(fdArray, 3, connFd);
+    env->DeleteLocalRef(connFd);
+    return reply.value;
+
+bail:
+    free(payload);
+    close_all(pipes, 6);
+    if (conn >= 0) close(conn);
+    throwIOException(env, err);
+    return -1;
+}
+
+/*
+ * Wait for the exit report; returns the exit code, 128+signal if the
+ * command was killed, or -1 if the broker went away.
+ */
+static jint shellBroker_wait(JNIEnv *env, jclass clazz, jobject connFd)
+{
+    struct broker_reply reply;
+    int conn = env->GetIntField(connFd, field_fileDescriptor_descriptor);
+    if (env->ExceptionOccurred() != NULL) {
+        return -1;
+    }
+    if (read_full(conn, &reply, sizeof(reply)) < 0 || reply.kind != BROKER_EXITED) {
+        return -1;
+    }
+    int status = reply.value;
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return -1;
+}
+
+static void shellBroker_signal(JNIEnv *env, jclass clazz, jobject connFd, jint signo)
+{
+    int conn = env->GetIntField(connFd, field_fileDescriptor_descriptor);
+    if (env->ExceptionOccurred() != NULL) {
+        return;
+    }
+    int32_t value = signo;
+    send(conn, &value, sizeof(value), MSG_NOSIGNAL);
+}
+
+static const char *classPathName = "com/botbrew/basil/Shell$Broker";
+static JNINativeMethod method_table[] = {
+    { "nativeSpawn", "(Ljava/lang/String;ILjava/lang/String;[Ljava/lang/String;[Ljava/lang/String;Z[Ljava/io/FileDescriptor;)I",
+        (void *) shellBroker_spawn },
+    { "nativeWait", "(Ljava/io/FileDescriptor;)I", (void *) shellBroker_wait },
+    { "nativeSignal", "(Ljava/io/FileDescriptor;I)V", (void *) shellBroker_signal },
+};
+
+int init_ShellBroker(JNIEnv *env) {
+    jclass clazz = env->FindClass("java/io/FileDescriptor");
+    if (clazz == NULL) {
+        return JNI_FALSE;
+    }
+    class_fileDescriptor = (jclass) env->NewGlobalRef(clazz);
+    env->DeleteLocalRef(clazz);
+    field_fileDescriptor_descriptor = env->GetFieldID(class_fileDescriptor, "descriptor", "I");
+    method_fileDescriptor_init = env->GetMethodID(class_fileDescriptor, "<init>", "()V");
+    if (field_fileDescriptor_descriptor == NULL || method_fileDescriptor_init == NULL) {
+        return JNI_FALSE;
+    }
+
+    if (!registerNativeMethods(env, classPathName, method_table,
+                 sizeof(method_table) / sizeof(method_table[0]))) {
+        return JNI_FALSE;
+    }
+
+    return JNI_TRUE;
+}
@@ -0,0 +1,8 @@
+#ifndef _SHELLBROKER_H
+#define _SHELLBROKER_H 1
+
+#include "jni.h"
+
+int init_ShellBroker(JNIEnv *env);
+
+#endif	/* !defined(_SHELLBROKER_H) */
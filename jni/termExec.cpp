@@ -37,69 +37,99 @@
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <sys/wait.h>
+#include <poll.h>
+#include <time.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <termios.h>
 #include <signal.h>
 
 #include "termExec.h"
+#include "reaper.h"
+#include "init/cgroup.h"
+
+extern char **environ;
 
 static jclass class_fileDescriptor;
 static jfieldID field_fileDescriptor_descriptor;
 static jmethodID method_fileDescriptor_init;
 
-typedef unsigned short char16_t;
+static int throwException(JNIEnv *env, const char *className, const char *message)
+{
+    jclass exClass;
 
-class String8 {
-public:
-    String8() {
-        mString = 0;
-    }
+    exClass = env->FindClass(className);
+    return env->ThrowNew(exClass, message);
+}
 
-    ~String8() {
-        if (mString) {
-            free(mString);
-        }
-    }
+static int throwOutOfMemoryError(JNIEnv *env, const char *message)
+{
+    return throwException(env, "java/lang/OutOfMemoryError", message);
+}
 
-    void set(const char16_t* o, size_t numChars) {
-        if (mString) {
-            free(mString);
-        }
-        mString = (char*) malloc(numChars + 1);
-        if (!mString) {
-            return;
-        }
-        for (size_t i = 0; i < numChars; i++) {
-            mString[i] = (char) o[i];
+static int throwIOException(JNIEnv *env, int errnum)
+{
+    return throwException(env, "java/io/IOException", strerror(errnum));
+}
+
+/*
+ * Build the environment for the child in the parent.  The child created
+ * by vfork() shares our address space, so it must not call putenv() on
+ * our environ; instead the overrides in envp are merged with at most
+ * environc entries of environ into res.  Entries without an '=' unset
+ * the named variable, as putenv() would.
+ */
+static void merge_environ(char *const envp[], size_t environc, char **res)
+{
+    size_t m = 0, k = 0;
+
+    while (envp[m]) m++;
+    for (char **e = environ; e && *e && environc; ++e, --environc) {
+        size_t len = strcspn(*e, "=");
+        bool overridden = false;
+        for (size_t i = 0; i < m; ++i) {
+            if (strncmp(*e, envp[i], len) == 0 &&
+                (envp[i][len] == '=' || envp[i][len] == '\0')) {
+                overridden = true;
+                break;
+            }
         }
-        mString[numChars] = '\0';
+        if (!overridden) res[k++] = *e;
     }
-
-    const char* string() {
-        return mString;
+    for (size_t i = 0; i < m; ++i) {
+        if (strchr(envp[i], '=')) res[k++] = envp[i];
     }
-private:
-    char* mString;
-};
-
-static int throwOutOfMemoryError(JNIEnv *env, const char *message)
-{
-    jclass exClass;
-    const char *className = "java/lang/OutOfMemoryError";
-
-    exClass = env->FindClass(className);
-    return env->ThrowNew(exClass, message);
+    res[k] = NULL;
 }
 
+/*
+ * Spawn cmd on a new pty with the complete environment envp.  We use
+ * vfork() (clone with CLONE_VM|CLONE_VFORK) rather than fork(): fork() has
+ * to duplicate the page tables of the whole VM process, which makes every
+ * spawn cost proportional to our RSS.
+ *
+ * Since the child borrows our memory and stack until it execs, it may only
+ * make async-signal-safe calls and must leave the parent's state alone.
+ * All signals are blocked around vfork() so no handler of ours can run on
+ * the shared stack; the child resets caught signals to their defaults
+ * before restoring the original mask.
+ *
+ * If cgroup_fd is an open cgroup.procs, the child moves itself there
+ * before it execs, so nothing it starts runs outside the group.
+ */
 static int create_subprocess(const char *cmd,
-    char *const argv[], char *const envp[], int* pProcessId)
+    char *const argv[], char *const envp[], int cgroup_fd, int* pProcessId)
 {
     char *devname;
     int ptm;
     pid_t pid;
+    sigset_t blockall, oldmask;
+    volatile int child_errno = 0;
 
     ptm = open("/dev/ptmx", O_RDWR); // | O_NOCTTY);
     if(ptm < 0){
@@ -111,116 +141,198 @@ static int create_subprocess(const char *cmd,
     if(grantpt(ptm) || unlockpt(ptm) ||
        ((devname = (char*) ptsname(ptm)) == 0)){
         LOGE("[ trouble with /dev/ptmx - %s ]\n", strerror(errno));
+        close(ptm);
         return -1;
     }
 
-    pid = fork();
-    if(pid < 0) {
-        LOGE("- fork failed: %s -\n", strerror(errno));
-        return -1;
-    }
+    sigfillset(&blockall);
+    pthread_sigmask(SIG_SETMASK, &blockall, &oldmask);
 
-    if(pid == 0){
-        close(ptm);
+    pid = vfork();
 
+    if(pid == 0){
+        struct sigaction sa;
         int pts;
 
+        sa.sa_handler = SIG_DFL;
+        sa.sa_flags = 0;
+        sigemptyset(&sa.sa_mask);
+        for (int signo = 1; signo < NSIG; signo++) {
+            struct sigaction old;
+            if (sigaction(signo, NULL, &old) == 0 &&
+                old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN) {
+                sigaction(signo, &sa, NULL);
+            }
+        }
+        sigprocmask(SIG_SETMASK, &oldmask, NULL);
+
         setsid();
 
+        if (cgroup_fd >= 0 && write(cgroup_fd, "0", 1) < 0) {
+            child_errno = errno;
+            _exit(-1);
+        }
+
         pts = open(devname, O_RDWR);
-        if(pts < 0) exit(-1);
+        if(pts < 0) {
+            child_errno = errno;
+            _exit(-1);
+        }
 
         dup2(pts, 0);
         dup2(pts, 1);
         dup2(pts, 2);
+        if (pts > 2) close(pts);
 
-        if (envp) {
-            for (; *envp; ++envp) {
-                putenv(*envp);
-            }
-        }
+        execve(cmd, argv, envp);
+        child_errno = errno;
+        _exit(-1);
+    }
 
-        execv(cmd, argv);
-        exit(-1);
-    } else {
-        *pProcessId = (int) pid;
-        return ptm;
+    int saved_errno = errno;
+    pthread_sigmask(SIG_SETMASK, &oldmask, NULL);
+
+    if(pid < 0) {
+        LOGE("- vfork failed: %s -\n", strerror(saved_errno));
+        close(ptm);
+        return -1;
+    }
+    if (child_errno) {
+        LOGE("- exec %s failed: %s -\n", cmd, strerror(child_errno));
     }
+
+    *pProcessId = (int) pid;
+    return ptm;
 }
 
 
-static jobject android_os_Exec_createSubProcess(JNIEnv *env, jobject clazz,
-    jstring cmd, jobjectArray args, jobjectArray envVars,
-    jintArray processIdArray)
+/*
+ * Everything one spawn needs (argv, envp, the merged child environment and
+ * the strings they point to) is carved out of this single buffer, which is
+ * kept and reused by the next spawn.  gArenaLock is held from marshaling
+ * until the child has exec'd.
+ */
+static pthread_mutex_t gArenaLock = PTHREAD_MUTEX_INITIALIZER;
+static char *gArena;
+static size_t gArenaSize;
+
+static char *arena_reserve(size_t size)
 {
-    const jchar* str = cmd ? env->GetStringCritical(cmd, 0) : 0;
-    String8 cmd_8;
-    if (str) {
-        cmd_8.set(str, env->GetStringLength(cmd));
-        env->ReleaseStringCritical(cmd, str);
-    }
-
-    jsize size = args ? env->GetArrayLength(args) : 0;
-    char **argv = NULL;
-    String8 tmp_8;
-    if (size > 0) {
-        argv = (char **)malloc((size+1)*sizeof(char *));
-        if (!argv) {
-            throwOutOfMemoryError(env, "Couldn't allocate argv array");
+    if (size > gArenaSize) {
+        size_t newSize = gArenaSize ? gArenaSize : 4096;
+        while (newSize < size) newSize *= 2;
+        char *p = (char *) malloc(newSize);
+        if (!p) {
             return NULL;
         }
-        for (int i = 0; i < size; ++i) {
-            jstring arg = reinterpret_cast<jstring>(env->GetObjectArrayElement(args, i));
-            str = env->GetStringCritical(arg, 0);
-            if (!str) {
-                throwOutOfMemoryError(env, "Couldn't get argument from array");
-                return NULL;
-            }
-            tmp_8.set(str, env->GetStringLength(arg));
-            env->ReleaseStringCritical(arg, str);
-            argv[i] = strdup(tmp_8.string());
-        }
-        argv[size] = NULL;
+        free(gArena);
+        gArena = p;
+        gArenaSize = newSize;
     }
+    return gArena;
+}
 
-    size = envVars ? env->GetArrayLength(envVars) : 0;
-    char **envp = NULL;
-    if (size > 0) {
-        envp = (char **)malloc((size+1)*sizeof(char *));
-        if (!envp) {
-            throwOutOfMemoryError(env, "Couldn't allocate envp array");
-            return NULL;
-        }
-        for (int i = 0; i < size; ++i) {
-            jstring var = reinterpret_cast<jstring>(env->GetObjectArrayElement(envVars, i));
-            str = env->GetStringCritical(var, 0);
-            if (!str) {
-                throwOutOfMemoryError(env, "Couldn't get env var from array");
-                return NULL;
-            }
-            tmp_8.set(str, env->GetStringLength(var));
-            env->ReleaseStringCritical(var, str);
-            envp[i] = strdup(tmp_8.string());
-        }
-        envp[size] = NULL;
+static size_t utf8_bound(JNIEnv *env, jstring str)
+{
+    return str ? 3 * (size_t) env->GetStringLength(str) + 1 : 1;
+}
+
+static size_t utf8_bound(JNIEnv *env, jobjectArray array, jsize size)
+{
+    size_t total = 0;
+    for (jsize i = 0; i < size; ++i) {
+        jstring str = reinterpret_cast<jstring>(env->GetObjectArrayElement(array, i));
+        total += utf8_bound(env, str);
+        env->DeleteLocalRef(str);
     }
+    return total;
+}
 
-    int procId;
-    int ptm = create_subprocess(cmd_8.string(), argv, envp, &procId);
+static char *marshal_string(JNIEnv *env, jstring str, char **cursor)
+{
+    char *res = *cursor;
+    if (!str) {
+        *(*cursor)++ = '\0';
+        return res;
+    }
+    size_t len = jstring_to_utf8(env, str, res);
+    if (!len) {
+        return NULL;
+    }
+    *cursor += len;
+    return res;
+}
 
-    if (argv) {
-        for (char **tmp = argv; *tmp; ++tmp) {
-            free(*tmp);
+static bool marshal_array(JNIEnv *env, jobjectArray array, jsize size,
+    char **out, char **cursor)
+{
+    for (jsize i = 0; i < size; ++i) {
+        jstring str = reinterpret_cast<jstring>(env->GetObjectArrayElement(array, i));
+        out[i] = marshal_string(env, str, cursor);
+        env->DeleteLocalRef(str);
+        if (!out[i]) {
+            return false;
         }
-        free(argv);
     }
-    if (envp) {
-        for (char **tmp = envp; *tmp; ++tmp) {
-            free(*tmp);
+    out[size] = NULL;
+    return true;
+}
+
+static jobject android_os_Exec_createSubProcessInCgroup(JNIEnv *env, jobject clazz,
+    jstring cmd, jobjectArray args, jobjectArray envVars,
+    jintArray processIdArray, jstring cgroup)
+{
+    int cgroup_fd = -1;
+    if (cgroup) {
+        const char *cgroup_8 = env->GetStringUTFChars(cgroup, NULL);
+        if (!cgroup_8) return NULL;
+        cgroup_fd = cgroup_open(cgroup_8);
+        int err = errno;
+        env->ReleaseStringUTFChars(cgroup, cgroup_8);
+        if (cgroup_fd < 0) {
+            throwIOException(env, err);
+            return NULL;
         }
-        free(envp);
     }
 
+    jsize argc = args ? env->GetArrayLength(args) : 0;
+    jsize envc = envVars ? env->GetArrayLength(envVars) : 0;
+    size_t environc = 0;
+    for (char **e = environ; e && *e; ++e) environc++;
+
+    size_t ptrs = (argc + 1) + (envc + 1) + (environc + envc + 1);
+    size_t bytes = ptrs * sizeof(char *) + utf8_bound(env, cmd) +
+        utf8_bound(env, args, argc) + utf8_bound(env, envVars, envc);
+
+    pthread_mutex_lock(&gArenaLock);
+    char *arena = arena_reserve(bytes);
+    if (!arena) {
+        pthread_mutex_unlock(&gArenaLock);
+        if (cgroup_fd >= 0) close(cgroup_fd);
+        throwOutOfMemoryError(env, "Couldn't allocate argv/envp arena");
+        return NULL;
+    }
+    char **argv = (char **) arena;
+    char **envp = argv + argc + 1;
+    char **child_envp = envp + envc + 1;
+    char *cursor = (char *) (child_envp + environc + envc + 1);
+
+    char *cmd_8 = marshal_string(env, cmd, &cursor);
+    if (!cmd_8 || !marshal_array(env, args, argc, argv, &cursor) ||
+        !marshal_array(env, envVars, envc, envp, &cursor)) {
+        pthread_mutex_unlock(&gArenaLock);
+        if (cgroup_fd >= 0) close(cgroup_fd);
+        throwOutOfMemoryError(env, "Couldn't get argument from array");
+        return NULL;
+    }
+    merge_environ(envp, environc, child_envp);
+
+    int procId = -1;
+    int ptm = create_subprocess(cmd_8, argv, child_envp, cgroup_fd, &procId);
+    pthread_mutex_unlock(&gArenaLock);
+    if (cgroup_fd >= 0) close(cgroup_fd);
+    reaper_track(procId);
+
     if (processIdArray) {
         int procIdLen = env->GetArrayLength(processIdArray);
         if (procIdLen > 0) {
@@ -246,6 +358,14 @@ static jobject android_os_Exec_createSubProcess(JNIEnv *env, jobject clazz,
     return result;
 }
 
+static jobject android_os_Exec_createSubProcess(JNIEnv *env, jobject clazz,
+    jstring cmd, jobjectArray args, jobjectArray envVars,
+    jintArray processIdArray)
+{
+    return android_os_Exec_createSubProcessInCgroup(env, clazz, cmd, args,
+        envVars, processIdArray, NULL);
+}
+
 
 static void android_os_Exec_setPtyWindowSize(JNIEnv *env, jobject clazz,
     jobject fileDescriptor, jint row, jint col, jint xpixel, jint ypixel)
@@ -288,15 +408,159 @@ static void android_os_Exec_setPtyUTF8Mode(JNIEnv *env, jobject clazz,
     tcsetattr(fd, TCSANOW, &tios);
 }
 
+static long long monotonic_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Resolve [offset, offset+length) of a direct ByteBuffer to a native
+ * pointer.  Throws and returns NULL if the buffer is not direct or the
+ * range does not fit.
+ */
+static char *directBufferRange(JNIEnv *env, jobject buffer,
+    jint offset, jint length)
+{
+    char *base = buffer ? (char *) env->GetDirectBufferAddress(buffer) : NULL;
+    if (!base) {
+        throwException(env, "java/lang/IllegalArgumentException",
+            "not a direct buffer");
+        return NULL;
+    }
+    jlong capacity = env->GetDirectBufferCapacity(buffer);
+    if (offset < 0 || length < 0 || (jlong) offset + length > capacity) {
+        throwException(env, "java/lang/IndexOutOfBoundsException",
+            "range outside of buffer");
+        return NULL;
+    }
+    return base + offset;
+}
+
+/*
+ * Read pty output straight into a direct buffer.  Blocks until some
+ * output is available, then keeps reading until at least minBatch bytes
+ * have been collected or timeoutMs has passed since the first byte, so
+ * bursts of output reach Java in one call instead of many.  A hung up
+ * pty reads as end of stream (-1).
+ */
+static jint android_os_Exec_readDirect(JNIEnv *env, jobject clazz,
+    jobject fileDescriptor, jobject buffer, jint offset, jint length,
+    jint minBatch, jint timeoutMs)
+{
+    int fd;
+    ssize_t n;
+    jint total;
+
+    fd = env->GetIntField(fileDescriptor, field_fileDescriptor_descriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return -1;
+    }
+
+    char *base = directBufferRange(env, buffer, offset, length);
+    if (!base || length == 0) {
+        return 0;
+    }
+
+    do {
+        n = read(fd, base, length);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        if (errno == EIO) {
+            return -1;
+        }
+        throwIOException(env, errno);
+        return -1;
+    }
+    if (n == 0) {
+        return -1;
+    }
+    total = n;
+
+    if (timeoutMs <= 0) {
+        return total;
+    }
+    long long deadline = monotonic_ms() + timeoutMs;
+    while (total < minBatch && total < length) {
+        struct pollfd pfd;
+        int remaining = (int) (deadline - monotonic_ms());
+        if (remaining <= 0) {
+            break;
+        }
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        int r = poll(&pfd, 1, remaining);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            break;
+        }
+        n = read(fd, base + total, length - total);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // report EOF or errors on the next call
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+/*
+ * Write all of [offset, offset+length) of a direct buffer to a pty.
+ */
+static jint android_os_Exec_writeDirect(JNIEnv *env, jobject clazz,
+    jobject fileDescriptor, jobject buffer, jint offset, jint length)
+{
+    int fd;
+    jint total = 0;
+
+    fd = env->GetIntField(fileDescriptor, field_fileDescriptor_descriptor);
+
+    if (env->ExceptionOccurred() != NULL) {
+        return -1;
+    }
+
+    const char *base = directBufferRange(env, buffer, offset, length);
+    if (!base) {
+        return -1;
+    }
+
+    while (total < length) {
+        ssize_t n = write(fd, base + total, length - total);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN) {
+                struct pollfd pfd;
+                pfd.fd = fd;
+                pfd.events = POLLOUT;
+                pfd.revents = 0;
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            throwIOException(env, errno);
+            return -1;
+        }
+        total += n;
+    }
+    return total;
+}
+
 static int android_os_Exec_waitFor(JNIEnv *env, jobject clazz,
     jint procId) {
-    int status;
-    waitpid(procId, &status, 0);
-    int result = 0;
-    if (WIFEXITED(status)) {
-        result = WEXITSTATUS(status);
+    struct reaper_status status;
+    if (reaper_wait(procId, &status) < 0) {
+        return -1;
     }
-    return result;
+    return reaper_code(&status);
 }
 
 static void android_os_Exec_close(JNIEnv *env, jobject clazz, jobject fileDescriptor)
@@ -355,12 +619,18 @@ static const char *classPathName = "jackpal/androidterm/Exec";
 static JNINativeMethod method_table[] = {
     { "createSubprocess", "(Ljava/lang/String;[Ljava/lang/String;[Ljava/lang/String;[I)Ljava/io/FileDescriptor;",
         (void*) android_os_Exec_createSubProcess },
+    { "createSubprocess", "(Ljava/lang/String;[Ljava/lang/String;[Ljava/lang/String;[ILjava/lang/String;)Ljava/io/FileDescriptor;",
+        (void*) android_os_Exec_createSubProcessInCgroup },
     { "setPtyWindowSize", "(Ljava/io/FileDescriptor;IIII)V",
         (void*) android_os_Exec_setPtyWindowSize},
     { "setPtyUTF8Mode", "(Ljava/io/FileDescriptor;Z)V",
         (void*) android_os_Exec_setPtyUTF8Mode},
     { "waitFor", "(I)I",
         (void*) android_os_Exec_waitFor},
+    { "readDirect", "(Ljava/io/FileDescriptor;Ljava/nio/ByteBuffer;IIII)I",
+        (void*) android_os_Exec_readDirect},
+    { "writeDirect", "(Ljava/io/FileDescriptor;Ljava/nio/ByteBuffer;II)I",
+        (void*) android_os_Exec_writeDirect},
     { "close", "(Ljava/io/FileDescriptor;)V",
         (void*) android_os_Exec_close},
     { "hangupProcessGroup", "(I)V",
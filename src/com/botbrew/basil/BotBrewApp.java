@@ -92,20 +92,42 @@ public class BotBrewApp extends Application {
 					sh.botbrew(path_init_src.getAbsolutePath(),path.getAbsolutePath(),"/system/bin/sh -c ''");
 					sh.stdin().close();
 					sinkOutput(sh);
-					return sh.waitFor() == 0;
+					if(sh.waitFor() != 0) return false;
+					startBroker(path_init_src,path);
+					return true;
 				} else if(path_img.isFile()) {
 					sh = Shell.Pipe.getRootShell().redirect();
 					sh.botbrew(path_init_src.getAbsolutePath(),path_img.getAbsolutePath(),"/system/bin/sh -c ''");
 					sh.stdin().close();
 					sinkOutput(sh);
-					return sh.waitFor() == 0;
+					if(sh.waitFor() != 0) return false;
+					startBroker(path_init_src,path_img);
+					return true;
 				} else return false;
 			}
+			// a listening broker lives in the mounted chroot's /run
+			if((!remount)&&(Shell.Broker.available(path.getAbsolutePath()))) return true;
 			sh = Shell.Pipe.getRootShell().redirect();
 			if(remount) sh.botbrew(path_init_src.getAbsolutePath(),path.getAbsolutePath(),"/system/bin/sh -c 'rm -rf /var/run /tmp /var/lock /botbrew/tmp; ln -s ../run /var/run; ln -s run/tmp /tmp; ln -s ../run/lock /var/lock; ln -s run/tmp /botbrew/tmp'");
 			else sh.botbrew(path_init_src.getAbsolutePath(),path.getAbsolutePath(),"/system/bin/sh -c ''");
 			sh.stdin().close();
 			sinkOutput(sh);
+			if(sh.waitFor() != 0) return false;
+			startBroker(path_init_src,path);
+			return true;
+		} catch(IOException ex) {
+			Log.v(TAG,"IOException");
+		} catch(InterruptedException ex) {
+			Log.v(TAG,"InterruptedException");
+		}
+		return false;
+	}
+	protected boolean startBroker(final File init, final File target) {
+		try {
+			final Shell sh = Shell.Pipe.getRootShell().redirect();
+			sh.exec("'"+init.getAbsolutePath()+"' --target '"+target.getAbsolutePath()+"' --broker="+android.os.Process.myUid());
+			sh.stdin().close();
+			sinkOutput(sh);
 			return sh.waitFor() == 0;
 		} catch(IOException ex) {
 			Log.v(TAG,"IOException");
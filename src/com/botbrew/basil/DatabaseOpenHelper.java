@@ -6,7 +6,7 @@ import android.database.sqlite.SQLiteOpenHelper;
 import android.util.Log;
 
 public class DatabaseOpenHelper extends SQLiteOpenHelper {
-	private static final int DB_VERSION = 1;
+	private static final int DB_VERSION = 3;
 	private static final String DB_NAME = "botbrew";
 	public static final String ID = "_id";
 	public static final String T_PACKAGECACHE = "packagecache";
@@ -14,17 +14,23 @@ public class DatabaseOpenHelper extends SQLiteOpenHelper {
 	public static final String C_SUMMARY = "summary";
 	public static final String C_INSTALLED = "installed";
 	public static final String C_UPGRADABLE = "upgradable";
+	public static final String C_SORTKEY = "sortkey";	// NaturalSort.key(name)
 	public static final String T_PACKAGECACHEFTS = "packagecachefts";
+	private final Context mContext;
 	public DatabaseOpenHelper(Context context) {
 		super(context,DB_NAME,null,DB_VERSION);
+		mContext = context;
 	}
 	@Override
 	public void onCreate(SQLiteDatabase db) {
-		db.execSQL("CREATE TABLE "+T_PACKAGECACHE+" ("+C_NAME+" TEXT NOT NULL, "+C_SUMMARY+" TEXT NOT NULL, "+C_INSTALLED+" TEXT, "+C_UPGRADABLE+" TEXT);");
+		db.execSQL("CREATE TABLE "+T_PACKAGECACHE+" ("+C_NAME+" TEXT NOT NULL, "+C_SUMMARY+" TEXT NOT NULL, "+C_INSTALLED+" TEXT, "+C_UPGRADABLE+" TEXT, "+C_SORTKEY+" BLOB);");
 		db.execSQL("CREATE UNIQUE INDEX idx_"+T_PACKAGECACHE+"_"+C_NAME+" ON "+T_PACKAGECACHE+" ("+C_NAME+");");
 		db.execSQL("CREATE INDEX idx_"+T_PACKAGECACHE+"_"+C_INSTALLED+" ON "+T_PACKAGECACHE+" ("+C_INSTALLED+");");
 		db.execSQL("CREATE INDEX idx_"+T_PACKAGECACHE+"_"+C_UPGRADABLE+" ON "+T_PACKAGECACHE+" ("+C_UPGRADABLE+");");
+		db.execSQL("CREATE INDEX idx_"+T_PACKAGECACHE+"_"+C_SORTKEY+" ON "+T_PACKAGECACHE+" ("+C_SORTKEY+");");
 		db.execSQL("CREATE VIRTUAL TABLE "+T_PACKAGECACHEFTS+" USING fts3("+C_NAME+" TEXT NOT NULL, "+C_SUMMARY+" TEXT NOT NULL);");
+		// the next refresh has nothing to be relative to
+		mContext.deleteFile(PackageIndex.SNAPSHOT);
 	}
 	@Override
 	public void onUpgrade(SQLiteDatabase db, int oldVersion, int newVersion) {
@@ -1,16 +1,9 @@
 package com.botbrew.basil;
 
-import java.io.BufferedReader;
 import java.io.File;
 import java.io.FileWriter;
 import java.io.IOException;
-import java.io.InputStreamReader;
-import java.util.ArrayList;
-import java.util.Collection;
 import java.util.EnumMap;
-import java.util.HashMap;
-import java.util.regex.Matcher;
-import java.util.regex.Pattern;
 
 import android.content.ContentResolver;
 import android.content.ContentValues;
@@ -198,7 +191,7 @@ public class DebianPackageManager {
 			File temp;
 			FileWriter tempwriter;
 			String dstfile;
-			Process p;
+			Shell p;
 			// set architectures
 			Log.v(BotBrewApp.TAG,"DebianPackageManager.pm_writeconf(): using architectures "+arch);
 			temp = new File(tmpdir,"arch.conf");
@@ -209,7 +202,7 @@ public class DebianPackageManager {
 			tempwriter.close();
 			dstfile = "/var/lib/dpkg/arch";
 			p = exec(true,"sh -c \"cp '"+temp+"' '"+dstfile+"' && chmod 0644 '"+dstfile+"' && chown 0:0 '"+dstfile+"'\"");
-			p.getOutputStream().close();
+			p.stdin().close();
 			BotBrewApp.sinkOutput(p);
 			BotBrewApp.sinkError(p);
 			temp.delete();
@@ -222,7 +215,7 @@ public class DebianPackageManager {
 			tempwriter.close();
 			dstfile = "/etc/apt/apt.conf.d/99botbrew";
 			p = exec(true,"sh -c \"cp '"+temp+"' '"+dstfile+"' && chmod 0644 '"+dstfile+"' && chown 0:0 '"+dstfile+"'\"");
-			p.getOutputStream().close();
+			p.stdin().close();
 			BotBrewApp.sinkOutput(p);
 			BotBrewApp.sinkError(p);
 			temp.delete();
@@ -244,8 +237,8 @@ public class DebianPackageManager {
 	}
 	public boolean pm_update() {
 		try {
-			Process p = exec(true,aptget_update());
-			p.getOutputStream().close();
+			Shell p = exec(true,aptget_update());
+			p.stdin().close();
 			BotBrewApp.sinkOutput(p);
 			BotBrewApp.sinkError(p);
 			if(p.waitFor() != 0) return false;
@@ -258,81 +251,46 @@ public class DebianPackageManager {
 			return false;
 		}
 	}
-	public boolean pm_refresh(final ContentResolver cr, final boolean reload) {
-		Collection<ContentValues> values;
+	/**
+	 * Bring the package cache up to date with the dpkg and apt databases,
+	 * applying only what changed since snapshot, and rewrite the search
+	 * index if anything did.
+	 */
+	public boolean pm_refresh(final ContentResolver cr, final File snapshot, final File search) {
+		final PackageIndex.Delta delta;
 		try {
-			ContentValues cv;
-			Matcher matcher;
-			String line;
-			// installed packages
-			final HashMap<String,ContentValues> installed = new HashMap<String,ContentValues>();
-			Process p = exec(false,dpkgquery("--show --showformat='${status} ${package} ${version}\\n'"));
-			p.getOutputStream().close();
-			BufferedReader p_stdout = new BufferedReader(new InputStreamReader(p.getInputStream()));
-			final Pattern re_name_version = Pattern.compile("^install ok installed (\\S+) (\\S+)$");
-			while((line = p_stdout.readLine()) != null) {
-				matcher = re_name_version.matcher(line);
-				if(matcher.find()) {
-					cv = new ContentValues();
-					line = matcher.group(1);
-					cv.put(DatabaseOpenHelper.C_NAME,line);
-					cv.put(DatabaseOpenHelper.C_INSTALLED,matcher.group(2));
-					cv.put(DatabaseOpenHelper.C_UPGRADABLE,"");
-					installed.put(line,cv);
-				}
-			}
-			BotBrewApp.sinkError(p);
-			if(p.waitFor() != 0) return false;
-			// upgradable packages
-			final DebianPackageManager dpm = new DebianPackageManager(this);
-			dpm.config(Config.APT_Get_Simulate,"1");
-			p = exec(false,dpm.aptget_distupgrade());
-			p.getOutputStream().close();
-			p_stdout = new BufferedReader(new InputStreamReader(p.getInputStream()));
-			final Pattern re_inst_name_upgradable = Pattern.compile("^Inst (\\S+) \\[(\\S+)\\]");
-			while((line = p_stdout.readLine()) != null) {
-				matcher = re_inst_name_upgradable.matcher(line);
-				if(matcher.find()) {
-					line = matcher.group(1);
-					cv = installed.get(line);
-					if(cv != null) cv.put(DatabaseOpenHelper.C_UPGRADABLE,matcher.group(2));
-				}
-			}
-			BotBrewApp.sinkError(p);
-			if(p.waitFor() != 0) return false;
-			if(reload) {	// available packages
-				values = new ArrayList<ContentValues>();
-				p = exec(false,(new DebianPackageManager(root)).aptcache_search());
-				p.getOutputStream().close();
-				p_stdout = new BufferedReader(new InputStreamReader(p.getInputStream()));
-				final Pattern re_name_summary = Pattern.compile("^(\\S+) - (.*)$");
-				while((line = p_stdout.readLine()) != null) {
-					matcher = re_name_summary.matcher(line);
-					if(!matcher.find()) continue;
-					line = matcher.group(1);
-					cv = installed.get(line);
-					if(cv == null) {
-						cv = new ContentValues();
-						cv.put(DatabaseOpenHelper.C_NAME,line);
-						cv.put(DatabaseOpenHelper.C_INSTALLED,"");
-						cv.put(DatabaseOpenHelper.C_UPGRADABLE,"");
-					}
-					cv.put(DatabaseOpenHelper.C_SUMMARY,matcher.group(2));
-					values.add(cv);
-				}
-				BotBrewApp.sinkError(p);
-				if(p.waitFor() != 0) return false;
-			} else values = installed.values();
+			delta = PackageIndex.read(root,config(Config.APT_Architectures),snapshot,search);
 		} catch(IOException e) {
 			Log.v(BotBrewApp.TAG,"DebianPackageManager.pm_refresh(): IOException: cannot refresh database");
 			return false;
-		} catch(InterruptedException ex) {
-			Log.v(BotBrewApp.TAG,"DebianPackageManager.pm_refresh(): InterruptedException: cannot refresh database");
-			return false;
 		}
-		final ContentValues[] a = new ContentValues[values.size()];
-		values.toArray(a);
-		cr.bulkInsert(reload?PackageCacheProvider.ContentUri.UPDATE_RELOAD.uri:PackageCacheProvider.ContentUri.UPDATE_REFRESH.uri,a);
+		if(delta.isEmpty()) {
+			// the lists may have been touched without changing, so keep their new fingerprints
+			delta.commit();
+			return true;
+		}
+		final ContentValues[] a = new ContentValues[delta.put.size()+delta.removed.size()];
+		final String[] names = new String[delta.put.size()];
+		int i = 0;
+		for(PackageIndex.Record pkg: delta.put) names[i++] = pkg.name;
+		final byte[][] keys = NaturalSort.keys(names);
+		i = 0;
+		for(PackageIndex.Record pkg: delta.put) {
+			final ContentValues cv = new ContentValues();
+			cv.put(DatabaseOpenHelper.C_NAME,pkg.name);
+			cv.put(DatabaseOpenHelper.C_SORTKEY,keys[i]);
+			cv.put(DatabaseOpenHelper.C_SUMMARY,pkg.summary);
+			cv.put(DatabaseOpenHelper.C_INSTALLED,pkg.installed()?pkg.version:"");
+			cv.put(DatabaseOpenHelper.C_UPGRADABLE,pkg.upgradable);
+			a[i++] = cv;
+		}
+		for(String name: delta.removed) {
+			final ContentValues cv = new ContentValues();
+			cv.put(DatabaseOpenHelper.C_NAME,name);
+			a[i++] = cv;
+		}
+		cr.bulkInsert(delta.full?PackageCacheProvider.ContentUri.UPDATE_RELOAD.uri:PackageCacheProvider.ContentUri.UPDATE_DELTA.uri,a);
+		delta.commit();
 		return true;
 	}
 	protected Shell.Pipe exec(final boolean superuser) throws IOException {
@@ -340,9 +298,7 @@ public class DebianPackageManager {
 		if(redirect) sh.redirect();
 		return sh;
 	}
-	protected Process exec(final boolean superuser, final CharSequence command) throws IOException {
-		final Shell.Pipe sh = exec(superuser);
-		sh.botbrew(root,command);
-		return sh.proc;
+	protected Shell exec(final boolean superuser, final CharSequence command) throws IOException {
+		return Shell.chroot(root,superuser,redirect,command);
 	}
 }
@@ -0,0 +1,86 @@
+package com.botbrew.basil;
+
+import java.io.File;
+import java.io.IOException;
+import java.io.UnsupportedEncodingException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+
+/**
+ * Directory listing in one native call: getdents64 and d_type, with a
+ * stat only for links, filesystems without d_type, or when STAT asks for
+ * size, mode and mtime.
+ */
+public class DirScan {
+	public static class Entry {
+		public final String name;
+		public final int type;
+		/**
+		 * size, mode and mtime are only set if hasStat()
+		 */
+		public final long size;
+		public final long mtime;
+		public final int mode;
+		private final int flags;
+		protected Entry(final String name, final int type, final long size, final long mtime, final int mode, final int flags) {
+			this.name = name;
+			this.type = type;
+			this.size = size;
+			this.mtime = mtime;
+			this.mode = mode;
+			this.flags = flags;
+		}
+		public boolean isDirectory() {
+			return type == TYPE_DIRECTORY;
+		}
+		public boolean isFile() {
+			return type == TYPE_FILE;
+		}
+		public boolean isLink() {
+			return (flags&FLAG_LINK) != 0;
+		}
+		public boolean canExecute() {
+			return (flags&FLAG_EXECUTABLE) != 0;
+		}
+		public boolean hasStat() {
+			return (flags&FLAG_STAT) != 0;
+		}
+	}
+	static {
+		System.loadLibrary("jackpal-androidterm4");
+	}
+	public static final int STAT = 1;
+	public static final int EXECUTABLE = 2;
+	public static final int SORT = 4;
+	public static final int TYPE_FILE = 0;
+	public static final int TYPE_DIRECTORY = 1;
+	public static final int TYPE_OTHER = 2;
+	private static final int FLAG_EXECUTABLE = 1;
+	private static final int FLAG_LINK = 2;
+	private static final int FLAG_STAT = 4;
+	private static final int RECORD_SIZE = 24;
+	/**
+	 * @param flags STAT, EXECUTABLE and SORT, for natural order like NaturalSort
+	 * @return every entry but . and ..
+	 */
+	public static Entry[] scan(final File dir, final int flags) throws IOException {
+		final byte[] buf = nativeScan(dir.getPath(),flags);
+		final ByteBuffer b = ByteBuffer.wrap(buf).order(ByteOrder.nativeOrder());
+		int count = 0;
+		for(int off = 0; off < buf.length; off = next(b,off)) count++;
+		final Entry[] res = new Entry[count];
+		for(int i = 0, off = 0; i < count; i++, off = next(b,off)) res[i] = read(b,buf,off);
+		return res;
+	}
+	// records are {size, mtime, mode, name length, type, flags, name} padded to 8 bytes
+	private static int next(final ByteBuffer b, final int off) {
+		return off+((RECORD_SIZE+(b.getShort(off+20)&0xffff)+7)&~7);
+	}
+	private static Entry read(final ByteBuffer b, final byte[] buf, final int off) throws UnsupportedEncodingException {
+		return new Entry(
+			new String(buf,off+RECORD_SIZE,b.getShort(off+20)&0xffff,"UTF-8"),
+			buf[off+22],b.getLong(off),b.getLong(off+8),b.getInt(off+16),buf[off+23]
+		);
+	}
+	private static native byte[] nativeScan(String path, int flags) throws IOException;
+}
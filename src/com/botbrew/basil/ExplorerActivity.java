@@ -1,9 +1,8 @@
 package com.botbrew.basil;
 
 import java.io.File;
+import java.io.IOException;
 import java.util.ArrayList;
-import java.util.Arrays;
-import java.util.Comparator;
 
 import android.content.Intent;
 import android.os.Bundle;
@@ -27,17 +26,6 @@ public class ExplorerActivity extends SherlockFragmentActivity {
 	private ListView mViewListParent;
 	private File mDirectory;
 	private boolean mIsWide = false;
-	private final Comparator<File> comparator = new Comparator<File>() {
-		private final AlphanumComparator alnum = new AlphanumComparator();
-		@Override
-		public int compare(final File o1, final File o2) {
-			final String s1 = o1.getName();
-			final String s2 = o2.getName();
-			int res = alnum.compare(s1.toLowerCase(),s2.toLowerCase());
-			if(res == 0)res = alnum.compare(s1,s2);
-			return res;
-		}
-	};
 	@Override
 	public void onCreate(final Bundle savedInstanceState) {
 		super.onCreate(savedInstanceState);
@@ -55,14 +43,13 @@ public class ExplorerActivity extends SherlockFragmentActivity {
 			mDirectory = file;
 			mViewPathSelf.setText(file.getAbsolutePath());
 			File parent = file.getParentFile();
-			File[] files;
+			DirScan.Entry[] files;
 			ArrayList<String> filenames = new ArrayList<String>();
 			if(mIsWide) {
 				if(parent != null) {
 					mViewPathParent.setText("siblings in "+parent.getAbsolutePath());
-					files = parent.listFiles();
-					Arrays.sort(files,comparator);
-					for(File f: files) if(f.isDirectory()) filenames.add("↱ "+f.getName());
+					files = scan(parent);
+					for(DirScan.Entry f: files) if(f.isDirectory()) filenames.add("↱ "+f.name);
 				} else mViewPathParent.setText("");
 				mViewListParent.setAdapter(new ArrayAdapter<Object>(
 					getApplicationContext(),
@@ -72,10 +59,9 @@ public class ExplorerActivity extends SherlockFragmentActivity {
 				filenames.clear();
 			}
 			if(parent != null) filenames.add("⇧ ..");
-			files = file.listFiles();
-			Arrays.sort(files,comparator);
-			for(File f: files) if(f.isDirectory()) filenames.add("⇨ "+f.getName());
-			for(File f: files) if(!f.isDirectory()) filenames.add("◇ "+f.getName());
+			files = scan(file);
+			for(DirScan.Entry f: files) if(f.isDirectory()) filenames.add("⇨ "+f.name);
+			for(DirScan.Entry f: files) if(!f.isDirectory()) filenames.add("◇ "+f.name);
 			mViewListSelf.setAdapter(new ArrayAdapter<Object>(
 				getApplicationContext(),
 				android.R.layout.simple_list_item_1,
@@ -83,6 +69,14 @@ public class ExplorerActivity extends SherlockFragmentActivity {
 			));
 		} else if(file.isFile()) selectFile(file);
 	}
+	// sorted, and typed without a stat per entry
+	private static DirScan.Entry[] scan(final File dir) {
+		try {
+			return DirScan.scan(dir,DirScan.SORT);
+		} catch(IOException ex) {
+			return new DirScan.Entry[0];
+		}
+	}
 	@Override
 	public void onBackPressed() {
 		setResultX(RESULT_CANCELED);
@@ -206,7 +206,7 @@ public class Main extends SherlockFragmentActivity {
 			protected Boolean doInBackground(final Void... ign) {
 				Log.v(BotBrewApp.TAG,"-> Main.onUpdateRequested("+update+")");
 				if(update) dpm.pm_update();
-				final boolean result = dpm.pm_refresh(getContentResolver(),update);
+				final boolean result = dpm.pm_refresh(getContentResolver(),getFileStreamPath(PackageIndex.SNAPSHOT),getFileStreamPath(PackageSearch.FILE));
 				Log.v(BotBrewApp.TAG,"<- Main.onUpdateRequested("+update+")");
 				return result;
 			}
@@ -1,98 +1,89 @@
 package com.botbrew.basil;
 
-import java.io.BufferedReader;
 import java.io.File;
 import java.io.FileNotFoundException;
-import java.io.FileReader;
 import java.io.IOException;
 import java.util.ArrayList;
 import java.util.List;
-import java.util.regex.Matcher;
-import java.util.regex.Pattern;
 
+/**
+ * Mount table from /proc/self/mountinfo, parsed natively by the same code
+ * init uses. find() and under() are hash and subtree lookups, not scans.
+ */
 public class MountFs {
 	public static class MountEntry {
-		protected final static Pattern re_mnt = Pattern.compile("^(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)\\s+(\\S+)$");
+		public final int mnt_id;
+		public final int parent_id;
 		public final String fs_spec;
 		public final String fs_file;
 		public final String fs_vfstype;
 		public final String fs_mntops;
-		public final int fs_freq;
-		public final int fs_passno;
-		protected final String str;
-		public MountEntry(final String entry) {
-			if(entry == null) throw new IllegalArgumentException();
-			final Matcher matcher = re_mnt.matcher(entry);
-			if(matcher.find()) {
-				fs_spec = matcher.group(1);
-				fs_file = matcher.group(2);
-				fs_vfstype = matcher.group(3);
-				fs_mntops = matcher.group(4);
-				fs_freq = new Integer(matcher.group(5));
-				fs_passno = new Integer(matcher.group(6));
-				str = entry;
-			} else throw new IllegalArgumentException(entry);
+		public final String fs_superops;
+		public final String mnt_root;
+		public final String mnt_optional;
+		public final int fs_freq = 0;
+		public final int fs_passno = 0;
+		protected MountEntry(final String[] fields, final int base) {
+			mnt_id = Integer.parseInt(fields[base]);
+			parent_id = Integer.parseInt(fields[base+1]);
+			fs_spec = fields[base+2];
+			fs_file = fields[base+3];
+			fs_vfstype = fields[base+4];
+			fs_mntops = fields[base+5];
+			fs_superops = fields[base+6];
+			mnt_root = fields[base+7];
+			mnt_optional = fields[base+8];
 		}
 		@Override
 		public String toString() {
-			return str;
+			return fs_spec+" "+fs_file+" "+fs_vfstype+" "+fs_mntops+" "+fs_freq+" "+fs_passno;
 		}
 	}
-	public static final File proc_self_mounts = new File("/proc/self/mounts");
-	public final List<MountEntry> mounts = new ArrayList<MountEntry>();
-	public MountFs() throws FileNotFoundException {
-		this(proc_self_mounts);
+	static {
+		System.loadLibrary("jackpal-androidterm4");
 	}
-	public MountFs(final File mnttab) throws FileNotFoundException {
-		final BufferedReader r = setmntent(mnttab);
-		try {
-			while(true) mounts.add(getmntent(r));
-		} catch(IOException ex) {
-		} catch(IllegalArgumentException ex) {
-		} finally {
-			try {
-				endmntent(r);
-			} catch(IOException ex) {
-			}
-		}
+	private static final int ENTRY_FIELDS = 9;
+	public static final File proc_self_mountinfo = new File("/proc/self/mountinfo");
+	public final List<MountEntry> mounts;
+	public MountFs() throws FileNotFoundException {
+		this(proc_self_mountinfo);
 	}
-	public static BufferedReader setmntent() throws FileNotFoundException {
-		return setmntent(proc_self_mounts);
+	public MountFs(final File mountinfo) throws FileNotFoundException {
+		mounts = entries(nativeRead(mountinfo.getPath()));
 	}
-	public static BufferedReader setmntent(final File mnttab) throws FileNotFoundException {
-		return new BufferedReader(new FileReader(mnttab));
+	/**
+	 * @return the mount that path lives on, or null
+	 */
+	public static MountEntry find(final File path) throws FileNotFoundException {
+		return find(proc_self_mountinfo,path);
 	}
-	public static MountEntry getmntent(final BufferedReader reader) throws IOException {
-		return new MountEntry(reader.readLine());
+	public static MountEntry find(final File mountinfo, final File path) throws FileNotFoundException {
+		final List<MountEntry> res = entries(nativeFind(mountinfo.getPath(),canonical(path)));
+		return res.isEmpty()?null:res.get(0);
 	}
-	public static void endmntent(final BufferedReader reader) throws IOException {
-		reader.close();
+	/**
+	 * @return every mount on or below path, in mount order
+	 */
+	public static List<MountEntry> under(final File path) throws FileNotFoundException {
+		return under(proc_self_mountinfo,path);
 	}
-	public static MountEntry find(final File path) throws FileNotFoundException {
-		return find(proc_self_mounts,path);
+	public static List<MountEntry> under(final File mountinfo, final File path) throws FileNotFoundException {
+		return entries(nativeUnder(mountinfo.getPath(),canonical(path)));
 	}
-	public static MountEntry find(final File mnttab, final File path) throws FileNotFoundException {
-		MountEntry res = null;
-		int maxlen = -1;
-		final BufferedReader r = setmntent(mnttab);
+	private static String canonical(final File path) {
 		try {
-			final String path_str = path.getCanonicalPath();
-			MountEntry mntent;
-			while(true) {
-				mntent = getmntent(r);
-				if((path_str.startsWith(mntent.fs_file))&&(mntent.fs_file.length() >= maxlen)) {
-					res = mntent;
-					maxlen = mntent.fs_file.length();
-				}
-			}
+			return path.getCanonicalPath();
 		} catch(IOException ex) {
-		} catch(IllegalArgumentException ex) {
-		} finally {
-			try {
-				endmntent(r);
-			} catch(IOException ex) {
-			}
+			return path.getAbsolutePath();
 		}
+	}
+	private static List<MountEntry> entries(final String[] fields) {
+		final int n = (fields == null)?0:fields.length/ENTRY_FIELDS;
+		final List<MountEntry> res = new ArrayList<MountEntry>(n);
+		for(int i = 0; i < n; i++) res.add(new MountEntry(fields,i*ENTRY_FIELDS));
 		return res;
 	}
-}
\ No newline at end of file
+	private static native String[] nativeRead(String mountinfo) throws FileNotFoundException;
+	private static native String[] nativeFind(String mountinfo, String path) throws FileNotFoundException;
+	private static native String[] nativeUnder(String mountinfo, String path) throws FileNotFoundException;
+}
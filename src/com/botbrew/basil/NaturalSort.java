@@ -0,0 +1,41 @@
+package com.botbrew.basil;
+
+import java.io.File;
+
+/**
+ * Natural order for names, case-insensitive and with runs of digits
+ * compared as numbers, so file2 comes before File10. Keys are computed
+ * natively once per name and compare bytewise, which also makes them
+ * usable as an indexed BLOB column.
+ */
+public class NaturalSort {
+	static {
+		System.loadLibrary("jackpal-androidterm4");
+	}
+	public static byte[] key(final String name) {
+		return nativeKeys(new String[] {name})[0];
+	}
+	public static byte[][] keys(final String[] names) {
+		return nativeKeys(names);
+	}
+	/**
+	 * @return the indices of names in natural order
+	 */
+	public static int[] order(final String[] names) {
+		return nativeOrder(names);
+	}
+	public static void sort(final String[] names) {
+		final int[] order = nativeOrder(names);
+		final String[] copy = names.clone();
+		for(int i = 0; i < order.length; i++) names[i] = copy[order[i]];
+	}
+	public static void sort(final File[] files) {
+		final String[] names = new String[files.length];
+		for(int i = 0; i < files.length; i++) names[i] = files[i].getName();
+		final int[] order = nativeOrder(names);
+		final File[] copy = files.clone();
+		for(int i = 0; i < order.length; i++) files[i] = copy[order[i]];
+	}
+	private static native byte[][] nativeKeys(String[] names);
+	private static native int[] nativeOrder(String[] names);
+}
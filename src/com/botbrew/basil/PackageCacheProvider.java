@@ -1,12 +1,16 @@
 package com.botbrew.basil;
 
+import java.io.IOException;
+
 import android.app.SearchManager;
 import android.content.ContentProvider;
 import android.content.ContentResolver;
 import android.content.ContentValues;
 import android.content.UriMatcher;
 import android.database.Cursor;
+import android.database.MatrixCursor;
 import android.database.sqlite.SQLiteDatabase;
+import android.database.sqlite.SQLiteDoneException;
 import android.database.sqlite.SQLiteStatement;
 import android.net.Uri;
 
@@ -21,7 +25,8 @@ public class PackageCacheProvider extends ContentProvider {
 		CACHE_SUGGEST(SearchManager.SUGGEST_URI_PATH_QUERY,ContentResolver.CURSOR_DIR_BASE_TYPE+"/cache"),
 		CACHE_SEARCH(SearchManager.SUGGEST_URI_PATH_QUERY+"/*",ContentResolver.CURSOR_ITEM_BASE_TYPE+"/cache"),
 		UPDATE_REFRESH("update/refresh",ContentResolver.CURSOR_DIR_BASE_TYPE+"/cache"),
-		UPDATE_RELOAD("update/reload",ContentResolver.CURSOR_DIR_BASE_TYPE+"/cache");
+		UPDATE_RELOAD("update/reload",ContentResolver.CURSOR_DIR_BASE_TYPE+"/cache"),
+		UPDATE_DELTA("update/delta",ContentResolver.CURSOR_DIR_BASE_TYPE+"/cache");
 		public final String path;
 		public final String type;
 		public final Uri uri;
@@ -34,6 +39,7 @@ public class PackageCacheProvider extends ContentProvider {
 		}
 	}
 	private static ContentUri[] sContentUriValues = ContentUri.values();
+	private static final int SUGGEST_LIMIT = 50;
 	@Override
 	public boolean onCreate() {
 		mDB = new DatabaseOpenHelper(getContext());
@@ -65,6 +71,26 @@ public class PackageCacheProvider extends ContentProvider {
 				return c;
 			case CACHE_SUGGEST:
 				if(selectionArgs == null) throw new IllegalArgumentException("selectionArgs must be provided for the Uri: "+uri);
+				int limit = SUGGEST_LIMIT;
+				try {
+					limit = Integer.parseInt(uri.getQueryParameter(SearchManager.SUGGEST_PARAMETER_LIMIT));
+				} catch(NumberFormatException ex) {}
+				try {
+					final String[] columns = new String[] {
+						"_id",
+						SearchManager.SUGGEST_COLUMN_TEXT_1,
+						SearchManager.SUGGEST_COLUMN_TEXT_2,
+						SearchManager.SUGGEST_COLUMN_INTENT_DATA_ID
+					};
+					final MatrixCursor m = new MatrixCursor(columns);
+					for(PackageSearch.Suggestion s: PackageSearch.query(getContext().getFileStreamPath(PackageSearch.FILE),selectionArgs[0],limit)) {
+						m.addRow(new Object[] {s.name,s.name,s.summary,s.name});
+					}
+					m.setNotificationUri(getContext().getContentResolver(),ContentUri.CACHE_BASE.uri);
+					return m;
+				} catch(IOException ex) {
+					// no index until the first refresh; fall back to full-text search
+				}
 				db = mDB.getReadableDatabase();
 				c = db.query(
 					DatabaseOpenHelper.T_PACKAGECACHEFTS,new String[] {
@@ -110,6 +136,11 @@ public class PackageCacheProvider extends ContentProvider {
 	public int delete(Uri uri, String selection, String[] selectionArgs) {
 		return 0;
 	}
+	private static void bindKey(final SQLiteStatement stmt, final int index, final ContentValues value) {
+		final byte[] key = value.getAsByteArray(DatabaseOpenHelper.C_SORTKEY);
+		if(key == null) stmt.bindNull(index);
+		else stmt.bindBlob(index,key);
+	}
 	@Override
 	public int bulkInsert(Uri uri, ContentValues[] values) {
 		final SQLiteDatabase db = mDB.getWritableDatabase();
@@ -127,23 +158,26 @@ public class PackageCacheProvider extends ContentProvider {
 							+DatabaseOpenHelper.C_NAME+","
 							+DatabaseOpenHelper.C_SUMMARY+","
 							+DatabaseOpenHelper.C_INSTALLED+","
-							+DatabaseOpenHelper.C_UPGRADABLE
-						+") values "+"(?,?,?,?)"
+							+DatabaseOpenHelper.C_UPGRADABLE+","
+							+DatabaseOpenHelper.C_SORTKEY
+						+") values "+"(?,?,?,?,?)"
 					);
+					// full-text rows share rowids with the cache, so UPDATE_DELTA can find them
 					stmt2 = db.compileStatement(
-						"INSERT INTO "+DatabaseOpenHelper.T_PACKAGECACHEFTS+" ("
+						"INSERT INTO "+DatabaseOpenHelper.T_PACKAGECACHEFTS+" (docid,"
 							+DatabaseOpenHelper.C_NAME+","
 							+DatabaseOpenHelper.C_SUMMARY
-						+") values "+"(?,?)"
+						+") values "+"(?,?,?)"
 					);
 					for(ContentValues value: values) {
 						stmt1.bindString(1,value.getAsString(DatabaseOpenHelper.C_NAME));
 						stmt1.bindString(2,value.getAsString(DatabaseOpenHelper.C_SUMMARY));
 						stmt1.bindString(3,value.getAsString(DatabaseOpenHelper.C_INSTALLED));
 						stmt1.bindString(4,value.getAsString(DatabaseOpenHelper.C_UPGRADABLE));
-						stmt1.execute();
-						stmt2.bindString(1,value.getAsString(DatabaseOpenHelper.C_NAME));
-						stmt2.bindString(2,value.getAsString(DatabaseOpenHelper.C_SUMMARY));
+						bindKey(stmt1,5,value);
+						stmt2.bindLong(1,stmt1.executeInsert());
+						stmt2.bindString(2,value.getAsString(DatabaseOpenHelper.C_NAME));
+						stmt2.bindString(3,value.getAsString(DatabaseOpenHelper.C_SUMMARY));
 						stmt2.execute();
 					}
 					db.setTransactionSuccessful();
@@ -152,6 +186,88 @@ public class PackageCacheProvider extends ContentProvider {
 					getContext().getContentResolver().notifyChange(ContentUri.CACHE_BASE.uri,null);
 				}
 				return values.length;
+			case UPDATE_DELTA:
+				// rows with just a name are removals, the rest replace or add a row
+				db.beginTransaction();
+				try {
+					final SQLiteStatement rowid = db.compileStatement(
+						"SELECT rowid FROM "+DatabaseOpenHelper.T_PACKAGECACHE+" WHERE "+DatabaseOpenHelper.C_NAME+"=?"
+					);
+					final SQLiteStatement insert = db.compileStatement(
+						"INSERT INTO "+DatabaseOpenHelper.T_PACKAGECACHE+" ("
+							+DatabaseOpenHelper.C_NAME+","
+							+DatabaseOpenHelper.C_SUMMARY+","
+							+DatabaseOpenHelper.C_INSTALLED+","
+							+DatabaseOpenHelper.C_UPGRADABLE+","
+							+DatabaseOpenHelper.C_SORTKEY
+						+") values "+"(?,?,?,?,?)"
+					);
+					final SQLiteStatement update = db.compileStatement(
+						"UPDATE "+DatabaseOpenHelper.T_PACKAGECACHE+" SET "
+							+DatabaseOpenHelper.C_SUMMARY+"=?,"
+							+DatabaseOpenHelper.C_INSTALLED+"=?,"
+							+DatabaseOpenHelper.C_UPGRADABLE+"=?"
+						+" WHERE rowid=?"
+					);
+					final SQLiteStatement delete = db.compileStatement(
+						"DELETE FROM "+DatabaseOpenHelper.T_PACKAGECACHE+" WHERE rowid=?"
+					);
+					final SQLiteStatement ftsInsert = db.compileStatement(
+						"INSERT INTO "+DatabaseOpenHelper.T_PACKAGECACHEFTS+" (docid,"
+							+DatabaseOpenHelper.C_NAME+","
+							+DatabaseOpenHelper.C_SUMMARY
+						+") values "+"(?,?,?)"
+					);
+					final SQLiteStatement ftsUpdate = db.compileStatement(
+						"UPDATE "+DatabaseOpenHelper.T_PACKAGECACHEFTS+" SET "
+							+DatabaseOpenHelper.C_SUMMARY+"=?"
+						+" WHERE docid=?"
+					);
+					final SQLiteStatement ftsDelete = db.compileStatement(
+						"DELETE FROM "+DatabaseOpenHelper.T_PACKAGECACHEFTS+" WHERE docid=?"
+					);
+					for(ContentValues value: values) {
+						final String name = value.getAsString(DatabaseOpenHelper.C_NAME);
+						long id;
+						rowid.bindString(1,name);
+						try {
+							id = rowid.simpleQueryForLong();
+						} catch(SQLiteDoneException ex) {
+							id = -1;
+						}
+						if(!value.containsKey(DatabaseOpenHelper.C_SUMMARY)) {
+							if(id < 0) continue;
+							delete.bindLong(1,id);
+							delete.execute();
+							ftsDelete.bindLong(1,id);
+							ftsDelete.execute();
+						} else if(id < 0) {
+							insert.bindString(1,name);
+							insert.bindString(2,value.getAsString(DatabaseOpenHelper.C_SUMMARY));
+							insert.bindString(3,value.getAsString(DatabaseOpenHelper.C_INSTALLED));
+							insert.bindString(4,value.getAsString(DatabaseOpenHelper.C_UPGRADABLE));
+							bindKey(insert,5,value);
+							ftsInsert.bindLong(1,insert.executeInsert());
+							ftsInsert.bindString(2,name);
+							ftsInsert.bindString(3,value.getAsString(DatabaseOpenHelper.C_SUMMARY));
+							ftsInsert.execute();
+						} else {
+							update.bindString(1,value.getAsString(DatabaseOpenHelper.C_SUMMARY));
+							update.bindString(2,value.getAsString(DatabaseOpenHelper.C_INSTALLED));
+							update.bindString(3,value.getAsString(DatabaseOpenHelper.C_UPGRADABLE));
+							update.bindLong(4,id);
+							update.execute();
+							ftsUpdate.bindString(1,value.getAsString(DatabaseOpenHelper.C_SUMMARY));
+							ftsUpdate.bindLong(2,id);
+							ftsUpdate.execute();
+						}
+					}
+					db.setTransactionSuccessful();
+				} finally {
+					db.endTransaction();
+					getContext().getContentResolver().notifyChange(ContentUri.CACHE_BASE.uri,null);
+				}
+				return values.length;
 			case UPDATE_REFRESH:
 				db.beginTransaction();
 				try {
@@ -0,0 +1,116 @@
+package com.botbrew.basil;
+
+import java.io.File;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Packages known to dpkg and APT under a BotBrew root, read natively from
+ * var/lib/dpkg/status and var/lib/apt/lists/*_Packages without running
+ * dpkg-query or apt-cache.  With a snapshot of what the package cache
+ * was last built from, only lists that changed are parsed again and only
+ * packages that changed are returned.
+ */
+public class PackageIndex {
+	public static class Record {
+		public final String name;
+		public final String version;
+		public final String summary;
+		public final String status;
+		/**
+		 * newest version for an enabled architecture if newer than the installed one, otherwise ""
+		 */
+		public final String upgradable;
+		protected Record(final String[] fields) {
+			name = fields[0];
+			version = fields[1];
+			summary = fields[2];
+			status = fields[3];
+			upgradable = fields[4];
+		}
+		public boolean installed() {
+			return "install ok installed".equals(status);
+		}
+	}
+	public static class Delta {
+		/**
+		 * put holds every package and the cache should be rebuilt from it
+		 */
+		public final boolean full;
+		public final List<Record> put = new ArrayList<Record>();
+		public final List<String> removed = new ArrayList<String>();
+		private final File snapshot;
+		private final File search;
+		protected Delta(final boolean full, final File snapshot, final File search) {
+			this.full = full;
+			this.snapshot = snapshot;
+			this.search = search;
+		}
+		public boolean isEmpty() {
+			return (!full)&&(put.isEmpty())&&(removed.isEmpty());
+		}
+		/**
+		 * Call once the delta has been applied, so the next read is relative to it.
+		 * If either file could not be written, both are dropped instead, so the
+		 * next read starts over with everything.
+		 */
+		public void commit() {
+			if((replace(snapshot))&&(replace(search))) return;
+			if(snapshot != null) snapshot.delete();
+			if(search != null) search.delete();
+		}
+		private static boolean replace(final File file) {
+			return (file == null)||(newFile(file).renameTo(file));
+		}
+	}
+	static {
+		System.loadLibrary("jackpal-androidterm4");
+	}
+	public static final String SNAPSHOT = "packageindex";
+	private static final int RECORD_FIELDS = 5;
+	private static final byte RESULT_FULL = 'F';
+	private static final byte OP_PUT = '+';
+	/**
+	 * @param architectures comma-separated, like APT::Architectures; null for dpkg's own
+	 * @return every package
+	 */
+	public static List<Record> read(final CharSequence root, final String architectures) throws IOException {
+		return read(root,architectures,null,null).put;
+	}
+	/**
+	 * @param snapshot what the previous read returned relative to, or null
+	 * @param search where to keep the PackageSearch index, or null
+	 * @return what changed since the snapshot, or everything if there is none
+	 */
+	public static Delta read(final CharSequence root, final String architectures, final File snapshot, final File search) throws IOException {
+		// whatever an uncommitted read left behind must not pass for this one's
+		if(snapshot != null) newFile(snapshot).delete();
+		if(search != null) newFile(search).delete();
+		final byte[] buf = nativeRead(root.toString(),architectures,snapshot==null?null:snapshot.getPath(),search==null?null:search.getPath());
+		final Delta res = new Delta((snapshot == null)||(buf[0] == RESULT_FULL),snapshot,search);
+		final String[] fields = new String[RECORD_FIELDS];
+		int off = 1;
+		while(off < buf.length) {
+			final boolean put = buf[off++] == OP_PUT;
+			for(int i = 0; i < (put?RECORD_FIELDS:1); i++) {
+				int end = off;
+				while(buf[end] != 0) end++;
+				fields[i] = new String(buf,off,end-off,"UTF-8");
+				off = end+1;
+			}
+			if(put) res.put.add(new Record(fields));
+			else res.removed.add(fields[0]);
+		}
+		return res;
+	}
+	private static File newFile(final File file) {
+		return new File(file.getPath()+".new");
+	}
+	/*
+	 * A result byte ('F'ull, 'D'elta or 'U'nchanged), then records: '+'
+	 * and NUL-terminated {name, version, summary, status, upgradable}, or
+	 * '-' and a NUL-terminated name.
+	 */
+	private static native byte[] nativeRead(String root, String architectures, String snapshot, String search) throws IOException;
+}
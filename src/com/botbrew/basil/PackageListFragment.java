@@ -31,7 +31,7 @@ public abstract class PackageListFragment extends SherlockListFragment implement
 					"*",DatabaseOpenHelper.C_NAME+" AS _id",
 					"(CASE WHEN "+DatabaseOpenHelper.C_UPGRADABLE+"='' THEN '' ELSE '⇪' END) AS status"
 				},
-				null,null,DatabaseOpenHelper.C_NAME
+				null,null,DatabaseOpenHelper.C_SORTKEY
 			);
 		}
 	}
@@ -48,7 +48,7 @@ public abstract class PackageListFragment extends SherlockListFragment implement
 					"*",DatabaseOpenHelper.C_NAME+" AS _id",
 					"(CASE WHEN "+DatabaseOpenHelper.C_UPGRADABLE+"='' THEN '' ELSE '⇪' END) AS status"
 				},
-				DatabaseOpenHelper.C_INSTALLED+"!=?",new String[] {""},DatabaseOpenHelper.C_NAME
+				DatabaseOpenHelper.C_INSTALLED+"!=?",new String[] {""},DatabaseOpenHelper.C_SORTKEY
 			);
 		}
 	}
@@ -62,7 +62,7 @@ public abstract class PackageListFragment extends SherlockListFragment implement
 			return new CursorLoader(
 				getActivity(),PackageCacheProvider.ContentUri.CACHE_BASE.uri,
 				new String[] {"*",DatabaseOpenHelper.C_NAME+" AS _id","'⇪' AS status"},
-				DatabaseOpenHelper.C_UPGRADABLE+"!=?",new String[] {""},DatabaseOpenHelper.C_NAME
+				DatabaseOpenHelper.C_UPGRADABLE+"!=?",new String[] {""},DatabaseOpenHelper.C_SORTKEY
 			);
 		}
 	}
@@ -218,40 +218,40 @@ public class PackageManagerActivity extends SherlockFragmentActivity {
 		final SharedPreferences pref = PreferenceManager.getDefaultSharedPreferences(this);
 		final String root = (new File(pref.getString("var_root",BotBrewApp.default_root))).getAbsolutePath();
 		final DebianPackageManager dpm = new DebianPackageManager(root);
-		Shell sh = null;
+		Shell.Term sh = null;
 		try {
 			// TODO: multiple package names in title
 			switch(what) {
 				case APTGET_INSTALL:
 					mActionBar.setTitle("Install "+pkg[0]);
 					sh = Shell.Term.getRootShell();
-					sh.botbrew(root,dpm.aptget_install(pkg));
+					sh.background(root,dpm.aptget_install(pkg));
 					break;
 				case APTGET_REINSTALL:
 					mActionBar.setTitle("Reinstall "+pkg[0]);
 					dpm.config(DebianPackageManager.Config.APT_Get_ReInstall,"1");
 					sh = Shell.Term.getRootShell();
-					sh.botbrew(root,dpm.aptget_install(pkg));
+					sh.background(root,dpm.aptget_install(pkg));
 					break;
 				case APTGET_UPGRADE:
 					mActionBar.setTitle("Upgrade "+pkg[0]);
 					sh = Shell.Term.getRootShell();
-					sh.botbrew(root,dpm.aptget_upgrade(pkg));
+					sh.background(root,dpm.aptget_upgrade(pkg));
 					break;
 				case APTGET_DISTUPGRADE:
 					mActionBar.setTitle("Dist-Upgrade "+pkg[0]);
 					sh = Shell.Term.getRootShell();
-					sh.botbrew(root,dpm.aptget_distupgrade(pkg));
+					sh.background(root,dpm.aptget_distupgrade(pkg));
 					break;
 				case APTGET_REMOVE:
 					mActionBar.setTitle("Remove "+pkg[0]);
 					sh = Shell.Term.getRootShell();
-					sh.botbrew(root,dpm.aptget_remove(pkg));
+					sh.background(root,dpm.aptget_remove(pkg));
 					break;
 				case APTGET_AUTOREMOVE:
 					mActionBar.setTitle("Autoremove "+pkg[0]);
 					sh = Shell.Term.getRootShell();
-					sh.botbrew(root,dpm.aptget_autoremove(pkg));
+					sh.background(root,dpm.aptget_autoremove(pkg));
 					break;
 			}
 			if(sh == null) return;
@@ -264,42 +264,30 @@ public class PackageManagerActivity extends SherlockFragmentActivity {
 			term.setTermOut(sh.stdin());
 			term.setTermIn(sh.stdout());
 			setViewFrame(term);
-			final Shell fsh = sh;
-			(new AsyncTask<Void,Void,Integer>() {
+			PtyPump.watch(sh.pid,new PtyPump.Listener() {
 				@Override
-				protected Integer doInBackground(final Void... ign) {
-					try {
-						return fsh.waitFor();
-					} catch(InterruptedException ex) {
-						return -1;
-					}
-				}
-				@Override
-				protected void onCancelled(Integer result) {
-					buttonOnClick((Button)findViewById(R.id.retry),new View.OnClickListener() {
-						@Override
-						public void onClick(View v) {
-							finish();
-							startActivity(getIntent());
-						}
-					});
-					mLocked = false;
-				}
-				@Override
-				protected void onPostExecute(Integer result) {
-					if(result.intValue() != 0) {
-						onCancelled(result);
-						return;
-					}
-					buttonOnClick((Button)findViewById(R.id.ok),new View.OnClickListener() {
+				public void onExit(final int status) {
+					runOnUiThread(new Runnable() {
 						@Override
-						public void onClick(View v) {
-							finish();
+						public void run() {
+							if(status != 0) buttonOnClick((Button)findViewById(R.id.retry),new View.OnClickListener() {
+								@Override
+								public void onClick(View v) {
+									finish();
+									startActivity(getIntent());
+								}
+							});
+							else buttonOnClick((Button)findViewById(R.id.ok),new View.OnClickListener() {
+								@Override
+								public void onClick(View v) {
+									finish();
+								}
+							});
+							mLocked = false;
 						}
 					});
-					mLocked = false;
 				}
-			}).execute();
+			});
 		} catch(IOException ex) {
 		}
 	}
@@ -318,7 +306,7 @@ public class PackageManagerActivity extends SherlockFragmentActivity {
 			protected Integer doInBackground(final Void... ign) {
 				try {
 					Shell sh = Shell.Term.getRootShell();
-					sh.botbrew(root,dpm.dpkg_install(pkg));
+					sh.background(root,dpm.dpkg_install(pkg));
 					InputStream sh_stdout = sh.stdout();
 					while(sh_stdout.read() != '\n');
 					while(sh_stdout.read() != '\n');
@@ -329,7 +317,7 @@ public class PackageManagerActivity extends SherlockFragmentActivity {
 					if(sh.waitFor() == 0) return 0;
 					sh = Shell.Term.getRootShell();
 					dpm.config(DebianPackageManager.Config.APT_Get_FixBroken,"1");
-					sh.botbrew(root,dpm.aptget_install());
+					sh.background(root,dpm.aptget_install());
 					sh_stdout = sh.stdout();
 					while(sh_stdout.read() != '\n');
 					term1.setColorScheme(new ColorScheme(7,0xffffffff,0,0xff000000));
@@ -0,0 +1,49 @@
+package com.botbrew.basil;
+
+import java.io.File;
+import java.io.IOException;
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * Type-ahead over package names and summaries, from a read-only index that
+ * PackageIndex writes during each refresh and that is mapped rather than
+ * loaded. Terms separated by spaces must all match; '*' matches anything,
+ * so "lib*ssl" finds names with "lib" and then "ssl" anywhere in them.
+ */
+public class PackageSearch {
+	public static class Suggestion {
+		public final String name;
+		public final String summary;
+		protected Suggestion(final String name, final String summary) {
+			this.name = name;
+			this.summary = summary;
+		}
+	}
+	static {
+		System.loadLibrary("jackpal-androidterm4");
+	}
+	public static final String FILE = "packagesearch";
+	/**
+	 * @return up to limit suggestions, best first: exact name, name prefix, within the name, within the summary
+	 * @throws java.io.FileNotFoundException if the index has not been written yet
+	 */
+	public static List<Suggestion> query(final File index, final String query, final int limit) throws IOException {
+		final byte[] buf = nativeQuery(index.getPath(),query,limit);
+		final List<Suggestion> res = new ArrayList<Suggestion>();
+		int off = 0;
+		while(off < buf.length) {
+			int end = off;
+			while(buf[end] != 0) end++;
+			final String name = new String(buf,off,end-off,"UTF-8");
+			off = end+1;
+			end = off;
+			while(buf[end] != 0) end++;
+			res.add(new Suggestion(name,new String(buf,off,end-off,"UTF-8")));
+			off = end+1;
+		}
+		return res;
+	}
+	// NUL-terminated {name, summary} for each suggestion
+	private static native byte[] nativeQuery(String index, String query, int limit) throws IOException;
+}
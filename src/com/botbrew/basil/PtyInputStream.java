@@ -0,0 +1,64 @@
+package com.botbrew.basil;
+
+import jackpal.androidterm.Exec;
+
+import java.io.FileDescriptor;
+import java.io.IOException;
+import java.io.InputStream;
+import java.nio.ByteBuffer;
+
+public class PtyInputStream extends InputStream {
+	public static final int DEFAULT_CAPACITY = 16384;
+	public static final int DEFAULT_MIN_BATCH = 4096;
+	public static final int DEFAULT_TIMEOUT_MS = 8;
+	protected final FileDescriptor fd;
+	protected final ByteBuffer buf;
+	protected final int minBatch;
+	protected final int timeoutMs;
+	protected int pos = 0;
+	protected int end = 0;
+	protected boolean eof = false;
+	public PtyInputStream(final FileDescriptor fd) {
+		this(fd,DEFAULT_CAPACITY,DEFAULT_MIN_BATCH,DEFAULT_TIMEOUT_MS);
+	}
+	public PtyInputStream(final FileDescriptor fd, final int capacity, final int minBatch, final int timeoutMs) {
+		this.fd = fd;
+		this.buf = ByteBuffer.allocateDirect(capacity);
+		this.minBatch = minBatch;
+		this.timeoutMs = timeoutMs;
+	}
+	protected boolean fill() throws IOException {
+		if(eof) return false;
+		pos = 0;
+		end = Exec.readDirect(fd,buf,0,buf.capacity(),minBatch,timeoutMs);
+		if(end < 0) {
+			end = 0;
+			eof = true;
+			return false;
+		}
+		return true;
+	}
+	@Override
+	public int read() throws IOException {
+		if((pos == end)&&(!fill())) return -1;
+		return buf.get(pos++)&0xff;
+	}
+	@Override
+	public int read(final byte[] b, final int off, final int len) throws IOException {
+		if(len == 0) return 0;
+		if((pos == end)&&(!fill())) return -1;
+		final int n = Math.min(len,end-pos);
+		buf.position(pos);
+		buf.get(b,off,n);
+		pos += n;
+		return n;
+	}
+	@Override
+	public int available() {
+		return end-pos;
+	}
+	// the descriptor belongs to the Shell.Term that created it
+	@Override
+	public void close() {
+	}
+}
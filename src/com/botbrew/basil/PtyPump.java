@@ -0,0 +1,63 @@
+package com.botbrew.basil;
+
+import java.util.concurrent.atomic.AtomicInteger;
+
+import android.util.SparseArray;
+
+/**
+ * Delivers the exits of any number of child processes on a single native
+ * thread, instead of one thread parked in Exec.waitFor() per child.
+ * Listeners run on that thread and must not block.
+ * <p>
+ * Only exits are delivered: pty output is still read by whoever owns the
+ * session. Exits come from the shared {@link Reaper}, so Exec.waitFor() may
+ * still be used on a watched pid.
+ */
+public class PtyPump {
+	public static interface Listener {
+		public void onExit(int status);
+	}
+	static {
+		System.loadLibrary("jackpal-androidterm4");
+	}
+	private static final int EVENT_INTS = 2;
+	private static final SparseArray<Listener> sListeners = new SparseArray<Listener>();
+	private static final AtomicInteger sNextToken = new AtomicInteger(1);
+	/**
+	 * Watch a child process for its exit.
+	 *
+	 * @param pid child process to wait for
+	 * @return a token for unwatch(), or 0 on failure
+	 */
+	public static int watch(final int pid, final Listener listener) {
+		final int token = sNextToken.getAndIncrement();
+		synchronized(sListeners) {
+			sListeners.put(token,listener);
+		}
+		if(nativeWatch(token,pid)) return token;
+		synchronized(sListeners) {
+			sListeners.remove(token);
+		}
+		return 0;
+	}
+	public static void unwatch(final int token) {
+		nativeUnwatch(token);
+		synchronized(sListeners) {
+			sListeners.remove(token);
+		}
+	}
+	// called from the native pump thread with a batch of {token, status} records
+	private static void dispatch(final int count, final int[] events) {
+		for(int i = 0; i < count; i++) {
+			final int base = i*EVENT_INTS;
+			final Listener listener;
+			synchronized(sListeners) {
+				listener = sListeners.get(events[base]);
+				sListeners.remove(events[base]);
+			}
+			if(listener != null) listener.onExit(events[base+1]);
+		}
+	}
+	private static native boolean nativeWatch(int token, int pid);
+	private static native void nativeUnwatch(int token);
+}
@@ -0,0 +1,72 @@
+package com.botbrew.basil;
+
+import android.util.SparseArray;
+
+/**
+ * Collects every child spawned through Exec on one native thread, woken by
+ * pidfd where the kernel has it and polling with wait4() otherwise, so no
+ * Java thread has to sit in waitFor() just to learn that a process died.
+ */
+public class Reaper {
+	public static interface Listener {
+		public void onExit(int pid, Status status);
+	}
+	public static class Status {
+		public final int exitCode;
+		public final int signal;
+		public final long utimeUs;
+		public final long stimeUs;
+		public final long maxRssKb;
+		public final long wallUs;
+		private Status(final long[] r) {
+			exitCode = (int)r[0];
+			signal = (int)r[1];
+			utimeUs = r[2];
+			stimeUs = r[3];
+			maxRssKb = r[4];
+			wallUs = r[5];
+		}
+		/** Shell-style status: the exit code, or 128+signal */
+		public int code() {
+			return signal != 0?128+signal:exitCode;
+		}
+	}
+	static {
+		System.loadLibrary("jackpal-androidterm4");
+	}
+	private static final SparseArray<Listener> sListeners = new SparseArray<Listener>();
+	/**
+	 * Non-blocking check; a returned status is consumed.
+	 *
+	 * @return the exit status, or null if pid is still running or unknown
+	 */
+	public static Status poll(final int pid) {
+		final long[] r = new long[6];
+		return nativePoll(pid,r)?new Status(r):null;
+	}
+	/**
+	 * Call listener on the reaper thread once pid exits, at once if it
+	 * already has. The listener must not block.
+	 */
+	public static boolean watch(final int pid, final Listener listener) {
+		synchronized(sListeners) {
+			sListeners.put(pid,listener);
+		}
+		if(nativeWatch(pid)) return true;
+		synchronized(sListeners) {
+			sListeners.remove(pid);
+		}
+		return false;
+	}
+	// called from the native reaper thread
+	private static void onExit(final int pid, final long[] r) {
+		final Listener listener;
+		synchronized(sListeners) {
+			listener = sListeners.get(pid);
+			sListeners.remove(pid);
+		}
+		if(listener != null) listener.onExit(pid,new Status(r));
+	}
+	private static native boolean nativePoll(int pid, long[] result);
+	private static native boolean nativeWatch(int pid);
+}
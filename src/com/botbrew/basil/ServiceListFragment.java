@@ -6,7 +6,7 @@ import java.io.IOException;
 import java.io.InputStreamReader;
 import java.util.ArrayList;
 import java.util.Collections;
-import java.util.HashSet;
+import java.util.HashMap;
 import java.util.Iterator;
 import java.util.regex.Matcher;
 import java.util.regex.Pattern;
@@ -60,52 +60,72 @@ class ServiceListEntry implements Comparable {
 		@Override
 		public ArrayList<ServiceListEntry> loadInBackground() {	// called from AsyncTask
 			final String root = mApplication.root();
+			final long now = System.currentTimeMillis()/1000;
 			ArrayList<ServiceListEntry> data = new ArrayList<ServiceListEntry>();
-			HashSet<String> done = new HashSet<String>();
+			ArrayList<String> unreadable = new ArrayList<String>();
+			try {
+				for(ServiceStatus.Service svc: ServiceStatus.read(new File(root))) {
+					if(!svc.enabled) data.add(new ServiceListEntry(svc.name,"off","this service is disabled",false));
+					else if(svc.main.state == ServiceStatus.UNREADABLE) unreadable.add(svc.name);
+					else data.add(new ServiceListEntry(svc.name,svc.main.status(),svc.describe(now),true));
+				}
+			} catch(IOException ex) {
+				final String[] svcs = (new File(root,"etc/service")).list();
+				if(svcs != null) for(String svc: svcs) unreadable.add(svc);
+			}
+			if(!unreadable.isEmpty()) fromPage(root,now,unreadable,data);
+			if(!unreadable.isEmpty()) svStatus(root,unreadable,data);
+			usage(data);
+			Collections.sort(data);
+			return data;
+		}
+		// from the sampler ServiceListFragment runs while it is shown
+		private static void usage(final ArrayList<ServiceListEntry> data) {
+			try {
+				final ServiceUsage.Sample sample = ServiceUsage.latest();
+				if(sample == null) return;
+				final HashMap<String,ServiceUsage.Usage> usage = sample.byName();
+				for(ServiceListEntry entry: data) {
+					final ServiceUsage.Usage u = usage.get(entry.name);
+					if((u != null)&&(u.processes > 0)) entry.detail += "\n"+u.describe(sample.intervalMs);
+				}
+			} catch(IOException ex) {
+			}
+		}
+		// init --supervise publishes what root may read anyway
+		private static void fromPage(final String root, final long now, final ArrayList<String> svcs, final ArrayList<ServiceListEntry> data) {
+			try {
+				final ServiceStatus.Service[] page = ServiceStatus.supervised(new File(root));
+				if(page != null) for(ServiceStatus.Service svc: page) if(svcs.remove(svc.name)) {
+					data.add(new ServiceListEntry(svc.name,svc.main.status(),svc.describe(now),true));
+				}
+			} catch(IOException ex) {
+			}
+		}
+		// supervise is created 0700, so without root we may have to ask sv
+		private static void svStatus(final String root, final ArrayList<String> svcs, final ArrayList<ServiceListEntry> data) {
 			Pattern re_status = Pattern.compile("^([^\\:]+)\\: ([^\\:]+)");
 			Matcher matcher;
-			Shell.Pipe sh;
 			String line;
-			String name;
-			String[] svcs = (new File(root,"etc/service")).list();
-			if((svcs != null)&&(svcs.length > 0)) {
-				try {
-					final StringBuffer sb = new StringBuffer("sv status");
-					for(String svc: svcs) {
-						sb.append(" ");
-						sb.append(svc);
-					}
-					sh = Shell.Pipe.getRootShell();
-					sh.botbrew(root,sb.toString());
-					sh.stdin().close();
-					final BufferedReader p_stdout = new BufferedReader(new InputStreamReader(sh.stdout()));
-					while((line = p_stdout.readLine()) != null) {
-						matcher = re_status.matcher(line);
-						if(matcher.find()) {
-							name = matcher.group(2);
-							done.add(name);
-							data.add(new ServiceListEntry(name,matcher.group(1),line,true));
-						}
-					}
-					p_stdout.close();
-					BotBrewApp.sinkError(sh);
-					sh.waitFor();
-				} catch(IOException ex) {
-				} catch(InterruptedException ex) {
-				}
-			}
-			svcs = (new File(root,"etc/sv")).list();
-			if(svcs != null) {
-				String d_status = "off";
-				String d_detail = "this service is disabled";
+			try {
+				final StringBuffer sb = new StringBuffer("sv status");
 				for(String svc: svcs) {
-					if((done.contains(svc))||("enabled".equals(svc))) continue;
-					done.add(svc);
-					data.add(new ServiceListEntry(svc,d_status,d_detail,false));
+					sb.append(" ");
+					sb.append(svc);
 				}
+				final Shell sh = Shell.chroot(root,true,false,sb);
+				sh.stdin().close();
+				final BufferedReader p_stdout = new BufferedReader(new InputStreamReader(sh.stdout()));
+				while((line = p_stdout.readLine()) != null) {
+					matcher = re_status.matcher(line);
+					if(matcher.find()) data.add(new ServiceListEntry(matcher.group(2),matcher.group(1),line,true));
+				}
+				p_stdout.close();
+				BotBrewApp.sinkError(sh);
+				sh.waitFor();
+			} catch(IOException ex) {
+			} catch(InterruptedException ex) {
 			}
-			Collections.sort(data);
-			return data;
 		}
 	}
 	public String name;
@@ -174,6 +194,7 @@ class ServiceListAdapter extends ArrayAdapter<ServiceListEntry> {
 
 public class ServiceListFragment extends SherlockListFragment implements LoaderManager.LoaderCallbacks<ArrayList<ServiceListEntry>> {
 	private static final int LOADER_ID = 0x02;
+	private static final int USAGE_INTERVAL = 2000;
 	private ServiceListAdapter adapter;
 	private BotBrewApp mApplication;
 	@Override
@@ -187,6 +208,16 @@ public class ServiceListFragment extends SherlockListFragment implements LoaderM
 		setListShown(false);	// progress indicator
 		getLoaderManager().initLoader(LOADER_ID,null,this);
 	}
+	@Override
+	public void onResume() {
+		super.onResume();
+		ServiceUsage.start(new File(mApplication.root()),USAGE_INTERVAL);
+	}
+	@Override
+	public void onPause() {
+		ServiceUsage.stop();
+		super.onPause();
+	}
 	/*@Override
 	public void onAttach(Activity activity) {
 		super.onAttach(activity);
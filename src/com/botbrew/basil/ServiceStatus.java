@@ -0,0 +1,194 @@
+package com.botbrew.basil;
+
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.channels.FileChannel;
+
+/**
+ * runit service status straight from each supervise/status file, without
+ * running sv as root. Services only in etc/sv are listed as disabled.
+ * Under init --supervise the same status is also in one world-readable
+ * page, for services whose supervise directory only root may read.
+ */
+public class ServiceStatus {
+	public static class Process {
+		public final int state;
+		public final int pid;
+		/**
+		 * unix time of the last state change
+		 */
+		public final long since;
+		private final int flags;
+		protected Process(final int state, final int pid, final long since, final int flags) {
+			this.state = state;
+			this.pid = pid;
+			this.since = since;
+			this.flags = flags;
+		}
+		public boolean isNormallyUp() {
+			return (flags&FLAG_NORMALLY_UP) != 0;
+		}
+		public boolean wantsUp() {
+			return (flags&FLAG_WANT_UP) != 0;
+		}
+		public boolean wantsDown() {
+			return (flags&FLAG_WANT_DOWN) != 0;
+		}
+		public boolean isPaused() {
+			return (flags&FLAG_PAUSED) != 0;
+		}
+		public boolean gotTerm() {
+			return (flags&FLAG_TERM) != 0;
+		}
+		/**
+		 * @return "run", "down" or "finish", as sv prints them
+		 */
+		public String status() {
+			switch(state) {
+				case RUN: return "run";
+				case FINISH: return "finish";
+				case DOWN: return "down";
+				default: return "warning";
+			}
+		}
+		// sv.c, svstatus_print()
+		private void describe(final StringBuilder sb, final String name, final long now) {
+			sb.append(status()).append(": ").append(name).append(": ");
+			if((state == NONE)||(state == UNREADABLE)) {
+				sb.append(state == NONE?"runsv not running":"unable to read supervise/status");
+				return;
+			}
+			if(state != DOWN) sb.append("(pid ").append(pid).append(") ");
+			sb.append(Math.max(now-since,0)).append('s');
+			if((pid != 0)&&(!isNormallyUp())) sb.append(", normally down");
+			if((pid == 0)&&(isNormallyUp())) sb.append(", normally up");
+			if((pid != 0)&&(isPaused())) sb.append(", paused");
+			if((pid == 0)&&(wantsUp())) sb.append(", want up");
+			if((pid != 0)&&(wantsDown())) sb.append(", want down");
+			if((pid != 0)&&(gotTerm())) sb.append(", got TERM");
+		}
+	}
+	public static class Service {
+		public final String name;
+		public final boolean enabled;
+		public final Process main;
+		/**
+		 * null if the service has no log directory
+		 */
+		public final Process log;
+		protected Service(final String name, final boolean enabled, final Process main, final Process log) {
+			this.name = name;
+			this.enabled = enabled;
+			this.main = main;
+			this.log = log;
+		}
+		/**
+		 * @return the line sv status would print, with times relative to now (in seconds)
+		 */
+		public String describe(final long now) {
+			final StringBuilder sb = new StringBuilder();
+			main.describe(sb,name,now);
+			if(log != null) {
+				sb.append("; ");
+				log.describe(sb,"log",now);
+			}
+			return sb.toString();
+		}
+	}
+	static {
+		System.loadLibrary("jackpal-androidterm4");
+	}
+	public static final int DOWN = 0;
+	public static final int RUN = 1;
+	public static final int FINISH = 2;
+	/**
+	 * no supervise/status: runsv is not running the service
+	 */
+	public static final int NONE = -1;
+	/**
+	 * supervise is only readable by root; see supervised(), or ask sv
+	 */
+	public static final int UNREADABLE = -2;
+	private static final int FLAG_ENABLED = 1;
+	private static final int FLAG_NORMALLY_UP = 2;
+	private static final int FLAG_HAS_LOG = 4;
+	private static final int FLAG_WANT_UP = 8;
+	private static final int FLAG_WANT_DOWN = 16;
+	private static final int FLAG_PAUSED = 32;
+	private static final int FLAG_TERM = 64;
+	private static final int RECORD_SIZE = 32;
+	/**
+	 * the status page, as in jni/init/supervise.h
+	 */
+	public static final String PAGE = "run/init.svc";
+	private static final int PAGE_SIZE = 4096;
+	private static final int PAGE_MAGIC = 0x53765031;
+	private static final int PAGE_HEADER_SIZE = 32;
+	private static final int PAGE_SLOT_SIZE = 80;
+	private static final int PAGE_NAME_MAX = 32;
+	/**
+	 * @return services in etc/service, then those only in etc/sv, each in directory order
+	 */
+	public static Service[] read(final File root) throws IOException {
+		final byte[] buf = nativeRead(root.getPath());
+		final ByteBuffer b = ByteBuffer.wrap(buf).order(ByteOrder.nativeOrder());
+		int count = 0;
+		for(int off = 0; off < buf.length; off = next(b,off)) count++;
+		final Service[] res = new Service[count];
+		for(int i = 0, off = 0; i < count; i++, off = next(b,off)) res[i] = read(b,buf,off);
+		return res;
+	}
+	// records are {since, log since, pid, log pid, state, log state, flags, log flags, name length, name} padded to 8 bytes
+	private static int next(final ByteBuffer b, final int off) {
+		return off+((RECORD_SIZE+(b.getShort(off+28)&0xffff)+7)&~7);
+	}
+	private static Service read(final ByteBuffer b, final byte[] buf, final int off) throws IOException {
+		final int flags = buf[off+26]&0xff;
+		return new Service(
+			new String(buf,off+RECORD_SIZE,b.getShort(off+28)&0xffff,"UTF-8"),
+			(flags&FLAG_ENABLED) != 0,
+			new Process(buf[off+24],b.getInt(off+16),b.getLong(off),flags),
+			((flags&FLAG_HAS_LOG) != 0)?new Process(buf[off+25],b.getInt(off+20),b.getLong(off+8),buf[off+27]&0xff):null
+		);
+	}
+	/**
+	 * @return the services supervised by init --supervise, or null if it is not running
+	 */
+	public static Service[] supervised(final File root) throws IOException {
+		final FileInputStream in = new FileInputStream(new File(root,PAGE));
+		final byte[] buf = new byte[PAGE_SIZE];
+		final ByteBuffer b = ByteBuffer.wrap(buf).order(ByteOrder.nativeOrder());
+		try {
+			final ByteBuffer page = in.getChannel().map(FileChannel.MapMode.READ_ONLY,0,PAGE_SIZE).order(ByteOrder.nativeOrder());
+			// sequence lock: the copy is good if seq was even and did not change
+			int seq;
+			do {
+				while(((seq = page.getInt(4))&1) != 0) Thread.yield();
+				page.position(0);
+				page.get(buf);
+			} while(page.getInt(4) != seq);
+		} finally {
+			in.close();
+		}
+		final int pid = b.getInt(8);
+		if((b.getInt(0) != PAGE_MAGIC)||(pid <= 0)||(!(new File("/proc/"+pid)).exists())) return null;
+		final Service[] res = new Service[Math.min(b.getInt(12),(PAGE_SIZE-PAGE_HEADER_SIZE)/PAGE_SLOT_SIZE)];
+		for(int i = 0; i < res.length; i++) {
+			final int off = PAGE_HEADER_SIZE+i*PAGE_SLOT_SIZE;
+			int len = 0;
+			while((len < PAGE_NAME_MAX)&&(buf[off+len] != 0)) len++;
+			final int flags = buf[off+74]&0xff;
+			res[i] = new Service(
+				new String(buf,off,len,"UTF-8"),
+				true,
+				new Process(buf[off+72],b.getInt(off+48),b.getLong(off+32),flags),
+				((flags&FLAG_HAS_LOG) != 0)?new Process(buf[off+73],b.getInt(off+52),b.getLong(off+40),buf[off+75]&0xff):null
+			);
+		}
+		return res;
+	}
+	private static native byte[] nativeRead(String root) throws IOException;
+}
@@ -0,0 +1,159 @@
+package com.botbrew.basil;
+
+import java.io.File;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.util.HashMap;
+
+/**
+ * Resource use of the services under init --supervise, sampled from /proc
+ * by a native thread. Each service is charged for every process descended
+ * from its ./run or log/run. The last 64 samples are kept, so a reader that
+ * polls less often than the interval can still compute rates.
+ * <p>
+ * Without root, PSS and I/O counters of processes run as another user may
+ * be unreadable; such samples have {@link Usage#isPartial()} set.
+ */
+public class ServiceUsage {
+	public static class Usage {
+		public final String name;
+		/**
+		 * CPU time used over the interval, in milliseconds
+		 */
+		public final int cpuMs;
+		public final int rssKb;
+		public final int pssKb;
+		/**
+		 * bytes read from and written to storage over the interval
+		 */
+		public final long readBytes;
+		public final long writeBytes;
+		public final int threads;
+		public final int processes;
+		private final int flags;
+		protected Usage(final String name, final int cpuMs, final int rssKb, final int pssKb, final long readBytes, final long writeBytes, final int threads, final int processes, final int flags) {
+			this.name = name;
+			this.cpuMs = cpuMs;
+			this.rssKb = rssKb;
+			this.pssKb = pssKb;
+			this.readBytes = readBytes;
+			this.writeBytes = writeBytes;
+			this.threads = threads;
+			this.processes = processes;
+			this.flags = flags;
+		}
+		public boolean isPartial() {
+			return (flags&(FLAG_NO_PSS|FLAG_NO_IO)) != 0;
+		}
+		/**
+		 * @return a one-line summary, with rates over intervalMs
+		 */
+		public String describe(final int intervalMs) {
+			final StringBuilder sb = new StringBuilder();
+			final int interval = Math.max(intervalMs,1);
+			sb.append("cpu ").append(cpuMs*100/interval).append("%, rss ");
+			size(sb,rssKb*1024L);
+			if((flags&FLAG_NO_PSS) == 0) size(sb.append(", pss "),pssKb*1024L);
+			if((flags&FLAG_NO_IO) == 0) {
+				size(sb.append(", io "),readBytes*1000/interval).append("/s in, ");
+				size(sb,writeBytes*1000/interval).append("/s out");
+			}
+			sb.append(", ").append(threads).append(threads == 1?" thread":" threads");
+			if(processes > 1) sb.append(" in ").append(processes).append(" processes");
+			return sb.toString();
+		}
+		private static StringBuilder size(final StringBuilder sb, final long bytes) {
+			if(bytes < 1024) return sb.append(bytes).append('B');
+			final String[] units = {"K","M","G"};
+			double value = bytes/1024.0;
+			int unit = 0;
+			while((value >= 1024)&&(unit < units.length-1)) {
+				value /= 1024;
+				unit++;
+			}
+			return sb.append(value < 10?String.format("%.1f",value):String.valueOf(Math.round(value))).append(units[unit]);
+		}
+	}
+	public static class Sample {
+		public final long seq;
+		/**
+		 * unix time in milliseconds
+		 */
+		public final long time;
+		public final int intervalMs;
+		public final Usage[] services;
+		protected Sample(final long seq, final long time, final int intervalMs, final Usage[] services) {
+			this.seq = seq;
+			this.time = time;
+			this.intervalMs = intervalMs;
+			this.services = services;
+		}
+		/**
+		 * @return each service's usage by name
+		 */
+		public HashMap<String,Usage> byName() {
+			final HashMap<String,Usage> res = new HashMap<String,Usage>();
+			for(Usage u: services) res.put(u.name,u);
+			return res;
+		}
+	}
+	static {
+		System.loadLibrary("jackpal-androidterm4");
+	}
+	private static final int FLAG_NO_PSS = 1;
+	private static final int FLAG_NO_IO = 2;
+	private static final int SAMPLE_HEADER_SIZE = 24;
+	private static final int RECORD_SIZE = 72;
+	private static final int NAME_MAX = 32;
+	private static Sample sLatest;
+	/**
+	 * Start sampling the services supervised under root, every intervalMs
+	 * (at least 250). Restarts the sampler if it is already running.
+	 */
+	public static boolean start(final File root, final int intervalMs) {
+		return nativeStart((new File(root,ServiceStatus.PAGE)).getPath(),intervalMs);
+	}
+	public static void stop() {
+		nativeStop();
+	}
+	/**
+	 * @return samples newer than seq, oldest first; pass -1 for all that are kept
+	 */
+	public static Sample[] read(final long seq) throws IOException {
+		final byte[] buf = nativeRead(seq);
+		final ByteBuffer b = ByteBuffer.wrap(buf).order(ByteOrder.nativeOrder());
+		int count = 0;
+		for(int off = 0; off < buf.length; off += SAMPLE_HEADER_SIZE+b.getInt(off+20)*RECORD_SIZE) count++;
+		final Sample[] res = new Sample[count];
+		for(int i = 0, off = 0; i < count; i++) {
+			final Usage[] services = new Usage[b.getInt(off+20)];
+			for(int j = 0; j < services.length; j++) services[j] = read(b,buf,off+SAMPLE_HEADER_SIZE+j*RECORD_SIZE);
+			res[i] = new Sample(b.getLong(off),b.getLong(off+8),b.getInt(off+16),services);
+			off += SAMPLE_HEADER_SIZE+services.length*RECORD_SIZE;
+		}
+		return res;
+	}
+	// records are {name, read bytes, write bytes, cpu ms, rss kB, pss kB, threads, processes, flags}
+	private static Usage read(final ByteBuffer b, final byte[] buf, final int off) throws IOException {
+		int len = 0;
+		while((len < NAME_MAX)&&(buf[off+len] != 0)) len++;
+		return new Usage(
+			new String(buf,off,len,"UTF-8"),
+			b.getInt(off+48),b.getInt(off+52),b.getInt(off+56),
+			b.getLong(off+32),b.getLong(off+40),
+			b.getInt(off+60),b.getInt(off+64),b.getInt(off+68)
+		);
+	}
+	/**
+	 * @return the most recent sample, or null if there is none yet
+	 */
+	public static synchronized Sample latest() throws IOException {
+		final Sample[] samples = read((sLatest == null)?-1:sLatest.seq);
+		if(samples.length > 0) sLatest = samples[samples.length-1];
+		return sLatest;
+	}
+	private static native boolean nativeStart(String page, int intervalMs);
+	private static native void nativeStop();
+	private static native byte[] nativeRead(long seq);
+}
@@ -52,7 +52,7 @@ public abstract class Shell {
 			fd = Exec.createSubprocess(cmd[0],cmd,new String[] {"PATH="+System.getenv("PATH"),"TERM=vt100"},processId);
 			pid = processId[0];
 			stdin(new FileOutputStream(fd));
-			stdout(new FileInputStream(fd));
+			stdout(new PtyInputStream(fd));
 		}
 		public void close() {
 			Exec.close(fd);
@@ -70,12 +70,73 @@ public abstract class Shell {
 			return new Term(rootshell,"--shell",usershell);
 		}
 	}
+	/**
+	 * A command run inside the chroot by `init --broker', which is already
+	 * mounted and chrooted, so no su or init has to be started per command.
+	 */
+	public static class Broker extends Shell {
+		static {
+			System.loadLibrary("jackpal-androidterm4");
+		}
+		public static final String SOCKET = "run/init.sock";
+		private static final int FLAG_SUPERUSER = 1;
+		public final int pid;
+		private final FileDescriptor conn;
+		private boolean closed = false;
+		public Broker(final CharSequence root, final boolean superuser, final boolean redirect, final String... cmd) throws IOException {
+			final FileDescriptor[] fds = new FileDescriptor[4];
+			pid = nativeSpawn((new File(root.toString(),SOCKET)).getPath(),superuser?FLAG_SUPERUSER:0,null,cmd,null,redirect,fds);
+			stdin(new FileOutputStream(fds[0]));
+			stdout(new FileInputStream(fds[1]));
+			stderr(fds[2]==null?new FileInputStream("/dev/null"):new FileInputStream(fds[2]));
+			conn = fds[3];
+		}
+		public synchronized void close() {
+			if(closed) return;
+			closed = true;
+			Exec.close(conn);
+		}
+		public synchronized void hangup() {
+			if(!closed) nativeSignal(conn,1);
+		}
+		public int waitFor() throws InterruptedException {
+			final int status = nativeWait(conn);
+			close();
+			return status;
+		}
+		public static boolean available(final CharSequence root) {
+			return (new File(root.toString(),SOCKET)).exists();
+		}
+		public static Broker sh(final CharSequence root, final boolean superuser, final boolean redirect, final CharSequence cmd) throws IOException {
+			return new Broker(root,superuser,redirect,"sh","-c",cmd.toString());
+		}
+		private static native int nativeSpawn(String socket, int flags, String cwd, String[] argv, String[] envp, boolean redirect, FileDescriptor[] fds) throws IOException;
+		private static native int nativeWait(FileDescriptor conn);
+		private static native void nativeSignal(FileDescriptor conn, int signo);
+	}
+	/**
+	 * init options for package work, which should yield CPU and I/O to the UI
+	 */
+	public static String background = "--cgroup=background --cpu-weight=20 --io-weight=20";
 	public static String usershell = "/system/bin/sh";
 	public static String rootshell = (new File("/system/bin/su")).exists()?"/system/bin/su":"/system/xbin/su";
 	protected OutputStream in;
 	protected InputStream out;
 	protected InputStream err;
 	abstract int waitFor() throws InterruptedException;
+	/**
+	 * Run cmd inside the chroot at root: through the broker when one is
+	 * listening, otherwise through su (or the setuid init) as before.
+	 */
+	public static Shell chroot(final CharSequence root, final boolean superuser, final boolean redirect, final CharSequence cmd) throws IOException {
+		if(Broker.available(root)) try {
+			return Broker.sh(root,superuser,redirect,cmd);
+		} catch(IOException ex) {}
+		final Pipe sh = superuser?Pipe.getRootShell():Pipe.getUserShell();
+		if(redirect) sh.redirect();
+		sh.botbrew(root,cmd);
+		return sh;
+	}
 	public OutputStream stdin() {
 		return in;
 	}
@@ -113,6 +174,14 @@ public abstract class Shell {
 		in.flush();
 		return this;
 	}
+	/**
+	 * Like botbrew(), in the background cgroup
+	 */
+	public Shell background(final CharSequence root, final CharSequence cmd) throws IOException {
+		in.write(("exec '"+root+"/init' "+background+" -- "+cmd+"\n").getBytes());
+		in.flush();
+		return this;
+	}
 	public Shell botbrew(final CharSequence init, final CharSequence root, final CharSequence cmd) throws IOException {
 		return botbrew(true,init,root,cmd);
 	}
@@ -1,8 +1,6 @@
 package com.botbrew.basil;
 
-import java.io.File;
 import java.io.IOException;
-import java.lang.reflect.Field;
 
 import android.app.Notification;
 import android.app.PendingIntent;
@@ -18,8 +16,13 @@ public class SupervisorService extends Service {
 			return SupervisorService.this;
 		}
 	}
+	/**
+	 * init --supervise runs the services in the foreground and stops them
+	 * all once its stdin hangs up, so closing that pipe is the shutdown.
+	 */
 	private class SupervisorProcess implements Runnable {
 		private int startId;
+		private Shell.Pipe sh;
 		public SupervisorProcess(int startId) {
 			this.startId = startId;
 		}
@@ -32,62 +35,26 @@ public class SupervisorService extends Service {
 				return;
 			}
 			Log.v(BotBrewApp.TAG,"SupervisorProcess.run(): supervisor started");
-			Shell.Pipe sh = null;
 			try {
-				sh = Shell.Pipe.getRootShell();
-				sh.botbrew(root,"runsvdir -P /etc/service 'log: ................................................................................................................................................................................................................................................................'");
-				sh.stdin().close();
+				synchronized(this) {
+					sh = Shell.Pipe.getRootShell().redirect();
+					sh.exec("'"+root+"/init' --supervise");
+				}
+				BotBrewApp.sinkOutput(sh);
 				sh.waitFor();
 			} catch(IOException ex) {
 			} catch(InterruptedException ex) {
 			} finally {
-				boolean exited = true;
-				if(sh != null) {
-					Process p = sh.proc;
-					try {
-						p.exitValue();
-					} catch(IllegalThreadStateException ex0) {
-						try {	// the process exists, so send SIGHUP
-							Log.v(BotBrewApp.TAG,"SupervisorProcess.run(): sending SIGHUP to runsvdir...");
-							Field f = p.getClass().getDeclaredField("id");
-							f.setAccessible(true);
-							f.get(p);
-							sh = Shell.Pipe.getRootShell();
-							sh.exec("kill -1 "+f.get(p));
-							sh.stdin().close();
-							if(sh.waitFor() == 0) {
-								p.waitFor();
-								exited = false;
-							}
-						} catch(NoSuchFieldException ex1) {
-							Log.v(BotBrewApp.TAG,"SupervisorProcess.run(): NoSuchFieldException");
-						} catch(IllegalAccessException ex1) {
-							Log.v(BotBrewApp.TAG,"SupervisorProcess.run(): IllegalAccessException");
-						} catch(IOException ex1) {
-							Log.v(BotBrewApp.TAG,"SupervisorProcess.run(): IOException");
-						} catch(InterruptedException ex1) {
-							Log.v(BotBrewApp.TAG,"SupervisorProcess.run(): InterruptedException");
-						}
-					}
-				}
-				if(exited) {	// the process does not exist, so clean up offline
-					try {
-						Log.v(BotBrewApp.TAG,"SupervisorProcess.run(): sending SIGTERM to runsv...");
-						sh = Shell.Pipe.getRootShell();
-						sh.botbrew(false,root,"killall -1 runsvdir || true\nkillall -15 runsv || true");
-						String[] enabled = (new File(root,"etc/service")).list();
-						if(enabled != null) for(String filename: enabled) sh.botbrew(false,root,"sv exit "+filename+" || true");
-						sh.stdin().close();
-						sh.waitFor();
-					} catch(IOException ex) {
-					} catch(InterruptedException ex) {
-					} finally {
-						stopSelfResult(startId);
-						Log.v(BotBrewApp.TAG,"SupervisorProcess.run(): supervisor stopped");
-					}
-				}
+				shutdown();
+				stopSelfResult(startId);
+				Log.v(BotBrewApp.TAG,"SupervisorProcess.run(): supervisor stopped");
 			}
 		}
+		public synchronized void shutdown() {
+			if(sh != null) try {
+				sh.stdin().close();
+			} catch(IOException ex) {}
+		}
 	}
 	private static boolean mRunning = false;
 	private static final int ID_RUNNING = 1;
@@ -117,7 +84,7 @@ public class SupervisorService extends Service {
 	@Override
 	public void onDestroy() {
 		if(mSupervisorThread != null) {
-			mSupervisorThread.interrupt();
+			mSupervisorProcess.shutdown();
 			mSupervisorThread = null;
 			mSupervisorProcess = null;
 		}
@@ -9,7 +9,6 @@ import java.io.IOException;
 import java.io.InputStream;
 import java.io.OutputStream;
 
-import android.os.AsyncTask;
 import android.os.Bundle;
 import android.view.GestureDetector;
 import android.view.LayoutInflater;
@@ -61,34 +60,19 @@ public class TerminalDialogFragment extends SherlockDialogFragment {
 					return true;
 				}
 			});
-			(new AsyncTask<Void,Void,Integer>() {
+			getDialog().setCancelable(false);
+			PtyPump.watch(sh.pid,new PtyPump.Listener() {
 				@Override
-				protected void onPreExecute() {
-					getDialog().setCancelable(false);
+				public void onExit(final int status) {
+					view.post(new Runnable() {
+						@Override
+						public void run() {
+							view.findViewById(R.id.close).setVisibility(View.VISIBLE);
+							getDialog().setCancelable(true);
+						}
+					});
 				}
-				@Override
-				protected Integer doInBackground(final Void... ign) {
-					try {
-						return sh.waitFor();
-					} catch(InterruptedException ex) {
-					}
-					return -1;
-				}
-				@Override
-				protected void onCancelled(Integer result) {
-					view.findViewById(R.id.close).setVisibility(View.VISIBLE);
-					getDialog().setCancelable(true);
-				}
-				@Override
-				protected void onPostExecute(Integer result) {
-					if(result.intValue() != 0) {
-						onCancelled(result);
-						return;
-					}
-					view.findViewById(R.id.close).setVisibility(View.VISIBLE);
-					getDialog().setCancelable(true);
-				}
-			}).execute();
+			});
 		} catch(IOException ex) {
 			view.findViewById(R.id.close).setVisibility(View.VISIBLE);
 		}
@@ -17,6 +17,8 @@
 package jackpal.androidterm;
 
 import java.io.FileDescriptor;
+import java.io.IOException;
+import java.nio.ByteBuffer;
 
 /**
  * Utility methods for creating and managing a subprocess.
@@ -51,6 +53,19 @@ public class Exec
      */
     public static native FileDescriptor createSubprocess(
         String cmd, String[] args, String[] envVars, int[] processId);
+
+    /**
+     * Create a subprocess in a cgroup v2 group, as made by
+     * `init --cgroup'. The child joins the group before it execs, so
+     * freezing or killing the group covers everything it starts.
+     *
+     * @param cgroup The name of the group, below botbrew/
+     * @throws IOException if the group does not exist or may not be
+     * joined; without root it must have been delegated to this uid
+     */
+    public static native FileDescriptor createSubprocess(
+        String cmd, String[] args, String[] envVars, int[] processId,
+        String cgroup) throws IOException;
         
     /**
      * Set the widow size for a given pty. Allows programs
@@ -70,11 +85,39 @@ public class Exec
      * Causes the calling thread to wait for the process associated with the
      * receiver to finish executing.
      *
-     * @return The exit value of the Process being waited on
+     * @return The exit value of the Process being waited on, 128+signal if
+     * it was killed by a signal, or -1 if it is not a child of this process
      *
      */
     public static native int waitFor(int processId);
 
+    /**
+     * Read output from a pty into a direct ByteBuffer without copying it
+     * through a Java array. Blocks until output is available, then keeps
+     * collecting until at least minBatch bytes have been read or timeoutMs
+     * milliseconds have passed, so that bursts of output are coalesced.
+     * The buffer's position and limit are not modified.
+     *
+     * @param buf A direct ByteBuffer
+     * @param offset Where in buf to start storing data
+     * @param length Maximum number of bytes to read
+     * @param minBatch Number of bytes to wait for before returning
+     * @param timeoutMs Maximum time to wait for minBatch bytes; 0 returns
+     * as soon as any output has been read
+     * @return The number of bytes read, or -1 at end of stream
+     */
+    public static native int readDirect(FileDescriptor fd, ByteBuffer buf,
+       int offset, int length, int minBatch, int timeoutMs) throws IOException;
+
+    /**
+     * Write length bytes starting at offset of a direct ByteBuffer to a
+     * pty. The buffer's position and limit are not modified.
+     *
+     * @return The number of bytes written
+     */
+    public static native int writeDirect(FileDescriptor fd, ByteBuffer buf,
+       int offset, int length) throws IOException;
+
     /**
      * Close a given file descriptor.
      */